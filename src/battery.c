@@ -21,36 +21,35 @@ void currentMeterInit(currentMeterState_t *state)
 }
 
 /**
- * Update the state of the current meter by estimating the current using the RC throttle position and current time you provide.
- *
- * Time is an absolute time in micro-seconds (not a delta).
+ * Estimate the current using the RC throttle position, using the FC's current meter settings.
  */
-void currentMeterUpdateVirtual(currentMeterState_t *state, int16_t currentMeterOffset, int16_t currentMeterScale, uint32_t throttle, uint32_t time)
+int32_t currentMeterVirtualMilliamps(int16_t currentMeterOffset, int16_t currentMeterScale, uint32_t throttle)
 {
-    int32_t throttleOffset, throttleFactor;
+    int32_t currentMilliamps, throttleOffset, throttleFactor;
 
     // Current consumption due to idling while armed (zero-throttle current usage):
-    state->currentMilliamps = (int32_t)currentMeterOffset * MILLIAMPS_PER_CENTIAMP;
+    currentMilliamps = (int32_t)currentMeterOffset * MILLIAMPS_PER_CENTIAMP;
 
     // Current consumption based on throttle position:
     throttleOffset = (int32_t)throttle - 1000;
     throttleFactor = throttleOffset + (throttleOffset * throttleOffset / 50);
 
-    state->currentMilliamps += throttleFactor * (int32_t)currentMeterScale  / 100;
-
-    if (state->lastTime != 0) {
-        state->energyMilliampHours += ((double) state->currentMilliamps * (time - state->lastTime)) / MICROSECONDS_PER_HOUR;
-    }
+    currentMilliamps += throttleFactor * (int32_t)currentMeterScale  / 100;
 
-    state->lastTime = time;
+    return currentMilliamps;
 }
 
-void currentMeterUpdateMeasured(currentMeterState_t *state, int16_t amperageMilliamps, uint32_t time)
+/**
+ * Update the state of the current meter with the current you provide, integrating it to get the energy used.
+ *
+ * Time is an absolute time in micro-seconds (not a delta).
+ */
+void currentMeterAddSample(currentMeterState_t *state, int32_t currentMilliamps, uint32_t time)
 {
-    state->currentMilliamps = amperageMilliamps;
+    state->currentMilliamps = currentMilliamps;
 
     if (state->lastTime != 0) {
-         state->energyMilliampHours += ((double) state->currentMilliamps * (time - state->lastTime)) / MICROSECONDS_PER_HOUR;
+        state->energyMilliampHours += ((double) state->currentMilliamps * (time - state->lastTime)) / MICROSECONDS_PER_HOUR;
     }
 
     state->lastTime = time;
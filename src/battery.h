@@ -1,6 +1,8 @@
 #ifndef BATTERY_H_
 #define BATTERY_H_
 
+#include <stdint.h>
+
 typedef struct currentMeterState_t {
     uint32_t lastTime;
 
@@ -9,7 +11,7 @@ typedef struct currentMeterState_t {
 } currentMeterState_t;
 
 void currentMeterInit(currentMeterState_t *state);
-void currentMeterUpdateVirtual(currentMeterState_t *state, int16_t currentMeterOffset, int16_t currentMeterScale, uint32_t throttle, uint32_t time);
-void currentMeterUpdateMeasured(currentMeterState_t *state, int16_t amperageMilliamps, uint32_t time);
+int32_t currentMeterVirtualMilliamps(int16_t currentMeterOffset, int16_t currentMeterScale, uint32_t throttle);
+void currentMeterAddSample(currentMeterState_t *state, int32_t currentMilliamps, uint32_t time);
 
 #endif
@@ -27,22 +27,54 @@
 #include "parser.h"
 #include "platform.h"
 #include "tools.h"
-#include "gpxwriter.h"
-#include "imu.h"
-#include "battery.h"
+#include "trackwriter.h"
+#include "derived.h"
 #include "units.h"
 #include "stats.h"
+#include "resample.h"
+#include "streammerge.h"
+#include "spectrum.h"
+#include "stepresponse.h"
 
 #define MIN_GPS_SATELLITES 5
+#define MAX_FIELD_PATTERNS 64
+
+typedef enum {
+    SPECTRUM_FORMAT_CSV,
+    SPECTRUM_FORMAT_BINARY
+} SpectrumFormat;
 
 typedef struct decodeOptions_t {
-    int help, raw, limits, debug, toStdout;
+    int help, raw, limits, debug, toStdout, statsOnly;
+    int spectrum, spectrogram, stepResponse;
     int logNumber;
     int simulateIMU, imuIgnoreMag;
+    // Magnetic declination in decimal degrees
+    double declination;
     int simulateCurrentMeter;
     int mergeGPS;
+    MergeJoinPolicy mergePolicy;
     const char *outputPrefix;
 
+    // Format of the GPS track file, and the tolerance in meters to simplify it to (0 to keep every point)
+    TrackFormat trackFormat;
+    double trackSimplifyTolerance;
+
+    // Glob patterns for the fields to output (output all fields if there are none)
+    char *fieldPatterns[MAX_FIELD_PATTERNS];
+    int fieldPatternCount;
+
+    // Rate to resample the main log to in Hz (0 to output every frame), and the aggregation to use for each field
+    double resampleRate;
+    char *aggregatePatterns[MAX_FIELD_PATTERNS];
+    ResampleAggregation aggregations[MAX_FIELD_PATTERNS];
+    int aggregatePatternCount;
+
+    // Samples per FFT window, microseconds of log per row of the spectrogram, and the format to write spectra in
+    int fftSize;
+    int64_t spectrogramInterval;
+    SpectrumFormat spectrumFormat;
+
     bool overrideSimCurrentMeterOffset, overrideSimCurrentMeterScale;
     int16_t simCurrentMeterOffset, simCurrentMeterScale;
 
@@ -50,11 +82,17 @@ typedef struct decodeOptions_t {
 } decodeOptions_t;
 
 decodeOptions_t options = {
-    .help = 0, .raw = 0, .limits = 0, .debug = 0, .toStdout = 0,
+    .help = 0, .raw = 0, .limits = 0, .debug = 0, .toStdout = 0, .statsOnly = 0,
+    .spectrum = 0, .spectrogram = 0, .stepResponse = 0,
     .logNumber = -1,
     .simulateIMU = false, .imuIgnoreMag = 0,
+    .declination = 0,
     .simulateCurrentMeter = false,
     .mergeGPS = 0,
+    .mergePolicy = MERGE_JOIN_HOLD,
+
+    .trackFormat = TRACK_FORMAT_GPX,
+    .trackSimplifyTolerance = 0,
 
     .overrideSimCurrentMeterOffset = false,
     .overrideSimCurrentMeterScale = false,
@@ -63,6 +101,15 @@ decodeOptions_t options = {
 
     .outputPrefix = NULL,
 
+    .fieldPatternCount = 0,
+
+    .resampleRate = 0,
+    .aggregatePatternCount = 0,
+
+    .fftSize = 512,
+    .spectrogramInterval = 100000,
+    .spectrumFormat = SPECTRUM_FORMAT_CSV,
+
     .unitGPSSpeed = UNIT_METERS_PER_SECOND,
     .unitFrameTime = UNIT_MICROSECONDS,
     .unitVbat = UNIT_VOLTS,
@@ -89,28 +136,96 @@ static uint32_t lastFrameIteration;
 
 static FILE *csvFile = 0, *eventFile = 0, *gpsCsvFile = 0;
 static char *eventFilename = 0, *gpsCsvFilename = 0;
-static gpxWriter_t *gpx = 0;
+static trackWriter_t *trackWriter = 0;
 
 // Computed states:
-static currentMeterState_t currentMeterMeasured;
-static currentMeterState_t currentMeterVirtual;
-static attitude_t attitude;
+static derivedEngine_t *derived;
 
 static Unit mainFieldUnit[FLIGHT_LOG_MAX_FIELDS];
 static Unit gpsGFieldUnit[FLIGHT_LOG_MAX_FIELDS];
 static Unit slowFieldUnit[FLIGHT_LOG_MAX_FIELDS];
 
 static int64_t bufferedSlowFrame[FLIGHT_LOG_MAX_FIELDS];
-static int64_t bufferedMainFrame[FLIGHT_LOG_MAX_FIELDS];
-static bool haveBufferedMainFrame;
 
+// For --merge-gps, the streams of frames that we join together:
+typedef enum {
+    MERGE_STREAM_MAIN = 0,
+    MERGE_STREAM_GPS,
+    MERGE_STREAM_SLOW,
+    MERGE_STREAM_COUNT
+} MergeStream;
+
+// How many main frames we'll hold while waiting for the GPS frame that follows them (for interpolation)
+#define MERGE_ROW_CAPACITY 4096
+
+static streamMerger_t *merger;
+
+/*
+ * The parser doesn't give us the frame times with --raw, so the GPS data is merged in the order that it was logged
+ * instead. Each main frame is held until we know whether a GPS frame follows it in the same iteration.
+ */
+static bool rawGPSMerge;
+static int64_t bufferedMainFrame[FLIGHT_LOG_MAX_FIELDS], bufferedGPSFrame[FLIGHT_LOG_MAX_FIELDS];
+static bool haveBufferedMainFrame;
 static int64_t bufferedFrameTime;
-static uint32_t bufferedFrameIteration;
 
-static int64_t bufferedGPSFrame[FLIGHT_LOG_MAX_FIELDS];
+// Indexes of the fields of each frame type that were selected for output, in output order:
+static int mainFieldOutput[FLIGHT_LOG_MAX_FIELDS], slowFieldOutput[FLIGHT_LOG_MAX_FIELDS], gpsFieldOutput[FLIGHT_LOG_MAX_FIELDS];
+static int mainFieldOutputCount, slowFieldOutputCount, gpsFieldOutputCount;
+
+// Which of the fields that we compute ourselves were selected for output (and so need to be simulated):
+typedef struct computedFieldSelection_t {
+    bool roll, pitch, heading;
+    bool energyCumulative;
+    bool currentVirtual, energyCumulativeVirtual;
+} computedFieldSelection_t;
+
+static computedFieldSelection_t computedFieldOutput;
+
+// Room for every main and slow field, plus the computed fields:
+#define COMPUTED_FIELD_COUNT 6
+#define RESAMPLE_MAX_COLUMNS (FLIGHT_LOG_MAX_FIELDS * 2 + COMPUTED_FIELD_COUNT)
+
+static resampler_t *resampler;
 
 static seriesStats_t looptimeStats;
 
+// Distributions of the selected fields and the looptime for --stats-only:
+typedef struct fieldSummary_t {
+    seriesStats_t moments;
+    quantileSketch_t sketch;
+} fieldSummary_t;
+
+static fieldSummary_t mainFieldSummary[FLIGHT_LOG_MAX_FIELDS], gpsFieldSummary[FLIGHT_LOG_MAX_FIELDS];
+
+#define LOOPTIME_HISTOGRAM_BINS 16384
+
+static quantileSketch_t looptimeSketch;
+static histogram_t looptimeHistogram;
+
+// For --spectrum and --spectrogram, the fields we analyse (a main field, or a PID sum from the derived engine):
+#define SPECTRUM_MAX_CHANNELS (3 + 3 + FLIGHT_LOG_MAX_MOTORS)
+
+typedef struct spectrumChannel_t {
+    int fieldIndex; // -1 for derived channels
+    DerivedChannel derivedChannel;
+} spectrumChannel_t;
+
+static spectrumChannel_t spectrumChannels[SPECTRUM_MAX_CHANNELS];
+static int spectrumChannelCount;
+
+static spectrumAnalyzer_t *spectrum;
+
+// For --step-response, the series of setpoints and gyro rates of each axis, which are channel `axis` and
+// `stepAxisCount + axis` of the series:
+static spectrumAnalyzer_t *stepSeries;
+static int stepAxes[STEP_RESPONSE_MAX_AXES], stepAxisCount;
+
+static const char* const STEP_RESPONSE_AXIS_NAME[STEP_RESPONSE_MAX_AXES] = {"roll", "pitch", "yaw"};
+
+// The output filenames for the spectra are this prefix followed by the kind of spectrum and the file extension
+static char *spectrumFilenamePrefix;
+
 #define ADJUSTMENT_FUNCTION_COUNT 21
 static char *INFLIGHT_ADJUSTMENT_FUNCTIONS[ADJUSTMENT_FUNCTION_COUNT] = {
         "NONE",
@@ -135,6 +250,14 @@ static char *INFLIGHT_ADJUSTMENT_FUNCTIONS[ADJUSTMENT_FUNCTION_COUNT] = {
         "ROLL_I",
         "ROLL_D"};
 
+/**
+ * In these modes we analyse the whole log and write out the results at the end, instead of printing each frame.
+ */
+static bool isAnalysisMode()
+{
+    return options.spectrum || options.spectrogram || options.stepResponse;
+}
+
 static void fprintfMilliampsInUnit(FILE *file, int32_t milliamps, Unit unit)
 {
     switch (unit) {
@@ -265,6 +388,11 @@ void onEvent(flightLog_t *log, flightLogEvent_t *event)
 {
     (void) log;
 
+    // Don't let the resampler interpolate across a pause in logging
+    if (resampler && event->event == FLIGHT_LOG_EVENT_LOGGING_RESUME) {
+        resamplerAddGap(resampler);
+    }
+
     // Open the event log if it wasn't open already
     if (!eventFile) {
         if (eventFilename) {
@@ -332,27 +460,31 @@ void onEvent(flightLog_t *log, flightLogEvent_t *event)
 }
 
 /**
- * Print out a comma separated list of field names for the given frame (and field units if not raw),
- * minus the "time" field if `skipTime` is set.
+ * Print the separator that goes before the next CSV column (unless this is the first column on the line).
  */
-void outputFieldNamesHeader(FILE *file, flightLogFrameDef_t *frame, Unit *fieldUnit, bool skipTime)
+static void outputFieldSeparator(FILE *file, bool *needComma)
 {
-    bool needComma = false;
+    if (*needComma) {
+        fprintf(file, ", ");
+    } else {
+        *needComma = true;
+    }
+}
 
-    for (int i = 0; i < frame->fieldCount; i++) {
-        if (skipTime && strcmp(frame->fieldName[i], "time") == 0)
-            continue;
+/**
+ * Print out a comma separated list of the names of the given fields from the frame (and field units if not raw).
+ */
+void outputFieldNamesHeader(FILE *file, flightLogFrameDef_t *frame, Unit *fieldUnit, const int *fieldIndexes, int fieldCount, bool *needComma)
+{
+    for (int i = 0; i < fieldCount; i++) {
+        int fieldIndex = fieldIndexes[i];
 
-        if (needComma) {
-            fprintf(file, ", ");
-        } else {
-            needComma = true;
-        }
+        outputFieldSeparator(file, needComma);
 
-        fprintf(file, "%s", frame->fieldName[i]);
+        fprintf(file, "%s", frame->fieldName[fieldIndex]);
 
-        if (fieldUnit && fieldUnit[i] != UNIT_RAW) {
-            fprintf(file, " (%s)", UNIT_NAME[fieldUnit[i]]);
+        if (fieldUnit && fieldUnit[fieldIndex] != UNIT_RAW) {
+            fprintf(file, " (%s)", UNIT_NAME[fieldUnit[fieldIndex]]);
         }
     }
 }
@@ -362,91 +494,59 @@ void outputFieldNamesHeader(FILE *file, flightLogFrameDef_t *frame, Unit *fieldU
  */
 void createGPSCSVFile(flightLog_t *log)
 {
-    if (!gpsCsvFile && gpsCsvFilename) {
+    // Don't bother creating the file if none of its fields were selected
+    if (!gpsCsvFile && gpsCsvFilename && gpsFieldOutputCount > 0) {
         gpsCsvFile = fopen(gpsCsvFilename, "wb");
 
         if (gpsCsvFile) {
+            bool needComma = true;
+
             // Since the GPS frame itself may or may not include a timestamp field, skip it and print our own:
-            fprintf(gpsCsvFile, "time (%s), ", UNIT_NAME[options.unitFrameTime]);
+            fprintf(gpsCsvFile, "time (%s)", UNIT_NAME[options.unitFrameTime]);
 
-            outputFieldNamesHeader(gpsCsvFile, &log->frameDefs['G'], gpsGFieldUnit, true);
+            outputFieldNamesHeader(gpsCsvFile, &log->frameDefs['G'], gpsGFieldUnit, gpsFieldOutput, gpsFieldOutputCount, &needComma);
 
             fprintf(gpsCsvFile, "\n");
         }
     }
 }
 
-static void updateSimulations(flightLog_t *log, int64_t *frame, int64_t currentTime)
+/**
+ * Compute the derived fields for this frame, the results are left in derived->columns.
+ */
+static void updateSimulations(int64_t *frame, int64_t currentTime)
 {
-    int16_t gyroADC[3];
-    int16_t accSmooth[3];
-    int16_t magADC[3];
-
-    bool hasMag = log->mainFieldIndexes.magADC[0] > -1;
-    bool hasThrottle = log->mainFieldIndexes.rcCommand[3] != -1;
-    bool hasAmperageADC = log->mainFieldIndexes.amperageLatest != -1;
-
-    int i;
-
-    if (options.simulateIMU) {
-        for (i = 0; i < 3; i++) {
-            gyroADC[i] = (int16_t) frame[log->mainFieldIndexes.gyroADC[i]];
-            accSmooth[i] = (int16_t) frame[log->mainFieldIndexes.accSmooth[i]];
-        }
-
-        if (hasMag && !options.imuIgnoreMag) {
-            for (i = 0; i < 3; i++) {
-                magADC[i] = (int16_t) frame[log->mainFieldIndexes.magADC[i]];
-            }
-        }
-
-        updateEstimatedAttitude(gyroADC, accSmooth, hasMag && !options.imuIgnoreMag ? magADC : NULL,
-            currentTime, log->sysConfig.acc_1G, log->sysConfig.gyroScale, &attitude);
-    }
+    derivedBatch_t batch;
 
-    if (hasAmperageADC) {
-        currentMeterUpdateMeasured(
-            &currentMeterMeasured,
-            flightLogAmperageADCToMilliamps(log, frame[log->mainFieldIndexes.amperageLatest]),
-            currentTime
-        );
-    }
+    if (!derived)
+        return;
 
-    if (options.simulateCurrentMeter && hasThrottle) {
-        int16_t throttle = frame[log->mainFieldIndexes.rcCommand[3]];
+    batch.count = 1;
+    batch.time = &currentTime;
+    batch.values = frame;
+    batch.fieldStride = 1;
+    batch.frameStride = 0;
 
-        currentMeterUpdateVirtual(
-            &currentMeterVirtual,
-            options.overrideSimCurrentMeterOffset ? options.simCurrentMeterOffset : log->sysConfig.currentMeterOffset,
-            options.overrideSimCurrentMeterScale ? options.simCurrentMeterScale : log->sysConfig.currentMeterScale,
-            throttle,
-            currentTime
-        );
-    }
+    derivedEngineProcess(derived, &batch);
 }
 
 /**
- * Print the GPS fields from the given GPS frame as comma-separated values (the GPS frame time is not printed).
+ * Print the selected GPS fields from the given GPS frame as comma-separated values (the GPS frame time is not printed).
  */
-void outputGPSFields(flightLog_t *log, FILE *file, int64_t *frame)
+void outputGPSFields(flightLog_t *log, FILE *file, int64_t *frame, bool *needComma)
 {
     char negSign[] = "-";
     char noSign[] = "";
 
-    int i;
     int32_t degrees;
     uint32_t fracDegrees;
-    bool needComma = false;
 
-    for (i = 0; i < log->frameDefs['G'].fieldCount; i++) {
-        //We've already printed the time:
-        if (i == log->gpsFieldIndexes.time)
-            continue;
+    (void) log;
 
-        if (needComma)
-            fprintf(file, ", ");
-        else
-            needComma = true;
+    for (int j = 0; j < gpsFieldOutputCount; j++) {
+        int i = gpsFieldOutput[j];
+
+        outputFieldSeparator(file, needComma);
 
         switch (gpsFieldTypes[i]) {
             case GPS_FIELD_TYPE_COORDINATE_DEGREES_TIMES_10000000:
@@ -494,36 +594,33 @@ void outputGPSFrame(flightLog_t *log, int64_t *frame)
 	bool haveRequiredPrecision = log->gpsFieldIndexes.GPS_numSat == -1 || frame[log->gpsFieldIndexes.GPS_numSat] >= MIN_GPS_SATELLITES;
 
     if (haveRequiredFields && haveRequiredPrecision) {
-		gpxWriterAddPoint(gpx, gpsFrameTime, frame[log->gpsFieldIndexes.GPS_coord[0]], frame[log->gpsFieldIndexes.GPS_coord[1]], frame[log->gpsFieldIndexes.GPS_altitude]);
+		trackWriterAddPoint(trackWriter, gpsFrameTime, frame[log->gpsFieldIndexes.GPS_coord[0]], frame[log->gpsFieldIndexes.GPS_coord[1]], frame[log->gpsFieldIndexes.GPS_altitude]);
     }
 
     createGPSCSVFile(log);
 
     if (gpsCsvFile) {
+        bool needComma = true;
+
         fprintfMicrosecondsInUnit(gpsCsvFile, gpsFrameTime, options.unitFrameTime);
-        fprintf(gpsCsvFile, ", ");
 
-        outputGPSFields(log, gpsCsvFile, frame);
+        outputGPSFields(log, gpsCsvFile, frame, &needComma);
 
         fprintf(gpsCsvFile, "\n");
     }
 }
 
-void outputSlowFrameFields(flightLog_t *log, int64_t *frame)
+void outputSlowFrameFields(flightLog_t *log, int64_t *frame, bool *needComma)
 {
     enum {
         BUFFER_LEN = 1024
     };
     char buffer[BUFFER_LEN];
 
-    bool needComma = false;
+    for (int j = 0; j < slowFieldOutputCount; j++) {
+        int i = slowFieldOutput[j];
 
-    for (int i = 0; i < log->frameDefs['S'].fieldCount; i++) {
-        if (needComma) {
-            fprintf(csvFile, ", ");
-        } else {
-            needComma = true;
-        }
+        outputFieldSeparator(csvFile, needComma);
 
         if ((i == log->slowFieldIndexes.flightModeFlags || i == log->slowFieldIndexes.stateFlags)
                 && options.unitFlags == UNIT_FLAGS) {
@@ -547,21 +644,16 @@ void outputSlowFrameFields(flightLog_t *log, int64_t *frame)
 }
 
 /**
- * Print out the fields from the main log stream in comma separated format.
+ * Print out the selected fields from the main log stream in comma separated format.
  *
  * Provide (uint32_t) -1 for the frameTime in order to mark the frame time as unknown.
  */
-void outputMainFrameFields(flightLog_t *log, int64_t frameTime, int64_t *frame)
+void outputMainFrameFields(flightLog_t *log, int64_t frameTime, int64_t *frame, bool *needComma)
 {
-    int i;
-    bool needComma = false;
+    for (int j = 0; j < mainFieldOutputCount; j++) {
+        int i = mainFieldOutput[j];
 
-    for (i = 0; i < log->frameDefs['I'].fieldCount; i++) {
-        if (needComma) {
-            fprintf(csvFile, ", ");
-        } else {
-            needComma = true;
-        }
+        outputFieldSeparator(csvFile, needComma);
 
         if (i == FLIGHT_LOG_FIELD_INDEX_TIME) {
             // Use the time the caller provided instead of the time in the frame
@@ -577,41 +669,193 @@ void outputMainFrameFields(flightLog_t *log, int64_t frameTime, int64_t *frame)
         }
     }
 
-    if (options.simulateIMU) {
-        fprintf(csvFile, ", %.2f, %.2f, %.2f", attitude.roll * 180 / M_PI, attitude.pitch * 180 / M_PI, attitude.heading * 180 / M_PI);
+    if (computedFieldOutput.roll) {
+        outputFieldSeparator(csvFile, needComma);
+        fprintf(csvFile, "%.2f", derived->columns[DERIVED_CHANNEL_ROLL].floats[0] * 180 / M_PI);
     }
 
-    if (log->mainFieldIndexes.amperageLatest != -1) {
-        // Integrate the ADC's current measurements to get cumulative energy usage
-        fprintf(csvFile, ", %d", (int) round(currentMeterMeasured.energyMilliampHours));
+    if (computedFieldOutput.pitch) {
+        outputFieldSeparator(csvFile, needComma);
+        fprintf(csvFile, "%.2f", derived->columns[DERIVED_CHANNEL_PITCH].floats[0] * 180 / M_PI);
+    }
+
+    if (computedFieldOutput.heading) {
+        outputFieldSeparator(csvFile, needComma);
+        fprintf(csvFile, "%.2f", derived->columns[DERIVED_CHANNEL_HEADING].floats[0] * 180 / M_PI);
     }
 
-    if (options.simulateCurrentMeter) {
-        fprintf(csvFile, ", ");
+    if (computedFieldOutput.energyCumulative) {
+        // Integrate the ADC's current measurements to get cumulative energy usage
+        outputFieldSeparator(csvFile, needComma);
+        fprintf(csvFile, "%d", (int) round(derived->columns[DERIVED_CHANNEL_ENERGY_CUMULATIVE].doubles[0]));
+    }
 
-        fprintfMilliampsInUnit(csvFile, currentMeterVirtual.currentMilliamps, options.unitAmperage);
+    if (computedFieldOutput.currentVirtual) {
+        outputFieldSeparator(csvFile, needComma);
+        fprintfMilliampsInUnit(csvFile, (int32_t) derived->columns[DERIVED_CHANNEL_CURRENT_VIRTUAL].ints[0], options.unitAmperage);
+    }
 
-        fprintf(csvFile, ", %d", (int) round(currentMeterVirtual.energyMilliampHours));
+    if (computedFieldOutput.energyCumulativeVirtual) {
+        outputFieldSeparator(csvFile, needComma);
+        fprintf(csvFile, "%d", (int) round(derived->columns[DERIVED_CHANNEL_ENERGY_CUMULATIVE_VIRTUAL].doubles[0]));
     }
 
     // Do we have a slow frame to print out too?
-    if (log->frameDefs['S'].fieldCount > 0) {
-        fprintf(csvFile, ", ");
+    outputSlowFrameFields(log, bufferedSlowFrame, needComma);
+}
+
+/**
+ * Called by the stream merger for each main frame with the GPS and slow frames that were joined onto it.
+ */
+static void outputMergedRow(streamMerger_t *source, int64_t time, const int64_t *mainFrame, const int64_t * const *secondary, void *userData)
+{
+    flightLog_t *log = (flightLog_t *) userData;
+    int64_t frame[FLIGHT_LOG_MAX_FIELDS], gpsFrame[FLIGHT_LOG_MAX_FIELDS];
+    bool needComma = false;
+
+    (void) source;
+
+    memcpy(frame, mainFrame, log->frameDefs['I'].fieldCount * sizeof(*frame));
 
-        outputSlowFrameFields(log, bufferedSlowFrame);
+    // Print zeros for the GPS and slow fields until their first frames arrive
+    if (secondary[MERGE_STREAM_GPS - 1]) {
+        memcpy(gpsFrame, secondary[MERGE_STREAM_GPS - 1], log->frameDefs['G'].fieldCount * sizeof(*gpsFrame));
+    } else {
+        memset(gpsFrame, 0, sizeof(gpsFrame));
+    }
+
+    if (secondary[MERGE_STREAM_SLOW - 1]) {
+        memcpy(bufferedSlowFrame, secondary[MERGE_STREAM_SLOW - 1], log->frameDefs['S'].fieldCount * sizeof(*bufferedSlowFrame));
+    } else {
+        memset(bufferedSlowFrame, 0, sizeof(bufferedSlowFrame));
     }
+
+    // Rows are produced in time order, so we can run the simulations as we print
+    updateSimulations(frame, time);
+
+    outputMainFrameFields(log, time, frame, &needComma);
+    outputGPSFields(log, csvFile, gpsFrame, &needComma);
+    fprintf(csvFile, "\n");
 }
 
-void outputMergeFrame(flightLog_t *log)
+/**
+ * Print the main frame held for --raw GPS merging, with the last GPS frame.
+ */
+static void outputBufferedMergeFrame(flightLog_t *log)
 {
-    outputMainFrameFields(log, bufferedFrameTime, bufferedMainFrame);
-    fprintf(csvFile, ", ");
-    outputGPSFields(log, csvFile, bufferedGPSFrame);
+    bool needComma = false;
+
+    outputMainFrameFields(log, bufferedFrameTime, bufferedMainFrame, &needComma);
+    outputGPSFields(log, csvFile, bufferedGPSFrame, &needComma);
     fprintf(csvFile, "\n");
 
     haveBufferedMainFrame = false;
 }
 
+/**
+ * Called by the resampler with each row of the resampled main log, which has a column for each selected main field,
+ * followed by the selected computed fields, then the selected slow fields.
+ */
+static void outputResampledRow(resampler_t *source, int64_t rowTime, const double *values, void *userData)
+{
+    flightLog_t *log = (flightLog_t *) userData;
+    int64_t slowFrame[FLIGHT_LOG_MAX_FIELDS];
+    bool needComma = false;
+    int column = 0;
+
+    (void) source;
+
+    for (int j = 0; j < mainFieldOutputCount; j++, column++) {
+        int i = mainFieldOutput[j];
+        // The aggregated values are rounded back to the resolution of the field so they can be printed in its unit
+        int64_t fieldValue = i == FLIGHT_LOG_FIELD_INDEX_TIME ? rowTime : (int64_t) llround(values[column]);
+
+        outputFieldSeparator(csvFile, &needComma);
+
+        if (!fprintfMainFieldInUnit(log, csvFile, i, fieldValue, mainFieldUnit[i])) {
+            fprintf(stderr, "Bad unit for field %d\n", i);
+            exit(-1);
+        }
+    }
+
+    if (computedFieldOutput.roll) {
+        outputFieldSeparator(csvFile, &needComma);
+        fprintf(csvFile, "%.2f", values[column++] * 180 / M_PI);
+    }
+
+    if (computedFieldOutput.pitch) {
+        outputFieldSeparator(csvFile, &needComma);
+        fprintf(csvFile, "%.2f", values[column++] * 180 / M_PI);
+    }
+
+    if (computedFieldOutput.heading) {
+        outputFieldSeparator(csvFile, &needComma);
+        fprintf(csvFile, "%.2f", values[column++] * 180 / M_PI);
+    }
+
+    if (computedFieldOutput.energyCumulative) {
+        outputFieldSeparator(csvFile, &needComma);
+        fprintf(csvFile, "%d", (int) round(values[column++]));
+    }
+
+    if (computedFieldOutput.currentVirtual) {
+        outputFieldSeparator(csvFile, &needComma);
+        fprintfMilliampsInUnit(csvFile, (int32_t) round(values[column++]), options.unitAmperage);
+    }
+
+    if (computedFieldOutput.energyCumulativeVirtual) {
+        outputFieldSeparator(csvFile, &needComma);
+        fprintf(csvFile, "%d", (int) round(values[column++]));
+    }
+
+    for (int j = 0; j < slowFieldOutputCount; j++) {
+        slowFrame[slowFieldOutput[j]] = (int64_t) values[column++];
+    }
+
+    outputSlowFrameFields(log, slowFrame, &needComma);
+
+    fprintf(csvFile, "\n");
+}
+
+/**
+ * Add the selected fields from the main frame (along with our computed fields and the current slow frame) to the
+ * resampler, in the column order that outputResampledRow() expects.
+ */
+static void resampleMainFrame(int64_t *frame)
+{
+    double values[RESAMPLE_MAX_COLUMNS];
+    int column = 0;
+
+    for (int j = 0; j < mainFieldOutputCount; j++) {
+        values[column++] = frame[mainFieldOutput[j]];
+    }
+
+    if (computedFieldOutput.roll) {
+        values[column++] = derived->columns[DERIVED_CHANNEL_ROLL].floats[0];
+    }
+    if (computedFieldOutput.pitch) {
+        values[column++] = derived->columns[DERIVED_CHANNEL_PITCH].floats[0];
+    }
+    if (computedFieldOutput.heading) {
+        values[column++] = derived->columns[DERIVED_CHANNEL_HEADING].floats[0];
+    }
+    if (computedFieldOutput.energyCumulative) {
+        values[column++] = derived->columns[DERIVED_CHANNEL_ENERGY_CUMULATIVE].doubles[0];
+    }
+    if (computedFieldOutput.currentVirtual) {
+        values[column++] = derived->columns[DERIVED_CHANNEL_CURRENT_VIRTUAL].ints[0];
+    }
+    if (computedFieldOutput.energyCumulativeVirtual) {
+        values[column++] = derived->columns[DERIVED_CHANNEL_ENERGY_CUMULATIVE_VIRTUAL].doubles[0];
+    }
+
+    for (int j = 0; j < slowFieldOutputCount; j++) {
+        values[column++] = bufferedSlowFrame[slowFieldOutput[j]];
+    }
+
+    resamplerAddSample(resampler, frame[FLIGHT_LOG_FIELD_INDEX_TIME], values);
+}
+
 void updateFrameStatistics(flightLog_t *log, int64_t *frame)
 {
     (void) log;
@@ -620,96 +864,261 @@ void updateFrameStatistics(flightLog_t *log, int64_t *frame)
         uint32_t looptime = (frame[FLIGHT_LOG_FIELD_INDEX_TIME] - lastFrameTime) / (frame[FLIGHT_LOG_FIELD_INDEX_ITERATION] - lastFrameIteration);
 
         seriesStats_append(&looptimeStats, looptime);
+
+        if (options.statsOnly) {
+            quantileSketch_add(&looptimeSketch, looptime);
+            histogram_add(&looptimeHistogram, looptime);
+        }
+    }
+}
+
+static void updateFieldSummaries(fieldSummary_t *summaries, const int *fieldIndexes, int fieldCount, int64_t *frame)
+{
+    for (int j = 0; j < fieldCount; j++) {
+        int i = fieldIndexes[j];
+
+        seriesStats_append(&summaries[i].moments, frame[i]);
+        quantileSketch_add(&summaries[i].sketch, frame[i]);
     }
 }
 
 /**
- * This is called when outputting the log in GPS merge mode. When we parse a main frame, we don't know if a GPS frame
- * exists at the same frame time yet, so we we buffer up the main frame data to print later until we know for sure.
- *
- * We also keep a copy of the GPS frame data so we can print it out multiple times if multiple main frames arrive
- * between GPS updates.
+ * Used instead of onFrameReady for --stats-only, we just accumulate the distribution of each selected field.
+ */
+void onFrameReadyStats(flightLog_t *log, bool frameValid, int64_t *frame, uint8_t frameType, int fieldCount, int frameOffset, int frameSize)
+{
+    (void) fieldCount;
+    (void) frameOffset;
+    (void) frameSize;
+
+    if (!frameValid) {
+        return;
+    }
+
+    switch (frameType) {
+        case 'G':
+            updateFieldSummaries(gpsFieldSummary, gpsFieldOutput, gpsFieldOutputCount, frame);
+        break;
+        case 'P':
+        case 'I':
+            updateFrameStatistics(log, frame);
+
+            lastFrameIteration = (uint32_t) frame[FLIGHT_LOG_FIELD_INDEX_ITERATION];
+            lastFrameTime = frame[FLIGHT_LOG_FIELD_INDEX_TIME];
+
+            updateFieldSummaries(mainFieldSummary, mainFieldOutput, mainFieldOutputCount, frame);
+        break;
+    }
+}
+
+static float spectrumChannelValue(flightLog_t *log, const spectrumChannel_t *channel, int64_t *frame)
+{
+    if (channel->fieldIndex == -1) {
+        return derived->columns[channel->derivedChannel].ints[0];
+    }
+
+    switch (mainFieldUnit[channel->fieldIndex]) {
+        case UNIT_DEGREES_PER_SECOND:
+            return flightlogGyroToRadiansPerSecond(log, frame[channel->fieldIndex]) * (180 / M_PI);
+        case UNIT_RADIANS_PER_SECOND:
+            return flightlogGyroToRadiansPerSecond(log, frame[channel->fieldIndex]);
+        default:
+            return frame[channel->fieldIndex];
+    }
+}
+
+/**
+ * Used instead of onFrameReady for --spectrum, --spectrogram and --step-response, the analysed fields of each main
+ * frame are given to the analyzers.
+ */
+void onFrameReadyAnalysis(flightLog_t *log, bool frameValid, int64_t *frame, uint8_t frameType, int fieldCount, int frameOffset, int frameSize)
+{
+    float values[SPECTRUM_MAX_CHANNELS];
+
+    (void) fieldCount;
+    (void) frameOffset;
+    (void) frameSize;
+
+    if (frameType != 'P' && frameType != 'I') {
+        return;
+    }
+
+    if (!frameValid) {
+        if (spectrum)
+            spectrumAnalyzerAddGap(spectrum);
+        if (stepSeries)
+            spectrumAnalyzerAddGap(stepSeries);
+        return;
+    }
+
+    updateFrameStatistics(log, frame);
+
+    updateSimulations(frame, lastFrameTime);
+
+    lastFrameIteration = (uint32_t) frame[FLIGHT_LOG_FIELD_INDEX_ITERATION];
+    lastFrameTime = frame[FLIGHT_LOG_FIELD_INDEX_TIME];
+
+    if (spectrum) {
+        for (int i = 0; i < spectrumChannelCount; i++) {
+            values[i] = spectrumChannelValue(log, &spectrumChannels[i], frame);
+        }
+
+        spectrumAnalyzerAddSample(spectrum, lastFrameTime, values);
+    }
+
+    if (stepSeries) {
+        for (int i = 0; i < stepAxisCount; i++) {
+            int axis = stepAxes[i];
+
+            /*
+             * The commanded rate in degrees per second, assuming linear rates (a full stick deflection of 500 gives
+             * 200 deg/s at an rcRate of 100).
+             */
+            values[i] = frame[log->mainFieldIndexes.rcCommand[axis]] * (float) log->sysConfig.rcRate / 250;
+            values[stepAxisCount + i] = flightlogGyroToRadiansPerSecond(log, frame[log->mainFieldIndexes.gyroADC[axis]]) * (180 / M_PI);
+        }
+
+        spectrumAnalyzerAddSample(stepSeries, lastFrameTime, values);
+    }
+}
+
+/**
+ * This is called when outputting the log in GPS merge mode. Main, GPS and slow frames are fed to the stream merger,
+ * which joins the GPS and slow frames onto each main frame using their timestamps.
  */
 void onFrameReadyMerge(flightLog_t *log, bool frameValid, int64_t *frame, uint8_t frameType, int fieldCount, int frameOffset, int frameSize)
 {
     int64_t gpsFrameTime;
 
+    (void) fieldCount;
     (void) frameOffset;
     (void) frameSize;
 
     switch (frameType) {
         case 'G':
             if (frameValid) {
-                if (log->gpsFieldIndexes.time == -1 || (int64_t) frame[log->gpsFieldIndexes.time] == lastFrameTime) {
+                if (log->gpsFieldIndexes.time == -1) {
                     //This GPS frame was logged in the same iteration as the main frame that preceded it
                     gpsFrameTime = lastFrameTime;
                 } else {
                     gpsFrameTime = frame[log->gpsFieldIndexes.time];
-
-                    /*
-                     * This GPS frame happened some time after the main frame that preceded it, so print out that main
-                     * frame with its older timestamp first if we didn't print it already.
-                     */
-                    if (haveBufferedMainFrame) {
-                        outputMergeFrame(log);
-                    }
                 }
 
-                /*
-                 * Copy this GPS data for later since we may need to duplicate it if there is another main frame before
-                 * we get another GPS update.
-                 */
-                memcpy(bufferedGPSFrame, frame, sizeof(*bufferedGPSFrame) * fieldCount);
-                bufferedFrameTime = gpsFrameTime;
-
-                outputMergeFrame(log);
+                streamMergerAdd(merger, MERGE_STREAM_GPS, gpsFrameTime, frame);
 
-                // We need at least lat/lon/altitude from the log to write a useful GPX track
+                // We need at least lat/lon/altitude from the log to write a useful GPS track
 				bool haveRequiredFields = log->gpsFieldIndexes.GPS_coord[0] != -1 && log->gpsFieldIndexes.GPS_coord[1] != -1 && log->gpsFieldIndexes.GPS_altitude != -1;
 				bool haveRequiredPrecision = log->gpsFieldIndexes.GPS_numSat == -1 || frame[log->gpsFieldIndexes.GPS_numSat] >= MIN_GPS_SATELLITES;
 
                 if (haveRequiredFields && haveRequiredPrecision) {
-                    gpxWriterAddPoint(gpx, gpsFrameTime, frame[log->gpsFieldIndexes.GPS_coord[0]], frame[log->gpsFieldIndexes.GPS_coord[1]], frame[log->gpsFieldIndexes.GPS_altitude]);
+                    trackWriterAddPoint(trackWriter, gpsFrameTime, frame[log->gpsFieldIndexes.GPS_coord[0]], frame[log->gpsFieldIndexes.GPS_coord[1]], frame[log->gpsFieldIndexes.GPS_altitude]);
                 }
+            } else {
+                streamMergerAddGap(merger, MERGE_STREAM_GPS);
             }
         break;
         case 'S':
             if (frameValid) {
-                if (haveBufferedMainFrame) {
-                    outputMergeFrame(log);
-                }
-
-                memcpy(bufferedSlowFrame, frame, sizeof(bufferedSlowFrame));
+                /*
+                 * Slow frames don't have a timestamp. They're written just before the main frame that they apply to,
+                 * so make sure they sort after the main frame that preceded them.
+                 */
+                streamMergerAdd(merger, MERGE_STREAM_SLOW, lastFrameTime + 1, frame);
             }
         break;
         case 'P':
         case 'I':
-            if (frameValid || (frame && options.raw)) {
-                if (haveBufferedMainFrame) {
-                    outputMergeFrame(log);
-                }
+            if (frameValid) {
+                updateFrameStatistics(log, frame);
 
-                if (frameValid) {
-                    updateFrameStatistics(log, frame);
+                lastFrameIteration = (uint32_t) frame[FLIGHT_LOG_FIELD_INDEX_ITERATION];
+                lastFrameTime = frame[FLIGHT_LOG_FIELD_INDEX_TIME];
 
-                    lastFrameIteration = (uint32_t) frame[FLIGHT_LOG_FIELD_INDEX_ITERATION];
-                    lastFrameTime = frame[FLIGHT_LOG_FIELD_INDEX_TIME];
+                streamMergerAdd(merger, MERGE_STREAM_MAIN, lastFrameTime, frame);
+            }
+        break;
+    }
+}
+
+/**
+ * This is called when outputting the log in GPS merge mode with --raw. When we parse a main frame, we don't know if a
+ * GPS frame exists at the same frame time yet, so we buffer up the main frame data to print later until we know for
+ * sure.
+ *
+ * We also keep a copy of the GPS frame data so we can print it out multiple times if multiple main frames arrive
+ * between GPS updates.
+ */
+static void onFrameReadyRawMerge(flightLog_t *log, bool frameValid, int64_t *frame, uint8_t frameType, int fieldCount)
+{
+    int64_t gpsFrameTime;
 
-                    updateSimulations(log, frame, lastFrameTime);
+    switch (frameType) {
+        case 'G':
+            if (frameValid) {
+                if (log->gpsFieldIndexes.time == -1 || (int64_t) frame[log->gpsFieldIndexes.time] == lastFrameTime) {
+                    //This GPS frame was logged in the same iteration as the main frame that preceded it
+                    gpsFrameTime = lastFrameTime;
+                } else {
+                    gpsFrameTime = frame[log->gpsFieldIndexes.time];
 
                     /*
-                     * Store this frame to print out later since we don't know if a GPS frame follows it yet.
+                     * This GPS frame happened some time after the main frame that preceded it, so print out that main
+                     * frame with its older timestamp first if we didn't print it already.
                      */
+                    if (haveBufferedMainFrame) {
+                        outputBufferedMergeFrame(log);
+                    }
+                }
+
+                /*
+                 * Copy this GPS data for later since we may need to duplicate it if there is another main frame before
+                 * we get another GPS update.
+                 */
+                memcpy(bufferedGPSFrame, frame, sizeof(*bufferedGPSFrame) * fieldCount);
+                bufferedFrameTime = gpsFrameTime;
+
+                outputBufferedMergeFrame(log);
+
+                // We need at least lat/lon/altitude from the log to write a useful GPS track
+                bool haveRequiredFields = log->gpsFieldIndexes.GPS_coord[0] != -1 && log->gpsFieldIndexes.GPS_coord[1] != -1 && log->gpsFieldIndexes.GPS_altitude != -1;
+                bool haveRequiredPrecision = log->gpsFieldIndexes.GPS_numSat == -1 || frame[log->gpsFieldIndexes.GPS_numSat] >= MIN_GPS_SATELLITES;
+
+                if (haveRequiredFields && haveRequiredPrecision) {
+                    trackWriterAddPoint(trackWriter, gpsFrameTime, frame[log->gpsFieldIndexes.GPS_coord[0]], frame[log->gpsFieldIndexes.GPS_coord[1]], frame[log->gpsFieldIndexes.GPS_altitude]);
+                }
+            }
+        break;
+        case 'S':
+            if (frameValid) {
+                if (haveBufferedMainFrame) {
+                    outputBufferedMergeFrame(log);
+                }
+
+                memcpy(bufferedSlowFrame, frame, sizeof(bufferedSlowFrame));
+            }
+        break;
+        case 'P':
+        case 'I':
+            if (frame) {
+                if (haveBufferedMainFrame) {
+                    outputBufferedMergeFrame(log);
+                }
+
+                if (frameValid) {
+                    updateFrameStatistics(log, frame);
+
+                    lastFrameIteration = (uint32_t) frame[FLIGHT_LOG_FIELD_INDEX_ITERATION];
+                    lastFrameTime = frame[FLIGHT_LOG_FIELD_INDEX_TIME];
+
+                    updateSimulations(frame, lastFrameTime);
+
+                    // Store this frame to print out later since we don't know if a GPS frame follows it yet
                     memcpy(bufferedMainFrame, frame, sizeof(*bufferedMainFrame) * fieldCount);
 
                     haveBufferedMainFrame = true;
-
-                    bufferedFrameIteration = lastFrameIteration;
                     bufferedFrameTime = lastFrameTime;
                 } else {
                     haveBufferedMainFrame = false;
-
-                    bufferedFrameIteration = -1;
                     bufferedFrameTime = -1;
                 }
             }
@@ -719,12 +1128,27 @@ void onFrameReadyMerge(flightLog_t *log, bool frameValid, int64_t *frame, uint8_
 
 void onFrameReady(flightLog_t *log, bool frameValid, int64_t *frame, uint8_t frameType, int fieldCount, int frameOffset, int frameSize)
 {
-    if (options.mergeGPS && log->frameDefs['G'].fieldCount > 0) {
+    if (options.statsOnly) {
+        onFrameReadyStats(log, frameValid, frame, frameType, fieldCount, frameOffset, frameSize);
+        return;
+    }
+
+    if (isAnalysisMode()) {
+        onFrameReadyAnalysis(log, frameValid, frame, frameType, fieldCount, frameOffset, frameSize);
+        return;
+    }
+
+    if (merger) {
         //Use the alternate frame processing routine which merges main stream data and GPS data together
         onFrameReadyMerge(log, frameValid, frame, frameType, fieldCount, frameOffset, frameSize);
         return;
     }
 
+    if (rawGPSMerge) {
+        onFrameReadyRawMerge(log, frameValid, frame, frameType, fieldCount);
+        return;
+    }
+
     switch (frameType) {
         case 'G':
             if (frameValid) {
@@ -736,25 +1160,42 @@ void onFrameReady(flightLog_t *log, bool frameValid, int64_t *frame, uint8_t fra
                 memcpy(bufferedSlowFrame, frame, sizeof(bufferedSlowFrame));
 
                 if (options.debug) {
+                    bool needComma = false;
+
                     fprintf(csvFile, "S frame: ");
-                    outputSlowFrameFields(log, bufferedSlowFrame);
+                    outputSlowFrameFields(log, bufferedSlowFrame, &needComma);
                     fprintf(csvFile, "\n");
                 }
             }
         break;
         case 'P':
         case 'I':
-            if (frameValid || (frame && options.raw)) {
+            if (resampler) {
+                if (frameValid) {
+                    updateFrameStatistics(log, frame);
+
+                    updateSimulations(frame, lastFrameTime);
+
+                    lastFrameIteration = (uint32_t) frame[FLIGHT_LOG_FIELD_INDEX_ITERATION];
+                    lastFrameTime = frame[FLIGHT_LOG_FIELD_INDEX_TIME];
+
+                    resampleMainFrame(frame);
+                } else {
+                    resamplerAddGap(resampler);
+                }
+            } else if (frameValid || (frame && options.raw)) {
                 if (frameValid) {
                     updateFrameStatistics(log, frame);
 
-                    updateSimulations(log, frame, lastFrameTime);
+                    updateSimulations(frame, lastFrameTime);
 
                     lastFrameIteration = (uint32_t) frame[FLIGHT_LOG_FIELD_INDEX_ITERATION];
                     lastFrameTime = frame[FLIGHT_LOG_FIELD_INDEX_TIME];
                 }
 
-                outputMainFrameFields(log, frameValid ? frame[FLIGHT_LOG_FIELD_INDEX_TIME] : -1, frame);
+                bool needComma = false;
+
+                outputMainFrameFields(log, frameValid ? frame[FLIGHT_LOG_FIELD_INDEX_TIME] : -1, frame, &needComma);
 
                 if (options.debug) {
                     fprintf(csvFile, ", %c, offset %d, size %d\n", (char) frameType, frameOffset, frameSize);
@@ -777,155 +1218,905 @@ void onFrameReady(flightLog_t *log, bool frameValid, int64_t *frame, uint8_t fra
     }
 }
 
-void resetGPSFieldIdents()
+void resetGPSFieldIdents()
+{
+    for (int i = 0; i < FLIGHT_LOG_MAX_FIELDS; i++) {
+        gpsFieldTypes[i] = GPS_FIELD_TYPE_INTEGER;
+    }
+}
+
+/**
+ * Sets the units/display format we should use for each GPS field into the global `gpsFieldTypes`.
+ */
+void identifyGPSFields(flightLog_t *log)
+{
+    int i;
+
+    for (i = 0; i < log->frameDefs['G'].fieldCount; i++) {
+        const char *fieldName = log->frameDefs['G'].fieldName[i];
+
+        if (strcmp(fieldName, "GPS_coord[0]") == 0) {
+            gpsFieldTypes[i] = GPS_FIELD_TYPE_COORDINATE_DEGREES_TIMES_10000000;
+        } else if (strcmp(fieldName, "GPS_coord[1]") == 0) {
+            gpsFieldTypes[i] = GPS_FIELD_TYPE_COORDINATE_DEGREES_TIMES_10000000;
+        } else if (strcmp(fieldName, "GPS_altitude") == 0) {
+            gpsFieldTypes[i] = GPS_FIELD_TYPE_METERS;
+        } else if (strcmp(fieldName, "GPS_speed") == 0) {
+            gpsFieldTypes[i] = GPS_FIELD_TYPE_METERS_PER_SECOND_TIMES_100;
+        } else if (strcmp(fieldName, "GPS_ground_course") == 0) {
+            gpsFieldTypes[i] = GPS_FIELD_TYPE_DEGREES_TIMES_10;
+        } else {
+            gpsFieldTypes[i] = GPS_FIELD_TYPE_INTEGER;
+        }
+    }
+}
+
+/**
+ * After reading in what fields are present, this routine is called in order to apply the user's
+ * commandline choices for field units to the global "mainFieldUnit" and "gpsGFieldUnit" arrays.
+ */
+void applyFieldUnits(flightLog_t *log)
+{
+    if (options.raw) {
+        for (int i = 0; i < FLIGHT_LOG_MAX_FIELDS; i++) {
+            mainFieldUnit[i] = UNIT_RAW;
+            gpsGFieldUnit[i] = UNIT_RAW;
+            slowFieldUnit[i] = UNIT_RAW;
+        }
+    } else {
+        memset(mainFieldUnit, 0, sizeof(mainFieldUnit));
+        memset(gpsGFieldUnit, 0, sizeof(gpsGFieldUnit));
+        memset(slowFieldUnit, 0, sizeof(slowFieldUnit));
+    
+        if (log->mainFieldIndexes.vbatLatest > -1) {
+            mainFieldUnit[log->mainFieldIndexes.vbatLatest] = options.unitVbat;
+        }
+
+        if (log->mainFieldIndexes.amperageLatest > -1) {
+            mainFieldUnit[log->mainFieldIndexes.amperageLatest] = options.unitAmperage;
+        }
+
+        if (log->mainFieldIndexes.BaroAlt > -1) {
+            mainFieldUnit[log->mainFieldIndexes.BaroAlt] = options.unitHeight;
+        }
+
+        if (log->mainFieldIndexes.time > -1) {
+            mainFieldUnit[log->mainFieldIndexes.time] = options.unitFrameTime;
+        }
+
+        if (log->gpsFieldIndexes.GPS_speed > -1) {
+            gpsGFieldUnit[log->gpsFieldIndexes.GPS_speed] = options.unitGPSSpeed;
+        }
+
+        for (int i = 0; i < 3; i++) {
+            if (log->mainFieldIndexes.accSmooth[i] > -1) {
+                mainFieldUnit[log->mainFieldIndexes.accSmooth[i]] = options.unitAcceleration;
+            }
+
+            if (log->mainFieldIndexes.gyroADC[i] > -1) {
+                mainFieldUnit[log->mainFieldIndexes.gyroADC[i]] = options.unitRotation;
+            }
+        }
+
+        // Slow frame fields:
+        if (log->slowFieldIndexes.flightModeFlags > -1) {
+            slowFieldUnit[log->slowFieldIndexes.flightModeFlags] = options.unitFlags;
+        }
+        if (log->slowFieldIndexes.stateFlags > -1) {
+            slowFieldUnit[log->slowFieldIndexes.stateFlags] = options.unitFlags;
+        }
+        if (log->slowFieldIndexes.failsafePhase > -1) {
+            slowFieldUnit[log->slowFieldIndexes.failsafePhase] = options.unitFlags;
+        }
+    }
+}
+
+/**
+ * Does the field name match one of the patterns the user gave with --fields? (All fields match if none were given.)
+ */
+static bool isFieldSelected(const char *fieldName)
+{
+    if (options.fieldPatternCount == 0) {
+        return true;
+    }
+
+    for (int i = 0; i < options.fieldPatternCount; i++) {
+        if (globMatch(options.fieldPatterns[i], fieldName)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool frameFieldsMatch(const char *pattern, flightLogFrameDef_t *frame, const int *fieldIndexes, int fieldCount)
+{
+    for (int i = 0; i < fieldCount; i++) {
+        if (globMatch(pattern, frame->fieldName[fieldIndexes[i]])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Point out the --fields patterns which didn't select any field of this log, since they're probably mistyped.
+ */
+static void warnUnmatchedFieldPatterns(flightLog_t *log)
+{
+    const struct {
+        const char *name;
+        bool selected;
+    } computedFields[] = {
+        {"roll", computedFieldOutput.roll},
+        {"pitch", computedFieldOutput.pitch},
+        {"heading", computedFieldOutput.heading},
+        {"energyCumulative", computedFieldOutput.energyCumulative},
+        {"currentVirtual", computedFieldOutput.currentVirtual},
+        {"energyCumulativeVirtual", computedFieldOutput.energyCumulativeVirtual}
+    };
+
+    for (int i = 0; i < options.fieldPatternCount; i++) {
+        const char *pattern = options.fieldPatterns[i];
+        bool matched = frameFieldsMatch(pattern, &log->frameDefs['I'], mainFieldOutput, mainFieldOutputCount)
+            || frameFieldsMatch(pattern, &log->frameDefs['S'], slowFieldOutput, slowFieldOutputCount)
+            || frameFieldsMatch(pattern, &log->frameDefs['G'], gpsFieldOutput, gpsFieldOutputCount);
+
+        for (unsigned int j = 0; !matched && j < sizeof(computedFields) / sizeof(computedFields[0]); j++) {
+            matched = computedFields[j].selected && globMatch(pattern, computedFields[j].name);
+        }
+
+        // The spectrum analysis can pick the PID sums too
+        for (int axis = 0; !matched && (options.spectrum || options.spectrogram) && axis < 3; axis++) {
+            matched = globMatch(pattern, derivedChannelName((DerivedChannel) (DERIVED_CHANNEL_AXIS_PID_SUM_ROLL + axis)));
+        }
+
+        if (!matched) {
+            fprintf(stderr, "The --fields pattern \"%s\" doesn't match any field of this log\n", pattern);
+        }
+    }
+}
+
+static int selectFrameFields(flightLogFrameDef_t *frame, int skipFieldIndex, int *fieldIndexes)
+{
+    int count = 0;
+
+    for (int i = 0; i < frame->fieldCount; i++) {
+        if (i != skipFieldIndex && isFieldSelected(frame->fieldName[i])) {
+            fieldIndexes[count++] = i;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Decide which of the fields of the log will be printed, based on the --fields patterns and the fields that are
+ * available in the log.
+ */
+void selectOutputFields(flightLog_t *log)
+{
+    mainFieldOutputCount = selectFrameFields(&log->frameDefs['I'], -1, mainFieldOutput);
+    slowFieldOutputCount = selectFrameFields(&log->frameDefs['S'], -1, slowFieldOutput);
+    // The GPS time is printed separately since it may not be present in the GPS frame
+    gpsFieldOutputCount = selectFrameFields(&log->frameDefs['G'], log->gpsFieldIndexes.time, gpsFieldOutput);
+
+    // None of the computed fields are summarised by --stats-only or analysed by --spectrum, so we needn't simulate them
+    if (options.statsOnly || isAnalysisMode()) {
+        memset(&computedFieldOutput, 0, sizeof(computedFieldOutput));
+    } else {
+        computedFieldOutput.roll = options.simulateIMU && isFieldSelected("roll");
+        computedFieldOutput.pitch = options.simulateIMU && isFieldSelected("pitch");
+        computedFieldOutput.heading = options.simulateIMU && isFieldSelected("heading");
+
+        computedFieldOutput.energyCumulative = log->mainFieldIndexes.amperageLatest != -1 && isFieldSelected("energyCumulative");
+
+        computedFieldOutput.currentVirtual = options.simulateCurrentMeter && isFieldSelected("currentVirtual");
+        computedFieldOutput.energyCumulativeVirtual = options.simulateCurrentMeter && isFieldSelected("energyCumulativeVirtual");
+    }
+
+    warnUnmatchedFieldPatterns(log);
+}
+
+/**
+ * Create the engine for the computed fields that were selected for output, and drop any that can't be computed for
+ * this log.
+ */
+static void createDerivedEngine(flightLog_t *log)
+{
+    derivedSettings_t settings;
+    bool requested[DERIVED_CHANNEL_COUNT] = {false};
+
+    derivedSettingsInit(&settings, log);
+
+    settings.magneticDeclination = options.declination;
+    settings.ignoreMag = options.imuIgnoreMag;
+
+    if (options.overrideSimCurrentMeterOffset)
+        settings.currentMeterOffset = options.simCurrentMeterOffset;
+    if (options.overrideSimCurrentMeterScale)
+        settings.currentMeterScale = options.simCurrentMeterScale;
+
+    requested[DERIVED_CHANNEL_ROLL] = computedFieldOutput.roll;
+    requested[DERIVED_CHANNEL_PITCH] = computedFieldOutput.pitch;
+    requested[DERIVED_CHANNEL_HEADING] = computedFieldOutput.heading;
+    requested[DERIVED_CHANNEL_ENERGY_CUMULATIVE] = computedFieldOutput.energyCumulative;
+    requested[DERIVED_CHANNEL_CURRENT_VIRTUAL] = computedFieldOutput.currentVirtual;
+    requested[DERIVED_CHANNEL_ENERGY_CUMULATIVE_VIRTUAL] = computedFieldOutput.energyCumulativeVirtual;
+
+    // The spectrum analysis reads the PID sums from the engine
+    if (options.spectrum || options.spectrogram) {
+        for (int axis = 0; axis < 3; axis++) {
+            DerivedChannel channel = (DerivedChannel) (DERIVED_CHANNEL_AXIS_PID_SUM_ROLL + axis);
+
+            requested[channel] = isFieldSelected(derivedChannelName(channel));
+        }
+    }
+
+    // We only ever compute one frame at a time, since we print as we decode
+    derived = derivedEngineCreate(log, &settings, requested, 1);
+
+    computedFieldOutput.roll = derived->available[DERIVED_CHANNEL_ROLL];
+    computedFieldOutput.pitch = derived->available[DERIVED_CHANNEL_PITCH];
+    computedFieldOutput.heading = derived->available[DERIVED_CHANNEL_HEADING];
+    computedFieldOutput.energyCumulative = derived->available[DERIVED_CHANNEL_ENERGY_CUMULATIVE];
+    computedFieldOutput.currentVirtual = derived->available[DERIVED_CHANNEL_CURRENT_VIRTUAL];
+    computedFieldOutput.energyCumulativeVirtual = derived->available[DERIVED_CHANNEL_ENERGY_CUMULATIVE_VIRTUAL];
+}
+
+static void addSpectrumChannel(int fieldIndex, DerivedChannel derivedChannel)
+{
+    spectrumChannels[spectrumChannelCount].fieldIndex = fieldIndex;
+    spectrumChannels[spectrumChannelCount].derivedChannel = derivedChannel;
+    spectrumChannelCount++;
+}
+
+/**
+ * The interval between logged frames in microseconds, or 0 if the log doesn't say what its looptime is.
+ */
+static double loggedFrameInterval(flightLog_t *log)
+{
+    // Only frameIntervalPNum out of every frameIntervalPDenom loop iterations are logged
+    return (double) log->sysConfig.looptime * log->frameIntervalPDenom / log->frameIntervalPNum;
+}
+
+/**
+ * Choose the gyro, PID and motor fields to analyse and create the spectrum analyzer for them (leaving `spectrum` NULL
+ * if none of them are in the log).
+ */
+static void createSpectrumAnalyzer(flightLog_t *log)
+{
+    spectrumSettings_t settings;
+
+    spectrumChannelCount = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        int fieldIndex = log->mainFieldIndexes.gyroADC[axis];
+
+        if (fieldIndex != -1 && isFieldSelected(log->frameDefs['I'].fieldName[fieldIndex])) {
+            addSpectrumChannel(fieldIndex, DERIVED_CHANNEL_COUNT);
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        DerivedChannel channel = (DerivedChannel) (DERIVED_CHANNEL_AXIS_PID_SUM_ROLL + axis);
+
+        if (derived->available[channel]) {
+            addSpectrumChannel(-1, channel);
+        }
+    }
+
+    for (int motor = 0; motor < FLIGHT_LOG_MAX_MOTORS; motor++) {
+        int fieldIndex = log->mainFieldIndexes.motor[motor];
+
+        if (fieldIndex != -1 && isFieldSelected(log->frameDefs['I'].fieldName[fieldIndex])) {
+            addSpectrumChannel(fieldIndex, DERIVED_CHANNEL_COUNT);
+        }
+    }
+
+    if (spectrumChannelCount == 0) {
+        fprintf(stderr, "There are no gyroADC, axisPID or motor fields to analyse in this log\n");
+        return;
+    }
+
+    spectrumSettingsInit(&settings);
+
+    settings.fftSize = options.fftSize;
+    settings.rowInterval = options.spectrogram ? options.spectrogramInterval : 0;
+
+    // Older logs don't record the looptime, in which case it's estimated from the frame timestamps
+    settings.sampleInterval = loggedFrameInterval(log);
+
+    spectrum = spectrumAnalyzerCreate(spectrumChannelCount, &settings);
+}
+
+/**
+ * Create the series to collect the setpoint and gyro rate of each axis in for --step-response (leaving `stepSeries`
+ * NULL if the log has no axes with both).
+ */
+static void createStepResponseSeries(flightLog_t *log)
+{
+    spectrumSettings_t settings;
+
+    stepAxisCount = 0;
+
+    for (int axis = 0; axis < STEP_RESPONSE_MAX_AXES; axis++) {
+        if (log->mainFieldIndexes.rcCommand[axis] != -1 && log->mainFieldIndexes.gyroADC[axis] != -1) {
+            stepAxes[stepAxisCount++] = axis;
+        }
+    }
+
+    if (stepAxisCount == 0) {
+        fprintf(stderr, "Can't estimate the step response because rcCommand or gyroADC data is missing\n");
+        return;
+    }
+
+    spectrumSettingsInit(&settings);
+
+    settings.sampleInterval = loggedFrameInterval(log);
+
+    stepSeries = spectrumAnalyzerCreate(stepAxisCount * 2, &settings);
+}
+
+/**
+ * Find the aggregation method for the field, and mark the --aggregate patterns that match it in `patternMatched`.
+ */
+static ResampleAggregation resampleAggregationForField(const char *fieldName, bool *patternMatched)
+{
+    ResampleAggregation result = RESAMPLE_MEAN;
+
+    // Later patterns override earlier ones
+    for (int i = 0; i < options.aggregatePatternCount; i++) {
+        if (globMatch(options.aggregatePatterns[i], fieldName)) {
+            result = options.aggregations[i];
+            patternMatched[i] = true;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Create a resampler with columns for the selected fields (see resampleMainFrame() for the column order).
+ */
+void createResampler(flightLog_t *log)
+{
+    ResampleAggregation aggregation[RESAMPLE_MAX_COLUMNS];
+    bool patternMatched[MAX_FIELD_PATTERNS] = {false};
+    int columnCount = 0;
+
+    for (int j = 0; j < mainFieldOutputCount; j++) {
+        aggregation[columnCount++] = resampleAggregationForField(log->frameDefs['I'].fieldName[mainFieldOutput[j]], patternMatched);
+    }
+
+    if (computedFieldOutput.roll) {
+        aggregation[columnCount++] = resampleAggregationForField("roll", patternMatched);
+    }
+    if (computedFieldOutput.pitch) {
+        aggregation[columnCount++] = resampleAggregationForField("pitch", patternMatched);
+    }
+    if (computedFieldOutput.heading) {
+        aggregation[columnCount++] = resampleAggregationForField("heading", patternMatched);
+    }
+    if (computedFieldOutput.energyCumulative) {
+        aggregation[columnCount++] = resampleAggregationForField("energyCumulative", patternMatched);
+    }
+    if (computedFieldOutput.currentVirtual) {
+        aggregation[columnCount++] = resampleAggregationForField("currentVirtual", patternMatched);
+    }
+    if (computedFieldOutput.energyCumulativeVirtual) {
+        aggregation[columnCount++] = resampleAggregationForField("energyCumulativeVirtual", patternMatched);
+    }
+
+    // Slow fields are mostly flags, so averaging them wouldn't make sense
+    for (int j = 0; j < slowFieldOutputCount; j++) {
+        aggregation[columnCount++] = RESAMPLE_LAST;
+    }
+
+    for (int i = 0; i < options.aggregatePatternCount; i++) {
+        if (!patternMatched[i]) {
+            fprintf(stderr, "The --aggregate pattern \"%s\" doesn't match any resampled field of this log\n", options.aggregatePatterns[i]);
+        }
+    }
+
+    resampler = resamplerCreate(columnCount, (int64_t) fmax(llround(1000000 / options.resampleRate), 1), aggregation, outputResampledRow, log);
+}
+
+void writeMainCSVHeader(flightLog_t *log)
+{
+    bool needComma = false;
+
+    outputFieldNamesHeader(csvFile, &log->frameDefs['I'], mainFieldUnit, mainFieldOutput, mainFieldOutputCount, &needComma);
+
+    if (computedFieldOutput.roll) {
+        outputFieldSeparator(csvFile, &needComma);
+        fprintf(csvFile, "roll");
+    }
+
+    if (computedFieldOutput.pitch) {
+        outputFieldSeparator(csvFile, &needComma);
+        fprintf(csvFile, "pitch");
+    }
+
+    if (computedFieldOutput.heading) {
+        outputFieldSeparator(csvFile, &needComma);
+        fprintf(csvFile, "heading");
+    }
+
+    if (computedFieldOutput.energyCumulative) {
+        outputFieldSeparator(csvFile, &needComma);
+        fprintf(csvFile, "energyCumulative (mAh)");
+    }
+
+    if (computedFieldOutput.currentVirtual) {
+        outputFieldSeparator(csvFile, &needComma);
+        fprintf(csvFile, "currentVirtual (%s)", UNIT_NAME[options.unitAmperage]);
+    }
+
+    if (computedFieldOutput.energyCumulativeVirtual) {
+        outputFieldSeparator(csvFile, &needComma);
+        fprintf(csvFile, "energyCumulativeVirtual (mAh)");
+    }
+
+    outputFieldNamesHeader(csvFile, &log->frameDefs['S'], slowFieldUnit, slowFieldOutput, slowFieldOutputCount, &needComma);
+
+    if (options.mergeGPS && log->frameDefs['G'].fieldCount > 0) {
+        outputFieldNamesHeader(csvFile, &log->frameDefs['G'], gpsGFieldUnit, gpsFieldOutput, gpsFieldOutputCount, &needComma);
+    }
+
+    fprintf(csvFile, "\n");
+}
+
+void onMetadataReady(flightLog_t *log)
+{
+    if (log->frameDefs['I'].fieldCount == 0) {
+        fprintf(stderr, "No fields found in log, is it missing its header?\n");
+        return;
+    } else if (options.simulateIMU && (log->mainFieldIndexes.accSmooth[0] == -1 || log->mainFieldIndexes.gyroADC[0] == -1)){
+        fprintf(stderr, "Can't simulate the IMU because accelerometer or gyroscope data is missing\n");
+        options.simulateIMU = false;
+    }
+
+    identifyGPSFields(log);
+    applyFieldUnits(log);
+    selectOutputFields(log);
+
+    if (options.statsOnly) {
+        return;
+    }
+
+    createDerivedEngine(log);
+
+    if (isAnalysisMode()) {
+        if (options.spectrum || options.spectrogram) {
+            createSpectrumAnalyzer(log);
+        }
+        if (options.stepResponse) {
+            createStepResponseSeries(log);
+        }
+        return;
+    }
+
+    if (options.resampleRate > 0) {
+        createResampler(log);
+    }
+
+    if (options.mergeGPS && log->frameDefs['G'].fieldCount > 0 && options.raw) {
+        rawGPSMerge = true;
+        haveBufferedMainFrame = false;
+        bufferedFrameTime = -1;
+        memset(bufferedGPSFrame, 0, sizeof(bufferedGPSFrame));
+        memset(bufferedMainFrame, 0, sizeof(bufferedMainFrame));
+    } else if (options.mergeGPS && log->frameDefs['G'].fieldCount > 0) {
+        int fieldCount[MERGE_STREAM_COUNT] = {log->frameDefs['I'].fieldCount, log->frameDefs['G'].fieldCount, log->frameDefs['S'].fieldCount};
+        // Slow frames are mostly flags, so they can't be interpolated
+        MergeJoinPolicy policy[MERGE_STREAM_COUNT] = {MERGE_JOIN_HOLD, options.mergePolicy, MERGE_JOIN_HOLD};
+
+        merger = streamMergerCreate(MERGE_STREAM_COUNT, fieldCount, policy, MERGE_ROW_CAPACITY, outputMergedRow, log);
+    }
+
+    writeMainCSVHeader(log);
+}
+
+static void writeJSONSketchStore(FILE *file, const quantileSketchStore_t *store)
+{
+    int start = 0, end = store->length;
+    bool needComma = false;
+
+    // Trim off the empty buckets at either end
+    while (start < end && store->counts[start] == 0)
+        start++;
+    while (end > start && store->counts[end - 1] == 0)
+        end--;
+
+    fprintf(file, "{\"offset\":%d,\"counts\":[", start < end ? store->offset + start : 0);
+
+    for (int i = start; i < end; i++) {
+        if (needComma)
+            fprintf(file, ",");
+        else
+            needComma = true;
+
+        fprintf(file, "%" PRIu64, store->counts[i]);
+    }
+
+    fprintf(file, "]}");
+}
+
+/**
+ * Write the distribution as JSON. The quantiles are read from the `exact` histogram if it's given and it holds every
+ * value in bins of width 1, otherwise they come from the sketch and are marked as approximate.
+ */
+static void writeJSONDistribution(FILE *file, seriesStats_t *moments, quantileSketch_t *sketch, const histogram_t *exact)
+{
+    bool approximate = !exact || exact->binWidth != 1 || exact->underflow || exact->overflow;
+    double quantiles[] = {0.50, 0.95, 0.99};
+    double values[3];
+
+    for (int i = 0; i < 3; i++) {
+        values[i] = approximate ? quantileSketch_getQuantile(sketch, quantiles[i]) : histogram_getQuantile(exact, quantiles[i]);
+    }
+
+    fprintf(file, "{\"count\":%" PRIu64 ",\"mean\":%.10g,\"variance\":%.10g,\"min\":%" PRId64 ",\"max\":%" PRId64
+        ",\"p50\":%.10g,\"p95\":%.10g,\"p99\":%.10g,\"approximate\":%s,",
+        quantileSketch_getCount(sketch), seriesStats_getMean(moments), seriesStats_getVariance(moments), sketch->min, sketch->max,
+        values[0], values[1], values[2], approximate ? "true" : "false");
+
+    // Include the sketch itself so that the distributions of several logs can be merged later
+    fprintf(file, "\"sketch\":{\"subBucketBits\":%d,\"negative\":", QUANTILE_SKETCH_SUB_BUCKET_BITS);
+    writeJSONSketchStore(file, &sketch->negative);
+    fprintf(file, ",\"positive\":");
+    writeJSONSketchStore(file, &sketch->positive);
+    fprintf(file, "}}");
+}
+
+static void writeJSONFieldSummaries(FILE *file, flightLogFrameDef_t *frameDef, fieldSummary_t *summaries, const int *fieldIndexes, int fieldCount)
+{
+    fprintf(file, "{");
+
+    for (int j = 0; j < fieldCount; j++) {
+        int i = fieldIndexes[j];
+
+        fprintf(file, "%s\n    \"%s\":", j > 0 ? "," : "", frameDef->fieldName[i]);
+        writeJSONDistribution(file, &summaries[i].moments, &summaries[i].sketch, NULL);
+    }
+
+    fprintf(file, "\n  }");
+}
+
+/**
+ * Write the results of --stats-only as JSON. Field values are in the log's raw units.
+ */
+void writeStatsJSON(flightLog_t *log, int logIndex, FILE *file)
+{
+    flightLogStatistics_t *stats = &log->stats;
+    uint8_t frameTypes[] = {'I', 'P', 'H', 'G', 'E', 'S'};
+    bool needComma = false;
+    int64_t nominalLooptime = histogram_getQuantile(&looptimeHistogram, 0.5);
+
+    fprintf(file, "{\n  \"log\":%d,\n  \"logCount\":%d,\n", logIndex + 1, log->logCount);
+
+    if (stats->haveFieldStats) {
+        fprintf(file, "  \"startTime\":%" PRId64 ",\n  \"endTime\":%" PRId64 ",\n",
+            stats->field[FLIGHT_LOG_FIELD_INDEX_TIME].min, stats->field[FLIGHT_LOG_FIELD_INDEX_TIME].max);
+    }
+
+    fprintf(file, "  \"frames\":{");
+    for (int i = 0; i < (int) sizeof(frameTypes); i++) {
+        flightLogFrameStatistics_t *frameStats = &stats->frame[frameTypes[i]];
+
+        if (frameStats->validCount) {
+            fprintf(file, "%s\"%c\":{\"count\":%d,\"bytes\":%d}", needComma ? "," : "", (char) frameTypes[i], frameStats->validCount, frameStats->bytes);
+            needComma = true;
+        }
+    }
+    fprintf(file, "},\n  \"corruptFrames\":%u,\n", stats->totalCorruptFrames);
+
+    fprintf(file, "  \"looptime\":");
+    writeJSONDistribution(file, &looptimeStats, &looptimeSketch, &looptimeHistogram);
+
+    // The jitter is each looptime's deviation from the median looptime:
+    fprintf(file, ",\n  \"looptimeJitter\":{\"nominal\":%" PRId64 ",\"binWidth\":%" PRId64 ",\"underflow\":%" PRIu64 ",\"overflow\":%" PRIu64 ",\"bins\":[",
+        nominalLooptime, looptimeHistogram.binWidth, looptimeHistogram.underflow, looptimeHistogram.overflow);
+
+    needComma = false;
+    for (int i = 0; i < looptimeHistogram.binCount; i++) {
+        if (looptimeHistogram.counts[i]) {
+            fprintf(file, "%s[%" PRId64 ",%" PRIu64 "]", needComma ? "," : "",
+                looptimeHistogram.min + i * looptimeHistogram.binWidth - nominalLooptime, looptimeHistogram.counts[i]);
+            needComma = true;
+        }
+    }
+    fprintf(file, "]},\n");
+
+    fprintf(file, "  \"fields\":");
+    writeJSONFieldSummaries(file, &log->frameDefs['I'], mainFieldSummary, mainFieldOutput, mainFieldOutputCount);
+
+    fprintf(file, ",\n  \"gpsFields\":");
+    writeJSONFieldSummaries(file, &log->frameDefs['G'], gpsFieldSummary, gpsFieldOutput, gpsFieldOutputCount);
+
+    fprintf(file, "\n}\n");
+}
+
+static void fprintfSpectrumChannelName(flightLog_t *log, FILE *file, const spectrumChannel_t *channel)
+{
+    if (channel->fieldIndex == -1) {
+        fprintf(file, "%s", derivedChannelName(channel->derivedChannel));
+    } else {
+        fprintf(file, "%s", log->frameDefs['I'].fieldName[channel->fieldIndex]);
+
+        if (mainFieldUnit[channel->fieldIndex] != UNIT_RAW) {
+            fprintf(file, " (%s)", UNIT_NAME[mainFieldUnit[channel->fieldIndex]]);
+        }
+    }
+}
+
+/**
+ * Write the power spectral density of each analysed field as CSV, one line per frequency bin.
+ */
+static void writeSpectrumCSV(flightLog_t *log, FILE *file)
 {
-    for (int i = 0; i < FLIGHT_LOG_MAX_FIELDS; i++) {
-        gpsFieldTypes[i] = GPS_FIELD_TYPE_INTEGER;
+    fprintf(file, "frequency (Hz)");
+
+    for (int i = 0; i < spectrumChannelCount; i++) {
+        fprintf(file, ", ");
+        fprintfSpectrumChannelName(log, file, &spectrumChannels[i]);
+    }
+
+    fprintf(file, "\n");
+
+    for (int bin = 0; bin < spectrum->binCount; bin++) {
+        fprintf(file, "%.3f", bin * spectrum->binWidth);
+
+        for (int i = 0; i < spectrumChannelCount; i++) {
+            fprintf(file, ", %g", spectrum->psd[i * spectrum->binCount + bin]);
+        }
+
+        fprintf(file, "\n");
     }
 }
 
 /**
- * Sets the units/display format we should use for each GPS field into the global `gpsFieldTypes`.
+ * Write the spectrogram as CSV, with one line for each field in each row of the spectrogram. Each line begins with
+ * the start time of the row and the field name, then the power spectral density in each frequency bin.
  */
-void identifyGPSFields(flightLog_t *log)
+static void writeSpectrogramCSV(flightLog_t *log, FILE *file)
 {
-    int i;
+    fprintf(file, "time (%s), field", UNIT_NAME[options.unitFrameTime]);
 
-    for (i = 0; i < log->frameDefs['G'].fieldCount; i++) {
-        const char *fieldName = log->frameDefs['G'].fieldName[i];
+    for (int bin = 0; bin < spectrum->binCount; bin++) {
+        fprintf(file, ", %.3f", bin * spectrum->binWidth);
+    }
 
-        if (strcmp(fieldName, "GPS_coord[0]") == 0) {
-            gpsFieldTypes[i] = GPS_FIELD_TYPE_COORDINATE_DEGREES_TIMES_10000000;
-        } else if (strcmp(fieldName, "GPS_coord[1]") == 0) {
-            gpsFieldTypes[i] = GPS_FIELD_TYPE_COORDINATE_DEGREES_TIMES_10000000;
-        } else if (strcmp(fieldName, "GPS_altitude") == 0) {
-            gpsFieldTypes[i] = GPS_FIELD_TYPE_METERS;
-        } else if (strcmp(fieldName, "GPS_speed") == 0) {
-            gpsFieldTypes[i] = GPS_FIELD_TYPE_METERS_PER_SECOND_TIMES_100;
-        } else if (strcmp(fieldName, "GPS_ground_course") == 0) {
-            gpsFieldTypes[i] = GPS_FIELD_TYPE_DEGREES_TIMES_10;
-        } else {
-            gpsFieldTypes[i] = GPS_FIELD_TYPE_INTEGER;
+    fprintf(file, "\n");
+
+    for (int row = 0; row < spectrum->rowCount; row++) {
+        if (spectrum->rowWindowCount[row] == 0) {
+            continue;
+        }
+
+        for (int i = 0; i < spectrumChannelCount; i++) {
+            const float *values = spectrum->spectrogram + ((size_t) row * spectrumChannelCount + i) * spectrum->binCount;
+
+            fprintfMicrosecondsInUnit(file, spectrum->rowTime[row], options.unitFrameTime);
+            fprintf(file, ", ");
+            fprintfSpectrumChannelName(log, file, &spectrumChannels[i]);
+
+            for (int bin = 0; bin < spectrum->binCount; bin++) {
+                fprintf(file, ", %g", values[bin]);
+            }
+
+            fprintf(file, "\n");
         }
     }
 }
 
 /**
- * After reading in what fields are present, this routine is called in order to apply the user's
- * commandline choices for field units to the global "mainFieldUnit" and "gpsGFieldUnit" arrays.
+ * Write the power spectral density (or the spectrogram) in binary. Everything is in host byte order:
+ *
+ * char magic[8]               "BBSPECT1"
+ * uint32_t channelCount, binCount, rowCount, fftSize
+ * double binWidth             Hz
+ * char name[][]               The name of each field, NUL-terminated
+ *
+ * Then for each row (the power spectral density has just one row):
+ *
+ * int64_t time                Microseconds, the start of the row
+ * float psd[channelCount][binCount]
  */
-void applyFieldUnits(flightLog_t *log)
+static void writeSpectrumBinary(flightLog_t *log, FILE *file, bool spectrogram)
 {
-    if (options.raw) {
-        for (int i = 0; i < FLIGHT_LOG_MAX_FIELDS; i++) {
-            mainFieldUnit[i] = UNIT_RAW;
-            gpsGFieldUnit[i] = UNIT_RAW;
-            slowFieldUnit[i] = UNIT_RAW;
+    uint32_t header[4];
+    float *values = malloc(spectrumChannelCount * spectrum->binCount * sizeof(*values));
+
+    header[0] = spectrumChannelCount;
+    header[1] = spectrum->binCount;
+    header[2] = 0;
+    header[3] = spectrum->settings.fftSize;
+
+    if (spectrogram) {
+        for (int row = 0; row < spectrum->rowCount; row++) {
+            if (spectrum->rowWindowCount[row] > 0) {
+                header[2]++;
+            }
         }
     } else {
-        memset(mainFieldUnit, 0, sizeof(mainFieldUnit));
-        memset(gpsGFieldUnit, 0, sizeof(gpsGFieldUnit));
-        memset(slowFieldUnit, 0, sizeof(slowFieldUnit));
-    
-        if (log->mainFieldIndexes.vbatLatest > -1) {
-            mainFieldUnit[log->mainFieldIndexes.vbatLatest] = options.unitVbat;
-        }
+        header[2] = 1;
+    }
 
-        if (log->mainFieldIndexes.amperageLatest > -1) {
-            mainFieldUnit[log->mainFieldIndexes.amperageLatest] = options.unitAmperage;
-        }
+    fwrite("BBSPECT1", 1, 8, file);
+    fwrite(header, sizeof(header[0]), 4, file);
+    fwrite(&spectrum->binWidth, sizeof(spectrum->binWidth), 1, file);
 
-        if (log->mainFieldIndexes.BaroAlt > -1) {
-            mainFieldUnit[log->mainFieldIndexes.BaroAlt] = options.unitHeight;
-        }
+    for (int i = 0; i < spectrumChannelCount; i++) {
+        fprintfSpectrumChannelName(log, file, &spectrumChannels[i]);
+        fputc('\0', file);
+    }
 
-        if (log->mainFieldIndexes.time > -1) {
-            mainFieldUnit[log->mainFieldIndexes.time] = options.unitFrameTime;
+    if (spectrogram) {
+        for (int row = 0; row < spectrum->rowCount; row++) {
+            if (spectrum->rowWindowCount[row] > 0) {
+                fwrite(&spectrum->rowTime[row], sizeof(spectrum->rowTime[row]), 1, file);
+                fwrite(spectrum->spectrogram + (size_t) row * spectrumChannelCount * spectrum->binCount, sizeof(*values), spectrumChannelCount * spectrum->binCount, file);
+            }
         }
+    } else {
+        int64_t startTime = spectrum->runCount > 0 ? spectrum->runs[0].startTime : 0;
 
-        if (log->gpsFieldIndexes.GPS_speed > -1) {
-            gpsGFieldUnit[log->gpsFieldIndexes.GPS_speed] = options.unitGPSSpeed;
+        for (int i = 0; i < spectrumChannelCount * spectrum->binCount; i++) {
+            values[i] = (float) spectrum->psd[i];
         }
 
-        for (int i = 0; i < 3; i++) {
-            if (log->mainFieldIndexes.accSmooth[i] > -1) {
-                mainFieldUnit[log->mainFieldIndexes.accSmooth[i]] = options.unitAcceleration;
-            }
+        fwrite(&startTime, sizeof(startTime), 1, file);
+        fwrite(values, sizeof(*values), spectrumChannelCount * spectrum->binCount, file);
+    }
 
-            if (log->mainFieldIndexes.gyroADC[i] > -1) {
-                mainFieldUnit[log->mainFieldIndexes.gyroADC[i]] = options.unitRotation;
-            }
-        }
+    free(values);
+}
 
-        // Slow frame fields:
-        if (log->slowFieldIndexes.flightModeFlags > -1) {
-            slowFieldUnit[log->slowFieldIndexes.flightModeFlags] = options.unitFlags;
-        }
-        if (log->slowFieldIndexes.stateFlags > -1) {
-            slowFieldUnit[log->slowFieldIndexes.stateFlags] = options.unitFlags;
-        }
-        if (log->slowFieldIndexes.failsafePhase > -1) {
-            slowFieldUnit[log->slowFieldIndexes.failsafePhase] = options.unitFlags;
-        }
+/**
+ * Open the output file for the given kind of analysis (or use stdout), returns NULL on failure.
+ */
+static FILE* createAnalysisFile(const char *kind, const char *extension)
+{
+    char *filename;
+    int filenameLen;
+    FILE *file;
+
+    if (options.toStdout) {
+        return stdout;
+    }
+
+    filenameLen = strlen(spectrumFilenamePrefix) + 1 + strlen(kind) + 1 + strlen(extension) + 1;
+    filename = malloc(filenameLen * sizeof(char));
+
+    snprintf(filename, filenameLen, "%s.%s.%s", spectrumFilenamePrefix, kind, extension);
+
+    file = fopen(filename, "wb");
+
+    if (file) {
+        fprintf(stderr, "Writing %s to '%s'...\n", kind, filename);
+    } else {
+        fprintf(stderr, "Failed to create output file %s\n", filename);
     }
+
+    free(filename);
+
+    return file;
 }
 
-void writeMainCSVHeader(flightLog_t *log)
+/**
+ * Write the averaged step response of each axis as CSV, one line per sample, with the lower and upper bounds of its
+ * 95% confidence interval.
+ */
+static void writeStepResponseCSV(const stepResponse_t *response, FILE *file)
 {
-    int i;
+    fprintf(file, "time (ms)");
+
+    for (int i = 0; i < stepAxisCount; i++) {
+        const char *name = STEP_RESPONSE_AXIS_NAME[stepAxes[i]];
+
+        fprintf(file, ", %s, %s lower, %s upper", name, name, name);
+    }
 
-    for (i = 0; i < log->frameDefs['I'].fieldCount; i++) {
-        if (i > 0)
-            fprintf(csvFile, ", ");
+    fprintf(file, "\n");
 
-        fprintf(csvFile, "%s", log->frameDefs['I'].fieldName[i]);
+    for (int sample = 0; sample < response->length; sample++) {
+        fprintf(file, "%.3f", sample * response->sampleInterval / 1000);
 
-        if (mainFieldUnit[i] != UNIT_RAW) {
-            fprintf(csvFile, " (%s)", UNIT_NAME[mainFieldUnit[i]]);
+        for (int i = 0; i < stepAxisCount; i++) {
+            int index = i * response->length + sample;
+
+            fprintf(file, ", %.4f, %.4f, %.4f", response->mean[index], response->lower[index], response->upper[index]);
         }
-    }
 
-    if (options.simulateIMU) {
-        fprintf(csvFile, ", roll, pitch, heading");
+        fprintf(file, "\n");
     }
+}
+
+/**
+ * Estimate the step response of each axis from the whole log and write it out.
+ */
+static void writeStepResponse()
+{
+    stepResponseSettings_t settings;
+    stepResponse_t *response;
+    int setpointChannel[STEP_RESPONSE_MAX_AXES], gyroChannel[STEP_RESPONSE_MAX_AXES];
+    FILE *file;
 
-    if (log->mainFieldIndexes.amperageLatest != -1) {
-        fprintf(csvFile, ", energyCumulative (mAh)");
+    if (!stepSeries) {
+        return;
     }
 
-    if (options.simulateCurrentMeter) {
-        fprintf(csvFile, ", currentVirtual (%s), energyCumulativeVirtual (mAh)", UNIT_NAME[options.unitAmperage]);
+    for (int i = 0; i < stepAxisCount; i++) {
+        setpointChannel[i] = i;
+        gyroChannel[i] = stepAxisCount + i;
     }
 
-    if (log->frameDefs['S'].fieldCount > 0) {
-        fprintf(csvFile, ", ");
+    stepResponseSettingsInit(&settings);
 
-        outputFieldNamesHeader(csvFile, &log->frameDefs['S'], slowFieldUnit, false);
+    response = stepResponseEstimate(stepSeries, stepAxisCount, setpointChannel, gyroChannel, &settings);
+
+    if (!response) {
+        return;
     }
 
-    if (options.mergeGPS && log->frameDefs['G'].fieldCount > 0) {
-        fprintf(csvFile, ", ");
+    for (int i = 0; i < stepAxisCount; i++) {
+        fprintf(stderr, "Step response for %s averaged over %d windows\n", STEP_RESPONSE_AXIS_NAME[stepAxes[i]], response->windowCount[i]);
+    }
 
-        outputFieldNamesHeader(csvFile, &log->frameDefs['G'], gpsGFieldUnit, true);
+    // We always write CSV, since there's so little data
+    if ((file = createAnalysisFile("step", "csv"))) {
+        writeStepResponseCSV(response, file);
+
+        if (file != stdout)
+            fclose(file);
     }
 
-    fprintf(csvFile, "\n");
+    stepResponseDestroy(response);
 }
 
-void onMetadataReady(flightLog_t *log)
+/**
+ * Compute the spectra of the analysed fields from the whole log and write them out.
+ */
+static void writeSpectra(flightLog_t *log)
 {
-    if (log->frameDefs['I'].fieldCount == 0) {
-        fprintf(stderr, "No fields found in log, is it missing its header?\n");
+    const char *extension = options.spectrumFormat == SPECTRUM_FORMAT_BINARY ? "bin" : "csv";
+    FILE *file;
+
+    if (!spectrum) {
         return;
-    } else if (options.simulateIMU && (log->mainFieldIndexes.accSmooth[0] == -1 || log->mainFieldIndexes.gyroADC[0] == -1)){
-        fprintf(stderr, "Can't simulate the IMU because accelerometer or gyroscope data is missing\n");
-        options.simulateIMU = false;
     }
 
-    identifyGPSFields(log);
-    applyFieldUnits(log);
+    spectrumAnalyzerCompute(spectrum);
 
-    writeMainCSVHeader(log);
+    if (spectrum->windowCount == 0) {
+        fprintf(stderr, "The log is too short to compute its spectrum (that needs %d frames in a row without any gaps)\n", options.fftSize);
+        return;
+    }
+
+    if (options.spectrum && (file = createAnalysisFile("spectrum", extension))) {
+        if (options.spectrumFormat == SPECTRUM_FORMAT_BINARY) {
+            writeSpectrumBinary(log, file, false);
+        } else {
+            writeSpectrumCSV(log, file);
+        }
+
+        if (file != stdout)
+            fclose(file);
+    }
+
+    if (options.spectrogram && (file = createAnalysisFile("spectrogram", extension))) {
+        if (options.spectrumFormat == SPECTRUM_FORMAT_BINARY) {
+            writeSpectrumBinary(log, file, true);
+        } else {
+            writeSpectrogramCSV(log, file);
+        }
+
+        if (file != stdout)
+            fclose(file);
+    }
 }
 
 void printStats(flightLog_t *log, int logIndex, bool raw, bool limits)
@@ -1048,30 +2239,46 @@ void printStats(flightLog_t *log, int logIndex, bool raw, bool limits)
 }
 
 void resetParseState() {
-    if (options.simulateIMU) {
-        imuInit();
-    }
-
-    if (options.mergeGPS) {
-        haveBufferedMainFrame = false;
-        bufferedFrameTime = -1;
-        bufferedFrameIteration = (uint32_t) -1;
-        memset(bufferedGPSFrame, 0, sizeof(bufferedGPSFrame));
-        memset(bufferedMainFrame, 0, sizeof(bufferedMainFrame));
-    }
-
     memset(bufferedSlowFrame, 0, sizeof(bufferedSlowFrame));
 
+    mainFieldOutputCount = slowFieldOutputCount = gpsFieldOutputCount = 0;
+    memset(&computedFieldOutput, 0, sizeof(computedFieldOutput));
+
     lastFrameIteration = (uint32_t) -1;
     lastFrameTime = -1;
 
     seriesStats_init(&looptimeStats);
+
+    if (options.statsOnly) {
+        for (int i = 0; i < FLIGHT_LOG_MAX_FIELDS; i++) {
+            seriesStats_init(&mainFieldSummary[i].moments);
+            quantileSketch_init(&mainFieldSummary[i].sketch);
+            seriesStats_init(&gpsFieldSummary[i].moments);
+            quantileSketch_init(&gpsFieldSummary[i].sketch);
+        }
+
+        quantileSketch_init(&looptimeSketch);
+        histogram_init(&looptimeHistogram, 0, 1, LOOPTIME_HISTOGRAM_BINS);
+    }
+}
+
+void freeParseState()
+{
+    if (options.statsOnly) {
+        for (int i = 0; i < FLIGHT_LOG_MAX_FIELDS; i++) {
+            quantileSketch_destroy(&mainFieldSummary[i].sketch);
+            quantileSketch_destroy(&gpsFieldSummary[i].sketch);
+        }
+
+        quantileSketch_destroy(&looptimeSketch);
+        histogram_destroy(&looptimeHistogram);
+    }
 }
 
 int decodeFlightLog(flightLog_t *log, const char *filename, int logIndex)
 {
     // Organise output files/streams
-    gpx = NULL;
+    trackWriter = NULL;
 
     gpsCsvFile = NULL;
     gpsCsvFilename = NULL;
@@ -1079,10 +2286,18 @@ int decodeFlightLog(flightLog_t *log, const char *filename, int logIndex)
     eventFile = NULL;
     eventFilename = NULL;
 
+    resampler = NULL;
+    merger = NULL;
+    rawGPSMerge = false;
+    derived = NULL;
+    spectrum = NULL;
+    stepSeries = NULL;
+    spectrumFilenamePrefix = NULL;
+
     if (options.toStdout) {
         csvFile = stdout;
     } else {
-        char *csvFilename = 0, *gpxFilename = 0;
+        char *csvFilename = 0, *trackFilename = 0;
         int filenameLen;
 
         const char *outputPrefix = 0;
@@ -1105,15 +2320,31 @@ int decodeFlightLog(flightLog_t *log, const char *filename, int logIndex)
             outputPrefixLen = logNameEnd - outputPrefix;
         }
 
-        filenameLen = outputPrefixLen + strlen(".00.csv") + 1;
-        csvFilename = malloc(filenameLen * sizeof(char));
+        if (isAnalysisMode()) {
+            // The spectra are written once the whole log has been analysed
+            filenameLen = outputPrefixLen + strlen(".00") + 1;
+            spectrumFilenamePrefix = malloc(filenameLen * sizeof(char));
+
+            snprintf(spectrumFilenamePrefix, filenameLen, "%.*s.%02d", outputPrefixLen, outputPrefix, logIndex + 1);
+        } else if (options.statsOnly) {
+            // This is the only output file in this mode
+            filenameLen = outputPrefixLen + strlen(".00.stats.json") + 1;
+            csvFilename = malloc(filenameLen * sizeof(char));
+
+            snprintf(csvFilename, filenameLen, "%.*s.%02d.stats.json", outputPrefixLen, outputPrefix, logIndex + 1);
+        } else {
+            filenameLen = outputPrefixLen + strlen(".00.csv") + 1;
+            csvFilename = malloc(filenameLen * sizeof(char));
+
+            snprintf(csvFilename, filenameLen, "%.*s.%02d.csv", outputPrefixLen, outputPrefix, logIndex + 1);
+        }
 
-        snprintf(csvFilename, filenameLen, "%.*s.%02d.csv", outputPrefixLen, outputPrefix, logIndex + 1);
+        const char *trackExtension = trackFormatFileExtension(options.trackFormat);
 
-        filenameLen = outputPrefixLen + strlen(".00.gps.gpx") + 1;
-        gpxFilename = malloc(filenameLen * sizeof(char));
+        filenameLen = outputPrefixLen + strlen(".00.gps.") + strlen(trackExtension) + 1;
+        trackFilename = malloc(filenameLen * sizeof(char));
 
-        snprintf(gpxFilename, filenameLen, "%.*s.%02d.gps.gpx", outputPrefixLen, outputPrefix, logIndex + 1);
+        snprintf(trackFilename, filenameLen, "%.*s.%02d.gps.%s", outputPrefixLen, outputPrefix, logIndex + 1, trackExtension);
 
         filenameLen = outputPrefixLen + strlen(".00.gps.csv") + 1;
         gpsCsvFilename = malloc(filenameLen * sizeof(char));
@@ -1125,35 +2356,83 @@ int decodeFlightLog(flightLog_t *log, const char *filename, int logIndex)
 
         snprintf(eventFilename, filenameLen, "%.*s.%02d.event", outputPrefixLen, outputPrefix, logIndex + 1);
 
-        csvFile = fopen(csvFilename, "wb");
+        if (isAnalysisMode()) {
+            csvFile = NULL;
+
+            fprintf(stderr, "Analysing log '%s'...\n", filename);
+        } else {
+            csvFile = fopen(csvFilename, "wb");
+
+            if (!csvFile) {
+                fprintf(stderr, "Failed to create output file %s\n", csvFilename);
 
-        if (!csvFile) {
-            fprintf(stderr, "Failed to create output file %s\n", csvFilename);
+                free(csvFilename);
+                return -1;
+            }
 
+            fprintf(stderr, "Decoding log '%s' to '%s'...\n", filename, csvFilename);
             free(csvFilename);
-            return -1;
         }
 
-        fprintf(stderr, "Decoding log '%s' to '%s'...\n", filename, csvFilename);
-        free(csvFilename);
+        if (options.statsOnly || isAnalysisMode()) {
+            free(gpsCsvFilename);
+            gpsCsvFilename = NULL;
 
-        gpx = gpxWriterCreate(gpxFilename);
-        free(gpxFilename);
+            free(eventFilename);
+            eventFilename = NULL;
+        } else {
+            trackWriter = trackWriterCreate(trackFilename, options.trackFormat, options.trackSimplifyTolerance);
+        }
+        free(trackFilename);
     }
 
     resetParseState();
 
     int success = flightLogParse(log, logIndex, onMetadataReady, onFrameReady, onEvent, options.raw);
 
-    if (options.mergeGPS && haveBufferedMainFrame) {
+    if (rawGPSMerge && haveBufferedMainFrame) {
         // Print out last log entry that wasn't already printed
-        outputMergeFrame(log);
+        outputBufferedMergeFrame(log);
+    }
+
+    if (merger) {
+        // Print out the log entries that are still waiting to be joined
+        streamMergerFlush(merger);
+        streamMergerDestroy(merger);
+        merger = NULL;
+    }
+
+    if (resampler) {
+        resamplerFlush(resampler);
+        resamplerDestroy(resampler);
+        resampler = NULL;
     }
 
-    if (success)
+    if (success) {
+        if (options.statsOnly) {
+            writeStatsJSON(log, logIndex, csvFile);
+        } else if (isAnalysisMode()) {
+            writeSpectra(log);
+            writeStepResponse();
+        }
+
         printStats(log, logIndex, options.raw, options.limits);
+    }
 
-    if (!options.toStdout)
+    freeParseState();
+
+    derivedEngineDestroy(derived);
+    derived = NULL;
+
+    spectrumAnalyzerDestroy(spectrum);
+    spectrum = NULL;
+
+    spectrumAnalyzerDestroy(stepSeries);
+    stepSeries = NULL;
+
+    free(spectrumFilenamePrefix);
+
+    if (csvFile && !options.toStdout)
         fclose(csvFile);
 
     free(eventFilename);
@@ -1164,7 +2443,7 @@ int decodeFlightLog(flightLog_t *log, const char *filename, int logIndex)
     if (gpsCsvFile)
         fclose(gpsCsvFile);
 
-    gpxWriterDestroy(gpx);
+    trackWriterDestroy(trackWriter);
 
     return success ? 0 : -1;
 }
@@ -1208,6 +2487,20 @@ void printUsage(const char *argv0)
         "   --help                   This page\n"
         "   --index <num>            Choose the log from the file that should be decoded (or omit to decode all)\n"
         "   --limits                 Print the limits and range of each field\n"
+        "   --stats-only             Don't output any frames, just write a summary of the distribution of each\n"
+        "                            field and of the looptime (as JSON), the quantiles of those marked\n"
+        "                            \"approximate\" are within 1%% of the true value\n"
+        "   --spectrum               Don't output any frames, just write the power spectral density of the\n"
+        "                            gyroADC, axisPID and motor fields (in squared field units per Hz)\n"
+        "   --spectrogram            Don't output any frames, just write how the spectrum of those fields changes\n"
+        "                            through the log\n"
+        "   --spectrum-format <fmt>  Format of the spectrum files (csv|binary), default is csv\n"
+        "   --fft-size <n>           Number of frames in each FFT window (must be even), default is 512\n"
+        "   --spectrogram-interval <ms>  Length of log covered by each row of the spectrogram, default is 100\n"
+        "   --step-response          Don't output any frames, just estimate the step response of each axis\n"
+        "                            from rcCommand and the gyro, averaged over the log\n"
+        "   --fields <patterns>      Only output fields whose names match one of these comma-separated wildcard\n"
+        "                            patterns (e.g. \"time,gyroADC*,motor[0]\")\n"
         "   --stdout                 Write log to stdout instead of to a file\n"
         "   --unit-amperage <unit>   Current meter unit (raw|mA|A), default is A (amps)\n"
         "   --unit-flags <unit>      State flags unit (raw|flags), default is flags\n"
@@ -1218,6 +2511,14 @@ void printUsage(const char *argv0)
         "   --unit-gps-speed <unit>  GPS speed unit (mps|kph|mph), default is mps (meters per second)\n"
         "   --unit-vbat <unit>       Vbat unit (raw|mV|V), default is V (volts)\n"
         "   --merge-gps              Merge GPS data into the main CSV log file instead of writing it separately\n"
+        "   --merge-policy <policy>  How GPS data is joined onto each frame when merging (hold|linear|nearest),\n"
+        "                            default is hold (the last GPS update), the only policy with --raw\n"
+        "   --track-format <format>  Format of the GPS track file (gpx|kml|geojson), default is gpx\n"
+        "   --track-simplify <m>     Drop GPS track points that lie within this many meters of the simplified track\n"
+        "   --resample <hz>          Resample the main log to this rate, one row per interval\n"
+        "   --aggregate <list>       How to combine the frames in each resampled interval, as a comma-separated\n"
+        "                            list of <method> or <field pattern>=<method>, where method is one of\n"
+        "                            mean|min|max|last|linear, default is mean (e.g. \"mean,motor*=max,gyroADC*=linear\")\n"
         "   --simulate-current-meter Simulate a virtual current meter using throttle data\n"
         "   --sim-current-meter-scale   Override the FC's settings for the current meter simulation\n"
         "   --sim-current-meter-offset  Override the FC's settings for the current meter simulation\n"
@@ -1244,6 +2545,7 @@ double parseDegreesMinutes(const char *s)
 void parseCommandlineOptions(int argc, char **argv)
 {
     int c;
+    char *fieldList;
 
     enum {
         SETTING_PREFIX = 1,
@@ -1260,6 +2562,15 @@ void parseCommandlineOptions(int argc, char **argv)
         SETTING_UNIT_ACCELERATION,
         SETTING_UNIT_FRAME_TIME,
         SETTING_UNIT_FLAGS,
+        SETTING_FIELDS,
+        SETTING_RESAMPLE,
+        SETTING_AGGREGATE,
+        SETTING_MERGE_POLICY,
+        SETTING_TRACK_FORMAT,
+        SETTING_TRACK_SIMPLIFY,
+        SETTING_FFT_SIZE,
+        SETTING_SPECTROGRAM_INTERVAL,
+        SETTING_SPECTRUM_FORMAT,
     };
 
     while (1)
@@ -1269,6 +2580,10 @@ void parseCommandlineOptions(int argc, char **argv)
             {"raw", no_argument, &options.raw, 1},
             {"debug", no_argument, &options.debug, 1},
             {"limits", no_argument, &options.limits, 1},
+            {"stats-only", no_argument, &options.statsOnly, 1},
+            {"spectrum", no_argument, &options.spectrum, 1},
+            {"spectrogram", no_argument, &options.spectrogram, 1},
+            {"step-response", no_argument, &options.stepResponse, 1},
             {"stdout", no_argument, &options.toStdout, 1},
             {"merge-gps", no_argument, &options.mergeGPS, 1},
             {"simulate-imu", no_argument, &options.simulateIMU, 1},
@@ -1288,6 +2603,15 @@ void parseCommandlineOptions(int argc, char **argv)
             {"unit-acceleration", required_argument, 0, SETTING_UNIT_ACCELERATION},
             {"unit-frame-time", required_argument, 0, SETTING_UNIT_FRAME_TIME},
             {"unit-flags", required_argument, 0, SETTING_UNIT_FLAGS},
+            {"fields", required_argument, 0, SETTING_FIELDS},
+            {"resample", required_argument, 0, SETTING_RESAMPLE},
+            {"aggregate", required_argument, 0, SETTING_AGGREGATE},
+            {"merge-policy", required_argument, 0, SETTING_MERGE_POLICY},
+            {"track-format", required_argument, 0, SETTING_TRACK_FORMAT},
+            {"track-simplify", required_argument, 0, SETTING_TRACK_SIMPLIFY},
+            {"fft-size", required_argument, 0, SETTING_FFT_SIZE},
+            {"spectrogram-interval", required_argument, 0, SETTING_SPECTROGRAM_INTERVAL},
+            {"spectrum-format", required_argument, 0, SETTING_SPECTRUM_FORMAT},
             {0, 0, 0, 0}
         };
 
@@ -1355,11 +2679,125 @@ void parseCommandlineOptions(int argc, char **argv)
                     exit(-1);
                 }
             break;
+            case SETTING_FIELDS:
+                fieldList = strdup(optarg);
+
+                // Split the list up into individual patterns, allowing spaces after the commas
+                for (char *pattern = strtok(fieldList, ","); pattern; pattern = strtok(NULL, ",")) {
+                    pattern = trimWhitespace(pattern);
+
+                    if (*pattern == '\0')
+                        continue;
+
+                    if (options.fieldPatternCount >= MAX_FIELD_PATTERNS) {
+                        fprintf(stderr, "Too many field patterns (the maximum is %d)\n", MAX_FIELD_PATTERNS);
+                        exit(-1);
+                    }
+
+                    options.fieldPatterns[options.fieldPatternCount++] = strdup(pattern);
+                }
+
+                free(fieldList);
+            break;
+            case SETTING_RESAMPLE:
+                options.resampleRate = atof(optarg);
+
+                if (options.resampleRate <= 0) {
+                    fprintf(stderr, "Bad resampling rate \"%s\"\n", optarg);
+                    exit(-1);
+                }
+            break;
+            case SETTING_AGGREGATE:
+                fieldList = strdup(optarg);
+
+                // Split the list up into pattern=method entries, allowing spaces around the commas and the equals
+                for (char *entry = strtok(fieldList, ","); entry; entry = strtok(NULL, ",")) {
+                    char *pattern, *methodName = strchr(entry, '=');
+
+                    if (methodName) {
+                        *methodName = '\0';
+                        methodName = trimWhitespace(methodName + 1);
+                        pattern = trimWhitespace(entry);
+
+                        if (*pattern == '\0') {
+                            fprintf(stderr, "Missing the field pattern before \"=%s\"\n", methodName);
+                            exit(-1);
+                        }
+                    } else {
+                        // A method on its own applies to every field
+                        methodName = trimWhitespace(entry);
+                        pattern = "*";
+
+                        if (*methodName == '\0')
+                            continue;
+                    }
+
+                    if (options.aggregatePatternCount >= MAX_FIELD_PATTERNS) {
+                        fprintf(stderr, "Too many aggregation patterns (the maximum is %d)\n", MAX_FIELD_PATTERNS);
+                        exit(-1);
+                    }
+
+                    if (!resampleAggregationFromName(methodName, &options.aggregations[options.aggregatePatternCount])) {
+                        fprintf(stderr, "Bad aggregation method \"%s\"\n", methodName);
+                        exit(-1);
+                    }
+
+                    options.aggregatePatterns[options.aggregatePatternCount++] = strdup(pattern);
+                }
+
+                free(fieldList);
+            break;
+            case SETTING_MERGE_POLICY:
+                if (!mergeJoinPolicyFromName(optarg, &options.mergePolicy)) {
+                    fprintf(stderr, "Bad merge policy \"%s\"\n", optarg);
+                    exit(-1);
+                }
+            break;
+            case SETTING_TRACK_FORMAT:
+                if (!trackFormatFromName(optarg, &options.trackFormat)) {
+                    fprintf(stderr, "Bad track format \"%s\"\n", optarg);
+                    exit(-1);
+                }
+            break;
+            case SETTING_TRACK_SIMPLIFY:
+                options.trackSimplifyTolerance = atof(optarg);
+
+                if (options.trackSimplifyTolerance < 0) {
+                    fprintf(stderr, "Bad track simplification tolerance \"%s\"\n", optarg);
+                    exit(-1);
+                }
+            break;
+            case SETTING_FFT_SIZE:
+                options.fftSize = atoi(optarg);
+
+                if (options.fftSize < 16 || options.fftSize % 2 != 0) {
+                    fprintf(stderr, "Bad FFT size \"%s\" (it must be an even number of at least 16)\n", optarg);
+                    exit(-1);
+                }
+            break;
+            case SETTING_SPECTROGRAM_INTERVAL:
+                options.spectrogramInterval = (int64_t) (atof(optarg) * 1000);
+
+                if (options.spectrogramInterval <= 0) {
+                    fprintf(stderr, "Bad spectrogram interval \"%s\"\n", optarg);
+                    exit(-1);
+                }
+            break;
+            case SETTING_SPECTRUM_FORMAT:
+                if (strcmp(optarg, "csv") == 0) {
+                    options.spectrumFormat = SPECTRUM_FORMAT_CSV;
+                } else if (strcmp(optarg, "binary") == 0) {
+                    options.spectrumFormat = SPECTRUM_FORMAT_BINARY;
+                } else {
+                    fprintf(stderr, "Bad spectrum format \"%s\"\n", optarg);
+                    exit(-1);
+                }
+            break;
             case SETTING_DECLINATION:
-                imuSetMagneticDeclination(parseDegreesMinutes(optarg));
+                options.declination = parseDegreesMinutes(optarg);
             break;
             case SETTING_DECLINATION_DECIMAL:
-                imuSetMagneticDeclination(atof(optarg));
+                options.declination = atof(optarg);
             break;
             case SETTING_CURRENT_METER_SCALE:
                 options.overrideSimCurrentMeterScale = true;
@@ -1403,6 +2841,26 @@ int main(int argc, char **argv)
         return -1;
     }
 
+    if (options.statsOnly && (options.raw || options.mergeGPS || options.resampleRate > 0)) {
+        fprintf(stderr, "--stats-only can't be combined with --raw, --merge-gps or --resample\n");
+        return -1;
+    }
+
+    if (isAnalysisMode() && (options.statsOnly || options.raw || options.mergeGPS || options.resampleRate > 0)) {
+        fprintf(stderr, "--spectrum, --spectrogram and --step-response can't be combined with --stats-only, --raw, --merge-gps or --resample\n");
+        return -1;
+    }
+
+    if (options.mergeGPS && options.raw && options.mergePolicy != MERGE_JOIN_HOLD) {
+        fprintf(stderr, "--raw doesn't give the frame timestamps that --merge-policy needs, so GPS data can only be held\n");
+        return -1;
+    }
+
+    if (options.resampleRate > 0 && (options.raw || options.mergeGPS)) {
+        fprintf(stderr, "Resampling can't be combined with --raw or --merge-gps\n");
+        return -1;
+    }
+
     if (options.toStdout && argc - optind > 1) {
         fprintf(stderr, "You can only decode one log at a time if you're printing to stdout\n");
         return -1;
@@ -1445,5 +2903,13 @@ int main(int argc, char **argv)
         flightLogDestroy(log);
     }
 
+    for (int i = 0; i < options.fieldPatternCount; i++) {
+        free(options.fieldPatterns[i]);
+    }
+
+    for (int i = 0; i < options.aggregatePatternCount; i++) {
+        free(options.aggregatePatterns[i]);
+    }
+
     return 0;
 }
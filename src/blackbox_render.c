@@ -32,6 +32,13 @@
 #include "datapoints.h"
 #include "expo.h"
 #include "imu.h"
+#include "derived.h"
+#include "rendercache.h"
+#include "videowriter.h"
+#include "pngwriter.h"
+#include "minmaxpyramid.h"
+#include "textcache.h"
+#include "surfacepool.h"
 
 #define STR_HELPER(x) #x
 #define STR(x) STR_HELPER(x)
@@ -52,6 +59,37 @@
 
 #define DATAPOINTS_EXTRA_COMPUTED_FIELDS 6
 
+// Number of frames the derived fields are computed for at a time
+#define DERIVED_BATCH_FRAMES 4096
+
+// plotLine() draws every frame that lands in a pixel column if there are at most this many, otherwise just the first,
+// smallest, largest and last of them
+#define PLOT_COLUMN_POINTS 4
+
+// How much of the log is shown across the width of the graphs at one time
+#define RENDER_WINDOW_WIDTH_MICROS (1000 * 1000)
+
+// How far (in pixels) a graph's lines can reach past the points they join, with their width, mitred corners and gap
+// warning boxes
+#define GRAPH_LINE_OVERHANG 32
+
+#define MAX_GRAPH_LINES (MAX_MOTORS + MAX_SERVOS)
+
+// Number of log frames between the saved prop angles, the angle at any time is found by integrating on from the last one
+#define PROP_PHASE_CHECKPOINT_FRAMES 256
+
+// Number of output frames which are averaged into the values shown by drawAccelerometerData()
+#define READOUT_HISTORY_FRAMES 32
+
+// The gyros, the PIDs and their sums, and the motors
+#define MAX_SMOOTHING_JOBS (3 + 3 * 3 + 3 + MAX_MOTORS)
+
+// When the log is streamed, this many seconds of output frames are drawn between each time more of the log is decoded
+#define STREAM_CHUNK_SECONDS 2
+
+// When the log is streamed, the points start out with room for this many frames, and grow if the window needs more
+#define STREAM_INITIAL_FRAME_CAPACITY 16384
+
 typedef enum Unit {
     UNIT_RAW = 0,
     UNIT_DEGREES_PER_SEC = 1
@@ -72,6 +110,18 @@ static const char* const PROP_STYLE_NAME[] = {
     "pie"
 };
 
+typedef enum OutputFormat {
+    OUTPUT_FORMAT_PNG = 0,
+    OUTPUT_FORMAT_Y4M = 1,
+    OUTPUT_FORMAT_BGRA = 2
+} OutputFormat;
+
+static const char* const OUTPUT_FORMAT_NAME[] = {
+    "png",
+    "y4m",
+    "bgra"
+};
+
 typedef struct point_t {
   double x, y;
 } point_t;
@@ -115,6 +165,9 @@ typedef struct renderOptions_t {
     int drawPidTable, drawSticks, drawCraft, drawTime, drawAcc;
 
     int pidSmoothing, gyroSmoothing, motorSmoothing;
+    FilterType smoothingFilter;
+    // For the low-pass smoothing filters, in Hz
+    double smoothingCutoff;
 
     int bottomGraphSplitAxes;
 
@@ -128,13 +181,218 @@ typedef struct renderOptions_t {
     //Start and end time of video in seconds offset from the beginning of the log
     uint32_t timeStart, timeEnd;
 
+    //This render draws part shardIndex of shardCount equal parts of the output frames (counting from zero)
+    int shardIndex, shardCount;
+
     colorAlpha_t sticksTextColor, stickColor, stickAreaColor, crosshairColor, stickTrailColor;
     int stickTrailLength, stickRadius, stickTrailRadius;
 
     char *filename, *outputPrefix;
+    char *cacheDirectory;
+
+    OutputFormat outputFormat;
+    //Where the video formats are written, stdout if this is NULL or "-"
+    char *outputFilename;
+
+    pngWriterSettings_t png;
+
+    //The graphs are drawn in full for the first frame of every run of this many output frames
+    int keyframeInterval;
+
+    //Draw a quick preview at draftScale times the size, and only every draftFrameStep'th output frame
+    int draft;
+    double draftScale;
+    int draftFrameStep;
+
+    //Decode the log a piece at a time as the frames are drawn, instead of all of it before the first frame
+    int stream;
 } renderOptions_t;
 
-int stickTrailCurrent[2] = {0, 0};
+/**
+ * The options which change how the datapoints are prepared, so a cache can only be reused if these are the same.
+ */
+typedef struct renderCacheSettings_t {
+    int32_t pidSmoothing, gyroSmoothing, motorSmoothing;
+    int32_t smoothingFilter;
+    double smoothingCutoff;
+} renderCacheSettings_t;
+
+/**
+ * The parts of the picture which show the log before the current time. These are worked out afresh from the log for
+ * each output frame, so that every output frame can be drawn on its own.
+ */
+typedef struct renderState_t {
+    //The angle each prop has turned through since the start of the log
+    double propAngles[MAX_MOTORS];
+
+    point_t *stickTrails[2];
+    int stickTrailCurrent[2];
+
+    //Weighted moving averages of the values shown by drawAccelerometerData()
+    double lastAccel, lastVoltage, lastCurrent;
+    int lastAlt;
+
+    //Each worker's output frames only move forwards in time, so each search for a frame can continue from where the
+    //last one left off
+    datapointsCursor_t firstFrameCursor, centerFrameCursor;
+} renderState_t;
+
+/**
+ * The settings shared by every output frame of the animation.
+ */
+typedef struct animation_t {
+    //The output frames drawn are startFrame, startFrame + frameStep, and so on before endFrame (outputFrames of them).
+    //When the log is streamed, endFrame is -1 and outputFrames is 0 until the end of the log is found.
+    uint32_t startFrame, endFrame, outputFrames;
+    uint32_t frameStep;
+
+    //The workers draw their frames up to this one, which is endFrame unless only part of the log has been decoded
+    uint32_t drawEndFrame;
+    int64_t logStartTime;
+
+    craft_parameters_t craftParameters;
+} animation_t;
+
+//The graphs which each have an axis line and label
+typedef enum Graph {
+    GRAPH_MOTORS = 0,
+    //One for each axis when the PIDs are plotted
+    GRAPH_PID_ROLL,
+    GRAPH_PID_PITCH,
+    GRAPH_PID_YAW,
+    //All three axes on one graph when they aren't
+    GRAPH_GYROS,
+    GRAPH_COUNT
+} Graph;
+
+/**
+ * A part of the picture which is the same in every output frame, so it's drawn once and then copied onto each frame.
+ * Only the pixels that were drawn on are kept, and (x, y) is where they go in the frame.
+ */
+typedef struct staticLayer_t {
+    bool drawn;
+    cairo_surface_t *surface;
+    int x, y;
+} staticLayer_t;
+
+typedef struct staticLayers_t {
+    staticLayer_t graphAxisLine[GRAPH_COUNT], graphLabel[GRAPH_COUNT];
+    staticLayer_t timeBar;
+    staticLayer_t stickSurrounds;
+    staticLayer_t pidTableBackground;
+    staticLayer_t craftBody;
+} staticLayers_t;
+
+typedef void (*staticLayerDrawFunc_t)(cairo_t *cr, const void *arg);
+
+/**
+ * One of the lines drawn on a graph.
+ */
+typedef struct graphLine_t {
+    int fieldIndex;
+    color_t color;
+    expoCurve_t *curve;
+    double lineWidth;
+
+    //NULL for a solid line
+    const double *dash;
+    int dashCount;
+} graphLine_t;
+
+typedef struct graph_t {
+    graphLine_t lines[MAX_GRAPH_LINES];
+    int lineCount;
+
+    //A value of 1.0 on the curve is drawn this many pixels from the axis
+    int plotHeight;
+
+    //No line of the graph is drawn further than this many pixels from the axis (apart from its overhang)
+    int extent;
+} graph_t;
+
+/**
+ * The lines of a graph as a worker last drew them, kept so that they can be scrolled along for the worker's next
+ * frame. The strip is the full width of the frame and covers the rows which the lines can reach.
+ */
+typedef struct graphStrip_t {
+    cairo_surface_t *surface;
+    //The row of the frame that the strip's top row goes on
+    int top;
+
+    bool drawn;
+    uint32_t outputFrameIndex;
+} graphStrip_t;
+
+/**
+ * The part of the log shown across the width of the graphs. The times are in microseconds multiplied by timeScale
+ * (the frame rate), so that every output frame's window starts on a whole number.
+ */
+typedef struct plotWindow_t {
+    int64_t startTime, endTime;
+    int timeScale;
+
+    //The first frame to draw, normally the one just before the window
+    int firstFrameIndex;
+
+    //The number of columns that the window is split into when decimating the lines, one for each pixel of the frame
+    int columnCount;
+} plotWindow_t;
+
+/**
+ * Output frames are dealt out to the workers in turn, and each worker draws its frames with its own cairo context
+ * and font face.
+ */
+typedef struct frameRenderWorker_t {
+    const animation_t *animation;
+
+    renderState_t state;
+
+    //Drawn on this worker's first frame, since they use its font face
+    staticLayers_t layers;
+
+    graphStrip_t graphStrips[GRAPH_COUNT];
+
+    FT_Face ftFace;
+    cairo_font_face_t *fontFace;
+
+    //The text drawn with fontFace, so the readouts on each frame can be copied in rather than drawn again
+    textCache_t *textCache;
+
+    //This worker draws every threadCount'th output frame, starting from threadIndex
+    int threadIndex, threadCount;
+    uint32_t nextOutputFrameIndex;
+
+    //The drawn frame converted for the videoWriter (if we're writing a video)
+    uint8_t *videoFrame;
+
+    //Signalled when the previous frame has been saved, so this worker can save the frame it has drawn
+    semaphore_t outputTurn;
+    semaphore_t *nextOutputTurn;
+} frameRenderWorker_t;
+
+/**
+ * A log which is decoded a piece at a time as the frames are drawn (with --stream). The log is decoded on a thread of
+ * its own, which waits whenever it has decoded as far as the next frames to be drawn need, so that the points are only
+ * changed while no frames are being drawn.
+ */
+typedef struct logStream_t {
+    semaphore_t decodeRequested, decodeDone;
+
+    //Decoding waits once a frame after decodeUntil has been decoded, and then framesAfter more (which the frames up to
+    //it are smoothed with)
+    int64_t decodeUntil;
+    int framesAfter, framesToGo;
+
+    //Set once the whole log has been decoded
+    bool complete;
+
+    derivedEngine_t *derived;
+    //The number of frames from the start of the log that the derived fields have been computed for
+    int derivedFrameCount;
+
+    datapointsSmoother_t smoothers[MAX_SMOOTHING_JOBS];
+    int smootherCount;
+} logStream_t;
 
 const double DASHED_LINE[] = {
     20.0,  /* ink */
@@ -175,7 +433,6 @@ typedef struct fieldIdentifications_t {
     int numCells;
 
     // Indexes of fields we compute from the data:
-    int roll, pitch, heading;
     int axisPIDSum[3];
     int cumulativeCurrent;
 } fieldIdentifications_t;
@@ -206,6 +463,7 @@ static const renderOptions_t defaultOptions = {
     .fps = 30, .help = 0, .threads = 3, .propStyle = PROP_STYLE_PIE_CHART,
     .plotPids = false, .plotPidSum = false, .plotGyros = true, .plotMotors = true,
     .pidSmoothing = 4, .gyroSmoothing = 2, .motorSmoothing = 2,
+    .smoothingFilter = FILTER_TYPE_MOVING_AVERAGE, .smoothingCutoff = 50,
     .drawCraft = true, .drawPidTable = true, .drawSticks = true, .drawTime = true,
     .drawAcc = true,
     .sticksTop = 0, .sticksRight = 0, .sticksWidth = 0,
@@ -213,6 +471,12 @@ static const renderOptions_t defaultOptions = {
     .gyroUnit = UNIT_RAW,
     .filename = 0,
     .timeStart = 0, .timeEnd = 0,
+    .shardIndex = 0, .shardCount = 1,
+    .outputFormat = OUTPUT_FORMAT_PNG, .outputFilename = NULL,
+    .png = {.compressionLevel = 6, .filter = PNG_FILTER_ADAPTIVE, .reduceColors = false, .threadCount = 1},
+    .keyframeInterval = 30,
+    .draft = 0, .draftScale = 0.5, .draftFrameStep = 10,
+    .stream = 0,
     .logNumber = 0,
     .gapless = 0,
     .rawAmperage = 0,
@@ -230,13 +494,26 @@ static const renderOptions_t defaultOptions = {
 extern cairo_font_face_t* cairo_ft_font_face_create_for_ft_face(FT_Face face, int load_flags);
 
 static renderOptions_t options;
+
+//The size of the frames that are written out. Everything is laid out at the image size and scaled by frameScale to fit.
+static int frameWidth, frameHeight;
+static double frameScale;
 static expoCurve_t *pitchStickCurve, *pidCurve, *gyroCurve, *accCurve, *motorCurve, *servoCurve;
 
-static semaphore_t pngRenderingSem;
-static bool pngRenderingSemCreated = false;
+//Compresses and writes out the PNG frames, and recycles the surfaces the frames are drawn on
+static threadPool_t *pngSavePool;
+static surfacePool_t *frameSurfacePool;
 
 static flightLog_t *flightLog;
 static datapoints_t *points;
+// For each field of the points that plotLine() draws, or NULL for the others
+static minMaxPyramid_t **fieldPyramids;
+
+static graph_t graphs[GRAPH_COUNT];
+
+// The estimated attitude of the craft for each frame in the points, or NULL if the log doesn't have the fields to estimate it
+static attitude_t *frameAttitude;
+static int frameAttitudeCapacity;
 static int selectedLogIndex;
 
 //Information about fields we have classified
@@ -246,7 +523,22 @@ static FT_Library freetypeLibrary;
 
 static uint32_t syncBeepTime = -1;
 
-static point_t *stickTrails[2];
+static cairo_user_data_key_t ftFaceKey;
+
+//The video the frames are written to, or NULL if they're saved as PNG files
+static videoWriter_t *videoWriter;
+
+//The log being decoded as the frames are drawn, or NULL if it was all decoded before the first frame
+static logStream_t *logStream;
+
+//The angle each prop has turned through since the start of the log, at every PROP_PHASE_CHECKPOINT_FRAMES'th frame of
+//the log (counting the frames discarded from the points too)
+static double *propPhaseCheckpoints[MAX_MOTORS];
+static int propPhaseCheckpointCapacity;
+
+//The angle each prop had turned through by the end of the first propPhaseFrameCount frames of the log
+static double propPhases[MAX_MOTORS];
+static int propPhaseFrameCount;
 
 void loadFrameIntoPoints(flightLog_t *log, bool frameValid, int64_t *frame, uint8_t frameType, int fieldCount, int frameOffset, int frameSize)
 {
@@ -278,6 +570,48 @@ void onLogEvent(flightLog_t *log, flightLogEvent_t *event)
     }
 }
 
+/**
+ * Add the frames of a streamed log to the points as they're decoded, and wait for the renderer to ask for more once
+ * we've decoded as far as it asked for.
+ */
+static void loadFrameIntoStream(flightLog_t *log, bool frameValid, int64_t *frame, uint8_t frameType, int fieldCount, int frameOffset, int frameSize)
+{
+    bool mainFrame = frameValid && (frameType == 'P' || frameType == 'I');
+
+    if (mainFrame && points->frameCount == points->frameCapacity) {
+        datapointsSetCapacity(points, points->frameCapacity * 2);
+    }
+
+    loadFrameIntoPoints(log, frameValid, frame, frameType, fieldCount, frameOffset, frameSize);
+
+    if (!mainFrame)
+        return;
+
+    if (logStream->framesToGo < 0 && frame[FLIGHT_LOG_FIELD_INDEX_TIME] > logStream->decodeUntil) {
+        logStream->framesToGo = logStream->framesAfter;
+    }
+
+    if (logStream->framesToGo >= 0 && logStream->framesToGo-- == 0) {
+        //Hand the points over to the renderer until it needs more of the log
+        semaphore_signal(&logStream->decodeDone);
+        semaphore_wait(&logStream->decodeRequested);
+    }
+}
+
+static void* logStreamRun(void *data)
+{
+    (void) data;
+
+    semaphore_wait(&logStream->decodeRequested);
+
+    flightLogParse(flightLog, selectedLogIndex, NULL, loadFrameIntoStream, onLogEvent, false);
+
+    logStream->complete = true;
+    semaphore_signal(&logStream->decodeDone);
+
+    return NULL;
+}
+
 void updateFieldMetadata()
 {
     int motorGraphColorIndex = 0;
@@ -344,44 +678,164 @@ void updateFieldMetadata()
     }
 }
 
-void drawCommandSticks(int64_t *frame, int imageWidth, int imageHeight, cairo_t *cr)
+/**
+ * Find the time at the centre of the window shown by the given output frame.
+ */
+static int64_t outputFrameCenterTime(const animation_t *animation, int64_t outputFrameIndex)
 {
-    double rcCommand[4] = {0, 0, 0, 0};
-    int stickSurroundRadius = imageHeight / 11;
-    if(options.sticksWidth > 0) {
-      stickSurroundRadius = options.sticksWidth;
+    return animation->logStartTime + (outputFrameIndex * 1000000) / options.fps;
+}
+
+/**
+ * Get the log frame at the centre of the given output frame (its index is stored into frameIndex if that isn't NULL).
+ *
+ * Returns false if there's no valid log frame there.
+ */
+static bool getOutputFrameCenter(const animation_t *animation, int64_t outputFrameIndex, int *frameIndex, int64_t *frame)
+{
+    int64_t frameTime;
+    int index = datapointsFindFrameAtTime(points, outputFrameCenterTime(animation, outputFrameIndex));
+
+    if (frameIndex)
+        *frameIndex = index;
+
+    return datapointsGetFrameAtIndex(points, index, &frameTime, frame);
+}
+
+/**
+ * Draw a static layer using the current transformation, font and antialiasing of the given context, and keep the
+ * smallest rectangle that holds everything that was drawn.
+ */
+static void createStaticLayer(cairo_t *cr, staticLayer_t *layer, staticLayerDrawFunc_t draw, const void *arg)
+{
+    cairo_surface_t *canvas = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, frameWidth, frameHeight);
+    cairo_t *canvasCr = cairo_create(canvas);
+    cairo_matrix_t matrix;
+    cairo_font_options_t *fontOptions;
+    const uint8_t *pixels;
+    int stride;
+    int left = frameWidth, right = -1, top = frameHeight, bottom = -1;
+
+    cairo_get_matrix(cr, &matrix);
+    cairo_set_matrix(canvasCr, &matrix);
+    cairo_get_font_matrix(cr, &matrix);
+    cairo_set_font_matrix(canvasCr, &matrix);
+    cairo_set_font_face(canvasCr, cairo_get_font_face(cr));
+    cairo_set_antialias(canvasCr, cairo_get_antialias(cr));
+
+    fontOptions = cairo_font_options_create();
+    cairo_get_font_options(cr, fontOptions);
+    cairo_set_font_options(canvasCr, fontOptions);
+    cairo_font_options_destroy(fontOptions);
+
+    draw(canvasCr, arg);
+
+    cairo_destroy(canvasCr);
+    cairo_surface_flush(canvas);
+
+    pixels = cairo_image_surface_get_data(canvas);
+    stride = cairo_image_surface_get_stride(canvas);
+
+    for (int y = 0; y < frameHeight; y++) {
+        const uint32_t *row = (const uint32_t *) (pixels + (size_t) y * stride);
+
+        for (int x = 0; x < frameWidth; x++) {
+            if (row[x]) {
+                if (x < left)
+                    left = x;
+                if (x > right)
+                    right = x;
+                if (y < top)
+                    top = y;
+                bottom = y;
+            }
+        }
     }
-    const int stickSpacing = stickSurroundRadius * 3;
-    const int yawStickMax = 500;
-    int stickIndex;
 
-    int stickRadius = stickSurroundRadius / 5;
-    int stickTrailRadius = stickRadius;
+    layer->drawn = true;
+    layer->surface = NULL;
 
-    if(options.stickRadius > 0) {
-      stickRadius = options.stickRadius;
+    if (right >= left) {
+        uint8_t *cropped;
+        int croppedStride;
+
+        layer->x = left;
+        layer->y = top;
+        layer->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, right - left + 1, bottom - top + 1);
+
+        cropped = cairo_image_surface_get_data(layer->surface);
+        croppedStride = cairo_image_surface_get_stride(layer->surface);
+
+        for (int y = top; y <= bottom; y++) {
+            memcpy(cropped + (size_t) (y - top) * croppedStride, pixels + (size_t) y * stride + left * 4, (right - left + 1) * 4);
+        }
+
+        cairo_surface_mark_dirty(layer->surface);
     }
 
-    if(options.stickTrailRadius > 0) {
-      stickTrailRadius = options.stickTrailRadius;
+    cairo_surface_destroy(canvas);
+}
+
+/**
+ * Copy a static layer onto the frame, drawing it with `draw` first if this is the first time it's been needed. The
+ * layer keeps the position it was first drawn at, so it must always be painted with the same transformation.
+ */
+static void paintStaticLayer(cairo_t *cr, staticLayer_t *layer, staticLayerDrawFunc_t draw, const void *arg)
+{
+    if (!layer->drawn) {
+        createStaticLayer(cr, layer, draw, arg);
     }
 
-    char stickLabel[16];
-    cairo_text_extents_t extent;
+    if (layer->surface) {
+        cairo_save(cr);
+        {
+            cairo_identity_matrix(cr);
+            cairo_set_source_surface(cr, layer->surface, layer->x, layer->y);
+            cairo_paint(cr);
+        }
+        cairo_restore(cr);
+    }
+}
 
-    (void) imageWidth;
+static void destroyStaticLayers(staticLayers_t *layers)
+{
+    //staticLayers_t holds nothing but layers
+    staticLayer_t *layer = (staticLayer_t *) layers;
+
+    for (size_t i = 0; i < sizeof(*layers) / sizeof(*layer); i++) {
+        if (layer[i].surface)
+            cairo_surface_destroy(layer[i].surface);
+    }
+}
+
+static int decideStickSurroundRadius(int imageHeight)
+{
+    if (options.sticksWidth > 0) {
+        return options.sticksWidth;
+    }
+
+    return imageHeight / 11;
+}
+
+/**
+ * Find the positions of the sticks (left stick x, left stick y, right stick x, right stick y) relative to the centres
+ * of their surrounds. Returns false if the log doesn't have the stick data to draw.
+ */
+static bool decideStickPositions(int64_t *frame, int stickSurroundRadius, double *stickPositions)
+{
+    double rcCommand[4] = {0, 0, 0, 0};
+    const int yawStickMax = 500;
+    int stickIndex;
 
     for (stickIndex = 0; stickIndex < 4; stickIndex++) {
         //Check that stick data is present to be drawn:
         if (flightLog->mainFieldIndexes.rcCommand[stickIndex] < 0)
-            return;
+            return false;
 
         rcCommand[stickIndex] = frame[flightLog->mainFieldIndexes.rcCommand[stickIndex]];
     }
 
-    //Compute the position of the sticks in the range [-1..1] (left stick x, left stick y, right stick x, right stick y)
-    double stickPositions[4];
-
+    //Compute the position of the sticks in the range [-1..1]
     stickPositions[0] = -rcCommand[2] / yawStickMax; //Yaw
     stickPositions[1] = (1500 - rcCommand[3]) / 500; //Throttle
     stickPositions[2] = expoCurveLookup(pitchStickCurve, rcCommand[0]); //Roll
@@ -395,11 +849,43 @@ void drawCommandSticks(int64_t *frame, int imageWidth, int imageHeight, cairo_t
         stickPositions[stickIndex] *= stickSurroundRadius;
     }
 
-    cairo_save(cr);
+    return true;
+}
+
+/**
+ * Fill the stick trails with the stick positions from the output frames before the given one (oldest first).
+ */
+static void decideStickTrails(renderState_t *state, const animation_t *animation, int64_t outputFrameIndex)
+{
+    int64_t frame[FLIGHT_LOG_MAX_FIELDS];
+    int stickSurroundRadius = decideStickSurroundRadius(options.imageHeight);
+    double stickPositions[4];
+
+    state->stickTrailCurrent[0] = 0;
+    state->stickTrailCurrent[1] = 0;
+
+    for (int64_t trailFrameIndex = outputFrameIndex - options.stickTrailLength; trailFrameIndex < outputFrameIndex; trailFrameIndex++) {
+        if (!getOutputFrameCenter(animation, trailFrameIndex, NULL, frame)
+                || !decideStickPositions(frame, stickSurroundRadius, stickPositions))
+            continue;
+
+        for (int i = 0; i < 2; i++) {
+            point_t p = {stickPositions[i * 2 + 0], stickPositions[i * 2 + 1]};
+            state->stickTrails[i][state->stickTrailCurrent[i]++] = p;
+        }
+    }
+}
+
+/**
+ * Draw the background box and crosshair of each stick (the stick spacing is 3 times the radius of the boxes).
+ */
+static void drawStickSurrounds(cairo_t *cr, const void *arg)
+{
+    int stickSurroundRadius = *(const int *) arg;
+    const int stickSpacing = stickSurroundRadius * 3;
 
     cairo_translate(cr, -stickSpacing / 2, 0);
 
-    //For each stick
     for (int i = 0; i < 2; i++) {
         //Fill in background
         cairo_set_source_rgba(cr, options.stickAreaColor.r, options.stickAreaColor.g, options.stickAreaColor.b, options.stickAreaColor.a);
@@ -415,32 +901,57 @@ void drawCommandSticks(int64_t *frame, int imageWidth, int imageHeight, cairo_t
         cairo_line_to(cr, 0, stickSurroundRadius);
         cairo_stroke(cr);
 
+        cairo_translate(cr, stickSpacing, 0);
+    }
+}
+
+void drawCommandSticks(const renderState_t *state, staticLayers_t *layers, textCache_t *textCache, int64_t *frame, int imageWidth, int imageHeight, cairo_t *cr)
+{
+    int stickSurroundRadius = decideStickSurroundRadius(imageHeight);
+    const int stickSpacing = stickSurroundRadius * 3;
+
+    int stickRadius = stickSurroundRadius / 5;
+    int stickTrailRadius = stickRadius;
+
+    if(options.stickRadius > 0) {
+      stickRadius = options.stickRadius;
+    }
+
+    if(options.stickTrailRadius > 0) {
+      stickTrailRadius = options.stickTrailRadius;
+    }
+
+    char stickLabel[16];
+    cairo_text_extents_t extent;
+
+    (void) imageWidth;
+
+    double stickPositions[4];
+
+    if (!decideStickPositions(frame, stickSurroundRadius, stickPositions))
+        return;
+
+    paintStaticLayer(cr, &layers->stickSurrounds, drawStickSurrounds, &stickSurroundRadius);
+
+    cairo_save(cr);
+
+    cairo_translate(cr, -stickSpacing / 2, 0);
+
+    //For each stick
+    for (int i = 0; i < 2; i++) {
         //Draw trail
-        for(int j = 0; j < stickTrailCurrent[i]; j++) {
-          point_t current = stickTrails[i][j];
+        for(int j = 0; j < state->stickTrailCurrent[i]; j++) {
+          point_t current = state->stickTrails[i][j];
 
-          cairo_set_source_rgba(cr, options.stickTrailColor.r, options.stickTrailColor.g, options.stickTrailColor.b, options.stickTrailColor.a - (options.stickTrailColor.a - (j / (stickTrailCurrent[i] + 1.0))));
+          cairo_set_source_rgba(cr, options.stickTrailColor.r, options.stickTrailColor.g, options.stickTrailColor.b, options.stickTrailColor.a - (options.stickTrailColor.a - (j / (state->stickTrailCurrent[i] + 1.0))));
           cairo_arc(cr, current.x, current.y, stickTrailRadius, 0, 2 * M_PI);
           cairo_fill(cr);
-
-          if(j > 0) {
-            stickTrails[i][j-1] = stickTrails[i][j];
-          }
         }
 
         //Draw circle to represent stick position
         double stickX = stickPositions[i * 2 + 0];
         double stickY = stickPositions[i * 2 + 1];
 
-        if(stickTrailCurrent[i] < options.stickTrailLength) {
-          stickTrailCurrent[i]++;
-        }
-
-        if(stickTrailCurrent[i] > 0) {
-          point_t p = {stickX, stickY};
-          stickTrails[i][stickTrailCurrent[i] - 1] = p;
-        }
-
         cairo_set_source_rgba(cr, options.stickColor.r, options.stickColor.g, options.stickColor.b, options.stickColor.a);
         cairo_arc(cr, stickX, stickY, stickRadius, 0, 2 * M_PI);
         cairo_fill(cr);
@@ -457,14 +968,14 @@ void drawCommandSticks(int64_t *frame, int imageWidth, int imageHeight, cairo_t
         cairo_text_extents(cr, stickLabel, &extent);
 
         cairo_move_to(cr, -extent.width / 2, stickSurroundRadius + extent.height + 8);
-        cairo_show_text(cr, stickLabel);
+        textCacheShowText(textCache, cr, stickLabel);
 
         //Draw vertical stick label
         snprintf(stickLabel, sizeof(stickLabel), "%" PRId64, frame[flightLog->mainFieldIndexes.rcCommand[(1 - i) * 2 + 1]]);
         cairo_text_extents(cr, stickLabel, &extent);
 
         cairo_move_to(cr, -stickSurroundRadius - extent.width - 8, extent.height / 2);
-        cairo_show_text(cr, stickLabel);
+        textCacheShowText(textCache, cr, stickLabel);
 
         //Advance to next stick
         cairo_translate(cr, stickSpacing, 0);
@@ -476,7 +987,7 @@ void drawCommandSticks(int64_t *frame, int imageWidth, int imageHeight, cairo_t
 /*
  * Draw a vertically-oriented propeller at the origin with the current source color
  */
-void drawPropeller(cairo_t *cr, craft_parameters_t *parameters)
+void drawPropeller(cairo_t *cr, const craft_parameters_t *parameters)
 {
     cairo_move_to(cr, 0, 0);
 
@@ -491,65 +1002,198 @@ void drawPropeller(cairo_t *cr, craft_parameters_t *parameters)
 }
 
 /**
- * Draw a craft with spinning blades at the origin
+ * Find how fast the prop spins (in radians per second) at the given motor output.
  */
-void drawCraft(cairo_t *cr, int64_t *frame, int64_t timeElapsedMicros, craft_parameters_t *parameters)
+static double decidePropSpeed(int64_t motorValue)
 {
-    static double propAngles[MAX_MOTORS] = {0};
+    double scaled = doubleMax(motorValue - (int32_t) flightLog->sysConfig.motorOutputLow, 0) / (flightLog->sysConfig.motorOutputHigh - flightLog->sysConfig.motorOutputLow);
 
-    double angularSpeed[MAX_MOTORS];
-    double rotationThisFrame[MAX_MOTORS];
-    int onionLayers[MAX_MOTORS];
-    int motorIndex, onion;
-    double opacity;
-
-    char motorLabel[16];
-    cairo_text_extents_t extent;
-
-    /*if (fieldMeta.heading) {
-        cairo_rotate(cr, intToFloat(frame[fieldMeta.heading]));
-    }*/
+    //If motors are armed (above minthrottle), keep them spinning at least a bit
+    if (scaled > 0)
+        scaled = scaled * 0.9 + 0.1;
 
-    //Draw arms
-    cairo_set_line_width(cr, parameters->bladeLength * 0.30);
-    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
-    cairo_set_source_rgba(cr, craftColor.r, craftColor.g, craftColor.b, craftColor.a);
+    return scaled * M_PI * 2 * MOTOR_MAX_RPS;
+}
 
-    for (motorIndex = 0; motorIndex < parameters->numMotors; motorIndex++) {
-        cairo_move_to(cr, 0, 0);
+/**
+ * Find how far each prop turns in the given time at the motor outputs of the given frame.
+ */
+static void decidePropRotation(int64_t *frame, int64_t timeElapsedMicros, const craft_parameters_t *parameters, double *rotationThisFrame)
+{
+    for (int motorIndex = 0; motorIndex < parameters->numMotors; motorIndex++) {
+        rotationThisFrame[motorIndex] = 0;
 
-        cairo_line_to(
-            cr,
-            parameters->motorSpacing * parameters->motorX[motorIndex] * 1.2,
-            parameters->motorSpacing * parameters->motorY[motorIndex] * 1.2
-        );
+        if (flightLog->mainFieldIndexes.motor[motorIndex] > -1) {
+            rotationThisFrame[motorIndex] = decidePropSpeed(frame[flightLog->mainFieldIndexes.motor[motorIndex]]) * timeElapsedMicros / 1000000;
+        }
     }
+}
 
-    cairo_stroke(cr);
-
-    //Draw the central hub
+/**
+ * Add up how far each prop has turned since the start of the log (a prefix sum of its speed over time), and save the
+ * angle at every PROP_PHASE_CHECKPOINT_FRAMES'th frame so that lookupPropPhase() can find the angle at any time.
+ *
+ * This carries on from the frames added up by the last call. A frame's turn lasts until the next frame, so the last
+ * frame is left for the next call unless the log is complete.
+ *
+ * The props don't turn across gaps in the log, since we don't know how fast they were going.
+ */
+static void computePropPhases(bool complete)
+{
+    int64_t motorValues[PROP_PHASE_CHECKPOINT_FRAMES];
+    int firstFrameIndex = propPhaseFrameCount - points->discardedFrameCount;
+    int endFrameIndex = complete ? points->frameCount : points->frameCount - 1;
+    int checkpointCount = (endFrameIndex + points->discardedFrameCount + PROP_PHASE_CHECKPOINT_FRAMES - 1) / PROP_PHASE_CHECKPOINT_FRAMES;
+
+    if (endFrameIndex <= firstFrameIndex)
+        return;
+
+    for (int motorIndex = 0; motorIndex < MAX_MOTORS; motorIndex++) {
+        int fieldIndex = flightLog->mainFieldIndexes.motor[motorIndex];
+        double phase = propPhases[motorIndex];
+
+        if (fieldIndex < 0)
+            continue;
+
+        if (checkpointCount > propPhaseCheckpointCapacity) {
+            propPhaseCheckpoints[motorIndex] = realloc(propPhaseCheckpoints[motorIndex], checkpointCount * 2 * sizeof(*propPhaseCheckpoints[motorIndex]));
+        }
+
+        for (int batchStart = firstFrameIndex, batchEnd; batchStart < endFrameIndex; batchStart = batchEnd) {
+            int logFrameIndex = batchStart + points->discardedFrameCount;
+
+            batchEnd = batchStart + PROP_PHASE_CHECKPOINT_FRAMES - logFrameIndex % PROP_PHASE_CHECKPOINT_FRAMES;
+            if (batchEnd > endFrameIndex)
+                batchEnd = endFrameIndex;
+
+            datapointsReadField(points, fieldIndex, batchStart, batchEnd - batchStart, motorValues);
+
+            if (logFrameIndex % PROP_PHASE_CHECKPOINT_FRAMES == 0) {
+                // Keep the angle small so it doesn't lose precision over long logs
+                phase = fmod(phase, M_PI * 2);
+                propPhaseCheckpoints[motorIndex][logFrameIndex / PROP_PHASE_CHECKPOINT_FRAMES] = phase;
+            }
+
+            for (int frameIndex = batchStart; frameIndex < batchEnd; frameIndex++) {
+                if (frameIndex + 1 < points->frameCount && !datapointsGetGapStartsAtIndex(points, frameIndex)) {
+                    phase += decidePropSpeed(motorValues[frameIndex - batchStart]) * (points->frameTime[frameIndex + 1] - points->frameTime[frameIndex]) / 1000000;
+                }
+            }
+        }
+
+        propPhases[motorIndex] = phase;
+    }
+
+    if (checkpointCount > propPhaseCheckpointCapacity)
+        propPhaseCheckpointCapacity = checkpointCount * 2;
+
+    propPhaseFrameCount = endFrameIndex + points->discardedFrameCount;
+}
+
+static void freePropPhases(void)
+{
+    for (int motorIndex = 0; motorIndex < MAX_MOTORS; motorIndex++) {
+        free(propPhaseCheckpoints[motorIndex]);
+        propPhaseCheckpoints[motorIndex] = NULL;
+        propPhases[motorIndex] = 0;
+    }
+
+    propPhaseCheckpointCapacity = 0;
+    propPhaseFrameCount = 0;
+}
+
+/**
+ * Find the angle the given prop has turned through between the start of the log and the given time.
+ */
+static double lookupPropPhase(int motorIndex, int64_t time)
+{
+    int64_t motorValues[PROP_PHASE_CHECKPOINT_FRAMES];
+    int frameIndex = datapointsFindFrameAtTime(points, time);
+    int logFrameIndex = frameIndex + points->discardedFrameCount;
+    int batchStart;
+    double phase;
+
+    if (!propPhaseCheckpoints[motorIndex] || frameIndex < 0)
+        return 0;
+
+    // The points are only ever discarded a whole batch at a time, so the batch is still there
+    batchStart = frameIndex - logFrameIndex % PROP_PHASE_CHECKPOINT_FRAMES;
+    phase = propPhaseCheckpoints[motorIndex][logFrameIndex / PROP_PHASE_CHECKPOINT_FRAMES];
+
+    datapointsReadField(points, flightLog->mainFieldIndexes.motor[motorIndex], batchStart, frameIndex - batchStart + 1, motorValues);
+
+    // Integrate on from the checkpoint in the same way as computePropPhases(), then over the part of the last frame
+    for (int i = batchStart; i < frameIndex; i++) {
+        if (!datapointsGetGapStartsAtIndex(points, i)) {
+            phase += decidePropSpeed(motorValues[i - batchStart]) * (points->frameTime[i + 1] - points->frameTime[i]) / 1000000;
+        }
+    }
+
+    if (frameIndex + 1 < points->frameCount && !datapointsGetGapStartsAtIndex(points, frameIndex)) {
+        phase += decidePropSpeed(motorValues[frameIndex - batchStart]) * (time - points->frameTime[frameIndex]) / 1000000;
+    }
+
+    return phase;
+}
+
+/**
+ * Draw the arms and central hub of the craft, which don't move.
+ */
+static void drawCraftBody(cairo_t *cr, const void *arg)
+{
+    const craft_parameters_t *parameters = (const craft_parameters_t *) arg;
+
+    //Draw arms
+    cairo_set_line_width(cr, parameters->bladeLength * 0.30);
+    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+    cairo_set_source_rgba(cr, craftColor.r, craftColor.g, craftColor.b, craftColor.a);
+
+    for (int motorIndex = 0; motorIndex < parameters->numMotors; motorIndex++) {
+        cairo_move_to(cr, 0, 0);
+
+        cairo_line_to(
+            cr,
+            parameters->motorSpacing * parameters->motorX[motorIndex] * 1.2,
+            parameters->motorSpacing * parameters->motorY[motorIndex] * 1.2
+        );
+    }
+
+    cairo_stroke(cr);
+
+    //Draw the central hub
     cairo_move_to(cr, 0, 0);
     cairo_arc(cr, 0, 0, parameters->motorSpacing * 0.4, 0, 2 * M_PI);
     cairo_fill(cr);
+}
 
-    //Compute prop speed and position
-    for (motorIndex = 0; motorIndex < parameters->numMotors; motorIndex++) {
-        if (flightLog->mainFieldIndexes.motor[motorIndex] > -1) {
-            double scaled = doubleMax(frame[flightLog->mainFieldIndexes.motor[motorIndex]] - (int32_t) flightLog->sysConfig.motorOutputLow, 0) / (flightLog->sysConfig.motorOutputHigh - flightLog->sysConfig.motorOutputLow);
+/**
+ * Draw a craft with spinning blades at the origin
+ */
+void drawCraft(cairo_t *cr, staticLayers_t *layers, textCache_t *textCache, const double *propAngles, int64_t *frame, int64_t timeElapsedMicros,
+    const craft_parameters_t *parameters)
+{
+    double rotationThisFrame[MAX_MOTORS];
+    int onionLayers[MAX_MOTORS];
+    int motorIndex, onion;
+    double opacity;
 
-            //If motors are armed (above minthrottle), keep them spinning at least a bit
-            if (scaled > 0)
-                scaled = scaled * 0.9 + 0.1;
+    char motorLabel[16];
+    cairo_text_extents_t extent;
+
+    /*if (fieldMeta.heading) {
+        cairo_rotate(cr, intToFloat(frame[fieldMeta.heading]));
+    }*/
 
-            angularSpeed[motorIndex] = scaled * M_PI * 2 * MOTOR_MAX_RPS;
+    paintStaticLayer(cr, &layers->craftBody, drawCraftBody, parameters);
 
-            rotationThisFrame[motorIndex] = angularSpeed[motorIndex] * timeElapsedMicros / 1000000;
+    //Compute prop speed and position
+    decidePropRotation(frame, timeElapsedMicros, parameters, rotationThisFrame);
 
-            // Don't need to draw as many onion layers if we aren't rotating very far
-            onionLayers[motorIndex] = (int) (doubleAbs(rotationThisFrame[motorIndex]) * 10);
-            if (onionLayers[motorIndex] < 1)
-                onionLayers[motorIndex] = 1;
-        }
+    for (motorIndex = 0; motorIndex < parameters->numMotors; motorIndex++) {
+        // Don't need to draw as many onion layers if we aren't rotating very far
+        onionLayers[motorIndex] = (int) (doubleAbs(rotationThisFrame[motorIndex]) * 10);
+        if (onionLayers[motorIndex] < 1)
+            onionLayers[motorIndex] = 1;
     }
 
     cairo_set_font_size(cr, FONTSIZE_CURRENT_VALUE_LABEL);
@@ -636,13 +1280,10 @@ void drawCraft(cairo_t *cr, int64_t *frame, int64_t timeElapsedMicros, craft_par
                 doubleMin(parameters->propColor[motorIndex].b * 1.25, 1)
             );
 
-            cairo_show_text (cr, motorLabel);
+            textCacheShowText(textCache, cr, motorLabel);
         }
         cairo_restore(cr);
     }
-
-    for (motorIndex = 0; motorIndex < parameters->numMotors; motorIndex++)
-        propAngles[motorIndex] += rotationThisFrame[motorIndex];
 }
 
 void decideCraftParameters(craft_parameters_t *parameters, int imageWidth, int imageHeight)
@@ -696,167 +1337,654 @@ void decideCraftParameters(craft_parameters_t *parameters, int imageWidth, int i
 }
 
 /**
- * Plot the given field within the specified time period. When the output from the curve applied to a field
- * value reaches 1.0 it'll be drawn plotHeight pixels away from the origin.
+ * The line that plotLine() is drawing.
+ */
+typedef struct plotLinePen_t {
+    const plotWindow_t *window;
+    expoCurve_t *curve;
+    int plotHeight;
+
+    bool drawingLine;
+    double lastX, lastY;
+} plotLinePen_t;
+
+/**
+ * Find the first frame at or after frameIndex whose time is at least the given time (or the frame count if there
+ * isn't one). This gallops forward from frameIndex, so it's quick when the frame is close by.
  */
-void plotLine(cairo_t *cr, color_t color, int64_t windowStartTime, int64_t windowEndTime, int firstFrameIndex,
-        int fieldIndex, expoCurve_t *curve, int plotHeight)
+static int findFrameAtOrAfterTime(int frameIndex, int64_t time)
+{
+    int low = frameIndex, high, step = 1;
+
+    if (low >= points->frameCount || points->frameTime[low] >= time)
+        return low;
+
+    //The frame is after low and at or before high
+    for (;;) {
+        high = low + step;
+
+        if (high >= points->frameCount) {
+            high = points->frameCount;
+            break;
+        }
+
+        if (points->frameTime[high] >= time)
+            break;
+
+        low = high;
+        step *= 2;
+    }
+
+    while (high - low > 1) {
+        int mid = low + (high - low) / 2;
+
+        if (points->frameTime[mid] >= time)
+            high = mid;
+        else
+            low = mid;
+    }
+
+    return high;
+}
+
+static void plotLinePoint(cairo_t *cr, plotLinePen_t *pen, int frameIndex, int64_t fieldValue)
 {
     static const int GAP_WARNING_BOX_RADIUS = 4;
-    uint32_t windowWidthMicros = (uint32_t) (windowEndTime - windowStartTime);
+
+    double nextX, nextY;
+
+    nextY = (double) -expoCurveLookup(pen->curve, fieldValue) * pen->plotHeight;
+    //Only one rounding, so a frame is always a whole number of pixels along from where an earlier window put it
+    nextX = (double) ((points->frameTime[frameIndex] * pen->window->timeScale - pen->window->startTime) * options.imageWidth)
+        / (pen->window->endTime - pen->window->startTime);
+
+    if (pen->drawingLine) {
+        if (!options.gapless && datapointsGetGapStartsAtIndex(points, frameIndex - 1)) {
+            //Draw a warning box at the beginning and end of the gap to mark it
+            cairo_rectangle(cr, pen->lastX - GAP_WARNING_BOX_RADIUS, pen->lastY - GAP_WARNING_BOX_RADIUS, GAP_WARNING_BOX_RADIUS * 2, GAP_WARNING_BOX_RADIUS * 2);
+            cairo_rectangle(cr, nextX - GAP_WARNING_BOX_RADIUS, nextY - GAP_WARNING_BOX_RADIUS, GAP_WARNING_BOX_RADIUS * 2, GAP_WARNING_BOX_RADIUS * 2);
+
+            cairo_move_to(cr, nextX, nextY);
+        } else {
+            cairo_line_to(cr, nextX, nextY);
+        }
+    } else {
+        cairo_move_to(cr, nextX, nextY);
+    }
+
+    pen->drawingLine = true;
+    pen->lastX = nextX;
+    pen->lastY = nextY;
+}
+
+static void plotLineFrame(cairo_t *cr, plotLinePen_t *pen, int fieldIndex, int frameIndex)
+{
     int64_t fieldValue;
-    int64_t frameTime;
 
-    bool drawingLine = false;
-    double lastX, lastY;
+    datapointsReadField(points, fieldIndex, frameIndex, 1, &fieldValue);
+    plotLinePoint(cr, pen, frameIndex, fieldValue);
+}
+
+static int64_t divideRoundingDown(int64_t numerator, int64_t denominator)
+{
+    int64_t quotient = numerator / denominator;
+
+    return quotient * denominator > numerator ? quotient - 1 : quotient;
+}
+
+static int64_t divideRoundingUp(int64_t numerator, int64_t denominator)
+{
+    int64_t quotient = numerator / denominator;
+
+    return quotient * denominator < numerator ? quotient + 1 : quotient;
+}
+
+/**
+ * Plot a field over the window, starting from the window's firstFrameIndex and ending with the first frame after it.
+ * When the output from the curve applied to a field value reaches 1.0 it'll be drawn plotHeight pixels away from the
+ * origin.
+ *
+ * Where more than PLOT_COLUMN_POINTS frames land in one pixel column of the frame, only the first and last frames of the column
+ * and the frames with the smallest and largest values are drawn (found with the field's min/max pyramid). These draw
+ * practically the same pixels as every frame of the column would (this is "M4" decimation), so the cost of drawing
+ * doesn't grow with the rate of the log. Columns are split at gaps so that their warning boxes are still drawn. The
+ * frames to the left of the window are split into columns the same way, so a frame is drawn the same way whichever
+ * window it's in.
+ */
+void plotLine(cairo_t *cr, color_t color, const plotWindow_t *window, int fieldIndex, expoCurve_t *curve, int plotHeight)
+{
+    const minMaxPyramid_t *pyramid = fieldPyramids ? fieldPyramids[fieldIndex] : NULL;
+    const int64_t windowWidth = window->endTime - window->startTime;
+    plotLinePen_t pen = {
+        .window = window,
+        .curve = curve, .plotHeight = plotHeight,
+        .drawingLine = false
+    };
+    int64_t fieldValues[PLOT_COLUMN_POINTS];
 
     //Draw points from this line until we leave the window
-    for (int frameIndex = firstFrameIndex; frameIndex < points->frameCount; frameIndex++) {
-        datapointsGetFieldAtIndex(points, frameIndex, fieldIndex, &fieldValue);
-        datapointsGetTimeAtIndex(points, frameIndex, &frameTime);
+    for (int frameIndex = window->firstFrameIndex; frameIndex < points->frameCount; ) {
+        int64_t frameTime = points->frameTime[frameIndex] * window->timeScale;
+        int columnEnd = frameIndex + 1;
+
+        if (pyramid && frameTime < window->endTime) {
+            int64_t column = divideRoundingDown((frameTime - window->startTime) * window->columnCount, windowWidth);
+            //The first log time (in microseconds) that lands in the next column
+            int64_t nextColumnTime = divideRoundingUp(
+                window->startTime + divideRoundingUp((column + 1) * windowWidth, window->columnCount), window->timeScale);
+            const uint8_t *gap;
+
+            columnEnd = findFrameAtOrAfterTime(frameIndex + 1, nextColumnTime);
 
-        double nextX, nextY;
+            gap = memchr(points->frameGap + frameIndex, 1, columnEnd - 1 - frameIndex);
 
-        nextY = (double) -expoCurveLookup(curve, fieldValue) * plotHeight;
-        nextX = (double)(frameTime - windowStartTime) / windowWidthMicros * options.imageWidth;
+            if (gap) {
+                columnEnd = (int) (gap - points->frameGap) + 1;
+            }
+        }
+
+        if (columnEnd - frameIndex > PLOT_COLUMN_POINTS) {
+            minMaxRange_t range;
+
+            minMaxPyramidQuery(pyramid, frameIndex + 1, columnEnd - frameIndex - 2, &range);
 
-        if (drawingLine) {
-            if (!options.gapless && datapointsGetGapStartsAtIndex(points, frameIndex - 1)) {
-                //Draw a warning box at the beginning and end of the gap to mark it
-                cairo_rectangle(cr, lastX - GAP_WARNING_BOX_RADIUS, lastY - GAP_WARNING_BOX_RADIUS, GAP_WARNING_BOX_RADIUS * 2, GAP_WARNING_BOX_RADIUS * 2);
-                cairo_rectangle(cr, nextX - GAP_WARNING_BOX_RADIUS, nextY - GAP_WARNING_BOX_RADIUS, GAP_WARNING_BOX_RADIUS * 2, GAP_WARNING_BOX_RADIUS * 2);
+            plotLineFrame(cr, &pen, fieldIndex, frameIndex);
 
-                cairo_move_to(cr, nextX, nextY);
+            //Keep the extremes in the order they happened
+            if (range.minIndex < range.maxIndex) {
+                plotLinePoint(cr, &pen, range.minIndex, range.min);
+                plotLinePoint(cr, &pen, range.maxIndex, range.max);
+            } else if (range.minIndex > range.maxIndex) {
+                plotLinePoint(cr, &pen, range.maxIndex, range.max);
+                plotLinePoint(cr, &pen, range.minIndex, range.min);
             } else {
-                cairo_line_to(cr, nextX, nextY);
+                plotLinePoint(cr, &pen, range.minIndex, range.min);
             }
+
+            plotLineFrame(cr, &pen, fieldIndex, columnEnd - 1);
         } else {
-            cairo_move_to(cr, nextX, nextY);
-        }
+            int count = datapointsReadField(points, fieldIndex, frameIndex, columnEnd - frameIndex, fieldValues);
 
-        drawingLine = true;
-        lastX = nextX;
-        lastY = nextY;
+            for (int i = 0; i < count; i++) {
+                plotLinePoint(cr, &pen, frameIndex + i, fieldValues[i]);
+            }
+        }
 
-        if (frameTime >= windowEndTime)
+        if (points->frameTime[columnEnd - 1] * window->timeScale >= window->endTime)
             break;
+
+        frameIndex = columnEnd;
     }
 
     cairo_set_source_rgb(cr, color.r, color.g, color.b);
     cairo_stroke(cr);
 }
 
-void drawPIDTable(cairo_t *cr, int64_t *frame)
+/**
+ * Build the min/max pyramid of each field that plotLine() will draw.
+ */
+static void createFieldPyramids(void)
 {
-    cairo_font_extents_t fontExtent;
+    int plotted[FLIGHT_LOG_MAX_FIELDS], plottedCount = 0;
 
-    cairo_font_extents(cr, &fontExtent);
+    if (options.plotMotors) {
+        for (int i = 0; i < fieldMeta.numMotors; i++)
+            plotted[plottedCount++] = flightLog->mainFieldIndexes.motor[i];
 
-    const double INTERROW_SPACING = 32;
-    const double VERT_SPACING = fontExtent.height + INTERROW_SPACING;
-    const double FIRST_ROW_TOP = fontExtent.height + INTERROW_SPACING;
-    const double HORZ_SPACING = 100, FIRST_COL_LEFT = 140;
+        for (int i = 0; i < MAX_SERVOS; i++)
+            plotted[plottedCount++] = flightLog->mainFieldIndexes.servo[i];
+    }
 
-    const double HORZ_EXTENT = FIRST_COL_LEFT + HORZ_SPACING * 5 - 30;
-    const double VERT_EXTENT = FIRST_ROW_TOP + fontExtent.height * 3 + INTERROW_SPACING * 2;
+    if (options.plotPids) {
+        for (int pidType = PID_P; pidType <= PID_D; pidType++)
+            for (int axis = 0; axis < 3; axis++)
+                plotted[plottedCount++] = flightLog->mainFieldIndexes.pid[pidType][axis];
+    }
 
-    const double PADDING = 32;
+    if (options.plotGyros) {
+        for (int axis = 0; axis < 3; axis++)
+            plotted[plottedCount++] = flightLog->mainFieldIndexes.gyroADC[axis];
+    }
 
-    char fieldLabel[16];
-    int pidType, axisIndex;
-    const char *pidName;
+    fieldPyramids = calloc(points->fieldCount, sizeof(*fieldPyramids));
 
-    cairo_save(cr);
+    for (int i = 0; i < plottedCount; i++) {
+        int fieldIndex = plotted[i];
 
-    //Centre about the origin
-    cairo_translate(cr, -HORZ_EXTENT / 2, -VERT_EXTENT / 2);
+        if (fieldIndex > -1 && fieldIndex < points->fieldCount && !fieldPyramids[fieldIndex]) {
+            fieldPyramids[fieldIndex] = minMaxPyramidCreate(points, fieldIndex);
+        }
+    }
+}
 
-    //Draw a background box
-    cairo_set_source_rgba(cr, 0, 0, 0, 0.33);
+static void destroyFieldPyramids(void)
+{
+    if (!fieldPyramids)
+        return;
 
-    cairo_rectangle(cr, -PADDING, -PADDING, HORZ_EXTENT + PADDING * 2, VERT_EXTENT + PADDING * 2);
+    for (int i = 0; i < points->fieldCount; i++) {
+        minMaxPyramidDestroy(fieldPyramids[i]);
+    }
 
-    cairo_fill(cr);
+    free(fieldPyramids);
+    fieldPyramids = NULL;
+}
 
-    cairo_set_font_size(cr, FONTSIZE_PID_TABLE_LABEL);
-    cairo_set_source_rgb(cr, 1, 1, 1);
+static void addGraphLine(graph_t *graph, int fieldIndex, color_t color, expoCurve_t *curve, double lineWidth,
+        const double *dash, int dashCount)
+{
+    graphLine_t *line = &graph->lines[graph->lineCount++];
+
+    line->fieldIndex = fieldIndex;
+    line->color = color;
+    line->curve = curve;
+    line->lineWidth = lineWidth;
+    line->dash = dash;
+    line->dashCount = dashCount;
+}
 
-    //Draw field labels first
-    for (pidType = PID_P - 1; pidType <= PID_TOTAL; pidType++) {
-        switch (pidType) {
-            case PID_P - 1:
-                pidName = "Gyro";
-            break;
-            case PID_P:
-                pidName = "P";
-            break;
-            case PID_I:
-                pidName = "I";
-            break;
-            case PID_D:
-                pidName = "D";
-            break;
-            case PID_TOTAL:
-                pidName = "Sum";
-            break;
-            default:
-                pidName = "";
-        }
-        cairo_move_to (cr, (pidType + 1) * HORZ_SPACING + FIRST_COL_LEFT, fontExtent.height);
-        cairo_show_text (cr, pidName);
-    }
+/**
+ * Decide which lines go on each graph, and how far from its axis they reach over the whole log (which needs the
+ * field pyramids, without them the lines are allowed to reach anywhere in the frame).
+ */
+static void decideGraphs(void)
+{
+    memset(graphs, 0, sizeof(graphs));
 
-    for (axisIndex = 0; axisIndex < 3; axisIndex++) {
-        switch (axisIndex) {
-            case 0:
-                pidName = "Roll";
-            break;
-            case 1:
-                pidName = "Pitch";
-            break;
-            case 2:
-                pidName = "Yaw";
-            break;
-            default:
-                pidName = "";
+    if (options.plotMotors) {
+        graph_t *graph = &graphs[GRAPH_MOTORS];
+
+        graph->plotHeight = (int) (options.imageHeight * (options.plotPids ? 0.15 : 0.20));
+
+        for (int i = 0; i < fieldMeta.numMotors; i++) {
+            addGraphLine(graph, flightLog->mainFieldIndexes.motor[i], fieldMeta.motorColors[i], motorCurve, 2.5, NULL, 0);
         }
 
-        cairo_move_to (cr, 0, FIRST_ROW_TOP + axisIndex * VERT_SPACING + fontExtent.height);
-        cairo_show_text (cr, pidName);
+        if (fieldMeta.numServos) {
+            for (int i = 0; i < MAX_SERVOS; i++) {
+                if (flightLog->mainFieldIndexes.servo[i] > -1) {
+                    addGraphLine(graph, flightLog->mainFieldIndexes.servo[i], fieldMeta.servoColors[i], motorCurve, 2.5, NULL, 0);
+                }
+            }
+        }
     }
 
-    //Now draw the values
-    for (pidType = PID_P - 1; pidType <= PID_TOTAL; pidType++) {
-        for (axisIndex = 0; axisIndex < 3; axisIndex++) {
-            int32_t fieldValue;
+    if (options.plotPids) {
+        //Three axes as different graphs
+        for (int axis = 0; axis < 3; axis++) {
+            graph_t *graph = &graphs[GRAPH_PID_ROLL + axis];
 
-            if (pidType == PID_P - 1) {
-                if (fieldMeta.hasGyros) {
-                    fieldValue = frame[flightLog->mainFieldIndexes.gyroADC[axisIndex]];
+            graph->plotHeight = (int) (options.imageHeight * 0.15);
 
-                    if (options.gyroUnit == UNIT_DEGREES_PER_SEC) {
-                        fieldValue = (int32_t) round(flightlogGyroToRadiansPerSecond(flightLog, fieldValue) * (180 / M_PI));
-                    }
-                } else
-                    fieldValue = 0;
-            } else if (fieldMeta.hasPIDs) {
-                if (pidType == PID_TOTAL) {
-                    fieldValue = frame[flightLog->mainFieldIndexes.pid[PID_P][axisIndex]]
-                        + frame[flightLog->mainFieldIndexes.pid[PID_I][axisIndex]]
-                        + (flightLog->mainFieldIndexes.pid[PID_D][axisIndex] > -1 ? frame[flightLog->mainFieldIndexes.pid[PID_D][axisIndex]] : 0);
-                } else if (flightLog->mainFieldIndexes.pid[pidType][axisIndex] > -1)
-                    fieldValue = frame[flightLog->mainFieldIndexes.pid[pidType][axisIndex]];
-                else
-                    fieldValue = 0;
-            } else
-                fieldValue = 0;
+            for (int pidType = PID_D; pidType >= PID_P; pidType--) {
+                int fieldIndex = flightLog->mainFieldIndexes.pid[pidType][axis];
 
-            snprintf(fieldLabel, sizeof(fieldLabel), "%d", fieldValue);
+                if (fieldIndex > -1) {
+                    color_t color = fieldMeta.PIDAxisColors[pidType][axis];
 
-            switch (pidType) {
-                case PID_P - 1:
-                    cairo_set_source_rgb(
-                        cr,
+                    switch (pidType) {
+                        case PID_P:
+                            addGraphLine(graph, fieldIndex, color, pidCurve, 2, NULL, 0);
+                        break;
+                        case PID_I:
+                            addGraphLine(graph, fieldIndex, color, pidCurve, 2, DASHED_LINE, DASHED_LINE_NUM_POINTS);
+                        break;
+                        case PID_D:
+                            addGraphLine(graph, fieldIndex, color, pidCurve, 2, DOTTED_LINE, DOTTED_LINE_NUM_POINTS);
+                    }
+                }
+            }
+
+            if (options.plotGyros) {
+                addGraphLine(graph, flightLog->mainFieldIndexes.gyroADC[axis], fieldMeta.gyroColors[axis], gyroCurve, 3, NULL, 0);
+            }
+        }
+    } else if (options.plotGyros) {
+        //Three gyro axes on one graph, with cairo's default line width
+        graph_t *graph = &graphs[GRAPH_GYROS];
+
+        graph->plotHeight = (int) (options.imageHeight * 0.25);
+
+        for (int axis = 0; axis < 3; axis++) {
+            addGraphLine(graph, flightLog->mainFieldIndexes.gyroADC[axis], fieldMeta.gyroColors[axis], gyroCurve, 2, NULL, 0);
+        }
+    }
+
+    for (int i = 0; i < GRAPH_COUNT; i++) {
+        graph_t *graph = &graphs[i];
+        double extent = 0;
+
+        for (int j = 0; j < graph->lineCount; j++) {
+            const graphLine_t *line = &graph->lines[j];
+            minMaxRange_t range;
+
+            if (!fieldPyramids || line->fieldIndex < 0 || line->fieldIndex >= points->fieldCount || !fieldPyramids[line->fieldIndex]) {
+                //No way to tell how far it goes
+                extent = options.imageHeight;
+                break;
+            }
+
+            //The curves only ever grow with distance from the origin, so the extremes of the field are the furthest out
+            if (minMaxPyramidQuery(fieldPyramids[line->fieldIndex], 0, points->frameCount, &range)) {
+                extent = fmax(extent, fabs(expoCurveLookup(line->curve, range.min)) * graph->plotHeight);
+                extent = fmax(extent, fabs(expoCurveLookup(line->curve, range.max)) * graph->plotHeight);
+            }
+        }
+
+        graph->extent = (int) ceil(extent);
+    }
+}
+
+static void drawGraphLines(cairo_t *cr, const graph_t *graph, const plotWindow_t *window)
+{
+    for (int i = 0; i < graph->lineCount; i++) {
+        const graphLine_t *line = &graph->lines[i];
+
+        cairo_set_line_width(cr, line->lineWidth);
+        cairo_set_dash(cr, line->dash, line->dashCount, 0);
+
+        plotLine(cr, line->color, window, line->fieldIndex, line->curve, graph->plotHeight);
+    }
+}
+
+/**
+ * Find how many pixels to the left the graph has moved since the strip was drawn, or return 0 if the strip should be
+ * drawn again in full instead.
+ */
+static int decideGraphScroll(const graph_t *graph, const graphStrip_t *strip, uint32_t outputFrameIndex, const plotWindow_t *window)
+{
+    int64_t windowWidth = window->endTime - window->startTime;
+    int64_t moved;
+
+    //A draft's graphs aren't drawn at the size they're laid out at, so they don't move by whole pixels
+    if (options.draft || !strip->drawn || outputFrameIndex <= strip->outputFrameIndex
+            || outputFrameIndex / options.keyframeInterval != strip->outputFrameIndex / options.keyframeInterval)
+        return 0;
+
+    //Dashes are measured along the line from wherever it starts, so they'd change if we started part way along
+    for (int i = 0; i < graph->lineCount; i++) {
+        if (graph->lines[i].dash)
+            return 0;
+    }
+
+    //Each output frame moves the window along by a second in the window's time units, find that in pixels (times width)
+    moved = (int64_t) (outputFrameIndex - strip->outputFrameIndex) * 1000000 * options.imageWidth;
+
+    if (moved % windowWidth != 0 || moved / windowWidth > options.imageWidth - 2 * GRAPH_LINE_OVERHANG)
+        return 0;
+
+    return (int) (moved / windowWidth);
+}
+
+/**
+ * Draw the lines of a graph onto the frame, whose transformation must put the graph's axis at y = 0.
+ *
+ * The lines are drawn onto the worker's strip for the graph, then copied onto the frame. When the worker's last frame
+ * was in the same keyframe interval and the graph has moved along by a whole number of pixels since, the strip is just
+ * scrolled to the left and only the pixels which the newly shown part of the log can reach are drawn again. Those come
+ * out the same as they would if the whole graph were drawn, since plotLine() puts each frame a whole number of pixels
+ * from where it was and splits the log into columns at the same times as before.
+ */
+static void paintGraph(cairo_t *cr, graphStrip_t *strip, const graph_t *graph, uint32_t outputFrameIndex, const plotWindow_t *window)
+{
+    int scroll = decideGraphScroll(graph, strip, outputFrameIndex, window);
+    plotWindow_t drawWindow = *window;
+    cairo_matrix_t matrix;
+    cairo_t *stripCr;
+    int stripHeight;
+
+    if (!strip->surface) {
+        double axisX = 0, axisY = 0;
+        int bottom;
+
+        cairo_user_to_device(cr, &axisX, &axisY);
+
+        strip->top = (int) floor(axisY) - graph->extent - GRAPH_LINE_OVERHANG;
+        bottom = (int) ceil(axisY) + graph->extent + GRAPH_LINE_OVERHANG;
+
+        if (strip->top < 0)
+            strip->top = 0;
+        if (bottom > frameHeight)
+            bottom = frameHeight;
+        if (bottom <= strip->top)
+            bottom = strip->top + 1;
+
+        strip->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, frameWidth, bottom - strip->top);
+    }
+
+    stripHeight = cairo_image_surface_get_height(strip->surface);
+
+    if (scroll) {
+        //Start far enough to the left of the pixels being drawn again that every line which reaches them is drawn
+        int firstColumn = options.imageWidth - scroll - 2 * GRAPH_LINE_OVERHANG;
+        int64_t firstColumnTime = (window->startTime + firstColumn * (window->endTime - window->startTime) / options.imageWidth) / window->timeScale;
+
+        drawWindow.firstFrameIndex = findFrameAtOrAfterTime(window->firstFrameIndex, firstColumnTime) - 1;
+
+        if (drawWindow.firstFrameIndex < window->firstFrameIndex)
+            drawWindow.firstFrameIndex = window->firstFrameIndex;
+
+        //Draw the whole graph again when a gap comes into view, rather than pick up part way through its warning boxes
+        if (!options.gapless) {
+            int endFrameIndex = findFrameAtOrAfterTime(drawWindow.firstFrameIndex, divideRoundingUp(window->endTime, window->timeScale));
+
+            if (endFrameIndex > drawWindow.firstFrameIndex
+                    && memchr(points->frameGap + drawWindow.firstFrameIndex, 1, endFrameIndex - drawWindow.firstFrameIndex)) {
+                scroll = 0;
+                drawWindow.firstFrameIndex = window->firstFrameIndex;
+            }
+        }
+    }
+
+    stripCr = cairo_create(strip->surface);
+
+    if (scroll) {
+        uint8_t *pixels;
+        int stride;
+
+        cairo_surface_flush(strip->surface);
+
+        pixels = cairo_image_surface_get_data(strip->surface);
+        stride = cairo_image_surface_get_stride(strip->surface);
+
+        for (int y = 0; y < stripHeight; y++) {
+            uint8_t *row = pixels + (size_t) y * stride;
+
+            memmove(row, row + scroll * 4, (frameWidth - scroll) * 4);
+        }
+
+        cairo_surface_mark_dirty(strip->surface);
+
+        cairo_rectangle(stripCr, frameWidth - scroll - GRAPH_LINE_OVERHANG, 0, scroll + GRAPH_LINE_OVERHANG, stripHeight);
+        cairo_clip(stripCr);
+    }
+
+    cairo_set_operator(stripCr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint(stripCr);
+    cairo_set_operator(stripCr, CAIRO_OPERATOR_OVER);
+
+    //The frame's transformation, moved up to the top of the strip
+    cairo_get_matrix(cr, &matrix);
+    matrix.y0 -= strip->top;
+    cairo_set_matrix(stripCr, &matrix);
+    cairo_set_antialias(stripCr, cairo_get_antialias(cr));
+
+    drawGraphLines(stripCr, graph, &drawWindow);
+
+    cairo_destroy(stripCr);
+
+    strip->drawn = true;
+    strip->outputFrameIndex = outputFrameIndex;
+
+    cairo_save(cr);
+    {
+        cairo_identity_matrix(cr);
+        cairo_set_source_surface(cr, strip->surface, 0, strip->top);
+        cairo_paint(cr);
+    }
+    cairo_restore(cr);
+}
+
+static void destroyGraphStrips(graphStrip_t *strips)
+{
+    for (int i = 0; i < GRAPH_COUNT; i++) {
+        if (strips[i].surface)
+            cairo_surface_destroy(strips[i].surface);
+    }
+}
+
+/**
+ * Where the rows and columns of the PID table go, relative to its top left corner.
+ */
+typedef struct pidTableLayout_t {
+    double fontHeight;
+    double vertSpacing, firstRowTop;
+    double horzSpacing, firstColLeft;
+    double horzExtent, vertExtent;
+} pidTableLayout_t;
+
+static void decidePIDTableLayout(cairo_t *cr, pidTableLayout_t *layout)
+{
+    cairo_font_extents_t fontExtent;
+
+    cairo_font_extents(cr, &fontExtent);
+
+    const double INTERROW_SPACING = 32;
+
+    layout->fontHeight = fontExtent.height;
+    layout->vertSpacing = fontExtent.height + INTERROW_SPACING;
+    layout->firstRowTop = fontExtent.height + INTERROW_SPACING;
+    layout->horzSpacing = 100;
+    layout->firstColLeft = 140;
+
+    layout->horzExtent = layout->firstColLeft + layout->horzSpacing * 5 - 30;
+    layout->vertExtent = layout->firstRowTop + fontExtent.height * 3 + INTERROW_SPACING * 2;
+}
+
+/**
+ * Draw the background box and the row and column captions of the PID table.
+ */
+static void drawPIDTableBackground(cairo_t *cr, const void *arg)
+{
+    pidTableLayout_t layout;
+
+    const double PADDING = 32;
+
+    int pidType, axisIndex;
+    const char *pidName;
+
+    (void) arg;
+
+    decidePIDTableLayout(cr, &layout);
+
+    //Centre about the origin
+    cairo_translate(cr, -layout.horzExtent / 2, -layout.vertExtent / 2);
+
+    //Draw a background box
+    cairo_set_source_rgba(cr, 0, 0, 0, 0.33);
+
+    cairo_rectangle(cr, -PADDING, -PADDING, layout.horzExtent + PADDING * 2, layout.vertExtent + PADDING * 2);
+
+    cairo_fill(cr);
+
+    cairo_set_font_size(cr, FONTSIZE_PID_TABLE_LABEL);
+    cairo_set_source_rgb(cr, 1, 1, 1);
+
+    //Draw field labels first
+    for (pidType = PID_P - 1; pidType <= PID_TOTAL; pidType++) {
+        switch (pidType) {
+            case PID_P - 1:
+                pidName = "Gyro";
+            break;
+            case PID_P:
+                pidName = "P";
+            break;
+            case PID_I:
+                pidName = "I";
+            break;
+            case PID_D:
+                pidName = "D";
+            break;
+            case PID_TOTAL:
+                pidName = "Sum";
+            break;
+            default:
+                pidName = "";
+        }
+        cairo_move_to (cr, (pidType + 1) * layout.horzSpacing + layout.firstColLeft, layout.fontHeight);
+        cairo_show_text (cr, pidName);
+    }
+
+    for (axisIndex = 0; axisIndex < 3; axisIndex++) {
+        switch (axisIndex) {
+            case 0:
+                pidName = "Roll";
+            break;
+            case 1:
+                pidName = "Pitch";
+            break;
+            case 2:
+                pidName = "Yaw";
+            break;
+            default:
+                pidName = "";
+        }
+
+        cairo_move_to (cr, 0, layout.firstRowTop + axisIndex * layout.vertSpacing + layout.fontHeight);
+        cairo_show_text (cr, pidName);
+    }
+}
+
+void drawPIDTable(cairo_t *cr, staticLayers_t *layers, textCache_t *textCache, int64_t *frame)
+{
+    pidTableLayout_t layout;
+
+    char fieldLabel[16];
+    int pidType, axisIndex;
+
+    decidePIDTableLayout(cr, &layout);
+
+    paintStaticLayer(cr, &layers->pidTableBackground, drawPIDTableBackground, NULL);
+
+    cairo_save(cr);
+
+    //Centre about the origin
+    cairo_translate(cr, -layout.horzExtent / 2, -layout.vertExtent / 2);
+
+    cairo_set_font_size(cr, FONTSIZE_PID_TABLE_LABEL);
+
+    //Now draw the values
+    for (pidType = PID_P - 1; pidType <= PID_TOTAL; pidType++) {
+        for (axisIndex = 0; axisIndex < 3; axisIndex++) {
+            int32_t fieldValue;
+
+            if (pidType == PID_P - 1) {
+                if (fieldMeta.hasGyros) {
+                    fieldValue = frame[flightLog->mainFieldIndexes.gyroADC[axisIndex]];
+
+                    if (options.gyroUnit == UNIT_DEGREES_PER_SEC) {
+                        fieldValue = (int32_t) round(flightlogGyroToRadiansPerSecond(flightLog, fieldValue) * (180 / M_PI));
+                    }
+                } else
+                    fieldValue = 0;
+            } else if (fieldMeta.hasPIDs) {
+                if (pidType == PID_TOTAL) {
+                    fieldValue = frame[flightLog->mainFieldIndexes.pid[PID_P][axisIndex]]
+                        + frame[flightLog->mainFieldIndexes.pid[PID_I][axisIndex]]
+                        + (flightLog->mainFieldIndexes.pid[PID_D][axisIndex] > -1 ? frame[flightLog->mainFieldIndexes.pid[PID_D][axisIndex]] : 0);
+                } else if (flightLog->mainFieldIndexes.pid[pidType][axisIndex] > -1)
+                    fieldValue = frame[flightLog->mainFieldIndexes.pid[pidType][axisIndex]];
+                else
+                    fieldValue = 0;
+            } else
+                fieldValue = 0;
+
+            snprintf(fieldLabel, sizeof(fieldLabel), "%d", fieldValue);
+
+            switch (pidType) {
+                case PID_P - 1:
+                    cairo_set_source_rgb(
+                        cr,
                         fieldMeta.gyroColors[axisIndex].r,
                         fieldMeta.gyroColors[axisIndex].g,
                         fieldMeta.gyroColors[axisIndex].b
@@ -882,10 +2010,10 @@ void drawPIDTable(cairo_t *cr, int64_t *frame)
 
             cairo_move_to (
                 cr,
-                FIRST_COL_LEFT + (pidType + 1) * HORZ_SPACING,
-                FIRST_ROW_TOP + axisIndex * VERT_SPACING + fontExtent.height
+                layout.firstColLeft + (pidType + 1) * layout.horzSpacing,
+                layout.firstRowTop + axisIndex * layout.vertSpacing + layout.fontHeight
             );
-            cairo_show_text (cr, fieldLabel);
+            textCacheShowText(textCache, cr, fieldLabel);
         }
     }
 
@@ -920,7 +2048,34 @@ void drawAxisLabel(cairo_t *cr, const char *axisLabel)
     cairo_show_text(cr, axisLabel);
 }
 
-void drawFrameLabel(cairo_t *cr, uint32_t frameIndex, uint32_t frameTimeMsec)
+static void drawAxisLineLayer(cairo_t *cr, const void *arg)
+{
+    (void) arg;
+
+    drawAxisLine(cr);
+}
+
+static void drawAxisLabelLayer(cairo_t *cr, const void *arg)
+{
+    drawAxisLabel(cr, (const char *) arg);
+}
+
+//Draw a bar highlighting the current time, at the centre of the graphs
+static void drawTimeBar(cairo_t *cr, const void *arg)
+{
+    double centerX = options.imageWidth / 2.0;
+
+    (void) arg;
+
+    cairo_set_source_rgba(cr, 1, 0.25, 0.25, 0.2);
+    cairo_set_line_width(cr, 20);
+
+    cairo_move_to(cr, centerX, 0);
+    cairo_line_to(cr, centerX, options.imageHeight);
+    cairo_stroke(cr);
+}
+
+void drawFrameLabel(cairo_t *cr, textCache_t *textCache, uint32_t frameIndex, uint32_t frameTimeMsec)
 {
     char frameNumberBuf[16];
     cairo_text_extents_t extentFrameNumber, extentFrameTime;
@@ -930,10 +2085,10 @@ void drawFrameLabel(cairo_t *cr, uint32_t frameIndex, uint32_t frameTimeMsec)
     cairo_set_font_size(cr, FONTSIZE_FRAME_LABEL);
     cairo_set_source_rgba(cr, 1, 1, 1, 0.65);
 
-    cairo_text_extents(cr, "#0000000", &extentFrameNumber);
+    textCacheLabelExtents(textCache, cr, "#0000000", &extentFrameNumber);
 
     cairo_move_to(cr, options.imageWidth - extentFrameNumber.width - 8, options.imageHeight - 8);
-    cairo_show_text(cr, frameNumberBuf);
+    textCacheShowText(textCache, cr, frameNumberBuf);
 
     int frameSec, frameMins;
 
@@ -945,36 +2100,27 @@ void drawFrameLabel(cairo_t *cr, uint32_t frameIndex, uint32_t frameTimeMsec)
 
     snprintf(frameNumberBuf, sizeof(frameNumberBuf), "%02d:%02d.%03d", frameMins, frameSec, frameTimeMsec);
 
-    cairo_text_extents(cr, "00:00.000", &extentFrameTime);
+    textCacheLabelExtents(textCache, cr, "00:00.000", &extentFrameTime);
 
     cairo_move_to(cr, options.imageWidth - extentFrameTime.width - 8, options.imageHeight - 8 - extentFrameNumber.height - 8);
-    cairo_show_text(cr, frameNumberBuf);
+    textCacheShowText(textCache, cr, frameNumberBuf);
 }
 
-void drawAccelerometerData(cairo_t *cr, int64_t *frame)
+/**
+ * Add the given frame to the moving averages shown by drawAccelerometerData().
+ */
+static void advanceAccelerometerData(renderState_t *state, int frameIndex, int64_t *frame)
 {
     int16_t accSmooth[3];
     attitude_t attitude;
     t_fp_vector acceleration;
     double magnitude;
-    static double lastAccel = 0, lastVoltage = 0, lastCurrent = 0;
-    static int lastAlt = 0;
-    cairo_text_extents_t extent;
-
-    char labelBuf[32];
-
-    cairo_set_font_size(cr, FONTSIZE_FRAME_LABEL);
-    cairo_set_source_rgba(cr, 1, 1, 1, 0.65);
-
-    cairo_text_extents(cr, "Acceleration 0.0G", &extent);
 
-    if (flightLog->sysConfig.acc_1G && fieldMeta.hasAccs) {
+    if (frameAttitude) {
         for (int axis = 0; axis < 3; axis++)
             accSmooth[axis] = frame[flightLog->mainFieldIndexes.accSmooth[axis]];
 
-        attitude.roll = intToFloat(frame[fieldMeta.roll]);
-        attitude.pitch = intToFloat(frame[fieldMeta.pitch]);
-        attitude.heading = intToFloat(frame[fieldMeta.heading]);
+        attitude = frameAttitude[frameIndex];
 
         //Need to calculate acc in earth frame in order to subtract the 1G of gravity from the result
         acceleration = calculateAccelerationInEarthFrame(accSmooth, &attitude, flightLog->sysConfig.acc_1G);
@@ -987,95 +2133,138 @@ void drawAccelerometerData(cairo_t *cr, int64_t *frame)
         magnitude = sqrt(acceleration.V.X * acceleration.V.X + acceleration.V.Y * acceleration.V.Y + acceleration.V.Z * acceleration.V.Z);
 
         //Weighted moving average with the recent history to smooth out noise
-        lastAccel = (lastAccel * 2 + magnitude) / 3;
+        state->lastAccel = (state->lastAccel * 2 + magnitude) / 3;
+    }
+
+    if (flightLog->mainFieldIndexes.vbatLatest > -1) {
+        state->lastVoltage = (state->lastVoltage * 2 + flightLogVbatADCToMillivolts(flightLog, frame[flightLog->mainFieldIndexes.vbatLatest]) / (1000.0 * fieldMeta.numCells)) / 3;
+    }
+
+    if (flightLog->mainFieldIndexes.BaroAlt > -1) {
+        state->lastAlt = (state->lastAlt * 2 + frame[flightLog->mainFieldIndexes.BaroAlt]) / 3;
+    }
+
+    if (flightLog->mainFieldIndexes.amperageLatest > -1) {
+        state->lastCurrent = (state->lastCurrent * 2 + flightLogAmperageADCToMilliamps(flightLog, frame[flightLog->mainFieldIndexes.amperageLatest]) / 1000.0) / 3;
+    }
+}
+
+/**
+ * Work out the moving averages shown by drawAccelerometerData() for the given output frame, from the output frames
+ * leading up to it.
+ */
+static void decideAccelerometerData(renderState_t *state, const animation_t *animation, int64_t outputFrameIndex)
+{
+    int64_t frame[FLIGHT_LOG_MAX_FIELDS];
+    int frameIndex;
+
+    state->lastAccel = 0;
+    state->lastVoltage = 0;
+    state->lastCurrent = 0;
+    state->lastAlt = 0;
+
+    for (int64_t historyFrameIndex = outputFrameIndex - READOUT_HISTORY_FRAMES + 1; historyFrameIndex <= outputFrameIndex; historyFrameIndex++) {
+        if (getOutputFrameCenter(animation, historyFrameIndex, &frameIndex, frame)) {
+            advanceAccelerometerData(state, frameIndex, frame);
+        }
+    }
+}
+
+void drawAccelerometerData(cairo_t *cr, textCache_t *textCache, const renderState_t *state, int64_t *frame)
+{
+    cairo_text_extents_t extent;
+
+    char labelBuf[32];
+
+    cairo_set_font_size(cr, FONTSIZE_FRAME_LABEL);
+    cairo_set_source_rgba(cr, 1, 1, 1, 0.65);
 
+    textCacheLabelExtents(textCache, cr, "Acceleration 0.0G", &extent);
+
+    if (frameAttitude) {
         cairo_move_to(cr, X_POS_LABEL, options.imageHeight - 8);
-        cairo_show_text(cr, "Accel.");
+        textCacheShowLabel(textCache, cr, "Accel.");
 
-        snprintf(labelBuf, sizeof(labelBuf), "%.2f G", lastAccel);
+        snprintf(labelBuf, sizeof(labelBuf), "%.2f G", state->lastAccel);
 
         cairo_move_to(cr, X_POS_VALUE, options.imageHeight - 8);
-        cairo_show_text(cr, labelBuf);
+        textCacheShowText(textCache, cr, labelBuf);
     }
 
     if (flightLog->mainFieldIndexes.vbatLatest > -1) {
-        lastVoltage = (lastVoltage * 2 + flightLogVbatADCToMillivolts(flightLog, frame[flightLog->mainFieldIndexes.vbatLatest]) / (1000.0 * fieldMeta.numCells)) / 3;
-
         cairo_move_to(cr, X_POS_LABEL, options.imageHeight - 8 - (extent.height + 8));
-        cairo_show_text(cr, "Batt. cell");
+        textCacheShowLabel(textCache, cr, "Batt. cell");
 
-        snprintf(labelBuf, sizeof(labelBuf), "%.2f V", lastVoltage);
+        snprintf(labelBuf, sizeof(labelBuf), "%.2f V", state->lastVoltage);
 
         cairo_move_to(cr, X_POS_VALUE, options.imageHeight - 8 - (extent.height + 8));
-        cairo_show_text(cr, labelBuf);
+        textCacheShowText(textCache, cr, labelBuf);
     }
 
     if (flightLog->mainFieldIndexes.BaroAlt > -1) {
-        lastAlt = (lastAlt * 2 + frame[flightLog->mainFieldIndexes.BaroAlt]) / 3;
-
         cairo_move_to(cr, X_POS_LABEL, options.imageHeight - 8 - (extent.height + 8) * 2);
-        cairo_show_text(cr, "Altitude");
+        textCacheShowLabel(textCache, cr, "Altitude");
 
-        snprintf(labelBuf, sizeof(labelBuf), "%.1f m", lastAlt / 100.0);
+        snprintf(labelBuf, sizeof(labelBuf), "%.1f m", state->lastAlt / 100.0);
 
         cairo_move_to(cr, X_POS_VALUE, options.imageHeight - 8 - (extent.height + 8) * 2);
-        cairo_show_text(cr, labelBuf);
+        textCacheShowText(textCache, cr, labelBuf);
     }
 
     if (flightLog->mainFieldIndexes.amperageLatest > -1) {
-        lastCurrent = (lastCurrent * 2 + flightLogAmperageADCToMilliamps(flightLog, frame[flightLog->mainFieldIndexes.amperageLatest]) / 1000.0) / 3;
         cairo_move_to(cr, X_POS_LABEL, options.imageHeight - 8 - (extent.height + 8) * 3);
-        cairo_show_text(cr, "Current");
+        textCacheShowLabel(textCache, cr, "Current");
 
-        snprintf(labelBuf, sizeof(labelBuf), "%.2f A", lastCurrent);
+        snprintf(labelBuf, sizeof(labelBuf), "%.2f A", state->lastCurrent);
         cairo_move_to(cr, X_POS_VALUE, options.imageHeight - 8 - (extent.height + 8) * 3);
-        cairo_show_text(cr, labelBuf);
+        textCacheShowText(textCache, cr, labelBuf);
 
         cairo_move_to(cr, X_POS_VALUE + 140, options.imageHeight - 8 - (extent.height + 8) * 3);
-        cairo_show_text(cr, "Total");
+        textCacheShowLabel(textCache, cr, "Total");
 
         snprintf(labelBuf, sizeof(labelBuf), "%" PRId64 " mAh", frame[fieldMeta.cumulativeCurrent]);
         cairo_move_to(cr, X_POS_VALUE + 220, options.imageHeight - 8 - (extent.height + 8) * 3);
-        cairo_show_text(cr, labelBuf);
+        textCacheShowText(textCache, cr, labelBuf);
 
 	if (options.rawAmperage) {
           cairo_move_to(cr, X_POS_VALUE + 400, options.imageHeight - 8 - (extent.height + 8) * 3);
-          cairo_show_text(cr, "ADC");
+          textCacheShowLabel(textCache, cr, "ADC");
 
 	  snprintf(labelBuf, sizeof(labelBuf), "%" PRId64, frame[flightLog->mainFieldIndexes.amperageLatest]);
           cairo_move_to(cr, X_POS_VALUE + 470, options.imageHeight - 8 - (extent.height + 8) * 3);
-          cairo_show_text(cr, labelBuf);
+          textCacheShowText(textCache, cr, labelBuf);
         }
     }
 }
 
-void* pngRenderThread(void *arg)
+static void pngSaveTask(void *arg)
 {
     char filename[256];
     pngRenderingTask_t *task = (pngRenderingTask_t *) arg;
 
     snprintf(filename, sizeof(filename), "%s.%02d.%06d.png", options.outputPrefix, task->outputLogIndex + 1, task->outputFrameIndex);
-    cairo_surface_write_to_png (task->surface, filename);
-    cairo_surface_destroy (task->surface);
+    cairo_surface_flush(task->surface);
+
+    if (!pngWriteARGB32ToFile(filename, cairo_image_surface_get_data(task->surface), cairo_image_surface_get_stride(task->surface),
+            cairo_image_surface_get_width(task->surface), cairo_image_surface_get_height(task->surface), &options.png)) {
+        fprintf(stderr, "Failed to write frame %s\n", filename);
+    }
 
-    //Release our slot in the rendering pool, we're done
-    semaphore_signal(&pngRenderingSem);
+    surfacePoolRelease(frameSurfacePool, task->surface);
 
     free(task);
-
-    return 0;
 }
 
 /**
  * PNG encoding is so slow and so easily run in parallel, so save the frames using this function
- * (which'll use extra threads to do the work). Be sure to call waitForFramesToSave() before
- * the program ends.
+ * (which'll use extra threads to do the work). The surface goes back to frameSurfacePool once it's saved. Be sure to
+ * call waitForFramesToSave() before the program ends.
  */
 void saveSurfaceAsync(cairo_surface_t *surface, int logIndex, int outputFrameIndex)
 {
-    if (!pngRenderingSemCreated) {
-        semaphore_create(&pngRenderingSem, options.threads);
-        pngRenderingSemCreated = true;
+    // The queue is as long as the pool is wide, so no more than two frames per thread are waiting to be saved
+    if (!pngSavePool) {
+        pngSavePool = thread_pool_create(options.threads, options.threads);
     }
 
     pngRenderingTask_t *task = (pngRenderingTask_t*) malloc(sizeof(*task));
@@ -1084,330 +2273,606 @@ void saveSurfaceAsync(cairo_surface_t *surface, int logIndex, int outputFrameInd
     task->outputLogIndex = logIndex;
     task->outputFrameIndex = outputFrameIndex;
 
-    // Reserve a slot in the rendering pool...
-    semaphore_wait(&pngRenderingSem);
-
-    thread_create_detached(pngRenderThread, task);
+    thread_pool_submit(pngSavePool, pngSaveTask, task);
 }
 
+/**
+ * Wait for the frames given to saveSurfaceAsync() to be saved, and stop the threads that saved them.
+ */
 void waitForFramesToSave()
 {
-    int i;
-
-    if (pngRenderingSemCreated) {
-        for (i = 0; i < options.threads; i++) {
-            semaphore_wait(&pngRenderingSem);
-        }
-    }
+    thread_pool_destroy(pngSavePool);
+    pngSavePool = NULL;
 }
 
-void renderAnimation(uint32_t startFrame, uint32_t endFrame)
+/**
+ * Draw the given output frame. The picture depends only on the log and the index of the frame, so frames can be
+ * drawn in any order.
+ */
+static cairo_surface_t* drawOutputFrame(frameRenderWorker_t *worker, uint32_t outputFrameIndex)
 {
-    //Change how much data is displayed at one time
-    const int windowWidthMicros = 1000 * 1000;
-
-    //Bring the current time into the center of the plot
-    const int startXTimeOffset = windowWidthMicros / 2;
-
-    int i;
-
-    int64_t logStartTime = flightLog->stats.field[FLIGHT_LOG_FIELD_INDEX_TIME].min;
-    int64_t logEndTime = flightLog->stats.field[FLIGHT_LOG_FIELD_INDEX_TIME].max;
-    int64_t logDurationMicro;
-
-    uint32_t outputFrames;
+    const animation_t *animation = worker->animation;
+    renderState_t *state = &worker->state;
 
     int64_t frameValues[FLIGHT_LOG_MAX_FIELDS];
-    uint64_t lastCenterTime;
     int64_t frameTime;
 
-    FT_Face ft_face;
-    cairo_font_face_t *cairo_face;
+    const int windowWidthMicros = RENDER_WINDOW_WIDTH_MICROS;
 
-    struct craftDrawingParameters_t craftParameters;
+    int64_t windowCenterTime = outputFrameCenterTime(animation, outputFrameIndex);
+    int64_t timeElapsedMicros = windowCenterTime - outputFrameCenterTime(animation, (int64_t) outputFrameIndex - 1);
 
-    //If sync beep time looks reasonable, start the log there instead of at the first frame
-    if (abs((int) ((int64_t)syncBeepTime - logStartTime)) < 1000000) //Expected to be well within 1 second of the start
-        logStartTime = syncBeepTime;
+    //Bring the current time into the center of the plot
+    int64_t windowStartTime = windowCenterTime - windowWidthMicros / 2;
+    int64_t windowEndTime = windowStartTime + windowWidthMicros;
 
-    logDurationMicro = logEndTime - logStartTime;
+    cairo_surface_t *surface = surfacePoolAcquire(frameSurfacePool);
+    cairo_t *cr = cairo_create(surface);
 
-    if (endFrame == (uint32_t) -1) {
-        endFrame = (uint32_t) ((logDurationMicro * options.fps + (1000000 - 1)) / 1000000);
-    }
-    outputFrames = endFrame - startFrame;
+    // Find the frame just to the left of the lines that can reach the first pixel so we can start drawing from there
+    int firstFrameIndex = datapointsAdvanceToTime(points, &state->firstFrameCursor,
+        windowStartTime - (int64_t) 2 * GRAPH_LINE_OVERHANG * windowWidthMicros / options.imageWidth - 1);
 
-    if (FT_New_Memory_Face(freetypeLibrary, (const FT_Byte*)SourceSansPro_Regular_otf, SourceSansPro_Regular_otf_len, 0, &ft_face)) {
-        fprintf(stderr, "Failed to load font file\n");
-        exit(-1);
+    if (firstFrameIndex == -1) {
+        firstFrameIndex = 0;
     }
-    cairo_face = cairo_ft_font_face_create_for_ft_face(ft_face, 0);
 
-    decideCraftParameters(&craftParameters, options.imageWidth, options.imageHeight);
+    //The same window, but without rounding its start to the microsecond
+    int64_t scaledWindowStartTime = (animation->logStartTime - windowWidthMicros / 2) * options.fps + (int64_t) outputFrameIndex * 1000000;
+    plotWindow_t window = {
+        .startTime = scaledWindowStartTime,
+        .endTime = scaledWindowStartTime + (int64_t) windowWidthMicros * options.fps,
+        .timeScale = options.fps,
+        .firstFrameIndex = firstFrameIndex,
+        .columnCount = frameWidth
+    };
 
-    //Exaggerate values around the origin and compress values near the edges:
-    pitchStickCurve = expoCurveCreate(0, 0.700, 500 * (flightLog->sysConfig.rcRate ? flightLog->sysConfig.rcRate : 100) / 100, 1.0, 10);
+    if (options.draft) {
+        cairo_font_options_t *fontOptions = cairo_font_options_create();
 
-    gyroCurve = expoCurveCreate(0, 0.2, 9.0e-6 / flightLog->sysConfig.gyroScale, 1.0, 10);
-    accCurve = expoCurveCreate(0, 0.7, 5000, 1.0, 10);
-    pidCurve = expoCurveCreate(0, 0.7, 500, 1.0, 10);
+        //Lay the frame out at the image size like the final render, but draw it smaller and without antialiasing
+        cairo_scale(cr, frameScale, frameScale);
+        cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
 
-    motorCurve = expoCurveCreate(-(flightLog->sysConfig.motorOutputHigh + flightLog->sysConfig.motorOutputLow) / 2, 1.0,
-            (flightLog->sysConfig.motorOutputHigh - flightLog->sysConfig.motorOutputLow) / 2, 1.0, 2);
+        cairo_font_options_set_antialias(fontOptions, CAIRO_ANTIALIAS_NONE);
+        cairo_set_font_options(cr, fontOptions);
+        cairo_font_options_destroy(fontOptions);
+    }
 
-    // Default Servo range is [1020...2000] but we'll just use [1000...2000] for simplicity
-    servoCurve = expoCurveCreate(-1500, 1.0, 1000, 1.0, 2);
+    cairo_set_font_face(cr, worker->fontFace);
 
-    int durationSecs = (outputFrames + (options.fps - 1)) / (options.fps);
-    int durationMins = durationSecs / 60;
-    durationSecs %= 60;
+    //Plot the upper motor graph
+    if (options.plotMotors) {
+        cairo_save(cr);
+        {
+            if (options.plotPids) {
+                //Move up a little bit to make room for the pid graphs
+                cairo_translate(cr, 0, options.imageHeight * 0.15);
+            } else {
+                cairo_translate(cr, 0, options.imageHeight * 0.25);
+            }
 
-    fprintf(stderr, "%d frames to be rendered at %d FPS [%d:%02d]\n", outputFrames, options.fps, durationMins, durationSecs);
-    fprintf(stderr, "\n");
+            paintStaticLayer(cr, &worker->layers.graphAxisLine[GRAPH_MOTORS], drawAxisLineLayer, NULL);
+            paintGraph(cr, &worker->graphStrips[GRAPH_MOTORS], &graphs[GRAPH_MOTORS], outputFrameIndex, &window);
+            paintStaticLayer(cr, &worker->layers.graphLabel[GRAPH_MOTORS], drawAxisLabelLayer, "Motors");
+        }
+        cairo_restore(cr);
+    }
+
+    //Plot the lower PID graphs
+    cairo_save(cr);
+    {
+        if (options.plotPids) {
+            //Plot three axes as different graphs
+            cairo_translate(cr, 0, options.imageHeight * 0.60);
+            for (int axis = 0; axis < 3; axis++) {
+                cairo_save(cr);
 
-    for (uint32_t outputFrameIndex = startFrame; outputFrameIndex < endFrame; outputFrameIndex++) {
-        int64_t windowCenterTime = logStartTime + ((int64_t) outputFrameIndex * 1000000) / options.fps;
-        int64_t windowStartTime = windowCenterTime - startXTimeOffset;
-        int64_t windowEndTime = windowStartTime + windowWidthMicros;
+                cairo_translate(cr, 0, options.imageHeight * 0.2 * (axis - 1));
+
+                paintStaticLayer(cr, &worker->layers.graphAxisLine[GRAPH_PID_ROLL + axis], drawAxisLineLayer, NULL);
+                paintGraph(cr, &worker->graphStrips[GRAPH_PID_ROLL + axis], &graphs[GRAPH_PID_ROLL + axis], outputFrameIndex, &window);
+
+                const char *axisLabel;
+                if (options.plotGyros) {
+                    switch (axis) {
+                        case 0:
+                            axisLabel = "Gyro + PID roll";
+                        break;
+                        case 1:
+                            axisLabel = "Gyro + PID pitch";
+                        break;
+                        case 2:
+                            axisLabel = "Gyro + PID yaw";
+                        break;
+                        default:
+                            axisLabel = "Unknown";
+                    }
+                } else {
+                    switch (axis) {
+                        case 0:
+                            axisLabel = "Roll PIDs";
+                        break;
+                        case 1:
+                            axisLabel = "Pitch PIDs";
+                        break;
+                        case 2:
+                            axisLabel = "Yaw PIDs";
+                        break;
+                        default:
+                            axisLabel = "Unknown";
+                    }
+                }
 
-        cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, options.imageWidth, options.imageHeight);
-        cairo_t *cr = cairo_create(surface);
+                paintStaticLayer(cr, &worker->layers.graphLabel[GRAPH_PID_ROLL + axis], drawAxisLabelLayer, axisLabel);
 
-        // Find the frame just to the left of the first pixel so we can start drawing lines from there
-        int firstFrameIndex = datapointsFindFrameAtTime(points, windowStartTime - 1);
+                cairo_restore(cr);
+            }
+        } else if (options.plotGyros) {
+            //Plot three gyro axes on one graph
+            cairo_translate(cr, 0, options.imageHeight * 0.70);
 
-        if (firstFrameIndex == -1) {
-            firstFrameIndex = 0;
+            paintStaticLayer(cr, &worker->layers.graphAxisLine[GRAPH_GYROS], drawAxisLineLayer, NULL);
+            paintGraph(cr, &worker->graphStrips[GRAPH_GYROS], &graphs[GRAPH_GYROS], outputFrameIndex, &window);
+            paintStaticLayer(cr, &worker->layers.graphLabel[GRAPH_GYROS], drawAxisLabelLayer, "Gyro");
         }
+    }
+    cairo_restore(cr);
 
-        cairo_set_font_face(cr, cairo_face);
+    //Draw a bar highlighting the current time if we are drawing any graphs
+    if (options.plotGyros || options.plotMotors || options.plotPids || options.plotPidSum) {
+        paintStaticLayer(cr, &worker->layers.timeBar, drawTimeBar, NULL);
+    }
 
-        //Plot the upper motor graph
-        if (options.plotMotors) {
-            int motorGraphHeight = (int) (options.imageHeight * (options.plotPids ? 0.15 : 0.20));
+    int centerFrameIndex = datapointsAdvanceToTime(points, &state->centerFrameCursor, windowCenterTime);
 
+    //Draw the command stick positions from the centered frame
+    if (datapointsGetFrameAtIndex(points, centerFrameIndex, &frameTime, frameValues)) {
+        if (options.drawSticks) {
             cairo_save(cr);
             {
-                if (options.plotPids) {
-                    //Move up a little bit to make room for the pid graphs
-                    cairo_translate(cr, 0, options.imageHeight * 0.15);
+
+                if(options.sticksTop != 0 && options.sticksRight != 0) {
+                  cairo_translate(cr, options.imageWidth - options.sticksRight, options.sticksTop);
+                } else if(options.sticksRight != 0) {
+                  cairo_translate(cr, options.imageWidth - options.sticksRight, 0.20 * options.imageHeight);
+                } else if(options.sticksTop != 0) {
+                  cairo_translate(cr, 0.75 * options.imageWidth, options.sticksTop);
                 } else {
-                    cairo_translate(cr, 0, options.imageHeight * 0.25);
+                  cairo_translate(cr, 0.75 * options.imageWidth, 0.20 * options.imageHeight);
                 }
 
-                drawAxisLine(cr);
+                decideStickTrails(state, animation, outputFrameIndex);
+                drawCommandSticks(state, &worker->layers, worker->textCache, frameValues, options.imageWidth, options.imageHeight, cr);
+            }
+            cairo_restore(cr);
+        }
 
-                cairo_set_line_width(cr, 2.5);
+        if (options.drawPidTable) {
+            cairo_save(cr);
+            {
+                cairo_translate(cr, 0.25 * options.imageWidth, 0.75 * options.imageHeight);
+                drawPIDTable(cr, &worker->layers, worker->textCache, frameValues);
+            }
+            cairo_restore(cr);
+        }
 
-                for (i = 0; i < fieldMeta.numMotors; i++) {
-                    plotLine(cr, fieldMeta.motorColors[i], windowStartTime, windowEndTime, firstFrameIndex,
-                            flightLog->mainFieldIndexes.motor[i], motorCurve, motorGraphHeight);
+        if (options.drawCraft) {
+            cairo_save(cr);
+            {
+                if(options.craftTop != 0 && options.craftRight != 0) {
+                  cairo_translate(cr, options.imageWidth - options.craftRight, options.craftTop);
+                } else if(options.craftRight != 0) {
+                  cairo_translate(cr, options.imageWidth - options.craftRight, 0.20 * options.imageHeight);
+                } else if(options.craftTop != 0) {
+                  cairo_translate(cr, 0.75 * options.imageWidth, options.craftTop);
+                } else {
+                  cairo_translate(cr, 0.75 * options.imageWidth, 0.20 * options.imageHeight);
                 }
 
-                if (fieldMeta.numServos) {
-                    for (i = 0; i < MAX_SERVOS; i++) {
-                        if (flightLog->mainFieldIndexes.servo[i] > -1) {
-                            plotLine(cr, fieldMeta.servoColors[i], windowStartTime, windowEndTime, firstFrameIndex,
-                                flightLog->mainFieldIndexes.servo[i], motorCurve, motorGraphHeight);
-                        }
-                    }
+                //The props are drawn turning from where they were at the previous output frame
+                for (int motorIndex = 0; motorIndex < animation->craftParameters.numMotors; motorIndex++) {
+                    state->propAngles[motorIndex] = lookupPropPhase(motorIndex, windowCenterTime - timeElapsedMicros);
                 }
 
-                drawAxisLabel(cr, "Motors");
+                drawCraft(cr, &worker->layers, worker->textCache, state->propAngles, frameValues, timeElapsedMicros, &animation->craftParameters);
             }
             cairo_restore(cr);
         }
 
-        //Plot the lower PID graphs
-        cairo_save(cr);
-        {
-            if (options.plotPids) {
-                //Plot three axes as different graphs
-                cairo_translate(cr, 0, options.imageHeight * 0.60);
-                for (int axis = 0; axis < 3; axis++) {
-                    cairo_save(cr);
+        if (options.drawAcc) {
+          decideAccelerometerData(state, animation, outputFrameIndex);
+          drawAccelerometerData(cr, worker->textCache, state, frameValues);
+        }
 
-                    cairo_translate(cr, 0, options.imageHeight * 0.2 * (axis - 1));
-
-                    drawAxisLine(cr);
-
-                    for (int pidType = PID_D; pidType >= PID_P; pidType--) {
-                        if (flightLog->mainFieldIndexes.pid[pidType][axis] > -1) {
-                            switch (pidType) {
-                                case PID_P:
-                                    cairo_set_line_width(cr, 2);
-                                break;
-                                case PID_I:
-                                    cairo_set_dash(cr, DASHED_LINE, DASHED_LINE_NUM_POINTS, 0);
-                                    cairo_set_line_width(cr, 2);
-                                break;
-                                case PID_D:
-                                    cairo_set_dash(cr, DOTTED_LINE, DOTTED_LINE_NUM_POINTS, 0);
-                                    cairo_set_line_width(cr, 2);
-                            }
-
-                            plotLine(cr, fieldMeta.PIDAxisColors[pidType][axis], windowStartTime, windowEndTime, firstFrameIndex,
-                                    flightLog->mainFieldIndexes.pid[pidType][axis], pidCurve, (int) (options.imageHeight * 0.15));
-
-                            cairo_set_dash(cr, 0, 0, 0);
-                        }
-                    }
+        if (options.drawTime)
+            drawFrameLabel(cr, worker->textCache, frameValues[FLIGHT_LOG_FIELD_INDEX_ITERATION], (uint32_t) ((windowCenterTime - flightLog->stats.field[FLIGHT_LOG_FIELD_INDEX_TIME].min) / 1000));
+    }
 
-                    if (options.plotGyros) {
-                        cairo_set_line_width(cr, 3);
+    // Draw a synchronisation line
+    if (syncBeepTime >= windowStartTime && syncBeepTime < windowEndTime) {
+        double lineX = (double) ((int64_t) options.imageWidth * (syncBeepTime - windowStartTime) / windowWidthMicros);
 
-                        plotLine(cr, fieldMeta.gyroColors[axis], windowStartTime, windowEndTime, firstFrameIndex,
-                            flightLog->mainFieldIndexes.gyroADC[axis], gyroCurve, (int) (options.imageHeight * 0.15));
-                    }
+        cairo_set_source_rgba(cr, 0.25, 0.25, 1, 0.2);
+        cairo_set_line_width(cr, 20);
 
-                    const char *axisLabel;
-                    if (options.plotGyros) {
-                        switch (axis) {
-                            case 0:
-                                axisLabel = "Gyro + PID roll";
-                            break;
-                            case 1:
-                                axisLabel = "Gyro + PID pitch";
-                            break;
-                            case 2:
-                                axisLabel = "Gyro + PID yaw";
-                            break;
-                            default:
-                                axisLabel = "Unknown";
-                        }
-                    } else {
-                        switch (axis) {
-                            case 0:
-                                axisLabel = "Roll PIDs";
-                            break;
-                            case 1:
-                                axisLabel = "Pitch PIDs";
-                            break;
-                            case 2:
-                                axisLabel = "Yaw PIDs";
-                            break;
-                            default:
-                                axisLabel = "Unknown";
-                        }
-                    }
+        cairo_move_to(cr, lineX, 0);
+        cairo_line_to(cr, lineX, options.imageHeight);
+        cairo_stroke(cr);
+    }
 
-                    drawAxisLabel(cr, axisLabel);
+    cairo_destroy(cr);
 
-                    cairo_restore(cr);
-                }
-            } else if (options.plotGyros) {
-                //Plot three gyro axes on one graph
-                cairo_translate(cr, 0, options.imageHeight * 0.70);
+    return surface;
+}
+
+static void freeFontFace(void *face)
+{
+    FT_Done_Face((FT_Face) face);
+}
 
-                drawAxisLine(cr);
+static void* frameRenderWorkerRun(void *data)
+{
+    frameRenderWorker_t *worker = (frameRenderWorker_t *) data;
+    const animation_t *animation = worker->animation;
+
+    for (; worker->nextOutputFrameIndex < animation->drawEndFrame; worker->nextOutputFrameIndex += worker->threadCount * animation->frameStep) {
+        uint32_t outputFrameIndex = worker->nextOutputFrameIndex;
+        cairo_surface_t *surface = drawOutputFrame(worker, outputFrameIndex);
+
+        // Convert the frame before waiting for our turn, so the workers do the conversions side by side
+        if (videoWriter) {
+            cairo_surface_flush(surface);
+            videoWriterConvertFrame(videoWriter, cairo_image_surface_get_data(surface), cairo_image_surface_get_stride(surface), worker->videoFrame);
+            surfacePoolRelease(frameSurfacePool, surface);
+        }
 
-                for (int axis = 0; axis < 3; axis++) {
-                    plotLine(cr, fieldMeta.gyroColors[axis], windowStartTime, windowEndTime, firstFrameIndex,
-                            flightLog->mainFieldIndexes.gyroADC[axis], gyroCurve, (int) (options.imageHeight * 0.25));
-                }
+        // Frames are saved in order, so wait for the worker which drew the previous frame to save it first
+        semaphore_wait(&worker->outputTurn);
 
-                drawAxisLabel(cr, "Gyro");
+        if (videoWriter) {
+            if (!videoWriterWriteFrame(videoWriter, worker->videoFrame)) {
+                fprintf(stderr, "Failed to write frame %u to the video output: %s\n", outputFrameIndex, strerror(errno));
+                exit(-1);
             }
+        } else {
+            saveSurfaceAsync(surface, selectedLogIndex, outputFrameIndex);
         }
-        cairo_restore(cr);
 
-        //Draw a bar highlighting the current time if we are drawing any graphs
-        if (options.plotGyros || options.plotMotors || options.plotPids || options.plotPidSum) {
-            double centerX = options.imageWidth / 2.0;
+        uint32_t frameWrittenCount = (outputFrameIndex - animation->startFrame) / animation->frameStep + 1;
+        if (animation->outputFrames == 0) {
+            //We don't know how many there'll be yet
+            if (frameWrittenCount % 500 == 0) {
+                fprintf(stderr, "Rendered %d frames...\n", frameWrittenCount);
+            }
+        } else if (frameWrittenCount % 500 == 0 || frameWrittenCount == animation->outputFrames) {
+            fprintf(stderr, "Rendered %d frames (%.1f%%)%s\n",
+                frameWrittenCount, (double)frameWrittenCount / animation->outputFrames * 100,
+                frameWrittenCount < animation->outputFrames ? "..." : ".");
+        }
 
-            cairo_set_source_rgba(cr, 1, 0.25, 0.25, 0.2);
-            cairo_set_line_width(cr, 20);
+        semaphore_signal(worker->nextOutputTurn);
+    }
 
-            cairo_move_to(cr, centerX, 0);
-            cairo_line_to(cr, centerX, options.imageHeight);
-            cairo_stroke(cr);
+    return NULL;
+}
+
+/**
+ * Have the workers draw their frames up to the animation's drawEndFrame.
+ */
+static void runFrameRenderWorkers(frameRenderWorker_t *workers, int threadCount)
+{
+    thread_t *threads = malloc(threadCount * sizeof(*threads));
+
+    // The calling thread does the first share of the work itself
+    for (int i = 1; i < threadCount; i++) {
+        threads[i] = thread_create(frameRenderWorkerRun, &workers[i]);
+    }
+
+    frameRenderWorkerRun(&workers[0]);
+
+    for (int i = 1; i < threadCount; i++) {
+        thread_join(threads[i]);
+    }
+
+    free(threads);
+}
+
+/**
+ * Find the output frame just after the end of the log, for an animation which starts at the given log time.
+ */
+static uint32_t decideLogEndFrame(int64_t logStartTime)
+{
+    int64_t logDurationMicro = flightLog->stats.field[FLIGHT_LOG_FIELD_INDEX_TIME].max - logStartTime;
+
+    return (uint32_t) ((logDurationMicro * options.fps + (1000000 - 1)) / 1000000);
+}
+
+static uint32_t countOutputFrames(uint32_t startFrame, uint32_t endFrame, uint32_t frameStep)
+{
+    return startFrame < endFrame ? (endFrame - startFrame + frameStep - 1) / frameStep : 0;
+}
+
+static void computeExtraFields(derivedEngine_t *derived, int firstFrameIndex);
+
+/**
+ * Decode more of a streamed log, until a frame after the given time and the frames that it's smoothed with have been
+ * decoded (or the log ends). Then compute the fields of the new frames, and smooth them as far as we can.
+ */
+static void decodeStreamUntil(int64_t time)
+{
+    if (!logStream->complete) {
+        logStream->decodeUntil = time;
+        logStream->framesToGo = -1;
+
+        semaphore_signal(&logStream->decodeRequested);
+        semaphore_wait(&logStream->decodeDone);
+    }
+
+    computeExtraFields(logStream->derived, logStream->derivedFrameCount - points->discardedFrameCount);
+    logStream->derivedFrameCount = points->frameCount + points->discardedFrameCount;
+
+    for (int i = 0; i < logStream->smootherCount; i++) {
+        datapointsSmootherAdvance(&logStream->smoothers[i], points, logStream->complete);
+    }
+
+    if (options.drawCraft) {
+        computePropPhases(logStream->complete);
+    }
+}
+
+/**
+ * Discard the frames of a streamed log from before the given time, apart from the one just before it. Only frames which
+ * are done with being smoothed are discarded, and only a whole number of prop phase batches at a time (see
+ * lookupPropPhase()).
+ */
+static void discardFramesBefore(int64_t time)
+{
+    int count = datapointsFindFrameAtTime(points, time) - 1;
+
+    for (int i = 0; i < logStream->smootherCount; i++) {
+        if (count > logStream->smoothers[i].smoothedFrameCount - points->discardedFrameCount)
+            count = logStream->smoothers[i].smoothedFrameCount - points->discardedFrameCount;
+    }
+
+    if (options.drawCraft && count > propPhaseFrameCount - points->discardedFrameCount)
+        count = propPhaseFrameCount - points->discardedFrameCount;
+
+    count -= count % PROP_PHASE_CHECKPOINT_FRAMES;
+
+    if (count <= 0)
+        return;
+
+    if (frameAttitude) {
+        memmove(frameAttitude, frameAttitude + count, (points->frameCount - count) * sizeof(*frameAttitude));
+    }
+
+    datapointsDiscardFrames(points, count);
+}
+
+/**
+ * Draw the frames of an animation from a streamed log, a few seconds of them at a time. Before each run of frames, the
+ * part of the log that they show is decoded, and the part that's behind all of them is discarded.
+ */
+static void renderStreamedAnimation(animation_t *animation, frameRenderWorker_t *workers, int threadCount)
+{
+    const uint32_t chunkFrames = options.fps * STREAM_CHUNK_SECONDS;
+    //The stick trails and readouts show the output frames before each one as well
+    const int lookBehindFrames = (options.stickTrailLength > READOUT_HISTORY_FRAMES ? options.stickTrailLength : READOUT_HISTORY_FRAMES) + 1;
+
+    for (uint32_t chunkStart = animation->startFrame; chunkStart < animation->endFrame; chunkStart = animation->drawEndFrame) {
+        uint32_t chunkEnd = chunkStart + chunkFrames;
+        int64_t firstTime = outputFrameCenterTime(animation, (int64_t) chunkStart - lookBehindFrames);
+        int64_t firstWindowTime = outputFrameCenterTime(animation, chunkStart) - RENDER_WINDOW_WIDTH_MICROS / 2
+            - (int64_t) 2 * GRAPH_LINE_OVERHANG * RENDER_WINDOW_WIDTH_MICROS / options.imageWidth - 1;
+
+        if (firstWindowTime < firstTime)
+            firstTime = firstWindowTime;
+
+        //Skip through the log up to the frames this run needs (if it starts later on) without keeping what's before them
+        while (!logStream->complete && points->frameCount > 0 && points->frameTime[points->frameCount - 1] < firstTime) {
+            int64_t skipTo = points->frameTime[points->frameCount - 1] + STREAM_CHUNK_SECONDS * 1000000;
+
+            decodeStreamUntil(skipTo < firstTime ? skipTo : firstTime);
+            discardFramesBefore(firstTime);
         }
 
-        int centerFrameIndex = datapointsFindFrameAtTime(points, windowCenterTime);
+        discardFramesBefore(firstTime);
 
-        //Draw the command stick positions from the centered frame
-        if (datapointsGetFrameAtIndex(points, centerFrameIndex, &frameTime, frameValues)) {
-            if (options.drawSticks) {
-                cairo_save(cr);
-                {
-
-                    if(options.sticksTop != 0 && options.sticksRight != 0) {
-                      cairo_translate(cr, options.imageWidth - options.sticksRight, options.sticksTop);
-                    } else if(options.sticksRight != 0) {
-                      cairo_translate(cr, options.imageWidth - options.sticksRight, 0.20 * options.imageHeight);
-                    } else if(options.sticksTop != 0) {
-                      cairo_translate(cr, 0.75 * options.imageWidth, options.sticksTop);
-                    } else {
-                      cairo_translate(cr, 0.75 * options.imageWidth, 0.20 * options.imageHeight);
-                    }
+        decodeStreamUntil(outputFrameCenterTime(animation, chunkEnd) + RENDER_WINDOW_WIDTH_MICROS / 2);
+
+        if (logStream->complete && animation->endFrame == (uint32_t) -1) {
+            animation->endFrame = decideLogEndFrame(animation->logStartTime);
+            animation->outputFrames = countOutputFrames(animation->startFrame, animation->endFrame, animation->frameStep);
+
+            fprintf(stderr, "Decoded the whole log, %u frames to be rendered\n", animation->outputFrames);
+        }
+
+        if (chunkEnd > animation->endFrame)
+            chunkEnd = animation->endFrame;
+
+        if (chunkEnd <= chunkStart)
+            break;
+
+        //The workers' cursors and the pyramids point at frames by their index, which discarding frames changes
+        for (int i = 0; i < threadCount; i++) {
+            datapointsCursorInit(&workers[i].state.firstFrameCursor);
+            datapointsCursorInit(&workers[i].state.centerFrameCursor);
+        }
+
+        destroyFieldPyramids();
+        createFieldPyramids();
+
+        animation->drawEndFrame = chunkEnd;
+        runFrameRenderWorkers(workers, threadCount);
+    }
+}
+
+void renderAnimation(uint32_t startFrame, uint32_t endFrame)
+{
+    int64_t logStartTime = flightLog->stats.field[FLIGHT_LOG_FIELD_INDEX_TIME].min;
+
+    uint32_t outputFrames;
+
+    animation_t animation;
+
+    int threadCount;
+    frameRenderWorker_t *workers;
+
+    //If sync beep time looks reasonable, start the log there instead of at the first frame
+    if (abs((int) ((int64_t)syncBeepTime - logStartTime)) < 1000000) //Expected to be well within 1 second of the start
+        logStartTime = syncBeepTime;
+
+    //A streamed log's end is found once it has all been decoded (see renderStreamedAnimation())
+    if (endFrame == (uint32_t) -1 && (!logStream || logStream->complete)) {
+        endFrame = decideLogEndFrame(logStartTime);
+    }
+
+    //Every frame can be drawn on its own, so each shard can take its own run of the frames
+    if (options.shardCount > 1) {
+        uint64_t totalFrames = endFrame - startFrame;
+        uint32_t shardStart = startFrame + (uint32_t) (totalFrames * options.shardIndex / options.shardCount);
+
+        endFrame = startFrame + (uint32_t) (totalFrames * (options.shardIndex + 1) / options.shardCount);
+        startFrame = shardStart;
+
+        fprintf(stderr, "Rendering shard %d of %d (frames %u to %u)\n", options.shardIndex + 1, options.shardCount, startFrame, endFrame);
+    }
+
+    outputFrames = endFrame != (uint32_t) -1 ? endFrame - startFrame : 0;
+
+    decideCraftParameters(&animation.craftParameters, options.imageWidth, options.imageHeight);
+
+    //Exaggerate values around the origin and compress values near the edges:
+    pitchStickCurve = expoCurveCreate(0, 0.700, 500 * (flightLog->sysConfig.rcRate ? flightLog->sysConfig.rcRate : 100) / 100, 1.0, 10);
+
+    gyroCurve = expoCurveCreate(0, 0.2, 9.0e-6 / flightLog->sysConfig.gyroScale, 1.0, 10);
+    accCurve = expoCurveCreate(0, 0.7, 5000, 1.0, 10);
+    pidCurve = expoCurveCreate(0, 0.7, 500, 1.0, 10);
+
+    motorCurve = expoCurveCreate(-(flightLog->sysConfig.motorOutputHigh + flightLog->sysConfig.motorOutputLow) / 2, 1.0,
+            (flightLog->sysConfig.motorOutputHigh - flightLog->sysConfig.motorOutputLow) / 2, 1.0, 2);
+
+    // Default Servo range is [1020...2000] but we'll just use [1000...2000] for simplicity
+    servoCurve = expoCurveCreate(-1500, 1.0, 1000, 1.0, 2);
+
+    int durationSecs = (outputFrames + (options.fps - 1)) / (options.fps);
+    int durationMins = durationSecs / 60;
+    durationSecs %= 60;
+
+    if (endFrame != (uint32_t) -1) {
+        fprintf(stderr, "%d frames to be rendered at %d FPS [%d:%02d]\n", outputFrames, options.fps, durationMins, durationSecs);
+    } else {
+        fprintf(stderr, "Rendering at %d FPS while the log is decoded\n", options.fps);
+    }
+
+    animation.frameStep = options.draft ? options.draftFrameStep : 1;
+
+    if (options.draft) {
+        //Draft the same frames wherever the render starts, so drafts of different parts of the log line up
+        startFrame = (startFrame + animation.frameStep - 1) / animation.frameStep * animation.frameStep;
+
+        if (endFrame != (uint32_t) -1) {
+            outputFrames = countOutputFrames(startFrame, endFrame, animation.frameStep);
+
+            fprintf(stderr, "Drafting %u of them (every %u) at %dx%d\n", outputFrames, animation.frameStep, frameWidth, frameHeight);
+        } else {
+            fprintf(stderr, "Drafting every %u frames at %dx%d\n", animation.frameStep, frameWidth, frameHeight);
+        }
+    }
+
+    fprintf(stderr, "\n");
+
+    animation.startFrame = startFrame;
+    animation.endFrame = endFrame;
+    animation.outputFrames = outputFrames;
+    animation.logStartTime = logStartTime;
+
+    //A streamed log's prop phases and pyramids are built a piece at a time as it's decoded, and since its pyramids
+    //only cover the part of the log that's been decoded, its graphs can't be fitted to the whole log
+    if (!logStream) {
+        if (options.drawCraft) {
+            computePropPhases(true);
+        }
+
+        createFieldPyramids();
+    }
+
+    decideGraphs();
+
+    threadCount = options.threads;
 
-                    drawCommandSticks(frameValues, options.imageWidth, options.imageHeight, cr);
-                }
-                cairo_restore(cr);
-            }
+    if (endFrame != (uint32_t) -1 && (uint32_t) threadCount > outputFrames)
+        threadCount = outputFrames;
+    if (threadCount < 1)
+        threadCount = 1;
 
-            if (options.drawPidTable) {
-                cairo_save(cr);
-                {
-                    cairo_translate(cr, 0.25 * options.imageWidth, 0.75 * options.imageHeight);
-                    drawPIDTable(cr, frameValues);
-                }
-                cairo_restore(cr);
-            }
+    frameSurfacePool = surfacePoolCreate(frameWidth, frameHeight);
 
-            if (options.drawCraft) {
-                cairo_save(cr);
-                {
-                    if(options.craftTop != 0 && options.craftRight != 0) {
-                      cairo_translate(cr, options.imageWidth - options.craftRight, options.craftTop);
-                    } else if(options.craftRight != 0) {
-                      cairo_translate(cr, options.imageWidth - options.craftRight, 0.20 * options.imageHeight);
-                    } else if(options.craftTop != 0) {
-                      cairo_translate(cr, 0.75 * options.imageWidth, options.craftTop);
-                    } else {
-                      cairo_translate(cr, 0.75 * options.imageWidth, 0.20 * options.imageHeight);
-                    }
+    workers = calloc(threadCount, sizeof(*workers));
 
-                    drawCraft(cr, frameValues, outputFrameIndex > 0 ? windowCenterTime - lastCenterTime : 0, &craftParameters);
-                }
-                cairo_restore(cr);
-            }
+    for (int i = 0; i < threadCount; i++) {
+        frameRenderWorker_t *worker = &workers[i];
 
-            if (options.drawAcc) {
-              drawAccelerometerData(cr, frameValues);
-            }
+        worker->animation = &animation;
+        worker->threadIndex = i;
+        worker->threadCount = threadCount;
+        worker->nextOutputFrameIndex = startFrame + i * animation.frameStep;
 
-            if (options.drawTime)
-                drawFrameLabel(cr, frameValues[FLIGHT_LOG_FIELD_INDEX_ITERATION], (uint32_t) ((windowCenterTime - flightLog->stats.field[FLIGHT_LOG_FIELD_INDEX_TIME].min) / 1000));
-        }
+        worker->state.stickTrails[0] = malloc(options.stickTrailLength * sizeof(point_t));
+        worker->state.stickTrails[1] = malloc(options.stickTrailLength * sizeof(point_t));
 
-        // Draw a synchronisation line
-        if (syncBeepTime >= windowStartTime && syncBeepTime < windowEndTime) {
-            double lineX = (double) ((int64_t) options.imageWidth * (syncBeepTime - windowStartTime) / windowWidthMicros);
+        datapointsCursorInit(&worker->state.firstFrameCursor);
+        datapointsCursorInit(&worker->state.centerFrameCursor);
 
-            cairo_set_source_rgba(cr, 0.25, 0.25, 1, 0.2);
-            cairo_set_line_width(cr, 20);
+        if (videoWriter) {
+            worker->videoFrame = malloc(videoWriterFrameSize(videoWriter));
+        }
 
-            cairo_move_to(cr, lineX, 0);
-            cairo_line_to(cr, lineX, options.imageHeight);
-            cairo_stroke(cr);
+        // FreeType faces can't be shared between threads, so each worker gets its own
+        if (FT_New_Memory_Face(freetypeLibrary, (const FT_Byte*)SourceSansPro_Regular_otf, SourceSansPro_Regular_otf_len, 0, &worker->ftFace)) {
+            fprintf(stderr, "Failed to load font file\n");
+            exit(-1);
         }
+        worker->fontFace = cairo_ft_font_face_create_for_ft_face(worker->ftFace, 0);
 
-        cairo_destroy(cr);
+        // Cairo may hold on to the font face after we're done with it, so let it free the FreeType face too
+        cairo_font_face_set_user_data(worker->fontFace, &ftFaceKey, worker->ftFace, freeFontFace);
 
-        lastCenterTime = windowCenterTime;
+        worker->textCache = textCacheCreate();
 
-        saveSurfaceAsync(surface, selectedLogIndex, outputFrameIndex);
+        // The first worker draws the first frame, so it may save it right away
+        semaphore_create(&worker->outputTurn, i == 0 ? 1 : 0);
+        worker->nextOutputTurn = &workers[(i + 1) % threadCount].outputTurn;
+    }
 
-        uint32_t frameWrittenCount = outputFrameIndex - startFrame + 1;
-        if (frameWrittenCount % 500 == 0 || frameWrittenCount == outputFrames) {
-            fprintf(stderr, "Rendered %d frames (%.1f%%)%s\n",
-                frameWrittenCount, (double)frameWrittenCount / outputFrames * 100,
-                frameWrittenCount < outputFrames ? "..." : ".");
-        }
+    if (logStream) {
+        renderStreamedAnimation(&animation, workers, threadCount);
+    } else {
+        animation.drawEndFrame = endFrame;
+        runFrameRenderWorkers(workers, threadCount);
     }
 
     waitForFramesToSave();
+
+    for (int i = 0; i < threadCount; i++) {
+        semaphore_destroy(&workers[i].outputTurn);
+        destroyStaticLayers(&workers[i].layers);
+        destroyGraphStrips(workers[i].graphStrips);
+        textCacheDestroy(workers[i].textCache);
+        cairo_font_face_destroy(workers[i].fontFace);
+        free(workers[i].state.stickTrails[0]);
+        free(workers[i].state.stickTrails[1]);
+        free(workers[i].videoFrame);
+    }
+
+    free(workers);
+
+    surfacePoolDestroy(frameSurfacePool);
+    frameSurfacePool = NULL;
+
+    freePropPhases();
+    destroyFieldPyramids();
 }
 
 void printUsage(const char *argv0)
@@ -1428,8 +2893,38 @@ void printUsage(const char *argv0)
         "   --fps                  FPS of the resulting video (default %d)\n"
         "   --threads              Number of threads to use to render frames (default %d)\n"
         "   --prefix <filename>    Set the prefix of the output frame filenames\n"
+        "   --output-format <name> Save the frames as \"png\" files, or stream them as an uncompressed\n"
+        "                          \"y4m\" video or \"bgra\" pixels for a video encoder (default %s)\n"
+        "   --output <filename>    File or pipe to stream the y4m or bgra video to (default stdout)\n"
+        "   --png-compression <n>  zlib compression level of the png frames, from 0 (fastest, no\n"
+        "                          compression) to 9 (smallest) (default %d)\n"
+        "   --png-filter <name>    Row filter for the png frames, \"none\" (fastest), \"sub\", \"up\",\n"
+        "                          \"average\", \"paeth\" or \"adaptive\" (default %s)\n"
+        "   --png-reduce           Save png frames with few colors (like transparent overlays) with\n"
+        "                          a palette, or as greyscale, when that keeps every pixel exact\n"
+        "   --png-threads <n>      Number of threads that compress each png frame (default %d)\n",
+        argv0, defaultOptions.imageWidth, defaultOptions.imageHeight, defaultOptions.fps, defaultOptions.threads,
+            OUTPUT_FORMAT_NAME[defaultOptions.outputFormat],
+            defaultOptions.png.compressionLevel, PNG_FILTER_NAME[defaultOptions.png.filter], defaultOptions.png.threadCount
+    );
+
+    // Split in two to keep each string within the length that every compiler supports
+    fprintf(stderr,
+        "   --cache-dir <dir>      Save the decoded log in this directory, or reuse it if it was already\n"
+        "                          saved for the same log and smoothing options\n"
         "   --start <x:xx>         Begin the log at this time offset (default 0:00)\n"
         "   --end <x:xx>           End the log at this time offset\n"
+        "   --shard <i/n>          Render only the i'th of n equal parts of the frames, so that separate\n"
+        "                          renders can share the work (e.g. 1/4 to 4/4)\n"
+        "   --keyframe-interval <n>  Draw the graphs in full on the first frame of every n, and scroll\n"
+        "                          them along for the frames in between (default %d, 1 to never scroll)\n"
+        "   --draft                Quickly preview the layout: draw smaller frames without antialiasing\n"
+        "                          or smoothing, and only every few frames\n"
+        "   --draft-scale <x>      Size of the draft frames compared to the full size (default %g)\n"
+        "   --draft-step <n>       Draft only every n'th frame (default %d)\n"
+        "   --stream               Decode the log a few seconds ahead of the frames being drawn, so the\n"
+        "                          first frames come out straight away and memory use stays the same\n"
+        "                          however long the log is\n"
         "   --[no-]draw-pid-table  Show table with PIDs and gyros (default on)\n"
         "   --[no-]draw-craft      Show craft drawing (default on)\n"
         "   --[no-]draw-sticks     Show RC command sticks (default on)\n"
@@ -1448,6 +2943,9 @@ void printUsage(const char *argv0)
         "   --smoothing-pid <n>    Smoothing window for the PIDs (default %d)\n"
         "   --smoothing-gyro <n>   Smoothing window for the gyroscopes (default %d)\n"
         "   --smoothing-motor <n>  Smoothing window for the motors (default %d)\n"
+        "   --smoothing-filter <name>  Smoothing filter to use for those windows, \"average\", \"gaussian\",\n"
+        "                          or \"lowpass\" or \"filtfilt\" at the cutoff frequency (default %s)\n"
+        "   --smoothing-cutoff <hz>  Cutoff frequency of the low-pass smoothing filters (default %g)\n"
         "   --unit-gyro <raw|degree>  Unit for the gyro values in the table (default %s)\n"
         "   --prop-style <name>    Style of propeller display (pie/blades, default %s)\n"
         "   --gapless              Fill in gaps in the log with straight lines\n"
@@ -1458,8 +2956,8 @@ void printUsage(const char *argv0)
         "   --sticks-cross-color   Set the RGBA sticks crosshair color (default 0.75,0.75,0.75,0.5)\n"
         "   --sticks-trail-length <px> Length of the stick trails (default %d)\n"
         "   --sticks-trail-color   Set the RGBA stick trail color (default 1.0,1.0,1.0,1.0)\n"
-        "\n", argv0, defaultOptions.imageWidth, defaultOptions.imageHeight, defaultOptions.fps, defaultOptions.threads,
-            defaultOptions.pidSmoothing, defaultOptions.gyroSmoothing, defaultOptions.motorSmoothing,
+        "\n", defaultOptions.keyframeInterval, defaultOptions.draftScale, defaultOptions.draftFrameStep, defaultOptions.pidSmoothing, defaultOptions.gyroSmoothing, defaultOptions.motorSmoothing,
+            FILTER_TYPE_NAME[defaultOptions.smoothingFilter], defaultOptions.smoothingCutoff,
             UNIT_NAME[defaultOptions.gyroUnit], PROP_STYLE_NAME[defaultOptions.propStyle], defaultOptions.stickTrailLength
     );
 }
@@ -1502,6 +3000,37 @@ bool parseFrameTime(const char *text, uint32_t *frameTime)
     return true;
 }
 
+bool parseOutputFormat(const char *text, OutputFormat *format)
+{
+    for (int i = 0; i < (int) (sizeof(OUTPUT_FORMAT_NAME) / sizeof(OUTPUT_FORMAT_NAME[0])); i++) {
+        if (strcmp(text, OUTPUT_FORMAT_NAME[i]) == 0) {
+            *format = (OutputFormat) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Parse a shard given as "i/n" (where i counts from 1) into a zero-based index and a count.
+ *
+ * Returns false if the text isn't a valid shard.
+ */
+bool parseShard(const char *text, int *shardIndex, int *shardCount)
+{
+    int index, count;
+    char trailing;
+
+    if (sscanf(text, "%d/%d%c", &index, &count, &trailing) != 2 || count < 1 || index < 1 || index > count)
+        return false;
+
+    *shardIndex = index - 1;
+    *shardCount = count;
+
+    return true;
+}
+
 bool parseTextColor(const char *text, colorAlpha_t *color) {
   int counter = 0;
   const char *cur;
@@ -1554,6 +3083,8 @@ void parseCommandlineOptions(int argc, char **argv)
         SETTING_SMOOTHING_PID,
         SETTING_SMOOTHING_GYRO,
         SETTING_SMOOTHING_MOTOR,
+        SETTING_SMOOTHING_FILTER,
+        SETTING_SMOOTHING_CUTOFF,
         SETTING_UNIT_GYRO,
         SETTING_PROP_STYLE,
         SETTING_THREADS,
@@ -1571,6 +3102,17 @@ void parseCommandlineOptions(int argc, char **argv)
         SETTING_CRAFT_WIDTH,
         SETTING_STICK_RADIUS,
         SETTING_STICK_TRAIL_RADIUS,
+        SETTING_CACHE_DIR,
+        SETTING_SHARD,
+        SETTING_OUTPUT_FORMAT,
+        SETTING_OUTPUT,
+        SETTING_PNG_COMPRESSION,
+        SETTING_PNG_FILTER,
+        SETTING_PNG_REDUCE,
+        SETTING_PNG_THREADS,
+        SETTING_KEYFRAME_INTERVAL,
+        SETTING_DRAFT_SCALE,
+        SETTING_DRAFT_STEP,
     };
 
     memcpy(&options, &defaultOptions, sizeof(options));
@@ -1605,6 +3147,8 @@ void parseCommandlineOptions(int argc, char **argv)
             {"smoothing-pid", required_argument, 0, SETTING_SMOOTHING_PID},
             {"smoothing-gyro", required_argument, 0, SETTING_SMOOTHING_GYRO},
             {"smoothing-motor", required_argument, 0, SETTING_SMOOTHING_MOTOR},
+            {"smoothing-filter", required_argument, 0, SETTING_SMOOTHING_FILTER},
+            {"smoothing-cutoff", required_argument, 0, SETTING_SMOOTHING_CUTOFF},
             {"unit-gyro", required_argument, 0, SETTING_UNIT_GYRO},
             {"prop-style", required_argument, 0, SETTING_PROP_STYLE},
             {"threads", required_argument, 0, SETTING_THREADS},
@@ -1624,6 +3168,19 @@ void parseCommandlineOptions(int argc, char **argv)
             {"craft-width", required_argument, 0, SETTING_CRAFT_WIDTH},
             {"sticks-radius", required_argument, 0, SETTING_STICK_RADIUS},
             {"sticks-trail-radius", required_argument, 0, SETTING_STICK_TRAIL_RADIUS},
+            {"cache-dir", required_argument, 0, SETTING_CACHE_DIR},
+            {"shard", required_argument, 0, SETTING_SHARD},
+            {"output-format", required_argument, 0, SETTING_OUTPUT_FORMAT},
+            {"output", required_argument, 0, SETTING_OUTPUT},
+            {"png-compression", required_argument, 0, SETTING_PNG_COMPRESSION},
+            {"png-filter", required_argument, 0, SETTING_PNG_FILTER},
+            {"png-reduce", no_argument, 0, SETTING_PNG_REDUCE},
+            {"png-threads", required_argument, 0, SETTING_PNG_THREADS},
+            {"keyframe-interval", required_argument, 0, SETTING_KEYFRAME_INTERVAL},
+            {"draft", no_argument, &options.draft, 1},
+            {"draft-scale", required_argument, 0, SETTING_DRAFT_SCALE},
+            {"draft-step", required_argument, 0, SETTING_DRAFT_STEP},
+            {"stream", no_argument, &options.stream, 1},
             {0, 0, 0, 0}
         };
 
@@ -1647,6 +3204,64 @@ void parseCommandlineOptions(int argc, char **argv)
                     exit(-1);
                 }
             break;
+            case SETTING_OUTPUT_FORMAT:
+                if (!parseOutputFormat(optarg, &options.outputFormat)) {
+                    fprintf(stderr, "Unknown output format '%s'\n", optarg);
+                    exit(-1);
+                }
+            break;
+            case SETTING_OUTPUT:
+                options.outputFilename = optarg;
+            break;
+            case SETTING_PNG_COMPRESSION:
+                options.png.compressionLevel = atoi(optarg);
+                if (options.png.compressionLevel < 0 || options.png.compressionLevel > 9) {
+                    fprintf(stderr, "Bad --png-compression level, expected 0 to 9\n");
+                    exit(-1);
+                }
+            break;
+            case SETTING_PNG_FILTER:
+                if (!pngFilterParse(optarg, &options.png.filter)) {
+                    fprintf(stderr, "Unknown png filter '%s'\n", optarg);
+                    exit(-1);
+                }
+            break;
+            case SETTING_PNG_REDUCE:
+                options.png.reduceColors = true;
+            break;
+            case SETTING_PNG_THREADS:
+                options.png.threadCount = atoi(optarg);
+                if (options.png.threadCount < 1) {
+                    options.png.threadCount = 1;
+                }
+            break;
+            case SETTING_KEYFRAME_INTERVAL:
+                options.keyframeInterval = atoi(optarg);
+                if (options.keyframeInterval < 1) {
+                    fprintf(stderr, "Bad --keyframe-interval, expected a number of frames of 1 or more\n");
+                    exit(-1);
+                }
+            break;
+            case SETTING_DRAFT_SCALE:
+                options.draftScale = atof(optarg);
+                if (!(options.draftScale > 0 && options.draftScale <= 1)) {
+                    fprintf(stderr, "Bad --draft-scale, expected a scale greater than 0 and at most 1\n");
+                    exit(-1);
+                }
+            break;
+            case SETTING_DRAFT_STEP:
+                options.draftFrameStep = atoi(optarg);
+                if (options.draftFrameStep < 1) {
+                    fprintf(stderr, "Bad --draft-step, expected a number of frames of 1 or more\n");
+                    exit(-1);
+                }
+            break;
+            case SETTING_SHARD:
+                if (!parseShard(optarg, &options.shardIndex, &options.shardCount))  {
+                    fprintf(stderr, "Bad --shard value, expected a shard number and count like 1/4\n");
+                    exit(-1);
+                }
+            break;
             case SETTING_STICKS_TEXT_COLOR:
                 if (!parseTextColor(optarg, &options.sticksTextColor))  {
                     fprintf(stderr, "Bad --sticks-text-color color value\n");
@@ -1698,6 +3313,19 @@ void parseCommandlineOptions(int argc, char **argv)
             case SETTING_SMOOTHING_MOTOR:
                 options.motorSmoothing = atoi(optarg);
             break;
+            case SETTING_SMOOTHING_FILTER:
+                if (!filterTypeParse(optarg, &options.smoothingFilter)) {
+                    fprintf(stderr, "Unknown smoothing filter '%s'\n", optarg);
+                    exit(-1);
+                }
+            break;
+            case SETTING_SMOOTHING_CUTOFF:
+                options.smoothingCutoff = atof(optarg);
+                if (options.smoothingCutoff <= 0) {
+                    fprintf(stderr, "Bad --smoothing-cutoff value\n");
+                    exit(-1);
+                }
+            break;
             case SETTING_UNIT_GYRO:
                 options.gyroUnit = parseUnit(optarg);
             break;
@@ -1729,6 +3357,9 @@ void parseCommandlineOptions(int argc, char **argv)
             case SETTING_STICK_RADIUS:
                 options.stickRadius = atoi(optarg);
             break;
+            case SETTING_CACHE_DIR:
+                options.cacheDirectory = optarg;
+            break;
             case SETTING_STICK_TRAIL_RADIUS:
                 options.stickTrailRadius = atoi(optarg);
             break;
@@ -1765,84 +3396,254 @@ void parseCommandlineOptions(int argc, char **argv)
     if (optind < argc) {
         options.filename = argv[optind];
     }
+
+    if (options.draft) {
+        //Smoothing doesn't change the layout, so a draft can do without it
+        options.pidSmoothing = 0;
+        options.gyroSmoothing = 0;
+        options.motorSmoothing = 0;
+
+        frameScale = options.draftScale;
+    } else {
+        frameScale = 1;
+    }
+
+    if (options.stream) {
+        if (options.cacheDirectory) {
+            fprintf(stderr, "--stream can't be used with --cache-dir, since the whole log is never decoded at once\n");
+            exit(-1);
+        }
+
+        if (options.shardCount > 1) {
+            fprintf(stderr, "--stream can't be used with --shard, since the length of the log isn't known until it has been decoded\n");
+            exit(-1);
+        }
+
+        //The low-pass filters depend on the rate of each whole run of the log between gaps
+        if ((options.pidSmoothing || options.gyroSmoothing || options.motorSmoothing)
+                && options.smoothingFilter != FILTER_TYPE_MOVING_AVERAGE && options.smoothingFilter != FILTER_TYPE_GAUSSIAN) {
+            fprintf(stderr, "--stream can only smooth with the \"average\" or \"gaussian\" filters\n");
+            exit(-1);
+        }
+    }
+
+    frameWidth = (int) ceil(options.imageWidth * frameScale);
+    frameHeight = (int) ceil(options.imageHeight * frameScale);
 }
 
-static void applySmoothing() {
+typedef struct smoothingJob_t {
+    int fieldIndex;
+    filterSettings_t filter;
+} smoothingJob_t;
+
+typedef struct smoothingWorker_t {
+    const smoothingJob_t *jobs;
+    int jobCount;
+
+    // This worker takes every threadCount'th job, starting from threadIndex
+    int threadIndex, threadCount;
+} smoothingWorker_t;
+
+static void* smoothingWorkerRun(void *data)
+{
+    smoothingWorker_t *worker = (smoothingWorker_t *) data;
+
+    for (int i = worker->threadIndex; i < worker->jobCount; i += worker->threadCount) {
+        datapointsFilterField(points, worker->jobs[i].fieldIndex, &worker->jobs[i].filter);
+    }
+
+    return NULL;
+}
+
+static void addSmoothingJob(smoothingJob_t *jobs, int *jobCount, int fieldIndex, int radius)
+{
+    smoothingJob_t *job = &jobs[(*jobCount)++];
+
+    job->fieldIndex = fieldIndex;
+    job->filter.type = options.smoothingFilter;
+    job->filter.radius = radius;
+    job->filter.cutoffFrequency = options.smoothingCutoff;
+}
+
+/**
+ * Decide which fields to smooth (the gyro, PID and motor fields) and how, and return the number of jobs stored into
+ * `jobs`, which must have room for MAX_SMOOTHING_JOBS.
+ */
+static int decideSmoothingJobs(smoothingJob_t *jobs)
+{
+    int jobCount = 0;
+
     if (options.gyroSmoothing && fieldMeta.hasGyros) {
         for (int axis = 0; axis < 3; axis++)
-            datapointsSmoothField(points, flightLog->mainFieldIndexes.gyroADC[axis], options.gyroSmoothing);
+            addSmoothingJob(jobs, &jobCount, flightLog->mainFieldIndexes.gyroADC[axis], options.gyroSmoothing);
     }
 
     if (options.pidSmoothing && fieldMeta.hasPIDs) {
         for (int pid = PID_P; pid <= PID_D; pid++)
             for (int axis = 0; axis < 3; axis++)
                 if (flightLog->mainFieldIndexes.pid[pid][axis] > -1)
-                    datapointsSmoothField(points, flightLog->mainFieldIndexes.pid[pid][axis], options.pidSmoothing);
+                    addSmoothingJob(jobs, &jobCount, flightLog->mainFieldIndexes.pid[pid][axis], options.pidSmoothing);
 
         //Smooth the synthetic PID sum field too
         for (int axis = 0; axis < 3; axis++)
-            datapointsSmoothField(points, fieldMeta.axisPIDSum[axis], options.pidSmoothing);
+            addSmoothingJob(jobs, &jobCount, fieldMeta.axisPIDSum[axis], options.pidSmoothing);
     }
 
     if (options.motorSmoothing) {
         for (int motor = 0; motor < fieldMeta.numMotors; motor++)
-            datapointsSmoothField(points, flightLog->mainFieldIndexes.motor[motor], options.motorSmoothing);
+            addSmoothingJob(jobs, &jobCount, flightLog->mainFieldIndexes.motor[motor], options.motorSmoothing);
     }
+
+    return jobCount;
 }
 
-void computeExtraFields(void) {
-    int16_t accSmooth[3], gyroADC[3], magADC[3];
-    int64_t frameTime, lastFrameTime = 0;
-    int32_t frameIndex;
-    int64_t frame[FLIGHT_LOG_MAX_FIELDS];
-    double cumulativeCurrent = 0.0; // in milliamp-hours
-    attitude_t attitude;
-    bool calculateAttitude = fieldMeta.hasGyros && fieldMeta.hasAccs && flightLog->sysConfig.acc_1G;
+/**
+ * Smooth the gyro, PID and motor fields. Each field is stored separately, so they're smoothed in parallel.
+ */
+static void applySmoothing() {
+    smoothingJob_t jobs[MAX_SMOOTHING_JOBS];
+    int jobCount = decideSmoothingJobs(jobs);
 
-    imuInit();
+    smoothingWorker_t *workers;
+    thread_t *threads;
+    int threadCount;
 
-    for (frameIndex = 0; frameIndex < points->frameCount; frameIndex++) {
-        if (datapointsGetFrameAtIndex(points, frameIndex, &frameTime, frame)) {
-            if (calculateAttitude) {
-                for (int axis = 0; axis < 3; axis++) {
-                    accSmooth[axis] = frame[flightLog->mainFieldIndexes.accSmooth[axis]];
-                    gyroADC[axis] = frame[flightLog->mainFieldIndexes.gyroADC[axis]];
-                }
+    threadCount = options.threads < jobCount ? options.threads : jobCount;
 
-                if (fieldMeta.hasMagADC) {
-                    for (int axis = 0; axis < 3; axis++) {
-                        magADC[axis] = frame[flightLog->mainFieldIndexes.magADC[axis]];
-                    }
-                }
+    if (threadCount < 1)
+        return;
 
-                updateEstimatedAttitude(gyroADC, accSmooth, fieldMeta.hasMagADC ? magADC : 0, (uint32_t) frameTime, flightLog->sysConfig.acc_1G, flightLog->sysConfig.gyroScale, &attitude);
+    workers = malloc(threadCount * sizeof(*workers));
+    threads = malloc(threadCount * sizeof(*threads));
 
-                //Pack those floats into signed ints to store into the datapoints array:
-                datapointsSetFieldAtIndex(points, frameIndex, fieldMeta.roll, floatToInt(attitude.roll));
-                datapointsSetFieldAtIndex(points, frameIndex, fieldMeta.pitch, floatToInt(attitude.pitch));
-                datapointsSetFieldAtIndex(points, frameIndex, fieldMeta.heading, floatToInt(attitude.heading));
-            }
+    for (int i = 0; i < threadCount; i++) {
+        workers[i].jobs = jobs;
+        workers[i].jobCount = jobCount;
+        workers[i].threadIndex = i;
+        workers[i].threadCount = threadCount;
+    }
 
-            if (fieldMeta.hasPIDs) {
-                for (int axis = 0; axis < 3; axis++) {
-                    int32_t pidSum = frame[flightLog->mainFieldIndexes.pid[PID_P][axis]] + frame[flightLog->mainFieldIndexes.pid[PID_I][axis]] + frame[flightLog->mainFieldIndexes.pid[PID_D][axis]];
+    // The calling thread does the first share of the work itself
+    for (int i = 1; i < threadCount; i++) {
+        threads[i] = thread_create(smoothingWorkerRun, &workers[i]);
+    }
 
-                    datapointsSetFieldAtIndex(points, frameIndex, fieldMeta.axisPIDSum[axis], pidSum);
-                }
+    smoothingWorkerRun(&workers[0]);
+
+    for (int i = 1; i < threadCount; i++) {
+        thread_join(threads[i]);
+    }
+
+    free(workers);
+    free(threads);
+}
+
+/**
+ * Create the engine which computes the derived fields that we show.
+ */
+static derivedEngine_t* createExtraFieldsEngine(void)
+{
+    derivedSettings_t settings;
+    bool requested[DERIVED_CHANNEL_COUNT] = {false};
+
+    derivedSettingsInit(&settings, flightLog);
+
+    requested[DERIVED_CHANNEL_ROLL] = fieldMeta.hasGyros && fieldMeta.hasAccs;
+    requested[DERIVED_CHANNEL_PITCH] = requested[DERIVED_CHANNEL_ROLL];
+    requested[DERIVED_CHANNEL_HEADING] = requested[DERIVED_CHANNEL_ROLL];
+
+    for (int axis = 0; axis < 3; axis++) {
+        requested[DERIVED_CHANNEL_AXIS_PID_SUM_ROLL + axis] = fieldMeta.hasPIDs;
+    }
+
+    requested[DERIVED_CHANNEL_ENERGY_CUMULATIVE] = fieldMeta.cumulativeCurrent > -1;
+
+    return derivedEngineCreate(flightLog, &settings, requested, DERIVED_BATCH_FRAMES);
+}
+
+/**
+ * Compute the derived fields for the frames of the points from firstFrameIndex onwards, carrying on from the frames
+ * the engine was given before. The attitude is kept in frameAttitude, while the integer fields are copied into the
+ * datapoints so they can be smoothed and plotted like the logged fields.
+ *
+ * The datapoints are stored in narrow columns, so they're widened into a buffer of int64 columns a batch of frames at
+ * a time for the derived engine to read from.
+ */
+static void computeExtraFields(derivedEngine_t *derived, int firstFrameIndex)
+{
+    derivedBatch_t batch;
+    int64_t *batchValues;
+
+    if (points->frameCount <= firstFrameIndex)
+        return;
+
+    if (derived->available[DERIVED_CHANNEL_ROLL] && frameAttitudeCapacity < points->frameCount) {
+        frameAttitudeCapacity = points->frameCapacity;
+        frameAttitude = realloc(frameAttitude, frameAttitudeCapacity * sizeof(*frameAttitude));
+    }
+
+    batchValues = malloc((size_t) points->fieldCount * DERIVED_BATCH_FRAMES * sizeof(*batchValues));
+
+    batch.values = batchValues;
+    batch.fieldStride = DERIVED_BATCH_FRAMES;
+    batch.frameStride = 1;
+
+    for (int batchStart = firstFrameIndex; batchStart < points->frameCount; batchStart += DERIVED_BATCH_FRAMES) {
+        for (int field = 0; field < points->fieldCount; field++) {
+            batch.count = datapointsReadField(points, field, batchStart, DERIVED_BATCH_FRAMES, batchValues + field * DERIVED_BATCH_FRAMES);
+        }
+
+        batch.time = points->frameTime + batchStart;
+
+        derivedEngineProcess(derived, &batch);
+
+        for (int i = 0; i < batch.count; i++) {
+            int frameIndex = batchStart + i;
+
+            for (int axis = 0; axis < 3; axis++) {
+                int64_t pidSum = derived->available[DERIVED_CHANNEL_AXIS_PID_SUM_ROLL + axis] ? derived->columns[DERIVED_CHANNEL_AXIS_PID_SUM_ROLL + axis].ints[i] : 0;
+
+                datapointsSetFieldAtIndex(points, frameIndex, fieldMeta.axisPIDSum[axis], pidSum);
             }
 
-            if (lastFrameTime != 0 && flightLog->mainFieldIndexes.amperageLatest != -1) {
-                /*
-                 * Multiply the current measurement against the time since the last loop to get the number of milliamp-hours
-                 * consumed (assume that the current usage was constant over that interval)
-                 */
-                cumulativeCurrent += (frameTime - lastFrameTime) / 1000000.0 / 60 / 60 * flightLogAmperageADCToMilliamps(flightLog, frame[flightLog->mainFieldIndexes.amperageLatest]);
+            if (derived->available[DERIVED_CHANNEL_ENERGY_CUMULATIVE]) {
+                datapointsSetFieldAtIndex(points, frameIndex, fieldMeta.cumulativeCurrent, round(derived->columns[DERIVED_CHANNEL_ENERGY_CUMULATIVE].doubles[i]));
+            }
 
-                datapointsSetFieldAtIndex(points, frameIndex, fieldMeta.cumulativeCurrent, round(cumulativeCurrent));
+            if (frameAttitude) {
+                frameAttitude[frameIndex].roll = derived->columns[DERIVED_CHANNEL_ROLL].floats[i];
+                frameAttitude[frameIndex].pitch = derived->columns[DERIVED_CHANNEL_PITCH].floats[i];
+                frameAttitude[frameIndex].heading = derived->columns[DERIVED_CHANNEL_HEADING].floats[i];
             }
-            lastFrameTime = frameTime;
         }
     }
+
+    free(batchValues);
+}
+
+/**
+ * Open the file (or pipe, or stdout) that the video formats are streamed to and write the video's header.
+ */
+static videoWriter_t* openVideoOutput(void)
+{
+    FILE *file;
+
+    if (!options.outputFilename || strcmp(options.outputFilename, "-") == 0) {
+#ifdef WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        file = stdout;
+    } else {
+        file = fopen(options.outputFilename, "wb");
+
+        if (!file) {
+            fprintf(stderr, "Failed to open video output '%s': %s\n", options.outputFilename, strerror(errno));
+            exit(-1);
+        }
+    }
+
+    return videoWriterCreate(file, options.outputFormat == OUTPUT_FORMAT_Y4M ? VIDEO_FORMAT_Y4M : VIDEO_FORMAT_BGRA,
+        frameWidth, frameHeight, options.fps, options.draft ? options.draftFrameStep : 1);
 }
 
 int chooseLog(flightLog_t *log)
@@ -1875,11 +3676,134 @@ int chooseLog(flightLog_t *log)
     }
 }
 
+/**
+ * Decide the range of values to store for each field of the datapoints. The caller must free the result.
+ */
+static flightLogFieldStatistics_t* decideFieldRanges(int combinedFieldCount)
+{
+    flightLogFieldStatistics_t *fieldRanges;
+
+    /*
+     * Each field is stored in the narrowest type that holds the range of values seen when the stats were gathered.
+     * The fields we compute ourselves don't have stats, so use the widest types for those unless we can bound them.
+     */
+    fieldRanges = malloc(sizeof(*fieldRanges) * combinedFieldCount);
+
+    for (int i = 0; i < combinedFieldCount; i++) {
+        fieldRanges[i].min = INT64_MIN;
+        fieldRanges[i].max = INT64_MAX;
+    }
+
+    for (int i = 0; i < flightLog->frameDefs['I'].fieldCount; i++) {
+        if (flightLog->stats.haveFieldStats) {
+            fieldRanges[i] = flightLog->stats.field[i];
+        } else if (flightLog->frameDefs['I'].fieldWidth[i] != 8) {
+            // The parser truncates these fields to 32 bits
+            fieldRanges[i].min = flightLog->frameDefs['I'].fieldSigned[i] ? INT32_MIN : 0;
+            fieldRanges[i].max = flightLog->frameDefs['I'].fieldSigned[i] ? INT32_MAX : UINT32_MAX;
+        }
+    }
+
+    // The PID sum can't get further from zero than the sum of its terms can
+    if (flightLog->stats.haveFieldStats) {
+        for (int axis = 0; axis < 3; axis++) {
+            fieldRanges[fieldMeta.axisPIDSum[axis]].min = 0;
+            fieldRanges[fieldMeta.axisPIDSum[axis]].max = 0;
+
+            for (int pid = 0; pid < 3; pid++) {
+                int fieldIndex = flightLog->mainFieldIndexes.pid[pid][axis];
+
+                if (fieldIndex > -1) {
+                    fieldRanges[fieldMeta.axisPIDSum[axis]].min += flightLog->stats.field[fieldIndex].min;
+                    fieldRanges[fieldMeta.axisPIDSum[axis]].max += flightLog->stats.field[fieldIndex].max;
+                }
+            }
+        }
+    }
+
+    return fieldRanges;
+}
+
+/**
+ * Decode the frames of the log into the datapoints, then compute the extra fields and smooth them. The stats of the
+ * log must have been gathered already.
+ */
+static void prepareDatapoints(int combinedFieldCount, char **fieldNames)
+{
+    flightLogFieldStatistics_t *fieldRanges = decideFieldRanges(combinedFieldCount);
+    derivedEngine_t *derived;
+
+    // Create the pre-allocated array of frames that we'll decode into
+    points = datapointsCreateWithRanges(combinedFieldCount, fieldNames, fieldRanges, (int) (flightLog->stats.field[FLIGHT_LOG_FIELD_INDEX_ITERATION].max + 1));
+
+    free(fieldRanges);
+
+    //Now decode the flight log into the points array
+    flightLogParse(flightLog, selectedLogIndex, 0, loadFrameIntoPoints, onLogEvent, false);
+
+    updateFieldMetadata();
+
+    derived = createExtraFieldsEngine();
+    computeExtraFields(derived, 0);
+    derivedEngineDestroy(derived);
+
+    applySmoothing();
+}
+
+/**
+ * Start decoding the log on a thread of its own, which decodes it a piece at a time as renderStreamedAnimation() asks
+ * for it. Only the headers of the log have been parsed, so the datapoints start small and grow as they're needed, and
+ * each field is stored in a type wide enough for any value the parser could give it.
+ */
+static void startLogStream(int combinedFieldCount, char **fieldNames)
+{
+    flightLogFieldStatistics_t *fieldRanges = decideFieldRanges(combinedFieldCount);
+    smoothingJob_t jobs[MAX_SMOOTHING_JOBS];
+    int jobCount;
+
+    points = datapointsCreateWithRanges(combinedFieldCount, fieldNames, fieldRanges, STREAM_INITIAL_FRAME_CAPACITY);
+
+    free(fieldRanges);
+
+    updateFieldMetadata();
+
+    logStream = calloc(1, sizeof(*logStream));
+
+    logStream->derived = createExtraFieldsEngine();
+
+    jobCount = decideSmoothingJobs(jobs);
+
+    //Decode far enough past the time we were asked for to smooth the frames up to that time
+    logStream->framesAfter = 2;
+
+    for (int i = 0; i < jobCount; i++) {
+        datapointsSmoother_t *smoother = &logStream->smoothers[logStream->smootherCount++];
+
+        datapointsSmootherInit(smoother, jobs[i].fieldIndex, &jobs[i].filter);
+
+        if (logStream->framesAfter < smoother->reach + 2)
+            logStream->framesAfter = smoother->reach + 2;
+    }
+
+    semaphore_create(&logStream->decodeRequested, 0);
+    semaphore_create(&logStream->decodeDone, 0);
+
+    //If the render ends before the log does, the decoder is left waiting for a request that never comes
+    thread_create_detached(logStreamRun, NULL);
+
+    //Decode the start of the log, so we know when it starts and where its sync beep is
+    decodeStreamUntil(INT64_MIN);
+    decodeStreamUntil(flightLog->stats.field[FLIGHT_LOG_FIELD_INDEX_TIME].min + 1000000);
+}
+
 int main(int argc, char **argv)
 {
     struct stat directoryStat;
     char outputDirectory[256];
     char **fieldNames;
+    char *cacheFilename = NULL;
+    uint64_t cacheKey = 0;
+    renderCache_t *cache = NULL;
     uint32_t frameStart, frameEnd;
     int fd;
 
@@ -1894,9 +3818,6 @@ int main(int argc, char **argv)
 
     options.bottomGraphSplitAxes = options.plotPids;
 
-    stickTrails[0] = malloc(options.stickTrailLength * sizeof(struct point_t));
-    stickTrails[1] = malloc(options.stickTrailLength * sizeof(struct point_t));
-
     fd = open(options.filename, O_RDONLY);
     if (fd < 0) {
         fprintf(stderr, "Failed to open log file '%s': %s\n", options.filename, strerror(errno));
@@ -1913,7 +3834,7 @@ int main(int argc, char **argv)
         return -1;
 
     //If the user didn't supply an output filename prefix, create our own based on the input filename
-    if (!options.outputPrefix) {
+    if (!options.outputPrefix && options.outputFormat == OUTPUT_FORMAT_PNG) {
         char *fileExtensionPeriod = strrchr(options.filename, '.');
         char *fileSlash = strrchr(options.filename, '/');
         char *logNameStart, *logNameEnd;
@@ -1943,16 +3864,39 @@ int main(int argc, char **argv)
         snprintf(options.outputPrefix, 256, "%s/%.*s", outputDirectory, (int) (logNameEnd - logNameStart), logNameStart);
     }
 
-    //First check out how many frames we need to store so we can pre-allocate (parsing will update the flightlog stats which contain that info)
-    flightLogParse(flightLog, selectedLogIndex, NULL, NULL, NULL, false);
+    if (options.stream) {
+        // The frames are decoded as they're rendered, so we don't get to look through the whole log first
+        flightLogParseMetadata(flightLog, selectedLogIndex);
+    } else if (options.cacheDirectory) {
+        renderCacheSettings_t cacheSettings;
+
+        memset(&cacheSettings, 0, sizeof(cacheSettings));
+
+        cacheSettings.pidSmoothing = options.pidSmoothing;
+        cacheSettings.gyroSmoothing = options.gyroSmoothing;
+        cacheSettings.motorSmoothing = options.motorSmoothing;
+        cacheSettings.smoothingFilter = options.smoothingFilter;
+        cacheSettings.smoothingCutoff = options.smoothingCutoff;
+
+        cacheKey = renderCacheKey(flightLog->logBegin[selectedLogIndex], flightLog->logBegin[selectedLogIndex + 1], &cacheSettings, sizeof(cacheSettings));
+
+        if (stat(options.cacheDirectory, &directoryStat) != 0) {
+            directory_create(options.cacheDirectory);
+        }
+
+        cacheFilename = malloc(strlen(options.cacheDirectory) + 32);
+        sprintf(cacheFilename, "%s/%016" PRIx64 ".bbcache", options.cacheDirectory, cacheKey);
+
+        // We only need the headers of the log to find out which fields we'll have, the rest can come from the cache
+        flightLogParseMetadata(flightLog, selectedLogIndex);
+    } else {
+        //First check out how many frames we need to store so we can pre-allocate (parsing will update the flightlog stats which contain that info)
+        flightLogParse(flightLog, selectedLogIndex, NULL, NULL, NULL, false);
+    }
 
     // Assign field indexes to the fields we'll add
     int newFieldIndex = flightLog->frameDefs['I'].fieldCount, combinedFieldCount;
 
-    fieldMeta.roll = newFieldIndex++;
-    fieldMeta.pitch = newFieldIndex++;
-    fieldMeta.heading = newFieldIndex++;
-
     fieldMeta.axisPIDSum[0] = newFieldIndex++;
     fieldMeta.axisPIDSum[1] = newFieldIndex++;
     fieldMeta.axisPIDSum[2] = newFieldIndex++;
@@ -1973,9 +3917,6 @@ int main(int argc, char **argv)
     }
 
     // And add our synthetic field names
-    fieldNames[fieldMeta.roll] = strdup("roll");
-    fieldNames[fieldMeta.pitch] = strdup("pitch");
-    fieldNames[fieldMeta.heading] = strdup("heading");
     fieldNames[fieldMeta.axisPIDSum[0]] = strdup("axisPID[0]");
     fieldNames[fieldMeta.axisPIDSum[1]] = strdup("axisPID[1]");
     fieldNames[fieldMeta.axisPIDSum[2]] = strdup("axisPID[2]");
@@ -1984,17 +3925,43 @@ int main(int argc, char **argv)
         fieldNames[fieldMeta.cumulativeCurrent] = strdup("cumulativeCurrent");
     }
 
-    // Create the pre-allocated array of frames that we'll decode into
-    points = datapointsCreate(combinedFieldCount, fieldNames, (int) (flightLog->stats.field[FLIGHT_LOG_FIELD_INDEX_ITERATION].max + 1));
+    if (cacheFilename) {
+        cache = renderCacheOpen(cacheFilename, cacheKey, combinedFieldCount, fieldNames);
 
-    //Now decode the flight log into the points array
-    flightLogParse(flightLog, selectedLogIndex, 0, loadFrameIntoPoints, onLogEvent, false);
+        if (cache) {
+            fprintf(stderr, "Using the decoded log from the cache '%s'\n", cacheFilename);
 
-    updateFieldMetadata();
+            memcpy(flightLog->stats.field, cache->contents.fieldStats, sizeof(cache->contents.fieldStats));
+            flightLog->stats.haveFieldStats = cache->contents.points->frameCount > 0;
 
-    computeExtraFields();
+            points = cache->contents.points;
+            frameAttitude = cache->contents.frameAttitude;
+            syncBeepTime = cache->contents.syncBeepTime;
 
-    applySmoothing();
+            updateFieldMetadata();
+        } else {
+            flightLogParse(flightLog, selectedLogIndex, NULL, NULL, NULL, false);
+        }
+    }
+
+    if (options.stream) {
+        startLogStream(combinedFieldCount, fieldNames);
+    } else if (!cache) {
+        prepareDatapoints(combinedFieldCount, fieldNames);
+
+        if (cacheFilename) {
+            renderCacheContents_t contents;
+
+            contents.points = points;
+            contents.frameAttitude = frameAttitude;
+            contents.syncBeepTime = syncBeepTime;
+            memcpy(contents.fieldStats, flightLog->stats.field, sizeof(contents.fieldStats));
+
+            if (renderCacheSave(cacheFilename, cacheKey, &contents)) {
+                fprintf(stderr, "Saved the decoded log to the cache '%s'\n", cacheFilename);
+            }
+        }
+    }
 
     frameStart = options.timeStart * options.fps;
 
@@ -2009,7 +3976,20 @@ int main(int argc, char **argv)
         return -1;
     }
 
+    if (options.outputFormat != OUTPUT_FORMAT_PNG) {
+        videoWriter = openVideoOutput();
+    }
+
     renderAnimation(frameStart, frameEnd);
 
+    if (videoWriter) {
+        FILE *videoFile = videoWriter->file;
+
+        videoWriterDestroy(videoWriter);
+
+        if (videoFile != stdout)
+            fclose(videoFile);
+    }
+
     return 0;
 }
@@ -1,12 +1,170 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <math.h>
 #include <string.h>
 
 #include "datapoints.h"
 #include "parser.h"
 
+/**
+ * Choose the narrowest type that can hold every value between min and max (inclusive).
+ */
+static DatapointsColumnType datapointsChooseColumnType(int64_t min, int64_t max)
+{
+    if (min >= 0) {
+        if (max <= UINT8_MAX)
+            return DATAPOINTS_COLUMN_UINT8;
+        if (max <= UINT16_MAX)
+            return DATAPOINTS_COLUMN_UINT16;
+        if (max <= UINT32_MAX)
+            return DATAPOINTS_COLUMN_UINT32;
+    } else {
+        if (min >= INT8_MIN && max <= INT8_MAX)
+            return DATAPOINTS_COLUMN_INT8;
+        if (min >= INT16_MIN && max <= INT16_MAX)
+            return DATAPOINTS_COLUMN_INT16;
+        if (min >= INT32_MIN && max <= INT32_MAX)
+            return DATAPOINTS_COLUMN_INT32;
+    }
+
+    return DATAPOINTS_COLUMN_INT64;
+}
+
+/**
+ * Get the size in bytes of each value in a column of the given type.
+ */
+size_t datapointsColumnTypeSize(DatapointsColumnType type)
+{
+    static const size_t COLUMN_VALUE_SIZE[] = {1, 1, 2, 2, 4, 4, 8};
+
+    return COLUMN_VALUE_SIZE[type];
+}
+
+static void datapointsColumnSetType(datapointsColumn_t *column, DatapointsColumnType type)
+{
+    column->type = type;
+
+    switch (type) {
+        case DATAPOINTS_COLUMN_INT8:
+            column->min = INT8_MIN;
+            column->max = INT8_MAX;
+        break;
+        case DATAPOINTS_COLUMN_UINT8:
+            column->min = 0;
+            column->max = UINT8_MAX;
+        break;
+        case DATAPOINTS_COLUMN_INT16:
+            column->min = INT16_MIN;
+            column->max = INT16_MAX;
+        break;
+        case DATAPOINTS_COLUMN_UINT16:
+            column->min = 0;
+            column->max = UINT16_MAX;
+        break;
+        case DATAPOINTS_COLUMN_INT32:
+            column->min = INT32_MIN;
+            column->max = INT32_MAX;
+        break;
+        case DATAPOINTS_COLUMN_UINT32:
+            column->min = 0;
+            column->max = UINT32_MAX;
+        break;
+        case DATAPOINTS_COLUMN_INT64:
+        default:
+            column->min = INT64_MIN;
+            column->max = INT64_MAX;
+    }
+}
+
+static int64_t datapointsColumnGet(const datapointsColumn_t *column, int frameIndex)
+{
+    switch (column->type) {
+        case DATAPOINTS_COLUMN_INT8:
+            return ((int8_t*) column->values)[frameIndex];
+        case DATAPOINTS_COLUMN_UINT8:
+            return ((uint8_t*) column->values)[frameIndex];
+        case DATAPOINTS_COLUMN_INT16:
+            return ((int16_t*) column->values)[frameIndex];
+        case DATAPOINTS_COLUMN_UINT16:
+            return ((uint16_t*) column->values)[frameIndex];
+        case DATAPOINTS_COLUMN_INT32:
+            return ((int32_t*) column->values)[frameIndex];
+        case DATAPOINTS_COLUMN_UINT32:
+            return ((uint32_t*) column->values)[frameIndex];
+        case DATAPOINTS_COLUMN_INT64:
+        default:
+            return ((int64_t*) column->values)[frameIndex];
+    }
+}
+
+static void datapointsColumnSet(datapointsColumn_t *column, int frameIndex, int64_t value)
+{
+    if (value < column->min)
+        value = column->min;
+    else if (value > column->max)
+        value = column->max;
+
+    switch (column->type) {
+        case DATAPOINTS_COLUMN_INT8:
+            ((int8_t*) column->values)[frameIndex] = (int8_t) value;
+        break;
+        case DATAPOINTS_COLUMN_UINT8:
+            ((uint8_t*) column->values)[frameIndex] = (uint8_t) value;
+        break;
+        case DATAPOINTS_COLUMN_INT16:
+            ((int16_t*) column->values)[frameIndex] = (int16_t) value;
+        break;
+        case DATAPOINTS_COLUMN_UINT16:
+            ((uint16_t*) column->values)[frameIndex] = (uint16_t) value;
+        break;
+        case DATAPOINTS_COLUMN_INT32:
+            ((int32_t*) column->values)[frameIndex] = (int32_t) value;
+        break;
+        case DATAPOINTS_COLUMN_UINT32:
+            ((uint32_t*) column->values)[frameIndex] = (uint32_t) value;
+        break;
+        case DATAPOINTS_COLUMN_INT64:
+        default:
+            ((int64_t*) column->values)[frameIndex] = value;
+    }
+}
+
+/**
+ * Move the column's values to a wider type if it can't hold every value between min and max.
+ */
+static void datapointsColumnWiden(datapointsColumn_t *column, int64_t min, int64_t max, int frameCount, int frameCapacity)
+{
+    datapointsColumn_t widened;
+
+    if (min >= column->min && max <= column->max)
+        return;
+
+    datapointsColumnSetType(&widened, datapointsChooseColumnType(min < column->min ? min : column->min, max > column->max ? max : column->max));
+    widened.values = malloc(datapointsColumnTypeSize(widened.type) * frameCapacity);
+
+    for (int i = 0; i < frameCount; i++) {
+        datapointsColumnSet(&widened, i, datapointsColumnGet(column, i));
+    }
+
+    free(column->values);
+    *column = widened;
+}
+
+/**
+ * Create storage for frames where every field can hold any 64-bit value.
+ */
 datapoints_t *datapointsCreate(int fieldCount, char **fieldNames, int frameCapacity)
+{
+    return datapointsCreateWithRanges(fieldCount, fieldNames, NULL, frameCapacity);
+}
+
+/**
+ * Create storage for frames where each field only needs to hold values in the range given for it in fieldRanges,
+ * so it can be stored in a narrower type (values outside of this range will be clamped to fit). If fieldRanges is
+ * NULL, every field is stored with 64 bits.
+ */
+datapoints_t *datapointsCreateWithRanges(int fieldCount, char **fieldNames, const flightLogFieldStatistics_t *fieldRanges, int frameCapacity)
 {
     datapoints_t *result = (datapoints_t*) malloc(sizeof(datapoints_t));
 
@@ -16,21 +174,141 @@ datapoints_t *datapointsCreate(int fieldCount, char **fieldNames, int frameCapac
     result->frameCount = 0;
     result->frameCapacity = frameCapacity;
 
-    result->frames = malloc(sizeof(*result->frames) * fieldCount * frameCapacity);
+    result->columns = malloc(sizeof(*result->columns) * fieldCount);
+
+    for (int i = 0; i < fieldCount; i++) {
+        DatapointsColumnType type = fieldRanges ? datapointsChooseColumnType(fieldRanges[i].min, fieldRanges[i].max) : DATAPOINTS_COLUMN_INT64;
+
+        datapointsColumnSetType(&result->columns[i], type);
+        result->columns[i].values = malloc(datapointsColumnTypeSize(type) * frameCapacity);
+    }
+
     result->frameTime = calloc(1, sizeof(*result->frameTime) * frameCapacity);
     result->frameGap = calloc(1, sizeof(*result->frameGap) * frameCapacity);
+    result->discardedFrameCount = 0;
+    result->external = false;
+
+    return result;
+}
+
+/**
+ * Create datapoints around `frameCount` frames which have already been stored elsewhere (such as in a mapped cache
+ * file), with the values of each field in columnValues[field] in a column of type columnTypes[field].
+ *
+ * The arrays remain owned by the caller and must outlive the datapoints, and the datapoints must not be modified
+ * (no frames can be added, and fields can't be set or smoothed).
+ */
+datapoints_t *datapointsCreateFromColumns(int fieldCount, char **fieldNames, const DatapointsColumnType *columnTypes,
+    void **columnValues, int64_t *frameTime, uint8_t *frameGap, int frameCount)
+{
+    datapoints_t *result = (datapoints_t*) malloc(sizeof(datapoints_t));
+
+    result->fieldCount = fieldCount;
+    result->fieldNames = fieldNames;
+
+    result->frameCount = frameCount;
+    result->frameCapacity = frameCount;
+
+    result->columns = malloc(sizeof(*result->columns) * fieldCount);
+
+    for (int i = 0; i < fieldCount; i++) {
+        datapointsColumnSetType(&result->columns[i], columnTypes[i]);
+        result->columns[i].values = columnValues[i];
+    }
+
+    result->frameTime = frameTime;
+    result->frameGap = frameGap;
+    result->discardedFrameCount = 0;
+    result->external = true;
 
     return result;
 }
 
 void datapointsDestroy(datapoints_t *points)
 {
-    free(points->frames);
-    free(points->frameTime);
-    free(points->frameGap);
+    if (!points->external) {
+        for (int i = 0; i < points->fieldCount; i++) {
+            free(points->columns[i].values);
+        }
+
+        free(points->frameTime);
+        free(points->frameGap);
+    }
+
+    free(points->columns);
     free(points);
 }
 
+/**
+ * Make room for frameCapacity frames in total, keeping the frames that have been added already.
+ */
+void datapointsSetCapacity(datapoints_t *points, int frameCapacity)
+{
+    if (frameCapacity < points->frameCount) {
+        fprintf(stderr, "Attempt to shrink datapoints to %d frames when %d have been added\n", frameCapacity, points->frameCount);
+        exit(-1);
+    }
+
+    for (int i = 0; i < points->fieldCount; i++) {
+        points->columns[i].values = realloc(points->columns[i].values, datapointsColumnTypeSize(points->columns[i].type) * frameCapacity);
+    }
+
+    points->frameTime = realloc(points->frameTime, sizeof(*points->frameTime) * frameCapacity);
+    points->frameGap = realloc(points->frameGap, sizeof(*points->frameGap) * frameCapacity);
+
+    if (frameCapacity > points->frameCapacity) {
+        memset(points->frameGap + points->frameCapacity, 0, frameCapacity - points->frameCapacity);
+    }
+
+    points->frameCapacity = frameCapacity;
+}
+
+/**
+ * Remove the first `count` frames, and move the frames after them down to the start to make room for more. The
+ * indexes of the remaining frames go down by `count`, which is added on to discardedFrameCount.
+ */
+void datapointsDiscardFrames(datapoints_t *points, int count)
+{
+    int keep;
+
+    if (count <= 0)
+        return;
+
+    if (count > points->frameCount)
+        count = points->frameCount;
+
+    keep = points->frameCount - count;
+
+    for (int i = 0; i < points->fieldCount; i++) {
+        size_t valueSize = datapointsColumnTypeSize(points->columns[i].type);
+
+        memmove(points->columns[i].values, (uint8_t*) points->columns[i].values + count * valueSize, keep * valueSize);
+    }
+
+    memmove(points->frameTime, points->frameTime + count, keep * sizeof(*points->frameTime));
+    memmove(points->frameGap, points->frameGap + count, keep * sizeof(*points->frameGap));
+
+    // Frames added later don't clear the gap flag, so it mustn't be left behind in the space we freed up
+    memset(points->frameGap + keep, 0, count * sizeof(*points->frameGap));
+
+    points->frameCount = keep;
+    points->discardedFrameCount += count;
+}
+
+/**
+ * Get the number of bytes used to store the frames (at full capacity).
+ */
+size_t datapointsGetStorageSize(datapoints_t *points)
+{
+    size_t result = (sizeof(*points->frameTime) + sizeof(*points->frameGap)) * points->frameCapacity;
+
+    for (int i = 0; i < points->fieldCount; i++) {
+        result += datapointsColumnTypeSize(points->columns[i].type) * points->frameCapacity;
+    }
+
+    return result;
+}
+
 /**
  * Smooth the values for the field with the given index by replacing each value with an
  * average over the a window of width (windowRadius*2+1) centered at the point.
@@ -42,12 +320,15 @@ void datapointsSmoothField(datapoints_t *points, int fieldIndex, int windowRadiu
     int valuesInHistory = 0;
 
     int64_t accumulator;
+    datapointsColumn_t *column;
 
     if (fieldIndex < 0 || fieldIndex >= points->fieldCount) {
         fprintf(stderr, "Attempt to smooth field that doesn't exist %d\n", fieldIndex);
         exit(-1);
     }
 
+    column = &points->columns[fieldIndex];
+
     // Field values so that we know what they were originally before we overwrote them
     int64_t *history = (int64_t*) malloc(sizeof(*history) * windowSize);
     int historyHead = 0; //Points to the next location to insert into
@@ -90,7 +371,7 @@ void datapointsSmoothField(datapoints_t *points, int fieldIndex, int windowRadiu
 
             //New value is added to the window
             if (windowRightIndex < partitionRight) {
-                int64_t fieldValue = points->frames[points->fieldCount * windowRightIndex + fieldIndex];
+                int64_t fieldValue = datapointsColumnGet(column, windowRightIndex);
 
                 accumulator += fieldValue;
 
@@ -106,7 +387,7 @@ void datapointsSmoothField(datapoints_t *points, int fieldIndex, int windowRadiu
 
             // Store the average of the history window into the frame in the center of the window
             if (windowCenterIndex >= partitionLeft) {
-                points->frames[points->fieldCount * windowCenterIndex + fieldIndex] = accumulator / valuesInHistory;
+                datapointsColumnSet(column, windowCenterIndex, accumulator / valuesInHistory);
             }
         }
     }
@@ -115,23 +396,377 @@ void datapointsSmoothField(datapoints_t *points, int fieldIndex, int windowRadiu
 }
 
 /**
- * Find the index of the latest frame whose time is equal to or later than 'time'.
+ * Smooth the values for the field with the given index using the given filter. Each run of frames between gaps in
+ * the log is filtered separately.
+ *
+ * The low-pass filters overshoot at steps, so the field's column is widened if it can't hold the filtered values.
+ *
+ * Different fields can be filtered at the same time from different threads.
+ */
+void datapointsFilterField(datapoints_t *points, int fieldIndex, const filterSettings_t *settings)
+{
+    datapointsColumn_t *column;
+    float *values, *scratch;
+    int partitionStart, partitionEnd;
+    int64_t filteredMin = INT64_MAX, filteredMax = INT64_MIN;
+
+    if (settings->type == FILTER_TYPE_MOVING_AVERAGE) {
+        datapointsSmoothField(points, fieldIndex, settings->radius);
+        return;
+    }
+
+    if (fieldIndex < 0 || fieldIndex >= points->fieldCount) {
+        fprintf(stderr, "Attempt to smooth field that doesn't exist %d\n", fieldIndex);
+        exit(-1);
+    }
+
+    column = &points->columns[fieldIndex];
+
+    values = malloc(points->frameCount * sizeof(*values));
+    scratch = malloc(filterScratchSize(settings, points->frameCount) * sizeof(*scratch));
+
+    for (partitionStart = 0; partitionStart < points->frameCount; partitionStart = partitionEnd) {
+        int count;
+        double sampleRate = 0;
+
+        // The frame that a gap starts after is the last frame of the partition
+        for (partitionEnd = partitionStart; partitionEnd < points->frameCount && !points->frameGap[partitionEnd]; partitionEnd++)
+            ;
+        if (partitionEnd < points->frameCount)
+            partitionEnd++;
+
+        count = partitionEnd - partitionStart;
+
+        if (count > 1 && points->frameTime[partitionEnd - 1] > points->frameTime[partitionStart]) {
+            sampleRate = (count - 1) * 1000000.0 / (points->frameTime[partitionEnd - 1] - points->frameTime[partitionStart]);
+        }
+
+        for (int i = partitionStart; i < partitionEnd; i++) {
+            values[i] = (float) datapointsColumnGet(column, i);
+        }
+
+        filterApply(settings, values + partitionStart, count, sampleRate, scratch);
+    }
+
+    for (int i = 0; i < points->frameCount; i++) {
+        int64_t value = lroundf(values[i]);
+
+        if (value < filteredMin)
+            filteredMin = value;
+        if (value > filteredMax)
+            filteredMax = value;
+    }
+
+    if (points->frameCount > 0 && !points->external) {
+        datapointsColumnWiden(column, filteredMin, filteredMax, points->frameCount, points->frameCapacity);
+    }
+
+    for (int i = 0; i < points->frameCount; i++) {
+        datapointsColumnSet(column, i, lroundf(values[i]));
+    }
+
+    free(values);
+    free(scratch);
+}
+
+/**
+ * Set up a smoother for the given field, which has smoothed none of the log so far.
+ *
+ * Returns false if the filter can't be applied a run of frames at a time (the low-pass filters, which depend on the
+ * rate of each whole run between gaps, or on the end of it).
+ */
+bool datapointsSmootherInit(datapointsSmoother_t *smoother, int fieldIndex, const filterSettings_t *settings)
+{
+    smoother->fieldIndex = fieldIndex;
+    smoother->settings = *settings;
+
+    switch (settings->type) {
+        case FILTER_TYPE_MOVING_AVERAGE:
+            smoother->reach = settings->radius;
+        break;
+        case FILTER_TYPE_GAUSSIAN:
+            smoother->reach = filterGaussianKernelRadius(settings->radius);
+        break;
+        default:
+            return false;
+    }
+
+    smoother->smoothedFrameCount = 0;
+    smoother->history = malloc((smoother->reach + 1) * sizeof(*smoother->history));
+    smoother->historyCount = 0;
+
+    return true;
+}
+
+void datapointsSmootherDestroy(datapointsSmoother_t *smoother)
+{
+    free(smoother->history);
+    smoother->history = NULL;
+}
+
+/**
+ * Smooth the frames of the run [runStart...runEnd) of `values` (where a frame's index in `values` is its index in the
+ * datapoints minus valuesStart) which lie in [first...end), and store them into the column.
+ */
+static void datapointsSmootherApplyRun(const datapointsSmoother_t *smoother, datapointsColumn_t *column, const int64_t *values,
+    int valuesStart, int runStart, int runEnd, int first, int end)
+{
+    int reach = smoother->reach;
+
+    if (first < runStart)
+        first = runStart;
+    if (end > runEnd)
+        end = runEnd;
+
+    if (first >= end)
+        return;
+
+    if (smoother->settings.type == FILTER_TYPE_MOVING_AVERAGE) {
+        // Integer sums, so this comes out the same as datapointsSmoothField() whichever order we add them in
+        for (int i = first; i < end; i++) {
+            int left = i - reach < runStart ? runStart : i - reach;
+            int right = i + reach >= runEnd ? runEnd - 1 : i + reach;
+            int64_t accumulator = 0;
+
+            for (int j = left; j <= right; j++) {
+                accumulator += values[j - valuesStart];
+            }
+
+            datapointsColumnSet(column, i, accumulator / (right - left + 1));
+        }
+    } else {
+        /*
+         * The filter only sees the frames that lie within reach of [first...end), and it only cuts its kernel short at
+         * the edges of what it sees. Those edges are at the ends of the run where they're within reach, so every frame
+         * is filtered over the same frames in the same order as when the run is filtered whole.
+         */
+        int sliceStart = first - reach < runStart ? runStart : first - reach;
+        int sliceEnd = end + reach > runEnd ? runEnd : end + reach;
+        int count = sliceEnd - sliceStart;
+        float *input = malloc((count * 2 + reach * 2 + 1) * sizeof(*input));
+        float *output = input + count;
+        float *kernel = output + count;
+
+        for (int i = 0; i < count; i++) {
+            input[i] = (float) values[sliceStart + i - valuesStart];
+        }
+
+        filterGaussianKernel(smoother->settings.radius, kernel);
+        filterGaussian(input, output, count, kernel, reach);
+
+        for (int i = first; i < end; i++) {
+            datapointsColumnSet(column, i, lroundf(output[i - sliceStart]));
+        }
+
+        free(input);
+    }
+}
+
+/**
+ * Smooth the frames which have been added since the last call, as far as the frames added so far allow. Once
+ * `complete` is set (no more frames will be added) every remaining frame is smoothed.
+ *
+ * The unsmoothed frames must not have been discarded from the datapoints.
+ */
+void datapointsSmootherAdvance(datapointsSmoother_t *smoother, datapoints_t *points, bool complete)
+{
+    int reach = smoother->reach;
+    int first = smoother->smoothedFrameCount - points->discardedFrameCount;
+    int end = complete ? points->frameCount : points->frameCount - reach;
+    int valuesStart, valuesEnd, runStart, historyStart;
+    int64_t *values;
+
+    if (first < 0) {
+        fprintf(stderr, "Frames were discarded before they were smoothed\n");
+        exit(-1);
+    }
+
+    if (end <= first)
+        return;
+
+    // Gather the original values of every frame that the frames in [first...end) are averaged with
+    valuesStart = first - smoother->historyCount;
+    valuesEnd = end + reach < points->frameCount ? end + reach : points->frameCount;
+
+    values = malloc((valuesEnd - valuesStart) * sizeof(*values));
+
+    memcpy(values, smoother->history, smoother->historyCount * sizeof(*values));
+    datapointsReadField(points, smoother->fieldIndex, first, valuesEnd - first, values + smoother->historyCount);
+
+    // The history is all from the same run as the first frame, so the first run begins with it
+    for (runStart = valuesStart; runStart < end; ) {
+        int runEnd;
+
+        // The frame that a gap starts after is the last frame of the run
+        for (runEnd = first > runStart ? first : runStart; runEnd < valuesEnd && !points->frameGap[runEnd]; runEnd++)
+            ;
+        if (runEnd < valuesEnd)
+            runEnd++;
+
+        datapointsSmootherApplyRun(smoother, &points->columns[smoother->fieldIndex], values, valuesStart, runStart, runEnd, first, end);
+
+        runStart = runEnd;
+    }
+
+    // Keep the original values that the next frames will need, which are the ones in the same run as the next frame
+    for (historyStart = end; historyStart > valuesStart && end - historyStart < reach; historyStart--) {
+        if (historyStart - 1 >= first && points->frameGap[historyStart - 1])
+            break;
+    }
+
+    smoother->historyCount = end - historyStart;
+    memcpy(smoother->history, values + (historyStart - valuesStart), smoother->historyCount * sizeof(*values));
+
+    smoother->smoothedFrameCount = end + points->discardedFrameCount;
+
+    free(values);
+}
+
+/**
+ * Find the index of the first frame in [low...high) whose time is later than 'time', or `high` if there is none. The
+ * frames are expected to have been added in time order.
+ */
+static int datapointsUpperBound(datapoints_t *points, int low, int high, int64_t time)
+{
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+
+        if (time < points->frameTime[mid]) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * Find the index of the latest frame whose time is equal to or earlier than 'time'.
  *
  * Returns -1 if the time is before any frame in the datapoints.
  */
 int datapointsFindFrameAtTime(datapoints_t *points, int64_t time)
 {
-    int i, lastGoodFrame = -1;
+    return datapointsUpperBound(points, 0, points->frameCount, time) - 1;
+}
+
+void datapointsCursorInit(datapointsCursor_t *cursor)
+{
+    cursor->frameIndex = -1;
+}
 
-    //TODO make me a binary search
-    for (i = 0; i < points->frameCount; i++) {
-        if (time < points->frameTime[i]) {
-            return lastGoodFrame;
-        }
-        lastGoodFrame = i;
+/**
+ * Find the same frame as datapointsFindFrameAtTime(), starting the search from the result of the last search with
+ * this cursor. Searching forwards costs O(log distance) in the number of frames between the two results, and
+ * searching backwards falls back to a search of the whole log.
+ */
+int datapointsAdvanceToTime(datapoints_t *points, datapointsCursor_t *cursor, int64_t time)
+{
+    int low = cursor->frameIndex, high, step;
+
+    if (low >= points->frameCount || (low >= 0 && time < points->frameTime[low])) {
+        cursor->frameIndex = datapointsFindFrameAtTime(points, time);
+        return cursor->frameIndex;
+    }
+
+    // Gallop forwards with doubling steps until we overshoot the time, then search the last step
+    low = low + 1;
+    high = low;
+
+    for (step = 1; high < points->frameCount && points->frameTime[high] <= time; step *= 2) {
+        low = high + 1;
+        high = low + step < points->frameCount ? low + step : points->frameCount;
     }
 
-    return lastGoodFrame;
+    cursor->frameIndex = datapointsUpperBound(points, low, high, time) - 1;
+
+    return cursor->frameIndex;
+}
+
+/**
+ * Get the value of the field at the given time, interpolated linearly between the frames either side of it. Values
+ * aren't interpolated across gaps in the log, the value of the frame before the gap is used instead.
+ *
+ * Returns false if the time is outside the range of the datapoints.
+ */
+bool datapointsGetValueAtTime(datapoints_t *points, int fieldIndex, int64_t time, double *value)
+{
+    int frameIndex = datapointsFindFrameAtTime(points, time);
+    int64_t leftValue, rightValue, leftTime, rightTime;
+
+    if (frameIndex < 0 || (frameIndex == points->frameCount - 1 && time > points->frameTime[frameIndex]))
+        return false;
+
+    leftValue = datapointsColumnGet(&points->columns[fieldIndex], frameIndex);
+
+    if (frameIndex == points->frameCount - 1 || points->frameGap[frameIndex]) {
+        *value = leftValue;
+        return true;
+    }
+
+    rightValue = datapointsColumnGet(&points->columns[fieldIndex], frameIndex + 1);
+    leftTime = points->frameTime[frameIndex];
+    rightTime = points->frameTime[frameIndex + 1];
+
+    if (rightTime == leftTime) {
+        *value = leftValue;
+    } else {
+        *value = leftValue + (double) (rightValue - leftValue) * (time - leftTime) / (rightTime - leftTime);
+    }
+
+    return true;
+}
+
+#define DATAPOINTS_READ_COLUMN(type) \
+    { \
+        const type *source = (const type*) column->values + firstFrameIndex; \
+        for (int i = 0; i < count; i++) { \
+            values[i] = source[i]; \
+        } \
+    }
+
+/**
+ * Copy the values of the given field for `count` frames beginning at firstFrameIndex into the `values` array.
+ *
+ * Returns the number of values copied, which is less than count if the end of the frames was reached.
+ */
+int datapointsReadField(datapoints_t *points, int fieldIndex, int firstFrameIndex, int count, int64_t *values)
+{
+    const datapointsColumn_t *column = &points->columns[fieldIndex];
+
+    if (firstFrameIndex < 0 || firstFrameIndex >= points->frameCount)
+        return 0;
+
+    if (count > points->frameCount - firstFrameIndex)
+        count = points->frameCount - firstFrameIndex;
+
+    // Each loop is over a single type, so they're easy for the compiler to vectorise
+    switch (column->type) {
+        case DATAPOINTS_COLUMN_INT8:
+            DATAPOINTS_READ_COLUMN(int8_t)
+        break;
+        case DATAPOINTS_COLUMN_UINT8:
+            DATAPOINTS_READ_COLUMN(uint8_t)
+        break;
+        case DATAPOINTS_COLUMN_INT16:
+            DATAPOINTS_READ_COLUMN(int16_t)
+        break;
+        case DATAPOINTS_COLUMN_UINT16:
+            DATAPOINTS_READ_COLUMN(uint16_t)
+        break;
+        case DATAPOINTS_COLUMN_INT32:
+            DATAPOINTS_READ_COLUMN(int32_t)
+        break;
+        case DATAPOINTS_COLUMN_UINT32:
+            DATAPOINTS_READ_COLUMN(uint32_t)
+        break;
+        case DATAPOINTS_COLUMN_INT64:
+            DATAPOINTS_READ_COLUMN(int64_t)
+        break;
+    }
+
+    return count;
 }
 
 bool datapointsGetFrameAtIndex(datapoints_t *points, int frameIndex, int64_t *frameTime, int64_t *frame)
@@ -139,7 +774,9 @@ bool datapointsGetFrameAtIndex(datapoints_t *points, int frameIndex, int64_t *fr
     if (frameIndex < 0 || frameIndex >= points->frameCount)
         return false;
 
-    memcpy(frame, points->frames + frameIndex * points->fieldCount, points->fieldCount * sizeof(*points->frames));
+    for (int i = 0; i < points->fieldCount; i++) {
+        frame[i] = datapointsColumnGet(&points->columns[i], frameIndex);
+    }
     *frameTime = points->frameTime[frameIndex];
 
     return true;
@@ -150,7 +787,7 @@ bool datapointsGetFieldAtIndex(datapoints_t *points, int frameIndex, int fieldIn
     if (frameIndex < 0 || frameIndex >= points->frameCount)
         return false;
 
-    *frameValue = points->frames[frameIndex * points->fieldCount + fieldIndex];
+    *frameValue = datapointsColumnGet(&points->columns[fieldIndex], frameIndex);
 
     return true;
 }
@@ -160,7 +797,7 @@ bool datapointsSetFieldAtIndex(datapoints_t *points, int frameIndex, int fieldIn
     if (frameIndex < 0 || frameIndex >= points->frameCount)
         return false;
 
-    points->frames[frameIndex * points->fieldCount + fieldIndex] = frameValue;
+    datapointsColumnSet(&points->columns[fieldIndex], frameIndex, frameValue);
 
     return true;
 }
@@ -190,7 +827,10 @@ bool datapointsAddFrame(datapoints_t *points, int64_t frameTime, const int64_t *
         return false;
 
     points->frameTime[points->frameCount] = frameTime;
-    memcpy(points->frames + points->frameCount * points->fieldCount, frame, points->fieldCount * sizeof(*points->frames));
+
+    for (int i = 0; i < points->fieldCount; i++) {
+        datapointsColumnSet(&points->columns[i], points->frameCount, frame[i]);
+    }
 
     points->frameCount++;
 
@@ -3,22 +3,98 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "parser.h"
+#include "filters.h"
+
+/**
+ * The narrowest integer type that can hold every value of a field is used to store it, since most fields need far
+ * fewer than 64 bits.
+ */
+typedef enum {
+    DATAPOINTS_COLUMN_INT8,
+    DATAPOINTS_COLUMN_UINT8,
+    DATAPOINTS_COLUMN_INT16,
+    DATAPOINTS_COLUMN_UINT16,
+    DATAPOINTS_COLUMN_INT32,
+    DATAPOINTS_COLUMN_UINT32,
+    DATAPOINTS_COLUMN_INT64
+} DatapointsColumnType;
+
+typedef struct datapointsColumn_t {
+    DatapointsColumnType type;
+
+    // The range of values the type can hold, values outside of this are clamped to fit
+    int64_t min, max;
+
+    // frameCapacity values of the column's type
+    void *values;
+} datapointsColumn_t;
 
 typedef struct datapoints_t {
     int fieldCount, frameCount;
     int frameCapacity;
     char **fieldNames;
 
-    int64_t *frames;
+    // The values of each field are stored contiguously (column-major) in a column per field
+    datapointsColumn_t *columns;
     int64_t *frameTime;
     uint8_t *frameGap;
+
+    // The number of frames removed from the start by datapointsDiscardFrames(), so the index of a frame in the whole
+    // log is its index here plus this
+    int discardedFrameCount;
+
+    // True if the arrays of frames belong to someone else (see datapointsCreateFromColumns())
+    bool external;
 } datapoints_t;
 
+/**
+ * Remembers where the last search for a time ended up, so that a series of searches for increasing times (such as
+ * one per frame of a video) only has to look at the frames between one result and the next.
+ */
+typedef struct datapointsCursor_t {
+    int frameIndex;
+} datapointsCursor_t;
+
+/**
+ * Smooths a field of datapoints which are still being added to, a run of frames at a time, with the same result that
+ * datapointsFilterField() gives once every frame has been added. Only the filters which look a fixed number of frames
+ * either side (the moving average and Gaussian) can be applied this way.
+ */
+typedef struct datapointsSmoother_t {
+    int fieldIndex;
+    filterSettings_t settings;
+
+    // How many frames either side of a frame its smoothed value depends on
+    int reach;
+
+    // The number of frames from the start of the log which have been smoothed
+    int smoothedFrameCount;
+
+    // The original values of the (up to reach) frames just before the first unsmoothed one, since the values in the
+    // datapoints have been smoothed. Only frames from the same run between gaps are kept.
+    int64_t *history;
+    int historyCount;
+} datapointsSmoother_t;
+
 datapoints_t *datapointsCreate(int fieldCount, char **fieldNames, int frameCapacity);
+datapoints_t *datapointsCreateWithRanges(int fieldCount, char **fieldNames, const flightLogFieldStatistics_t *fieldRanges, int frameCapacity);
+datapoints_t *datapointsCreateFromColumns(int fieldCount, char **fieldNames, const DatapointsColumnType *columnTypes,
+    void **columnValues, int64_t *frameTime, uint8_t *frameGap, int frameCount);
 void datapointsDestroy(datapoints_t *points);
 
+void datapointsSetCapacity(datapoints_t *points, int frameCapacity);
+void datapointsDiscardFrames(datapoints_t *points, int count);
+
+size_t datapointsColumnTypeSize(DatapointsColumnType type);
+
 bool datapointsGetFrameAtIndex(datapoints_t *points, int frameIndex, int64_t *frameTime, int64_t *frame);
 
+int datapointsReadField(datapoints_t *points, int fieldIndex, int firstFrameIndex, int count, int64_t *values);
+size_t datapointsGetStorageSize(datapoints_t *points);
+
 bool datapointsGetFieldAtIndex(datapoints_t *points, int frameIndex, int fieldIndex, int64_t *frameValue);
 bool datapointsSetFieldAtIndex(datapoints_t *points, int frameIndex, int fieldIndex, int64_t frameValue);
 
@@ -26,9 +102,19 @@ bool datapointsGetGapStartsAtIndex(datapoints_t *points, int frameIndex);
 bool datapointsGetTimeAtIndex(datapoints_t *points, int frameIndex, int64_t *frameTime);
 int datapointsFindFrameAtTime(datapoints_t *points, int64_t time);
 
+void datapointsCursorInit(datapointsCursor_t *cursor);
+int datapointsAdvanceToTime(datapoints_t *points, datapointsCursor_t *cursor, int64_t time);
+
+bool datapointsGetValueAtTime(datapoints_t *points, int fieldIndex, int64_t time, double *value);
+
 bool datapointsAddFrame(datapoints_t *points, int64_t frameTime, const int64_t *frame);
 void datapointsAddGap(datapoints_t *points);
 
 void datapointsSmoothField(datapoints_t *points, int fieldIndex, int windowSize);
+void datapointsFilterField(datapoints_t *points, int fieldIndex, const filterSettings_t *settings);
+
+bool datapointsSmootherInit(datapointsSmoother_t *smoother, int fieldIndex, const filterSettings_t *settings);
+void datapointsSmootherAdvance(datapointsSmoother_t *smoother, datapoints_t *points, bool complete);
+void datapointsSmootherDestroy(datapointsSmoother_t *smoother);
 
 #endif
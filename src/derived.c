@@ -0,0 +1,392 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "derived.h"
+
+/*
+ * Computes the channels we derive from the main frames of a log (attitude, PID sums, current and energy usage).
+ *
+ * Each channel is produced by a kernel, which names the log fields and other derived channels it reads from and
+ * processes a whole batch of frames at a time. Only the kernels needed for the requested channels are run, in an order
+ * where every kernel runs after the kernels that produce its inputs.
+ */
+
+typedef struct derivedInput_t {
+    // Value of the input for frame i of the batch is at values[i * stride], or values is NULL if the input is missing
+    const int64_t *values;
+    int stride;
+} derivedInput_t;
+
+typedef void (*DerivedKernelReset)(derivedEngine_t *engine, derivedKernelState_t *state);
+typedef void (*DerivedKernelProcess)(derivedEngine_t *engine, derivedKernelState_t *state, int count, const int64_t *time,
+    const derivedInput_t *inputs);
+
+typedef struct derivedKernelDefinition_t {
+    /*
+     * Names of the log fields or derived channels the kernel reads, of which the first `requiredInputCount` must exist.
+     * Only integer channels can be read by other kernels.
+     */
+    const char *inputs[DERIVED_KERNEL_MAX_INPUTS];
+    int inputCount, requiredInputCount;
+
+    // The channel the kernel writes (kernels which write several channels know which ones they are)
+    DerivedChannel output;
+
+    DerivedKernelReset reset;
+    DerivedKernelProcess process;
+} derivedKernelDefinition_t;
+
+typedef struct derivedChannelDefinition_t {
+    const char *name;
+    DerivedChannelType type;
+    DerivedKernel kernel;
+} derivedChannelDefinition_t;
+
+static const derivedChannelDefinition_t DERIVED_CHANNELS[DERIVED_CHANNEL_COUNT] = {
+    {"roll", DERIVED_TYPE_FLOAT, DERIVED_KERNEL_ATTITUDE},
+    {"pitch", DERIVED_TYPE_FLOAT, DERIVED_KERNEL_ATTITUDE},
+    {"heading", DERIVED_TYPE_FLOAT, DERIVED_KERNEL_ATTITUDE},
+    {"axisPID[0]", DERIVED_TYPE_INT64, DERIVED_KERNEL_AXIS_PID_SUM_ROLL},
+    {"axisPID[1]", DERIVED_TYPE_INT64, DERIVED_KERNEL_AXIS_PID_SUM_PITCH},
+    {"axisPID[2]", DERIVED_TYPE_INT64, DERIVED_KERNEL_AXIS_PID_SUM_YAW},
+    {"currentMeasured", DERIVED_TYPE_INT64, DERIVED_KERNEL_CURRENT_MEASURED},
+    {"energyCumulative", DERIVED_TYPE_DOUBLE, DERIVED_KERNEL_ENERGY_CUMULATIVE},
+    {"currentVirtual", DERIVED_TYPE_INT64, DERIVED_KERNEL_CURRENT_VIRTUAL},
+    {"energyCumulativeVirtual", DERIVED_TYPE_DOUBLE, DERIVED_KERNEL_ENERGY_CUMULATIVE_VIRTUAL},
+};
+
+static void resetAttitude(derivedEngine_t *engine, derivedKernelState_t *state)
+{
+    imuInit(&state->imu);
+    imuSetMagneticDeclination(&state->imu, engine->settings.magneticDeclination);
+}
+
+static void processAttitude(derivedEngine_t *engine, derivedKernelState_t *state, int count, const int64_t *time,
+    const derivedInput_t *inputs)
+{
+    const int64_t *gyroADC[3], *accSmooth[3], *magADC[3];
+    bool useMag = !engine->settings.ignoreMag;
+    int stride = inputs[0].stride;
+
+    for (int axis = 0; axis < 3; axis++) {
+        gyroADC[axis] = inputs[axis].values;
+        accSmooth[axis] = inputs[3 + axis].values;
+        magADC[axis] = inputs[6 + axis].values;
+
+        // All the fields come from the same frames, so they all have the same stride
+        useMag = useMag && magADC[axis] && inputs[6 + axis].stride == stride;
+    }
+
+    updateEstimatedAttitudeBatch(&state->imu, count, time, gyroADC, accSmooth, useMag ? magADC : NULL, stride,
+        engine->log->sysConfig.acc_1G, engine->log->sysConfig.gyroScale,
+        engine->columns[DERIVED_CHANNEL_ROLL].floats, engine->columns[DERIVED_CHANNEL_PITCH].floats,
+        engine->columns[DERIVED_CHANNEL_HEADING].floats);
+}
+
+static void processAxisPIDSum(derivedEngine_t *engine, derivedKernelState_t *state, int count, const int64_t *time,
+    const derivedInput_t *inputs)
+{
+    int64_t *sum = engine->columns[state->output].ints;
+
+    (void) time;
+
+    for (int i = 0; i < count; i++) {
+        sum[i] = inputs[0].values[i * inputs[0].stride];
+    }
+
+    // The I and D terms aren't logged on every axis
+    for (int term = 1; term < 3; term++) {
+        if (inputs[term].values) {
+            for (int i = 0; i < count; i++) {
+                sum[i] += inputs[term].values[i * inputs[term].stride];
+            }
+        }
+    }
+}
+
+static void processCurrentMeasured(derivedEngine_t *engine, derivedKernelState_t *state, int count, const int64_t *time,
+    const derivedInput_t *inputs)
+{
+    int64_t *current = engine->columns[state->output].ints;
+
+    (void) time;
+
+    for (int i = 0; i < count; i++) {
+        current[i] = flightLogAmperageADCToMilliamps(engine->log, (uint16_t) inputs[0].values[i * inputs[0].stride]);
+    }
+}
+
+static void processCurrentVirtual(derivedEngine_t *engine, derivedKernelState_t *state, int count, const int64_t *time,
+    const derivedInput_t *inputs)
+{
+    int64_t *current = engine->columns[state->output].ints;
+
+    (void) time;
+
+    for (int i = 0; i < count; i++) {
+        current[i] = currentMeterVirtualMilliamps(engine->settings.currentMeterOffset, engine->settings.currentMeterScale,
+            (uint32_t) inputs[0].values[i * inputs[0].stride]);
+    }
+}
+
+static void resetEnergy(derivedEngine_t *engine, derivedKernelState_t *state)
+{
+    (void) engine;
+
+    currentMeterInit(&state->meter);
+}
+
+/**
+ * Integrate the current input over time to get the energy used in milliamp-hours.
+ */
+static void processEnergy(derivedEngine_t *engine, derivedKernelState_t *state, int count, const int64_t *time,
+    const derivedInput_t *inputs)
+{
+    double *energy = engine->columns[state->output].doubles;
+
+    for (int i = 0; i < count; i++) {
+        currentMeterAddSample(&state->meter, (int32_t) inputs[0].values[i * inputs[0].stride], (uint32_t) time[i]);
+
+        energy[i] = state->meter.energyMilliampHours;
+    }
+}
+
+static const derivedKernelDefinition_t DERIVED_KERNELS[DERIVED_KERNEL_COUNT] = {
+    {
+        {"gyroADC[0]", "gyroADC[1]", "gyroADC[2]", "accSmooth[0]", "accSmooth[1]", "accSmooth[2]", "magADC[0]", "magADC[1]", "magADC[2]"}, 9, 6,
+        DERIVED_CHANNEL_ROLL, resetAttitude, processAttitude
+    },
+    {
+        {"axisP[0]", "axisI[0]", "axisD[0]"}, 3, 1,
+        DERIVED_CHANNEL_AXIS_PID_SUM_ROLL, NULL, processAxisPIDSum
+    },
+    {
+        {"axisP[1]", "axisI[1]", "axisD[1]"}, 3, 1,
+        DERIVED_CHANNEL_AXIS_PID_SUM_PITCH, NULL, processAxisPIDSum
+    },
+    {
+        {"axisP[2]", "axisI[2]", "axisD[2]"}, 3, 1,
+        DERIVED_CHANNEL_AXIS_PID_SUM_YAW, NULL, processAxisPIDSum
+    },
+    {
+        {"amperageLatest"}, 1, 1,
+        DERIVED_CHANNEL_CURRENT_MEASURED, NULL, processCurrentMeasured
+    },
+    {
+        {"currentMeasured"}, 1, 1,
+        DERIVED_CHANNEL_ENERGY_CUMULATIVE, resetEnergy, processEnergy
+    },
+    {
+        {"rcCommand[3]"}, 1, 1,
+        DERIVED_CHANNEL_CURRENT_VIRTUAL, NULL, processCurrentVirtual
+    },
+    {
+        {"currentVirtual"}, 1, 1,
+        DERIVED_CHANNEL_ENERGY_CUMULATIVE_VIRTUAL, resetEnergy, processEnergy
+    },
+};
+
+const char *derivedChannelName(DerivedChannel channel)
+{
+    return DERIVED_CHANNELS[channel].name;
+}
+
+bool derivedChannelFromName(const char *name, DerivedChannel *channel)
+{
+    for (int i = 0; i < DERIVED_CHANNEL_COUNT; i++) {
+        if (strcmp(DERIVED_CHANNELS[i].name, name) == 0) {
+            *channel = (DerivedChannel) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Use the FC's settings from the log header, with no magnetic declination.
+ */
+void derivedSettingsInit(derivedSettings_t *settings, flightLog_t *log)
+{
+    settings->magneticDeclination = 0;
+    settings->ignoreMag = false;
+
+    settings->currentMeterOffset = log->sysConfig.currentMeterOffset;
+    settings->currentMeterScale = log->sysConfig.currentMeterScale;
+}
+
+static int findMainFieldIndex(flightLog_t *log, const char *name)
+{
+    for (int i = 0; i < log->frameDefs['I'].fieldCount; i++) {
+        if (strcmp(log->frameDefs['I'].fieldName[i], name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+typedef enum {
+    KERNEL_UNVISITED = 0,
+    KERNEL_VISITING,
+    KERNEL_VISITED
+} KernelVisitState;
+
+/**
+ * Enable the kernel if its inputs are available, after scheduling the kernels that produce the derived channels it
+ * reads. Returns true if the kernel can be run.
+ */
+static bool derivedEngineScheduleKernel(derivedEngine_t *engine, DerivedKernel kernel, KernelVisitState *visitState)
+{
+    const derivedKernelDefinition_t *definition = &DERIVED_KERNELS[kernel];
+    derivedKernelState_t *state = &engine->kernels[kernel];
+
+    if (visitState[kernel] == KERNEL_VISITED) {
+        return state->enabled;
+    }
+    if (visitState[kernel] == KERNEL_VISITING) {
+        // A kernel that depends on itself can never be run
+        return false;
+    }
+
+    visitState[kernel] = KERNEL_VISITING;
+    state->enabled = true;
+    state->output = definition->output;
+
+    // The attitude estimate needs to know what 1G reads as on the accelerometer
+    if (kernel == DERIVED_KERNEL_ATTITUDE && engine->log->sysConfig.acc_1G == 0) {
+        state->enabled = false;
+    }
+
+    for (int i = 0; i < definition->inputCount && state->enabled; i++) {
+        DerivedChannel channel;
+
+        state->inputField[i] = findMainFieldIndex(engine->log, definition->inputs[i]);
+        state->inputChannel[i] = -1;
+
+        if (state->inputField[i] == -1 && derivedChannelFromName(definition->inputs[i], &channel)
+                && derivedEngineScheduleKernel(engine, DERIVED_CHANNELS[channel].kernel, visitState)) {
+            state->inputChannel[i] = channel;
+        }
+
+        if (i < definition->requiredInputCount && state->inputField[i] == -1 && state->inputChannel[i] == -1) {
+            state->enabled = false;
+        }
+    }
+
+    visitState[kernel] = KERNEL_VISITED;
+
+    if (state->enabled) {
+        engine->schedule[engine->scheduleLength++] = kernel;
+    }
+
+    return state->enabled;
+}
+
+/**
+ * Create an engine to compute the channels for which requested[channel] is true (and the channels they depend on), from
+ * the main frames of the given log in batches of up to `capacity` frames.
+ *
+ * Channels that can't be computed for this log are marked as unavailable in engine->available.
+ */
+derivedEngine_t* derivedEngineCreate(flightLog_t *log, const derivedSettings_t *settings, const bool *requested, int capacity)
+{
+    derivedEngine_t *result = calloc(1, sizeof(*result));
+    KernelVisitState visitState[DERIVED_KERNEL_COUNT] = {KERNEL_UNVISITED};
+
+    result->log = log;
+    result->settings = *settings;
+    result->capacity = capacity;
+    result->scheduleLength = 0;
+
+    for (int i = 0; i < DERIVED_CHANNEL_COUNT; i++) {
+        if (requested[i]) {
+            derivedEngineScheduleKernel(result, DERIVED_CHANNELS[i].kernel, visitState);
+        }
+    }
+
+    // Allocate the outputs of the kernels we'll run, including those that were only needed as inputs
+    for (int i = 0; i < DERIVED_CHANNEL_COUNT; i++) {
+        derivedColumn_t *column = &result->columns[i];
+
+        column->type = DERIVED_CHANNELS[i].type;
+        result->available[i] = result->kernels[DERIVED_CHANNELS[i].kernel].enabled;
+
+        if (result->available[i]) {
+            switch (column->type) {
+                case DERIVED_TYPE_INT64:
+                    column->ints = malloc(capacity * sizeof(*column->ints));
+                break;
+                case DERIVED_TYPE_FLOAT:
+                    column->floats = malloc(capacity * sizeof(*column->floats));
+                break;
+                case DERIVED_TYPE_DOUBLE:
+                    column->doubles = malloc(capacity * sizeof(*column->doubles));
+                break;
+            }
+        }
+    }
+
+    derivedEngineReset(result);
+
+    return result;
+}
+
+/**
+ * Reset the state of the kernels, ready to process a log from the beginning.
+ */
+void derivedEngineReset(derivedEngine_t *engine)
+{
+    for (int i = 0; i < engine->scheduleLength; i++) {
+        DerivedKernel kernel = engine->schedule[i];
+
+        if (DERIVED_KERNELS[kernel].reset) {
+            DERIVED_KERNELS[kernel].reset(engine, &engine->kernels[kernel]);
+        }
+    }
+}
+
+/**
+ * Compute the available channels for the frames of the batch (which must follow the frames of the previous batch).
+ * The results are left in engine->columns.
+ */
+void derivedEngineProcess(derivedEngine_t *engine, const derivedBatch_t *batch)
+{
+    derivedInput_t inputs[DERIVED_KERNEL_MAX_INPUTS];
+
+    for (int i = 0; i < engine->scheduleLength; i++) {
+        DerivedKernel kernel = engine->schedule[i];
+        const derivedKernelDefinition_t *definition = &DERIVED_KERNELS[kernel];
+        derivedKernelState_t *state = &engine->kernels[kernel];
+
+        for (int j = 0; j < definition->inputCount; j++) {
+            if (state->inputField[j] != -1) {
+                inputs[j].values = batch->values + (ptrdiff_t) state->inputField[j] * batch->fieldStride;
+                inputs[j].stride = batch->frameStride;
+            } else if (state->inputChannel[j] != -1) {
+                inputs[j].values = engine->columns[state->inputChannel[j]].ints;
+                inputs[j].stride = 1;
+            } else {
+                inputs[j].values = NULL;
+                inputs[j].stride = 0;
+            }
+        }
+
+        definition->process(engine, state, batch->count, batch->time, inputs);
+    }
+}
+
+void derivedEngineDestroy(derivedEngine_t *engine)
+{
+    if (!engine)
+        return;
+
+    for (int i = 0; i < DERIVED_CHANNEL_COUNT; i++) {
+        free(engine->columns[i].ints);
+        free(engine->columns[i].floats);
+        free(engine->columns[i].doubles);
+    }
+
+    free(engine);
+}
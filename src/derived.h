@@ -0,0 +1,116 @@
+#ifndef DERIVED_H_
+#define DERIVED_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "parser.h"
+#include "imu.h"
+#include "battery.h"
+
+typedef enum DerivedChannel {
+    DERIVED_CHANNEL_ROLL = 0,
+    DERIVED_CHANNEL_PITCH,
+    DERIVED_CHANNEL_HEADING,
+    DERIVED_CHANNEL_AXIS_PID_SUM_ROLL,
+    DERIVED_CHANNEL_AXIS_PID_SUM_PITCH,
+    DERIVED_CHANNEL_AXIS_PID_SUM_YAW,
+    DERIVED_CHANNEL_CURRENT_MEASURED,
+    DERIVED_CHANNEL_ENERGY_CUMULATIVE,
+    DERIVED_CHANNEL_CURRENT_VIRTUAL,
+    DERIVED_CHANNEL_ENERGY_CUMULATIVE_VIRTUAL,
+    DERIVED_CHANNEL_COUNT
+} DerivedChannel;
+
+typedef enum DerivedChannelType {
+    DERIVED_TYPE_INT64 = 0,
+    DERIVED_TYPE_FLOAT,
+    DERIVED_TYPE_DOUBLE
+} DerivedChannelType;
+
+typedef enum DerivedKernel {
+    DERIVED_KERNEL_ATTITUDE = 0,
+    DERIVED_KERNEL_AXIS_PID_SUM_ROLL,
+    DERIVED_KERNEL_AXIS_PID_SUM_PITCH,
+    DERIVED_KERNEL_AXIS_PID_SUM_YAW,
+    DERIVED_KERNEL_CURRENT_MEASURED,
+    DERIVED_KERNEL_ENERGY_CUMULATIVE,
+    DERIVED_KERNEL_CURRENT_VIRTUAL,
+    DERIVED_KERNEL_ENERGY_CUMULATIVE_VIRTUAL,
+    DERIVED_KERNEL_COUNT
+} DerivedKernel;
+
+#define DERIVED_KERNEL_MAX_INPUTS 9
+
+/**
+ * A batch of main frames to compute the derived channels for. The value of log field `f` in frame `i` of the batch is
+ * found at values[f * fieldStride + i * frameStride], so both arrays of frames and columns of fields can be used.
+ */
+typedef struct derivedBatch_t {
+    int count;
+    const int64_t *time;
+
+    const int64_t *values;
+    int fieldStride, frameStride;
+} derivedBatch_t;
+
+typedef struct derivedColumn_t {
+    DerivedChannelType type;
+
+    // The value of the channel for each frame of the last batch, in the member that matches its type:
+    int64_t *ints;
+    float *floats;
+    double *doubles;
+} derivedColumn_t;
+
+typedef struct derivedSettings_t {
+    // Decimal degrees
+    double magneticDeclination;
+    bool ignoreMag;
+
+    int16_t currentMeterOffset, currentMeterScale;
+} derivedSettings_t;
+
+typedef struct derivedKernelState_t {
+    bool enabled;
+
+    // The channel the kernel writes its results to
+    DerivedChannel output;
+
+    // For each input, the index of the log field it reads from, or the derived channel it reads from, or -1 for both
+    // if the input is missing from this log
+    int inputField[DERIVED_KERNEL_MAX_INPUTS];
+    int inputChannel[DERIVED_KERNEL_MAX_INPUTS];
+
+    imuState_t imu;
+    currentMeterState_t meter;
+} derivedKernelState_t;
+
+typedef struct derivedEngine_t {
+    flightLog_t *log;
+    derivedSettings_t settings;
+
+    // The largest batch that can be processed
+    int capacity;
+
+    bool available[DERIVED_CHANNEL_COUNT];
+    derivedColumn_t columns[DERIVED_CHANNEL_COUNT];
+
+    derivedKernelState_t kernels[DERIVED_KERNEL_COUNT];
+
+    // The enabled kernels in the order they'll be run (every kernel comes after the kernels it reads from)
+    DerivedKernel schedule[DERIVED_KERNEL_COUNT];
+    int scheduleLength;
+} derivedEngine_t;
+
+void derivedSettingsInit(derivedSettings_t *settings, flightLog_t *log);
+
+derivedEngine_t* derivedEngineCreate(flightLog_t *log, const derivedSettings_t *settings, const bool *requested, int capacity);
+void derivedEngineReset(derivedEngine_t *engine);
+void derivedEngineProcess(derivedEngine_t *engine, const derivedBatch_t *batch);
+void derivedEngineDestroy(derivedEngine_t *engine);
+
+const char *derivedChannelName(DerivedChannel channel);
+bool derivedChannelFromName(const char *name, DerivedChannel *channel);
+
+#endif
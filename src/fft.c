@@ -0,0 +1,431 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fft.h"
+
+/*
+ * A mixed-radix, decimation-in-time FFT (in the style of KISS FFT).
+ *
+ * The transform size is factored into radix-4, 2, 3 and 5 stages with specialised butterflies, and any larger prime
+ * factors are handled by a generic (O(p^2)) butterfly. Each stage recursively transforms `radix` interleaved
+ * sub-sequences of the input and then joins them together in the output buffer.
+ *
+ * Real transforms of even size are computed by packing the input into a complex sequence of half the length, then
+ * separating the spectra of the even and odd samples afterwards.
+ */
+
+static inline fftComplex_t complexMultiply(fftComplex_t a, fftComplex_t b)
+{
+    fftComplex_t result;
+
+    result.re = a.re * b.re - a.im * b.im;
+    result.im = a.re * b.im + a.im * b.re;
+
+    return result;
+}
+
+static inline fftComplex_t complexAdd(fftComplex_t a, fftComplex_t b)
+{
+    fftComplex_t result = {a.re + b.re, a.im + b.im};
+
+    return result;
+}
+
+static inline fftComplex_t complexSubtract(fftComplex_t a, fftComplex_t b)
+{
+    fftComplex_t result = {a.re - b.re, a.im - b.im};
+
+    return result;
+}
+
+static void fftButterfly2(const fftPlan_t *plan, fftComplex_t *out, int stride, int m)
+{
+    const fftComplex_t *twiddle = plan->twiddles;
+    fftComplex_t *out2 = out + m;
+
+    for (int i = 0; i < m; i++) {
+        fftComplex_t t = complexMultiply(out2[i], *twiddle);
+
+        twiddle += stride;
+
+        out2[i] = complexSubtract(out[i], t);
+        out[i] = complexAdd(out[i], t);
+    }
+}
+
+static void fftButterfly3(const fftPlan_t *plan, fftComplex_t *out, int stride, int m)
+{
+    const fftComplex_t *twiddle1 = plan->twiddles, *twiddle2 = plan->twiddles;
+    float epi3 = plan->twiddles[stride * m].im;
+
+    for (int i = 0; i < m; i++) {
+        fftComplex_t s0, s1, s2, s3;
+
+        s1 = complexMultiply(out[i + m], *twiddle1);
+        s2 = complexMultiply(out[i + 2 * m], *twiddle2);
+
+        s3 = complexAdd(s1, s2);
+        s0 = complexSubtract(s1, s2);
+
+        twiddle1 += stride;
+        twiddle2 += stride * 2;
+
+        out[i + m].re = out[i].re - s3.re * 0.5f;
+        out[i + m].im = out[i].im - s3.im * 0.5f;
+
+        s0.re *= epi3;
+        s0.im *= epi3;
+
+        out[i] = complexAdd(out[i], s3);
+
+        out[i + 2 * m].re = out[i + m].re + s0.im;
+        out[i + 2 * m].im = out[i + m].im - s0.re;
+
+        out[i + m].re -= s0.im;
+        out[i + m].im += s0.re;
+    }
+}
+
+static void fftButterfly4(const fftPlan_t *plan, fftComplex_t *out, int stride, int m)
+{
+    const fftComplex_t *twiddle1 = plan->twiddles, *twiddle2 = plan->twiddles, *twiddle3 = plan->twiddles;
+
+    for (int i = 0; i < m; i++) {
+        fftComplex_t s0, s1, s2, s3, s4, s5;
+
+        s0 = complexMultiply(out[i + m], *twiddle1);
+        s1 = complexMultiply(out[i + 2 * m], *twiddle2);
+        s2 = complexMultiply(out[i + 3 * m], *twiddle3);
+
+        s5 = complexSubtract(out[i], s1);
+        out[i] = complexAdd(out[i], s1);
+
+        s3 = complexAdd(s0, s2);
+        s4 = complexSubtract(s0, s2);
+
+        out[i + 2 * m] = complexSubtract(out[i], s3);
+
+        twiddle1 += stride;
+        twiddle2 += stride * 2;
+        twiddle3 += stride * 3;
+
+        out[i] = complexAdd(out[i], s3);
+
+        if (plan->inverse) {
+            out[i + m].re = s5.re - s4.im;
+            out[i + m].im = s5.im + s4.re;
+            out[i + 3 * m].re = s5.re + s4.im;
+            out[i + 3 * m].im = s5.im - s4.re;
+        } else {
+            out[i + m].re = s5.re + s4.im;
+            out[i + m].im = s5.im - s4.re;
+            out[i + 3 * m].re = s5.re - s4.im;
+            out[i + 3 * m].im = s5.im + s4.re;
+        }
+    }
+}
+
+static void fftButterfly5(const fftPlan_t *plan, fftComplex_t *out, int stride, int m)
+{
+    const fftComplex_t *twiddles = plan->twiddles;
+    fftComplex_t ya = twiddles[stride * m], yb = twiddles[stride * 2 * m];
+    fftComplex_t *out0 = out, *out1 = out + m, *out2 = out + 2 * m, *out3 = out + 3 * m, *out4 = out + 4 * m;
+
+    for (int i = 0; i < m; i++) {
+        fftComplex_t s0, s1, s2, s3, s4, s5, s6, s7, s8, s9, s10, s11, s12;
+
+        s0 = out0[i];
+
+        s1 = complexMultiply(out1[i], twiddles[i * stride]);
+        s2 = complexMultiply(out2[i], twiddles[2 * i * stride]);
+        s3 = complexMultiply(out3[i], twiddles[3 * i * stride]);
+        s4 = complexMultiply(out4[i], twiddles[4 * i * stride]);
+
+        s7 = complexAdd(s1, s4);
+        s10 = complexSubtract(s1, s4);
+        s8 = complexAdd(s2, s3);
+        s9 = complexSubtract(s2, s3);
+
+        out0[i].re += s7.re + s8.re;
+        out0[i].im += s7.im + s8.im;
+
+        s5.re = s0.re + s7.re * ya.re + s8.re * yb.re;
+        s5.im = s0.im + s7.im * ya.re + s8.im * yb.re;
+
+        s6.re = s10.im * ya.im + s9.im * yb.im;
+        s6.im = -s10.re * ya.im - s9.re * yb.im;
+
+        out1[i] = complexSubtract(s5, s6);
+        out4[i] = complexAdd(s5, s6);
+
+        s11.re = s0.re + s7.re * yb.re + s8.re * ya.re;
+        s11.im = s0.im + s7.im * yb.re + s8.im * ya.re;
+
+        s12.re = -s10.im * yb.im + s9.im * ya.im;
+        s12.im = s10.re * yb.im - s9.re * ya.im;
+
+        out2[i] = complexAdd(s11, s12);
+        out3[i] = complexSubtract(s11, s12);
+    }
+}
+
+/**
+ * A butterfly for any radix `p`, computed directly from the definition of the DFT.
+ */
+static void fftButterflyGeneric(const fftPlan_t *plan, fftComplex_t *out, int stride, int m, int p)
+{
+    fftComplex_t *scratch = malloc(p * sizeof(*scratch));
+
+    for (int u = 0; u < m; u++) {
+        for (int q = 0, k = u; q < p; q++, k += m) {
+            scratch[q] = out[k];
+        }
+
+        for (int q1 = 0, k = u; q1 < p; q1++, k += m) {
+            int twiddleIndex = 0;
+
+            out[k] = scratch[0];
+
+            for (int q = 1; q < p; q++) {
+                twiddleIndex += stride * k;
+
+                if (twiddleIndex >= plan->size) {
+                    twiddleIndex -= plan->size;
+                }
+
+                out[k] = complexAdd(out[k], complexMultiply(scratch[q], plan->twiddles[twiddleIndex]));
+            }
+        }
+    }
+
+    free(scratch);
+}
+
+static void fftWork(const fftPlan_t *plan, fftComplex_t *out, const fftComplex_t *in, int stride, const int *factors)
+{
+    int p = factors[0]; // The radix of this stage
+    int m = factors[1]; // The length of each of the sub-transforms it joins
+
+    if (m == 1) {
+        for (int i = 0; i < p; i++) {
+            out[i] = in[i * stride];
+        }
+    } else {
+        for (int i = 0; i < p; i++) {
+            fftWork(plan, out + i * m, in + i * stride, stride * p, factors + 2);
+        }
+    }
+
+    switch (p) {
+        case 2:
+            fftButterfly2(plan, out, stride, m);
+        break;
+        case 3:
+            fftButterfly3(plan, out, stride, m);
+        break;
+        case 4:
+            fftButterfly4(plan, out, stride, m);
+        break;
+        case 5:
+            fftButterfly5(plan, out, stride, m);
+        break;
+        default:
+            fftButterflyGeneric(plan, out, stride, m, p);
+    }
+}
+
+/**
+ * Split the size into the radixes of the stages of the transform, preferring radix 4 and then small primes.
+ */
+static void fftFactor(int size, int *factors)
+{
+    int p = 4;
+    int limit = (int) floor(sqrt((double) size));
+
+    do {
+        while (size % p) {
+            switch (p) {
+                case 4:
+                    p = 2;
+                break;
+                case 2:
+                    p = 3;
+                break;
+                default:
+                    p += 2;
+            }
+
+            if (p > limit) {
+                p = size;
+            }
+        }
+
+        size /= p;
+
+        *factors++ = p;
+        *factors++ = size;
+    } while (size > 1);
+}
+
+/**
+ * Create a plan for a complex FFT of the given size (which must be at least 1). The inverse transform is unscaled
+ * (a forward and inverse transform multiplies the input by the size).
+ */
+fftPlan_t* fftPlanCreate(int size, bool inverse)
+{
+    fftPlan_t *plan;
+
+    if (size < 1) {
+        return NULL;
+    }
+
+    plan = calloc(1, sizeof(*plan));
+
+    plan->size = size;
+    plan->inverse = inverse;
+    plan->twiddles = malloc(size * sizeof(*plan->twiddles));
+
+    for (int i = 0; i < size; i++) {
+        double phase = -2 * M_PI * i / size;
+
+        if (inverse) {
+            phase = -phase;
+        }
+
+        plan->twiddles[i].re = (float) cos(phase);
+        plan->twiddles[i].im = (float) sin(phase);
+    }
+
+    fftFactor(size, plan->factors);
+
+    return plan;
+}
+
+void fftPlanDestroy(fftPlan_t *plan)
+{
+    if (plan) {
+        free(plan->twiddles);
+        free(plan);
+    }
+}
+
+/**
+ * Transform the `plan->size` complex values of the input into the output. The input and output must not overlap.
+ */
+void fftTransform(const fftPlan_t *plan, const fftComplex_t *input, fftComplex_t *output)
+{
+    fftWork(plan, output, input, 1, plan->factors);
+}
+
+/**
+ * Create a plan for a real FFT of the given size, which must be even. Returns NULL if the size isn't supported.
+ *
+ * Like the complex transform, the inverse is unscaled.
+ */
+fftRealPlan_t* fftRealPlanCreate(int size, bool inverse)
+{
+    fftRealPlan_t *plan;
+    int halfSize = size / 2;
+
+    if (size < 2 || size % 2 != 0) {
+        return NULL;
+    }
+
+    plan = malloc(sizeof(*plan));
+
+    plan->size = size;
+    plan->inverse = inverse;
+    plan->half = fftPlanCreate(halfSize, inverse);
+    plan->twiddles = malloc((halfSize / 2 + 1) * sizeof(*plan->twiddles));
+
+    for (int i = 0; i < halfSize / 2 + 1; i++) {
+        double phase = -M_PI * ((double) (i + 1) / halfSize + 0.5);
+
+        if (inverse) {
+            phase = -phase;
+        }
+
+        plan->twiddles[i].re = (float) cos(phase);
+        plan->twiddles[i].im = (float) sin(phase);
+    }
+
+    return plan;
+}
+
+void fftRealPlanDestroy(fftRealPlan_t *plan)
+{
+    if (plan) {
+        fftPlanDestroy(plan->half);
+        free(plan->twiddles);
+        free(plan);
+    }
+}
+
+/**
+ * Transform the `plan->size` real samples of the input into `plan->size / 2 + 1` frequency bins in the output (from
+ * DC up to the Nyquist frequency). The scratch buffer must have room for `plan->size / 2` values.
+ *
+ * The plan must not be an inverse plan. Each thread must use its own output and scratch buffers.
+ */
+void fftRealForward(const fftRealPlan_t *plan, const float *input, fftComplex_t *output, fftComplex_t *scratch)
+{
+    int halfSize = plan->size / 2;
+    fftComplex_t dc;
+
+    // Transform the even samples as the real part and the odd samples as the imaginary part:
+    fftWork(plan->half, scratch, (const fftComplex_t *) input, 1, plan->half->factors);
+
+    dc = scratch[0];
+
+    output[0].re = dc.re + dc.im;
+    output[0].im = 0;
+    output[halfSize].re = dc.re - dc.im;
+    output[halfSize].im = 0;
+
+    // Then separate the two spectra and combine them into the spectrum of the whole sequence:
+    for (int k = 1; k <= halfSize / 2; k++) {
+        fftComplex_t fpk = scratch[k];
+        fftComplex_t fpnk = {scratch[halfSize - k].re, -scratch[halfSize - k].im};
+        fftComplex_t f1k, f2k, t;
+
+        f1k = complexAdd(fpk, fpnk);
+        f2k = complexSubtract(fpk, fpnk);
+        t = complexMultiply(f2k, plan->twiddles[k - 1]);
+
+        output[k].re = (f1k.re + t.re) * 0.5f;
+        output[k].im = (f1k.im + t.im) * 0.5f;
+        output[halfSize - k].re = (f1k.re - t.re) * 0.5f;
+        output[halfSize - k].im = (t.im - f1k.im) * 0.5f;
+    }
+}
+
+/**
+ * Transform the `plan->size / 2 + 1` frequency bins of the input back into `plan->size` real samples (multiplied by
+ * the size, since the transform is unscaled). The plan must be an inverse plan, and the scratch buffer must have room
+ * for `plan->size / 2` values.
+ */
+void fftRealInverse(const fftRealPlan_t *plan, const fftComplex_t *input, float *output, fftComplex_t *scratch)
+{
+    int halfSize = plan->size / 2;
+
+    // Recombine the spectra of the even and odd samples into the spectrum of a half-length complex sequence:
+    scratch[0].re = input[0].re + input[halfSize].re;
+    scratch[0].im = input[0].re - input[halfSize].re;
+
+    for (int k = 1; k <= halfSize / 2; k++) {
+        fftComplex_t fk = input[k];
+        fftComplex_t fnkc = {input[halfSize - k].re, -input[halfSize - k].im};
+        fftComplex_t fek, fok;
+
+        fek = complexAdd(fk, fnkc);
+        fok = complexMultiply(complexSubtract(fk, fnkc), plan->twiddles[k - 1]);
+
+        scratch[k] = complexAdd(fek, fok);
+        scratch[halfSize - k].re = fek.re - fok.re;
+        scratch[halfSize - k].im = fok.im - fek.im;
+    }
+
+    // Whose transform has the even samples in its real part and the odd samples in its imaginary part:
+    fftWork(plan->half, (fftComplex_t *) output, scratch, 1, plan->half->factors);
+}
@@ -0,0 +1,48 @@
+#ifndef FFT_H_
+#define FFT_H_
+
+#include <stdbool.h>
+
+typedef struct fftComplex_t {
+    float re, im;
+} fftComplex_t;
+
+// Enough stages for any transform size that fits in an int
+#define FFT_MAX_FACTORS 32
+
+/**
+ * A complex FFT of a fixed size. Plans are never modified by the transforms that use them, so one plan can be shared
+ * between threads.
+ */
+typedef struct fftPlan_t {
+    int size;
+    bool inverse;
+
+    // For each stage of the transform, the radix of that stage followed by the length of the sub-transforms it joins
+    int factors[2 * FFT_MAX_FACTORS];
+
+    fftComplex_t *twiddles;
+} fftPlan_t;
+
+/**
+ * A transform of `size` real samples into their size / 2 + 1 non-negative frequency bins (or back again for an
+ * inverse plan). It's computed with a complex FFT of half the size.
+ */
+typedef struct fftRealPlan_t {
+    int size;
+    bool inverse;
+
+    fftPlan_t *half;
+    fftComplex_t *twiddles;
+} fftRealPlan_t;
+
+fftPlan_t* fftPlanCreate(int size, bool inverse);
+void fftPlanDestroy(fftPlan_t *plan);
+void fftTransform(const fftPlan_t *plan, const fftComplex_t *input, fftComplex_t *output);
+
+fftRealPlan_t* fftRealPlanCreate(int size, bool inverse);
+void fftRealPlanDestroy(fftRealPlan_t *plan);
+void fftRealForward(const fftRealPlan_t *plan, const float *input, fftComplex_t *output, fftComplex_t *scratch);
+void fftRealInverse(const fftRealPlan_t *plan, const fftComplex_t *input, float *output, fftComplex_t *scratch);
+
+#endif
@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "filters.h"
+
+/*
+ * Smoothing filters for a series of evenly spaced samples. The averaging filters only average over the samples that
+ * exist, so they don't pull the ends of the series towards zero.
+ *
+ * The loops over samples are kept free of branches and calls so the compiler can vectorise them.
+ */
+
+const char* const FILTER_TYPE_NAME[FILTER_TYPE_COUNT] = {
+    "average", "gaussian", "lowpass", "filtfilt"
+};
+
+bool filterTypeParse(const char *name, FilterType *type)
+{
+    for (int i = 0; i < FILTER_TYPE_COUNT; i++) {
+        if (strcmp(name, FILTER_TYPE_NAME[i]) == 0) {
+            *type = (FilterType) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Replace each sample with the average of the samples in a window of (radius * 2 + 1) centered on it.
+ */
+void filterMovingAverage(const float *input, float *output, int count, int radius)
+{
+    double sum = 0;
+    int left = 0, right = 0;
+
+    for (int i = 0; i < count; i++) {
+        // Slide the window [left...right) along to [i - radius...i + radius]
+        while (right < count && right <= i + radius) {
+            sum += input[right++];
+        }
+        while (left < i - radius) {
+            sum -= input[left++];
+        }
+
+        output[i] = (float) (sum / (right - left));
+    }
+}
+
+/**
+ * The number of samples either side of the center of the Gaussian kernel that matches a moving average of the given
+ * radius.
+ */
+int filterGaussianKernelRadius(int radius)
+{
+    double sigma = sqrt(radius * (radius + 1) / 3.0);
+
+    return (int) ceil(3 * sigma);
+}
+
+/**
+ * Fill the kernel with (filterGaussianKernelRadius(radius) * 2 + 1) weights, which have the same standard deviation
+ * as a moving average of the given radius.
+ */
+void filterGaussianKernel(int radius, float *kernel)
+{
+    int kernelRadius = filterGaussianKernelRadius(radius);
+    double sigma = sqrt(radius * (radius + 1) / 3.0);
+
+    for (int i = -kernelRadius; i <= kernelRadius; i++) {
+        kernel[i + kernelRadius] = (float) exp(-(i * i) / (2 * sigma * sigma));
+    }
+}
+
+void filterGaussian(const float *input, float *output, int count, const float *kernel, int kernelRadius)
+{
+    for (int i = 0; i < count; i++) {
+        int first = i - kernelRadius < 0 ? 0 : i - kernelRadius;
+        int last = i + kernelRadius >= count ? count - 1 : i + kernelRadius;
+        float sum = 0, weightSum = 0;
+
+        for (int j = first; j <= last; j++) {
+            float weight = kernel[j - i + kernelRadius];
+
+            sum += input[j] * weight;
+            weightSum += weight;
+        }
+
+        output[i] = sum / weightSum;
+    }
+}
+
+/**
+ * Set up a second order low-pass filter with a Butterworth response.
+ */
+void biquadFilterInitLowPass(biquadFilter_t *filter, double cutoffFrequency, double sampleRate)
+{
+    const double Q = 1 / sqrt(2);
+    double omega, cosOmega, alpha, a0;
+
+    // Cutoffs at or above the Nyquist frequency don't filter anything
+    if (cutoffFrequency <= 0 || cutoffFrequency >= sampleRate * 0.5) {
+        filter->b0 = 1;
+        filter->b1 = filter->b2 = filter->a1 = filter->a2 = 0;
+        return;
+    }
+
+    omega = 2 * M_PI * cutoffFrequency / sampleRate;
+    cosOmega = cos(omega);
+    alpha = sin(omega) / (2 * Q);
+    a0 = 1 + alpha;
+
+    filter->b0 = (float) ((1 - cosOmega) / 2 / a0);
+    filter->b1 = (float) ((1 - cosOmega) / a0);
+    filter->b2 = filter->b0;
+    filter->a1 = (float) (-2 * cosOmega / a0);
+    filter->a2 = (float) ((1 - alpha) / a0);
+}
+
+/**
+ * Filter the values in place, either forwards or backwards. The filter starts as if it had always seen the first
+ * value it's given, so there's no transient at the start.
+ */
+void biquadFilterApply(const biquadFilter_t *filter, float *values, int count, bool reverse)
+{
+    int step = reverse ? -1 : 1;
+    int i = reverse ? count - 1 : 0;
+    float z1, z2;
+
+    if (count == 0)
+        return;
+
+    // The state of the transposed direct form II filter after a long run of the first value
+    z2 = (filter->b2 - filter->a2) * values[i];
+    z1 = (filter->b1 - filter->a1) * values[i] + z2;
+
+    for (int n = 0; n < count; n++, i += step) {
+        float input = values[i];
+        float output = filter->b0 * input + z1;
+
+        z1 = filter->b1 * input - filter->a1 * output + z2;
+        z2 = filter->b2 * input - filter->a2 * output;
+
+        values[i] = output;
+    }
+}
+
+/**
+ * The number of floats of scratch space needed by filterApply() for a series of `count` samples.
+ */
+int filterScratchSize(const filterSettings_t *settings, int count)
+{
+    switch (settings->type) {
+        case FILTER_TYPE_MOVING_AVERAGE:
+            return count;
+        case FILTER_TYPE_GAUSSIAN:
+            return count + filterGaussianKernelRadius(settings->radius) * 2 + 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Filter the `count` samples in place, which are 1/sampleRate seconds apart.
+ */
+void filterApply(const filterSettings_t *settings, float *values, int count, double sampleRate, float *scratch)
+{
+    biquadFilter_t biquad;
+    int kernelRadius;
+
+    switch (settings->type) {
+        case FILTER_TYPE_MOVING_AVERAGE:
+            memcpy(scratch, values, count * sizeof(*values));
+            filterMovingAverage(scratch, values, count, settings->radius);
+        break;
+        case FILTER_TYPE_GAUSSIAN:
+            kernelRadius = filterGaussianKernelRadius(settings->radius);
+
+            memcpy(scratch, values, count * sizeof(*values));
+            filterGaussianKernel(settings->radius, scratch + count);
+            filterGaussian(scratch, values, count, scratch + count, kernelRadius);
+        break;
+        case FILTER_TYPE_LOWPASS:
+        case FILTER_TYPE_FILTFILT:
+            biquadFilterInitLowPass(&biquad, settings->cutoffFrequency, sampleRate);
+
+            biquadFilterApply(&biquad, values, count, false);
+
+            if (settings->type == FILTER_TYPE_FILTFILT) {
+                biquadFilterApply(&biquad, values, count, true);
+            }
+        break;
+        default:
+        break;
+    }
+}
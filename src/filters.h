@@ -0,0 +1,48 @@
+#ifndef FILTERS_H_
+#define FILTERS_H_
+
+#include <stdbool.h>
+
+typedef enum FilterType {
+    // Average over a window of (radius * 2 + 1) samples
+    FILTER_TYPE_MOVING_AVERAGE = 0,
+    // Gaussian-weighted average with the same standard deviation as the moving average of the same radius
+    FILTER_TYPE_GAUSSIAN,
+    // Second order Butterworth low-pass filter at a cutoff frequency, which delays the signal like the craft's own filters
+    FILTER_TYPE_LOWPASS,
+    // The low-pass filter run forwards and then backwards, so the result isn't delayed (it's also twice as steep)
+    FILTER_TYPE_FILTFILT,
+    FILTER_TYPE_COUNT
+} FilterType;
+
+typedef struct filterSettings_t {
+    FilterType type;
+
+    // For the averaging filters, in samples
+    int radius;
+
+    // For the low-pass filters, in Hz
+    double cutoffFrequency;
+} filterSettings_t;
+
+typedef struct biquadFilter_t {
+    float b0, b1, b2, a1, a2;
+} biquadFilter_t;
+
+extern const char* const FILTER_TYPE_NAME[FILTER_TYPE_COUNT];
+
+bool filterTypeParse(const char *name, FilterType *type);
+
+void filterMovingAverage(const float *input, float *output, int count, int radius);
+
+int filterGaussianKernelRadius(int radius);
+void filterGaussianKernel(int radius, float *kernel);
+void filterGaussian(const float *input, float *output, int count, const float *kernel, int kernelRadius);
+
+void biquadFilterInitLowPass(biquadFilter_t *filter, double cutoffFrequency, double sampleRate);
+void biquadFilterApply(const biquadFilter_t *filter, float *values, int count, bool reverse);
+
+int filterScratchSize(const filterSettings_t *settings, int count);
+void filterApply(const filterSettings_t *settings, float *values, int count, double sampleRate, float *scratch);
+
+#endif
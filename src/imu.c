@@ -2,6 +2,8 @@
  * This IMU code is used for attitude estimation, and is directly derived from Baseflight's imu.c.
  */
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 //For msvcrt to define M_PI:
 #define _USE_MATH_DEFINES
@@ -30,44 +32,42 @@ typedef enum {
 
 //Settings that would normally be set by the user in MW config:
 static const uint16_t gyro_cmpf_factor = 600;
-static const float accz_lpf_cutoff = 5.0f;
 static const uint16_t gyro_cmpfm_factor = 250;
-static float magneticDeclination = 0.0f;
 
-//IMU fields:
-static float fc_acc;
-static float invGyroComplimentaryFilter_M_Factor;
+#define INV_GYR_CMPF_FACTOR   (1.0f / ((float)gyro_cmpf_factor + 1.0f))
+#define INV_GYR_CMPFM_FACTOR  (1.0f / ((float)gyro_cmpfm_factor + 1.0f))
 
-static t_fp_vector EstM;
-static t_fp_vector EstN;
-static uint32_t previousTime;
+// How many samples updateEstimatedAttitudeBatch() prepares at a time
+#define IMU_BATCH_CHUNK 256
 
 /**
- * Call before any other routines in order to set up IMU constants and such.
+ * Call before any other routines in order to reset the estimator state.
  */
-void imuInit(void)
+void imuInit(imuState_t *imu)
 {
-    fc_acc = (float) (0.5f / (M_PI * accz_lpf_cutoff)); // calculate RC time constant used in the accZ lpf
-    invGyroComplimentaryFilter_M_Factor = (1.0f / (gyro_cmpfm_factor + 1.0f));
+    imu->EstG.V.X = 0.0f;
+    imu->EstG.V.Y = 0.0f;
+    imu->EstG.V.Z = 0.0f;
 
-    EstM.V.X = 1.0f;
-    EstM.V.Y = 0.0f;
-    EstM.V.Z = 0.0f;
+    imu->EstM.V.X = 1.0f;
+    imu->EstM.V.Y = 0.0f;
+    imu->EstM.V.Z = 0.0f;
 
-    EstN.V.X = 1.0f;
-    EstN.V.Y = 0.0f;
-    EstN.V.Z = 0.0f;
+    imu->EstN.V.X = 1.0f;
+    imu->EstN.V.Y = 0.0f;
+    imu->EstN.V.Z = 0.0f;
 
-    previousTime = 0;
+    imu->previousTime = 0;
+    imu->magneticDeclination = 0.0f;
 }
 
 /**
  * Set the magnetic declination in decimal degrees.
  */
-void imuSetMagneticDeclination(double declination)
+void imuSetMagneticDeclination(imuState_t *imu, double declination)
 {
     //Convert to radians now so we don't have to later on
-    magneticDeclination = (float) (declination * RAD);
+    imu->magneticDeclination = (float) (declination * RAD);
 }
 
 // **************************************************
@@ -84,10 +84,6 @@ void imuSetMagneticDeclination(double declination)
 //
 // **************************************************
 
-#define INV_GYR_CMPF_FACTOR   (1.0f / ((float)gyro_cmpf_factor + 1.0f))
-
-static t_fp_vector EstG;
-
 static void normalizeVector(struct fp_vector *src, struct fp_vector *dest)
 {
     float length;
@@ -158,7 +154,7 @@ t_fp_vector calculateAccelerationInEarthFrame(int16_t accSmooth[3], attitude_t *
 }
 
 // baseflight calculation by Luggi09 originates from arducopter
-static float calculateHeading(t_fp_vector *vec, float angleradRoll, float angleradPitch)
+static float calculateHeading(t_fp_vector *vec, float angleradRoll, float angleradPitch, float magneticDeclination)
 {
     float cosineRoll = cosf(angleradRoll);
     float sineRoll = sinf(angleradRoll);
@@ -174,53 +170,151 @@ static float calculateHeading(t_fp_vector *vec, float angleradRoll, float angler
     return hd;
 }
 
-void updateEstimatedAttitude(int16_t gyroADC[3], int16_t accSmooth[3], int16_t magADC[3], uint32_t currentTime, uint16_t acc_1G, float gyroScale, attitude_t *attitude)
+/**
+ * Check that the accelerometer is reading between 0.85G and 1.15G (given the sum of the squares of the axes), otherwise
+ * the craft is accelerating and we can't use it as a reference for the gravity vector.
+ */
+static bool accelerationIsValid(int32_t accMag, uint16_t acc_1G)
+{
+    accMag = accMag * 100 / ((int32_t)acc_1G * acc_1G);
+
+    return 72 < (uint16_t)accMag && (uint16_t)accMag < 133;
+}
+
+/**
+ * Advance the estimate by one sample, given the angles the gyros rotated through since the previous sample.
+ */
+static void imuApplySample(imuState_t *imu, float deltaGyroAngle[3], bool accValid, const float accSmooth[3], const float *magADC, attitude_t *attitude)
+{
+    rotateVector(&imu->EstG.V, deltaGyroAngle);
+
+    // Apply complimentary filter (Gyro drift correction)
+    // If accel magnitude >1.15G or <0.85G and  ACC vector outside of the limit range => we neutralize the effect of accelerometers in the angle estimation.
+    // To do that, we just skip filter, as Est V already rotated by Gyro
+    if (accValid) {
+        for (int axis = 0; axis < 3; axis++)
+            imu->EstG.A[axis] = (imu->EstG.A[axis] * (float)gyro_cmpf_factor + accSmooth[axis]) * INV_GYR_CMPF_FACTOR;
+    }
+
+    // Attitude of the estimated vector
+    attitude->roll = atan2f(imu->EstG.V.Y, imu->EstG.V.Z);
+    attitude->pitch = atan2f(-imu->EstG.V.X, sqrtf(imu->EstG.V.Y * imu->EstG.V.Y + imu->EstG.V.Z * imu->EstG.V.Z));
+
+    if (magADC) {
+        rotateVector(&imu->EstM.V, deltaGyroAngle);
+
+        for (int axis = 0; axis < 3; axis++) {
+            imu->EstM.A[axis] = (imu->EstM.A[axis] * gyro_cmpfm_factor + magADC[axis]) * INV_GYR_CMPFM_FACTOR;
+        }
+        attitude->heading = calculateHeading(&imu->EstM, attitude->roll, attitude->pitch, imu->magneticDeclination);
+    } else {
+        rotateVector(&imu->EstN.V, deltaGyroAngle);
+        normalizeVector(&imu->EstN.V, &imu->EstN.V);
+        attitude->heading = calculateHeading(&imu->EstN, attitude->roll, attitude->pitch, imu->magneticDeclination);
+    }
+}
+
+/**
+ * Update the attitude estimate with one frame of sensor readings. magADC may be NULL if there's no magnetometer.
+ */
+void updateEstimatedAttitude(imuState_t *imu, int16_t gyroADC[3], int16_t accSmooth[3], int16_t magADC[3], uint32_t currentTime, uint16_t acc_1G, float gyroScale, attitude_t *attitude)
 {
     int32_t accMag = 0;
     uint32_t deltaTime;
-    float scale, deltaGyroAngle[3];
+    float scale, deltaGyroAngle[3], acc[3], mag[3];
 
-    if (previousTime == 0) {
+    if (imu->previousTime == 0) {
         deltaTime = 1;
     } else {
-        deltaTime = currentTime - previousTime;
+        deltaTime = currentTime - imu->previousTime;
     }
 
     scale = deltaTime * gyroScale;
-    previousTime = currentTime;
+    imu->previousTime = currentTime;
 
-    // Initialization
     for (int axis = 0; axis < 3; axis++) {
         deltaGyroAngle[axis] = gyroADC[axis] * scale;
+        acc[axis] = accSmooth[axis];
 
         accMag += (int32_t)accSmooth[axis] * accSmooth[axis];
+
+        if (magADC) {
+            mag[axis] = magADC[axis];
+        }
     }
-    accMag = accMag * 100 / ((int32_t)acc_1G * acc_1G);
 
-    rotateVector(&EstG.V, deltaGyroAngle);
+    imuApplySample(imu, deltaGyroAngle, accelerationIsValid(accMag, acc_1G), acc, magADC ? mag : NULL, attitude);
+}
 
-    // Apply complimentary filter (Gyro drift correction)
-    // If accel magnitude >1.15G or <0.85G and  ACC vector outside of the limit range => we neutralize the effect of accelerometers in the angle estimation.
-    // To do that, we just skip filter, as Est V already rotated by Gyro
-    if (72 < (uint16_t)accMag && (uint16_t)accMag < 133) {
-        for (int axis = 0; axis < 3; axis++)
-            EstG.A[axis] = (EstG.A[axis] * (float)gyro_cmpf_factor + accSmooth[axis]) * INV_GYR_CMPF_FACTOR;
-    }
+/**
+ * Update the attitude estimate with `count` frames of sensor readings, writing the attitude after each frame to the
+ * roll/pitch/heading arrays (in radians).
+ *
+ * The sensor readings are given as one pointer per axis, with successive frames `stride` values apart, so that both
+ * columns and arrays of frames can be read. magADC may be NULL if there's no magnetometer.
+ *
+ * The per-frame conversions don't depend on the estimator state, so they're done for a chunk of frames at a time in
+ * simple loops the compiler can vectorise, which leaves only the filter itself to run sequentially.
+ */
+void updateEstimatedAttitudeBatch(imuState_t *imu, int count, const int64_t *time, const int64_t * const gyroADC[3],
+    const int64_t * const accSmooth[3], const int64_t * const magADC[3], int stride, uint16_t acc_1G, float gyroScale,
+    float *roll, float *pitch, float *heading)
+{
+    float deltaGyroAngle[3][IMU_BATCH_CHUNK], acc[3][IMU_BATCH_CHUNK], mag[3][IMU_BATCH_CHUNK];
+    float scale[IMU_BATCH_CHUNK];
+    int32_t accMag[IMU_BATCH_CHUNK];
 
-    // Attitude of the estimated vector
-    attitude->roll = atan2f(EstG.V.Y, EstG.V.Z);
-    attitude->pitch = atan2f(-EstG.V.X, sqrtf(EstG.V.Y * EstG.V.Y + EstG.V.Z * EstG.V.Z));
+    for (int chunkStart = 0; chunkStart < count; chunkStart += IMU_BATCH_CHUNK) {
+        int chunkLength = count - chunkStart < IMU_BATCH_CHUNK ? count - chunkStart : IMU_BATCH_CHUNK;
+        int i;
+
+        // Time since the previous frame
+        for (i = 0; i < chunkLength; i++) {
+            uint32_t previousTime = i == 0 ? imu->previousTime : (uint32_t) time[chunkStart + i - 1];
+            uint32_t deltaTime = previousTime == 0 ? 1 : (uint32_t) time[chunkStart + i] - previousTime;
+
+            scale[i] = deltaTime * gyroScale;
+        }
+
+        imu->previousTime = (uint32_t) time[chunkStart + chunkLength - 1];
+
+        for (i = 0; i < chunkLength; i++) {
+            accMag[i] = 0;
+        }
 
-    if (magADC) {
-        rotateVector(&EstM.V, deltaGyroAngle);
-        
         for (int axis = 0; axis < 3; axis++) {
-            EstM.A[axis] = (EstM.A[axis] * gyro_cmpfm_factor + magADC[axis]) * invGyroComplimentaryFilter_M_Factor;
+            const int64_t *gyroColumn = gyroADC[axis] + (ptrdiff_t) chunkStart * stride;
+            const int64_t *accColumn = accSmooth[axis] + (ptrdiff_t) chunkStart * stride;
+
+            for (i = 0; i < chunkLength; i++) {
+                int16_t accValue = (int16_t) accColumn[i * stride];
+
+                deltaGyroAngle[axis][i] = (int16_t) gyroColumn[i * stride] * scale[i];
+                acc[axis][i] = accValue;
+                accMag[i] += (int32_t) accValue * accValue;
+            }
+
+            if (magADC) {
+                const int64_t *magColumn = magADC[axis] + (ptrdiff_t) chunkStart * stride;
+
+                for (i = 0; i < chunkLength; i++) {
+                    mag[axis][i] = (int16_t) magColumn[i * stride];
+                }
+            }
+        }
+
+        // Now run the filter over the chunk
+        for (i = 0; i < chunkLength; i++) {
+            float frameDelta[3] = {deltaGyroAngle[0][i], deltaGyroAngle[1][i], deltaGyroAngle[2][i]};
+            float frameAcc[3] = {acc[0][i], acc[1][i], acc[2][i]};
+            float frameMag[3] = {mag[0][i], mag[1][i], mag[2][i]};
+            attitude_t attitude;
+
+            imuApplySample(imu, frameDelta, accelerationIsValid(accMag[i], acc_1G), frameAcc, magADC ? frameMag : NULL, &attitude);
+
+            roll[chunkStart + i] = attitude.roll;
+            pitch[chunkStart + i] = attitude.pitch;
+            heading[chunkStart + i] = attitude.heading;
         }
-        attitude->heading = calculateHeading(&EstM, attitude->roll, attitude->pitch);
-    } else {
-        rotateVector(&EstN.V, deltaGyroAngle);
-        normalizeVector(&EstN.V, &EstN.V);
-        attitude->heading = calculateHeading(&EstN, attitude->roll, attitude->pitch);
     }
 }
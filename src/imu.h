@@ -1,6 +1,8 @@
 #ifndef IMU_H_
 #define IMU_H_
 
+#include <stdint.h>
+
 typedef struct fp_vector {
     float X;
     float Y;
@@ -19,10 +21,22 @@ typedef struct attitude_t {
     float heading;
 } attitude_t;
 
-void imuInit(void);
-void imuSetMagneticDeclination(double declination);
+typedef struct imuState_t {
+    // Estimated gravity, magnetic field and north vectors in the craft's frame:
+    t_fp_vector EstG, EstM, EstN;
+    uint32_t previousTime;
+
+    // Radians
+    float magneticDeclination;
+} imuState_t;
+
+void imuInit(imuState_t *imu);
+void imuSetMagneticDeclination(imuState_t *imu, double declination);
 
-void updateEstimatedAttitude(int16_t gyroADC[3], int16_t accSmooth[3], int16_t magADC[3], uint32_t currentTime, uint16_t acc_1G, float gyroScale, attitude_t *attitude);
+void updateEstimatedAttitude(imuState_t *imu, int16_t gyroADC[3], int16_t accSmooth[3], int16_t magADC[3], uint32_t currentTime, uint16_t acc_1G, float gyroScale, attitude_t *attitude);
+void updateEstimatedAttitudeBatch(imuState_t *imu, int count, const int64_t *time, const int64_t * const gyroADC[3],
+    const int64_t * const accSmooth[3], const int64_t * const magADC[3], int stride, uint16_t acc_1G, float gyroScale,
+    float *roll, float *pitch, float *heading);
 t_fp_vector calculateAccelerationInEarthFrame(int16_t accSmooth[3], attitude_t *attitude, uint16_t acc_1G);
 
 #endif
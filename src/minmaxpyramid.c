@@ -0,0 +1,199 @@
+#include <stdlib.h>
+
+#include "minmaxpyramid.h"
+
+// Number of values read from the datapoints at a time while building the pyramid
+#define MINMAX_PYRAMID_READ_FRAMES 256
+
+static void rangeInit(minMaxRange_t *range)
+{
+    range->min = INT64_MAX;
+    range->max = INT64_MIN;
+    range->minIndex = -1;
+    range->maxIndex = -1;
+}
+
+/**
+ * Widen the range to cover another one. Ties go to the earlier frame, so the result doesn't depend on the order that
+ * the parts of a run are combined in.
+ */
+static void rangeMerge(minMaxRange_t *range, const minMaxRange_t *other)
+{
+    if (other->minIndex != -1 && (other->min < range->min || (other->min == range->min && other->minIndex < range->minIndex))) {
+        range->min = other->min;
+        range->minIndex = other->minIndex;
+    }
+
+    if (other->maxIndex != -1 && (other->max > range->max || (other->max == range->max && other->maxIndex < range->maxIndex))) {
+        range->max = other->max;
+        range->maxIndex = other->maxIndex;
+    }
+}
+
+static void rangeAddValues(minMaxRange_t *range, const int64_t *values, int firstFrameIndex, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (range->minIndex == -1 || values[i] < range->min) {
+            range->min = values[i];
+            range->minIndex = firstFrameIndex + i;
+        }
+
+        if (range->maxIndex == -1 || values[i] > range->max) {
+            range->max = values[i];
+            range->maxIndex = firstFrameIndex + i;
+        }
+    }
+}
+
+/**
+ * Add the frames of a run that's shorter than a block, straight from the datapoints.
+ */
+static void rangeAddFrames(const minMaxPyramid_t *pyramid, minMaxRange_t *range, int firstFrameIndex, int endFrameIndex)
+{
+    int64_t values[MINMAX_PYRAMID_BASE_FRAMES];
+    minMaxRange_t part;
+
+    if (endFrameIndex <= firstFrameIndex)
+        return;
+
+    rangeInit(&part);
+    rangeAddValues(&part, values, firstFrameIndex,
+        datapointsReadField(pyramid->points, pyramid->fieldIndex, firstFrameIndex, endFrameIndex - firstFrameIndex, values));
+    rangeMerge(range, &part);
+}
+
+/**
+ * Build the pyramid for the given field of the datapoints. The datapoints mustn't change while the pyramid is in use.
+ */
+minMaxPyramid_t* minMaxPyramidCreate(datapoints_t *points, int fieldIndex)
+{
+    minMaxPyramid_t *pyramid = malloc(sizeof(*pyramid));
+    int64_t values[MINMAX_PYRAMID_READ_FRAMES];
+    int blockCount = points->frameCount / MINMAX_PYRAMID_BASE_FRAMES;
+    minMaxRange_t *level;
+
+    pyramid->points = points;
+    pyramid->fieldIndex = fieldIndex;
+    pyramid->levelCount = 0;
+
+    // Each level has at most half the blocks of the one below, so this is enough for any number of frames
+    pyramid->blockCount = malloc(32 * sizeof(*pyramid->blockCount));
+    pyramid->levels = malloc(32 * sizeof(*pyramid->levels));
+
+    if (blockCount == 0)
+        return pyramid;
+
+    // Frames left over at the end which don't fill a block are always read directly
+    level = malloc(blockCount * sizeof(*level));
+
+    for (int start = 0; start < blockCount * MINMAX_PYRAMID_BASE_FRAMES; start += MINMAX_PYRAMID_READ_FRAMES) {
+        int count = datapointsReadField(points, fieldIndex, start, MINMAX_PYRAMID_READ_FRAMES, values);
+
+        for (int i = 0; i + MINMAX_PYRAMID_BASE_FRAMES <= count && (start + i) / MINMAX_PYRAMID_BASE_FRAMES < blockCount; i += MINMAX_PYRAMID_BASE_FRAMES) {
+            minMaxRange_t *block = &level[(start + i) / MINMAX_PYRAMID_BASE_FRAMES];
+
+            rangeInit(block);
+            rangeAddValues(block, values + i, start + i, MINMAX_PYRAMID_BASE_FRAMES);
+        }
+    }
+
+    while (blockCount > 0) {
+        pyramid->levels[pyramid->levelCount] = level;
+        pyramid->blockCount[pyramid->levelCount] = blockCount;
+        pyramid->levelCount++;
+
+        blockCount /= 2;
+
+        if (blockCount > 0) {
+            minMaxRange_t *below = level;
+
+            level = malloc(blockCount * sizeof(*level));
+
+            for (int i = 0; i < blockCount; i++) {
+                level[i] = below[i * 2];
+                rangeMerge(&level[i], &below[i * 2 + 1]);
+            }
+        }
+    }
+
+    return pyramid;
+}
+
+void minMaxPyramidDestroy(minMaxPyramid_t *pyramid)
+{
+    if (pyramid) {
+        for (int i = 0; i < pyramid->levelCount; i++) {
+            free(pyramid->levels[i]);
+        }
+
+        free(pyramid->levels);
+        free(pyramid->blockCount);
+        free(pyramid);
+    }
+}
+
+/**
+ * Find the smallest and largest values of the field over `count` frames beginning at firstFrameIndex.
+ *
+ * Returns false if there are no frames in that run.
+ */
+bool minMaxPyramidQuery(const minMaxPyramid_t *pyramid, int firstFrameIndex, int count, minMaxRange_t *range)
+{
+    int endFrameIndex;
+    int firstBlock, endBlock;
+
+    if (firstFrameIndex < 0) {
+        count += firstFrameIndex;
+        firstFrameIndex = 0;
+    }
+
+    endFrameIndex = firstFrameIndex + count;
+
+    if (endFrameIndex > pyramid->points->frameCount)
+        endFrameIndex = pyramid->points->frameCount;
+
+    rangeInit(range);
+
+    if (endFrameIndex <= firstFrameIndex)
+        return false;
+
+    // The whole blocks in the run, and the frames either side of them
+    firstBlock = (firstFrameIndex + MINMAX_PYRAMID_BASE_FRAMES - 1) / MINMAX_PYRAMID_BASE_FRAMES;
+    endBlock = endFrameIndex / MINMAX_PYRAMID_BASE_FRAMES;
+
+    if (pyramid->levelCount > 0 && endBlock > pyramid->blockCount[0])
+        endBlock = pyramid->blockCount[0];
+
+    if (pyramid->levelCount == 0 || firstBlock >= endBlock) {
+        // The run doesn't cover a whole block, but it might still be longer than one
+        for (int start = firstFrameIndex; start < endFrameIndex; start += MINMAX_PYRAMID_BASE_FRAMES) {
+            rangeAddFrames(pyramid, range, start, start + MINMAX_PYRAMID_BASE_FRAMES < endFrameIndex ? start + MINMAX_PYRAMID_BASE_FRAMES : endFrameIndex);
+        }
+
+        return true;
+    }
+
+    rangeAddFrames(pyramid, range, firstFrameIndex, firstBlock * MINMAX_PYRAMID_BASE_FRAMES);
+
+    for (int start = endBlock * MINMAX_PYRAMID_BASE_FRAMES; start < endFrameIndex; start += MINMAX_PYRAMID_BASE_FRAMES) {
+        rangeAddFrames(pyramid, range, start, start + MINMAX_PYRAMID_BASE_FRAMES < endFrameIndex ? start + MINMAX_PYRAMID_BASE_FRAMES : endFrameIndex);
+    }
+
+    // Climb the pyramid, taking the blocks at the ends of the run that don't pair up with a block inside it
+    for (int level = 0; firstBlock < endBlock; level++) {
+        if (firstBlock & 1) {
+            rangeMerge(range, &pyramid->levels[level][firstBlock]);
+            firstBlock++;
+        }
+
+        if (endBlock & 1) {
+            endBlock--;
+            rangeMerge(range, &pyramid->levels[level][endBlock]);
+        }
+
+        firstBlock /= 2;
+        endBlock /= 2;
+    }
+
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef MINMAXPYRAMID_H_
+#define MINMAXPYRAMID_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "datapoints.h"
+
+// The number of frames summarised by each block of the bottom level of the pyramid
+#define MINMAX_PYRAMID_BASE_FRAMES 32
+
+/**
+ * The smallest and largest values of a field over a run of frames, and the (first) frames where they were found.
+ */
+typedef struct minMaxRange_t {
+    int64_t min, max;
+    int minIndex, maxIndex;
+} minMaxRange_t;
+
+/**
+ * The minimum and maximum of a field over every aligned block of MINMAX_PYRAMID_BASE_FRAMES frames, then over every
+ * pair of those blocks, and so on up. The extremes of any run of frames can then be found from a handful of blocks,
+ * however long the run is.
+ */
+typedef struct minMaxPyramid_t {
+    datapoints_t *points;
+    int fieldIndex;
+
+    int levelCount;
+    // Level 0 is the bottom level, each block of level i + 1 covers two blocks of level i
+    int *blockCount;
+    minMaxRange_t **levels;
+} minMaxPyramid_t;
+
+minMaxPyramid_t* minMaxPyramidCreate(datapoints_t *points, int fieldIndex);
+void minMaxPyramidDestroy(minMaxPyramid_t *pyramid);
+
+bool minMaxPyramidQuery(const minMaxPyramid_t *pyramid, int firstFrameIndex, int count, minMaxRange_t *range);
+
+#endif
@@ -436,6 +436,8 @@ static void parseHeaderLine(flightLog_t *log, mmapStream_t *stream)
 		log->sysConfig.motorOutputHigh = log->sysConfig.maxthrottle;
     } else if (strcmp(fieldName, "rcRate") == 0) {
         log->sysConfig.rcRate = atoi(fieldValue);
+    } else if (strcmp(fieldName, "looptime") == 0) {
+        log->sysConfig.looptime = atoi(fieldValue);
     } else if (strcmp(fieldName, "vbatscale") == 0) {
         log->sysConfig.vbatscale = atoi(fieldValue);
     } else if (strcmp(fieldName, "vbatref") == 0) {
@@ -1321,6 +1323,8 @@ static void resetSysConfigToDefaults(flightLogSysConfig_t *config)
     config->rcRate = 90;
     config->yawRate = 0;
 
+    config->looptime = 0;
+
     // Default these to silly numbers, because if we don't know the hardware we can't even begin to guess:
     config->acc_1G = 1;
     config->gyroScale = 1;
@@ -1328,7 +1332,10 @@ static void resetSysConfigToDefaults(flightLogSysConfig_t *config)
     config->firmwareType = FIRMWARE_TYPE_UNKNOWN;
 }
 
-bool flightLogParse(flightLog_t *log, int logIndex, FlightLogMetadataReady onMetadataReady, FlightLogFrameReady onFrameReady, FlightLogEventReady onEvent, bool raw)
+/**
+ * Parse the log with the given index, stopping once the headers have been read if metadataOnly is set.
+ */
+static bool parseLog(flightLog_t *log, int logIndex, FlightLogMetadataReady onMetadataReady, FlightLogFrameReady onFrameReady, FlightLogEventReady onEvent, bool raw, bool metadataOnly)
 {
     ParserState parserState = PARSER_STATE_HEADER;
     bool looksLikeFrameCompleted = false;
@@ -1429,6 +1436,9 @@ bool flightLogParse(flightLog_t *log, int logIndex, FlightLogMetadataReady onMet
 
                             if (onMetadataReady)
                                 onMetadataReady(log);
+
+                            if (metadataOnly)
+                                return true;
                         } // else skip garbage which apparently precedes the first data frame
                     break;
                 }
@@ -1509,6 +1519,20 @@ bool flightLogParse(flightLog_t *log, int logIndex, FlightLogMetadataReady onMet
     return true;
 }
 
+bool flightLogParse(flightLog_t *log, int logIndex, FlightLogMetadataReady onMetadataReady, FlightLogFrameReady onFrameReady, FlightLogEventReady onEvent, bool raw)
+{
+    return parseLog(log, logIndex, onMetadataReady, onFrameReady, onEvent, raw, false);
+}
+
+/**
+ * Only parse the headers of the log with the given index, so the field definitions and system configuration are
+ * available without decoding any frames (the statistics will all be zero).
+ */
+bool flightLogParseMetadata(flightLog_t *log, int logIndex)
+{
+    return parseLog(log, logIndex, NULL, NULL, NULL, false, true);
+}
+
 void flightLogDestroy(flightLog_t *log)
 {
     streamDestroy(log->private->stream);
@@ -111,6 +111,9 @@ typedef struct flightLogSysConfig_t {
     int motorOutputLow, motorOutputHigh; // Betaflight
     unsigned int rcRate, yawRate;
 
+    // Microseconds between flight controller loop iterations, or 0 if the log doesn't say
+    int looptime;
+
     // Calibration constants from the hardware sensors:
     uint16_t acc_1G;
     float gyroScale;
@@ -180,6 +183,7 @@ void flightlogFlightStateToString(uint32_t flightState, char *dest, int destLen)
 void flightlogFailsafePhaseToString(uint8_t failsafePhase, char *dest, int destLen);
 
 bool flightLogParse(flightLog_t *log, int logIndex, FlightLogMetadataReady onMetadataReady, FlightLogFrameReady onFrameReady, FlightLogEventReady onEvent, bool raw);
+bool flightLogParseMetadata(flightLog_t *log, int logIndex);
 void flightLogDestroy(flightLog_t *log);
 
 #endif
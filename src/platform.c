@@ -4,9 +4,12 @@
     #include <direct.h>
 #else
     #include <sys/stat.h>
+    #include <unistd.h>
 #endif
 
 #include <sys/stat.h>
+#include <stdlib.h>
+#include <limits.h>
 
 #ifndef WIN32
     #define POSIX
@@ -16,6 +19,30 @@
     pthread_attr_t pthreadCreateDetached;
 #endif
 
+typedef struct threadPoolJob_t {
+    //NULL asks the thread which takes the job to exit
+    threadPoolTask_t task;
+    void *data;
+} threadPoolJob_t;
+
+struct threadPool_t {
+    thread_t *threads;
+    int threadCount;
+
+    //A ring buffer of the jobs waiting for a thread
+    threadPoolJob_t *queue;
+    int queueCapacity, queueHead, queueTail;
+
+    //Held while the queue is changed
+    semaphore_t queueLock;
+    //Counts the free and the filled entries of the queue
+    semaphore_t queueFree, queueFilled;
+
+    //Signalled as each task finishes, and the number of submitted tasks that thread_pool_wait() hasn't waited for yet
+    semaphore_t taskFinished;
+    int unfinishedCount;
+};
+
 #ifdef WIN32
     /*
      * I don't want to have to define my thread routine stdcall on windows and cdecl on POSIX, so
@@ -59,6 +86,180 @@ void thread_create_detached(threadRoutine_t threadFunc, void *data)
 #endif
 }
 
+/**
+ * Start a thread that must later be waited for with thread_join().
+ */
+thread_t thread_create(threadRoutine_t threadFunc, void *data)
+{
+    thread_t thread;
+
+#if defined(WIN32)
+    win32ThreadFuncWrapper_t *wrap = malloc(sizeof(*wrap));
+
+    wrap->threadFunc = threadFunc;
+    wrap->data = data;
+
+    thread = CreateThread(NULL, 0, win32ThreadFuncUnwrap, wrap, 0, NULL);
+#else
+    pthread_create(&thread, NULL, threadFunc, data);
+#endif
+
+    return thread;
+}
+
+void thread_join(thread_t thread)
+{
+#if defined(WIN32)
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+static void thread_pool_enqueue(threadPool_t *pool, threadPoolTask_t task, void *data)
+{
+    semaphore_wait(&pool->queueFree);
+    semaphore_wait(&pool->queueLock);
+
+    pool->queue[pool->queueTail].task = task;
+    pool->queue[pool->queueTail].data = data;
+    pool->queueTail = (pool->queueTail + 1) % pool->queueCapacity;
+
+    if (task) {
+        pool->unfinishedCount++;
+    }
+
+    semaphore_signal(&pool->queueLock);
+    semaphore_signal(&pool->queueFilled);
+}
+
+static void* thread_pool_run(void *data)
+{
+    threadPool_t *pool = (threadPool_t *) data;
+    threadPoolJob_t job;
+
+    do {
+        semaphore_wait(&pool->queueFilled);
+        semaphore_wait(&pool->queueLock);
+
+        job = pool->queue[pool->queueHead];
+        pool->queueHead = (pool->queueHead + 1) % pool->queueCapacity;
+
+        semaphore_signal(&pool->queueLock);
+        semaphore_signal(&pool->queueFree);
+
+        if (job.task) {
+            job.task(job.data);
+            semaphore_signal(&pool->taskFinished);
+        }
+    } while (job.task);
+
+    return NULL;
+}
+
+/**
+ * Start a pool of threadCount threads. Up to queueCapacity tasks can wait for a free thread before
+ * thread_pool_submit() blocks.
+ */
+threadPool_t* thread_pool_create(int threadCount, int queueCapacity)
+{
+    threadPool_t *pool = malloc(sizeof(*pool));
+
+    pool->threadCount = threadCount < 1 ? 1 : threadCount;
+    pool->queueCapacity = queueCapacity < 1 ? 1 : queueCapacity;
+    pool->queueHead = 0;
+    pool->queueTail = 0;
+    pool->unfinishedCount = 0;
+
+    pool->queue = malloc(pool->queueCapacity * sizeof(*pool->queue));
+
+    semaphore_create(&pool->queueLock, 1);
+    semaphore_create(&pool->queueFree, pool->queueCapacity);
+    semaphore_create(&pool->queueFilled, 0);
+    semaphore_create(&pool->taskFinished, 0);
+
+    pool->threads = malloc(pool->threadCount * sizeof(*pool->threads));
+
+    for (int i = 0; i < pool->threadCount; i++) {
+        pool->threads[i] = thread_create(thread_pool_run, pool);
+    }
+
+    return pool;
+}
+
+/**
+ * Queue up task(data) to be run by the next free thread of the pool, waiting for room in the queue if it's full.
+ */
+void thread_pool_submit(threadPool_t *pool, threadPoolTask_t task, void *data)
+{
+    thread_pool_enqueue(pool, task, data);
+}
+
+/**
+ * Wait for every task submitted so far to finish. Tasks mustn't be submitted while this is waiting.
+ */
+void thread_pool_wait(threadPool_t *pool)
+{
+    int count;
+
+    semaphore_wait(&pool->queueLock);
+    count = pool->unfinishedCount;
+    pool->unfinishedCount = 0;
+    semaphore_signal(&pool->queueLock);
+
+    for (int i = 0; i < count; i++) {
+        semaphore_wait(&pool->taskFinished);
+    }
+}
+
+/**
+ * Finish the tasks that have been submitted, then stop the threads and free the pool.
+ */
+void thread_pool_destroy(threadPool_t *pool)
+{
+    if (!pool)
+        return;
+
+    thread_pool_wait(pool);
+
+    for (int i = 0; i < pool->threadCount; i++) {
+        thread_pool_enqueue(pool, NULL, NULL);
+    }
+
+    for (int i = 0; i < pool->threadCount; i++) {
+        thread_join(pool->threads[i]);
+    }
+
+    semaphore_destroy(&pool->queueLock);
+    semaphore_destroy(&pool->queueFree);
+    semaphore_destroy(&pool->queueFilled);
+    semaphore_destroy(&pool->taskFinished);
+
+    free(pool->threads);
+    free(pool->queue);
+    free(pool);
+}
+
+/**
+ * Get the number of processors that are available to run our threads (at least 1).
+ */
+int platform_cpu_count()
+{
+    int count;
+
+#if defined(WIN32)
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    count = info.dwNumberOfProcessors;
+#else
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    return count < 1 ? 1 : count;
+}
+
 void semaphore_signal(semaphore_t *sem)
 {
 #if defined(__APPLE__)
@@ -86,7 +287,7 @@ void semaphore_create(semaphore_t *sem, int initialCount)
 #if defined(__APPLE__)
     *sem = dispatch_semaphore_create(initialCount);
 #elif defined(WIN32)
-    *sem = CreateSemaphore(NULL, initialCount, initialCount, NULL);
+    *sem = CreateSemaphore(NULL, initialCount, LONG_MAX, NULL);
 #else
     sem_init(sem, 0, initialCount);
 #endif
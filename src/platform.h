@@ -51,8 +51,24 @@ typedef struct fileMapping_t {
 } fileMapping_t;
 
 typedef void*(*threadRoutine_t)(void *data);
+typedef void (*threadPoolTask_t)(void *data);
+
+/**
+ * A fixed set of threads which run the tasks given to thread_pool_submit() in the order they arrive, so callers that
+ * have a stream of small jobs don't have to start a thread for each one.
+ */
+typedef struct threadPool_t threadPool_t;
 
 void thread_create_detached(threadRoutine_t threadFunc, void *data);
+thread_t thread_create(threadRoutine_t threadFunc, void *data);
+void thread_join(thread_t thread);
+
+threadPool_t* thread_pool_create(int threadCount, int queueCapacity);
+void thread_pool_submit(threadPool_t *pool, threadPoolTask_t task, void *data);
+void thread_pool_wait(threadPool_t *pool);
+void thread_pool_destroy(threadPool_t *pool);
+
+int platform_cpu_count();
 
 bool mmap_file(fileMapping_t *mapping, int fd);
 void munmap_file(fileMapping_t *mapping);
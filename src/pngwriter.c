@@ -0,0 +1,630 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "pngwriter.h"
+#include "platform.h"
+
+/*
+ * A PNG writer for cairo's ARGB32 images (native-endian 32-bit pixels with premultiplied colour), which lets the
+ * renderer trade file size for speed.
+ *
+ * The rows of the image are cut into bands which are filtered and deflated by separate threads. Each band is
+ * compressed as its own raw deflate stream, and all but the last band end with a sync flush, which leaves the stream
+ * on a byte boundary without ending it. A compressor that starts afresh never refers back to data before its start,
+ * so the bands joined end to end form one valid deflate stream. The bands lose the chance to refer back into the band
+ * before them, which costs a little compression at each boundary. Their Adler-32 checksums are combined to give the
+ * checksum of the whole zlib stream.
+ */
+
+// Bands any smaller than this aren't worth a thread
+#define PNG_MIN_ROWS_PER_BAND 16
+
+#define PNG_PALETTE_MAX_SIZE 256
+// Power of two, and large enough that the palette's hash table stays sparse
+#define PNG_PALETTE_HASH_SIZE 1024
+
+#define PNG_COLOR_TYPE_GREY 0
+#define PNG_COLOR_TYPE_RGB 2
+#define PNG_COLOR_TYPE_PALETTE 3
+#define PNG_COLOR_TYPE_GREY_ALPHA 4
+#define PNG_COLOR_TYPE_RGBA 6
+
+const char* const PNG_FILTER_NAME[PNG_FILTER_COUNT] = {
+    "none",
+    "sub",
+    "up",
+    "average",
+    "paeth",
+    "adaptive"
+};
+
+typedef struct pngImage_t {
+    const uint8_t *pixels;
+    int stride, width, height;
+
+    int colorType;
+    int bytesPerPixel;
+    PngFilter filter;
+    int compressionLevel;
+
+    // The premultiplied ARGB32 pixel of each palette entry, and a hash table which maps them back to their index
+    uint32_t palette[PNG_PALETTE_MAX_SIZE];
+    int paletteSize;
+    uint32_t paletteHashKey[PNG_PALETTE_HASH_SIZE];
+    int16_t paletteHashIndex[PNG_PALETTE_HASH_SIZE];
+} pngImage_t;
+
+typedef struct pngBand_t {
+    const pngImage_t *image;
+    int firstRow, rowCount;
+    bool last;
+
+    uint8_t *output;
+    size_t outputLength, outputCapacity;
+
+    // The checksum of the filtered rows that were compressed, and their length
+    uLong adler;
+    size_t inputLength;
+
+    bool failed;
+} pngBand_t;
+
+void pngWriterSettingsInit(pngWriterSettings_t *settings)
+{
+    // The same as cairo_surface_write_to_png(), which uses libpng's defaults
+    settings->compressionLevel = 6;
+    settings->filter = PNG_FILTER_ADAPTIVE;
+    settings->reduceColors = false;
+    settings->threadCount = 1;
+}
+
+bool pngFilterParse(const char *name, PngFilter *filter)
+{
+    for (int i = 0; i < PNG_FILTER_COUNT; i++) {
+        if (strcmp(name, PNG_FILTER_NAME[i]) == 0) {
+            *filter = (PngFilter) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static uint32_t readPixel(const uint8_t *row, int x)
+{
+    uint32_t pixel;
+
+    memcpy(&pixel, row + x * 4, sizeof(pixel));
+
+    return pixel;
+}
+
+static uint8_t unpremultiply(uint32_t color, uint32_t alpha)
+{
+    uint32_t result;
+
+    if (alpha == 0)
+        return 0;
+
+    result = (color * 255 + alpha / 2) / alpha;
+
+    return result > 255 ? 255 : (uint8_t) result;
+}
+
+static unsigned int paletteHash(uint32_t pixel)
+{
+    return (pixel * 2654435761u) >> 22;
+}
+
+/**
+ * Find the palette index of the given pixel, or -1 if it's not in the palette. The slot of the hash table where the
+ * pixel is, or where it should go, is stored in `slot`.
+ */
+static int paletteFind(const pngImage_t *image, uint32_t pixel, unsigned int *slot)
+{
+    for (*slot = paletteHash(pixel); image->paletteHashIndex[*slot] != -1; *slot = (*slot + 1) & (PNG_PALETTE_HASH_SIZE - 1)) {
+        if (image->paletteHashKey[*slot] == pixel)
+            return image->paletteHashIndex[*slot];
+    }
+
+    return -1;
+}
+
+/**
+ * Find the palette index of the given pixel, adding it to the palette if it's not there. Returns -1 if the palette
+ * is full.
+ */
+static int paletteAdd(pngImage_t *image, uint32_t pixel)
+{
+    unsigned int slot;
+    int index = paletteFind(image, pixel, &slot);
+
+    if (index != -1 || image->paletteSize == PNG_PALETTE_MAX_SIZE)
+        return index;
+
+    image->palette[image->paletteSize] = pixel;
+    image->paletteHashKey[slot] = pixel;
+    image->paletteHashIndex[slot] = (int16_t) image->paletteSize;
+
+    return image->paletteSize++;
+}
+
+/**
+ * Choose the smallest PNG colour type that can hold every pixel of the image exactly: a palette if there are few
+ * enough colours, then greyscale if every pixel is grey, dropping the alpha channel if every pixel is opaque.
+ */
+static void chooseReducedColorType(pngImage_t *image)
+{
+    bool paletteFits = true, grey = true, opaque = true;
+    uint32_t lastPixel = 0;
+    bool havePixel = false;
+
+    image->paletteSize = 0;
+    for (int i = 0; i < PNG_PALETTE_HASH_SIZE; i++)
+        image->paletteHashIndex[i] = -1;
+
+    for (int y = 0; y < image->height; y++) {
+        const uint8_t *row = image->pixels + (size_t) y * image->stride;
+
+        for (int x = 0; x < image->width; x++) {
+            uint32_t pixel = readPixel(row, x);
+
+            // Overlays are mostly long runs of the same pixel, so don't bother looking those up again
+            if (havePixel && pixel == lastPixel)
+                continue;
+
+            lastPixel = pixel;
+            havePixel = true;
+
+            if (paletteFits && paletteAdd(image, pixel) == -1) {
+                paletteFits = false;
+            }
+
+            if (grey && (((pixel >> 16) & 0xFF) != (pixel & 0xFF) || ((pixel >> 8) & 0xFF) != (pixel & 0xFF))) {
+                grey = false;
+            }
+
+            if (opaque && (pixel >> 24) != 0xFF) {
+                opaque = false;
+            }
+        }
+    }
+
+    if (paletteFits) {
+        image->colorType = PNG_COLOR_TYPE_PALETTE;
+        image->bytesPerPixel = 1;
+    } else if (grey) {
+        image->colorType = opaque ? PNG_COLOR_TYPE_GREY : PNG_COLOR_TYPE_GREY_ALPHA;
+        image->bytesPerPixel = opaque ? 1 : 2;
+    } else {
+        image->colorType = opaque ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_RGBA;
+        image->bytesPerPixel = opaque ? 3 : 4;
+    }
+}
+
+/**
+ * Convert a row of the image into the bytes of the image's PNG colour type.
+ */
+static void convertRow(const pngImage_t *image, int y, uint8_t *output)
+{
+    const uint8_t *row = image->pixels + (size_t) y * image->stride;
+
+    for (int x = 0; x < image->width; x++) {
+        uint32_t pixel = readPixel(row, x);
+        uint32_t alpha = pixel >> 24;
+        unsigned int slot;
+
+        switch (image->colorType) {
+            case PNG_COLOR_TYPE_PALETTE:
+                *(output++) = (uint8_t) paletteFind(image, pixel, &slot);
+            break;
+            case PNG_COLOR_TYPE_GREY:
+                *(output++) = pixel & 0xFF;
+            break;
+            case PNG_COLOR_TYPE_GREY_ALPHA:
+                *(output++) = unpremultiply(pixel & 0xFF, alpha);
+                *(output++) = (uint8_t) alpha;
+            break;
+            case PNG_COLOR_TYPE_RGB:
+                *(output++) = (pixel >> 16) & 0xFF;
+                *(output++) = (pixel >> 8) & 0xFF;
+                *(output++) = pixel & 0xFF;
+            break;
+            default:
+                *(output++) = unpremultiply((pixel >> 16) & 0xFF, alpha);
+                *(output++) = unpremultiply((pixel >> 8) & 0xFF, alpha);
+                *(output++) = unpremultiply(pixel & 0xFF, alpha);
+                *(output++) = (uint8_t) alpha;
+        }
+    }
+}
+
+static uint8_t paethPredictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+    if (pa <= pb && pa <= pc)
+        return (uint8_t) a;
+    if (pb <= pc)
+        return (uint8_t) b;
+    return (uint8_t) c;
+}
+
+/**
+ * Filter a row with the given filter type, writing the filter type byte followed by the filtered row. `previous` is
+ * the unfiltered row above, or NULL for the top row of the image.
+ */
+static void filterRow(PngFilter filter, const uint8_t *row, const uint8_t *previous, int rowLength, int bytesPerPixel, uint8_t *output)
+{
+    *(output++) = (uint8_t) filter;
+
+    for (int i = 0; i < rowLength; i++) {
+        int left = i >= bytesPerPixel ? row[i - bytesPerPixel] : 0;
+        int up = previous ? previous[i] : 0;
+        int upLeft = previous && i >= bytesPerPixel ? previous[i - bytesPerPixel] : 0;
+
+        switch (filter) {
+            case PNG_FILTER_SUB:
+                output[i] = (uint8_t) (row[i] - left);
+            break;
+            case PNG_FILTER_UP:
+                output[i] = (uint8_t) (row[i] - up);
+            break;
+            case PNG_FILTER_AVERAGE:
+                output[i] = (uint8_t) (row[i] - ((left + up) >> 1));
+            break;
+            case PNG_FILTER_PAETH:
+                output[i] = (uint8_t) (row[i] - paethPredictor(left, up, upLeft));
+            break;
+            default:
+                output[i] = row[i];
+        }
+    }
+}
+
+/**
+ * The usual heuristic for choosing a filter: the filtered bytes closest to zero (as signed values) tend to compress
+ * best.
+ */
+static uint64_t filteredRowCost(const uint8_t *filtered, int rowLength)
+{
+    uint64_t cost = 0;
+
+    for (int i = 1; i <= rowLength; i++) {
+        cost += filtered[i] < 128 ? filtered[i] : 256 - filtered[i];
+    }
+
+    return cost;
+}
+
+/**
+ * Feed the given bytes into the band's compressor, growing the band's output as needed.
+ */
+static bool deflateBandData(pngBand_t *band, z_stream *stream, const uint8_t *data, size_t length, int flush)
+{
+    int status;
+
+    stream->next_in = (Bytef *) data;
+    stream->avail_in = (uInt) length;
+
+    do {
+        if (band->outputLength == band->outputCapacity) {
+            band->outputCapacity = band->outputCapacity * 2 + 64;
+            band->output = realloc(band->output, band->outputCapacity);
+        }
+
+        stream->next_out = band->output + band->outputLength;
+        stream->avail_out = (uInt) (band->outputCapacity - band->outputLength);
+
+        status = deflate(stream, flush);
+
+        if (status == Z_STREAM_ERROR)
+            return false;
+
+        band->outputLength = band->outputCapacity - stream->avail_out;
+    } while (stream->avail_out == 0 || (flush == Z_FINISH && status != Z_STREAM_END));
+
+    return true;
+}
+
+/**
+ * Filter and compress the rows of the band with the given (freshly initialised) compressor.
+ */
+static bool deflateBandRows(pngBand_t *band, z_stream *stream)
+{
+    const pngImage_t *image = band->image;
+    int rowLength = image->width * image->bytesPerPixel;
+    uint8_t *rows[2], *filtered[PNG_FILTER_ADAPTIVE];
+    int current = 0;
+    bool success = true;
+
+    rows[0] = malloc(rowLength);
+    rows[1] = malloc(rowLength);
+
+    for (int i = 0; i < PNG_FILTER_ADAPTIVE; i++)
+        filtered[i] = malloc(rowLength + 1);
+
+    band->outputCapacity = deflateBound(stream, (uLong) (rowLength + 1) * band->rowCount) + 64;
+    band->output = malloc(band->outputCapacity);
+    band->adler = adler32(0, NULL, 0);
+
+    // The filters look at the row above, even when it belongs to the band before this one
+    if (band->firstRow > 0) {
+        convertRow(image, band->firstRow - 1, rows[1]);
+    }
+
+    for (int y = band->firstRow; y < band->firstRow + band->rowCount && success; y++) {
+        const uint8_t *previous = y > 0 ? rows[current ^ 1] : NULL;
+        const uint8_t *chosen;
+        bool lastRow = y == band->firstRow + band->rowCount - 1;
+
+        convertRow(image, y, rows[current]);
+
+        if (image->filter == PNG_FILTER_ADAPTIVE) {
+            uint64_t bestCost = UINT64_MAX;
+            int best = 0;
+
+            for (int f = 0; f < PNG_FILTER_ADAPTIVE; f++) {
+                uint64_t cost;
+
+                filterRow((PngFilter) f, rows[current], previous, rowLength, image->bytesPerPixel, filtered[f]);
+                cost = filteredRowCost(filtered[f], rowLength);
+
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    best = f;
+                }
+            }
+
+            chosen = filtered[best];
+        } else {
+            filterRow(image->filter, rows[current], previous, rowLength, image->bytesPerPixel, filtered[0]);
+            chosen = filtered[0];
+        }
+
+        band->adler = adler32(band->adler, chosen, rowLength + 1);
+        band->inputLength += rowLength + 1;
+
+        success = deflateBandData(band, stream, chosen, rowLength + 1, lastRow ? (band->last ? Z_FINISH : Z_SYNC_FLUSH) : Z_NO_FLUSH);
+
+        current ^= 1;
+    }
+
+    free(rows[0]);
+    free(rows[1]);
+
+    for (int i = 0; i < PNG_FILTER_ADAPTIVE; i++)
+        free(filtered[i]);
+
+    return success;
+}
+
+static void* pngBandRun(void *data)
+{
+    pngBand_t *band = (pngBand_t *) data;
+    z_stream stream;
+
+    memset(&stream, 0, sizeof(stream));
+
+    // A raw deflate stream, since the zlib header and checksum are written for the whole image instead
+    if (deflateInit2(&stream, band->image->compressionLevel, Z_DEFLATED, -MAX_WBITS, 8,
+            band->image->filter == PNG_FILTER_NONE ? Z_DEFAULT_STRATEGY : Z_FILTERED) != Z_OK) {
+        band->failed = true;
+    } else {
+        band->failed = !deflateBandRows(band, &stream);
+        deflateEnd(&stream);
+    }
+
+    return NULL;
+}
+
+static void writeUInt32BE(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value >> 24;
+    buffer[1] = (value >> 16) & 0xFF;
+    buffer[2] = (value >> 8) & 0xFF;
+    buffer[3] = value & 0xFF;
+}
+
+/**
+ * Write a chunk whose data is the concatenation of the given parts.
+ */
+static bool writeChunk(FILE *file, const char *type, const uint8_t * const *parts, const size_t *partLengths, int partCount)
+{
+    uint8_t header[8], trailer[4];
+    size_t length = 0;
+    uLong crc;
+
+    for (int i = 0; i < partCount; i++)
+        length += partLengths[i];
+
+    writeUInt32BE(header, (uint32_t) length);
+    memcpy(header + 4, type, 4);
+
+    crc = crc32(0, header + 4, 4);
+
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header))
+        return false;
+
+    for (int i = 0; i < partCount; i++) {
+        if (partLengths[i] > 0) {
+            crc = crc32(crc, parts[i], (uInt) partLengths[i]);
+
+            if (fwrite(parts[i], 1, partLengths[i], file) != partLengths[i])
+                return false;
+        }
+    }
+
+    writeUInt32BE(trailer, (uint32_t) crc);
+
+    return fwrite(trailer, 1, sizeof(trailer), file) == sizeof(trailer);
+}
+
+static bool writeSimpleChunk(FILE *file, const char *type, const uint8_t *data, size_t length)
+{
+    return writeChunk(file, type, &data, &length, 1);
+}
+
+static bool writePalette(FILE *file, const pngImage_t *image)
+{
+    uint8_t colors[PNG_PALETTE_MAX_SIZE * 3], alphas[PNG_PALETTE_MAX_SIZE];
+    bool opaque = true;
+
+    for (int i = 0; i < image->paletteSize; i++) {
+        uint32_t pixel = image->palette[i];
+        uint32_t alpha = pixel >> 24;
+
+        colors[i * 3] = unpremultiply((pixel >> 16) & 0xFF, alpha);
+        colors[i * 3 + 1] = unpremultiply((pixel >> 8) & 0xFF, alpha);
+        colors[i * 3 + 2] = unpremultiply(pixel & 0xFF, alpha);
+        alphas[i] = (uint8_t) alpha;
+
+        if (alpha != 0xFF)
+            opaque = false;
+    }
+
+    return writeSimpleChunk(file, "PLTE", colors, image->paletteSize * 3)
+        && (opaque || writeSimpleChunk(file, "tRNS", alphas, image->paletteSize));
+}
+
+/**
+ * Write the image data as one IDAT chunk per band, with the zlib header in the first and the checksum in the last.
+ */
+static bool writeImageData(FILE *file, const pngImage_t *image, const pngBand_t *bands, int bandCount)
+{
+    int level = image->compressionLevel;
+    uint8_t zlibHeader[2], zlibTrailer[4];
+    uLong adler = adler32(0, NULL, 0);
+
+    // Deflate with a 32K window, and a hint of how hard the compressor tried
+    zlibHeader[0] = 0x78;
+    zlibHeader[1] = (uint8_t) ((level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6);
+    zlibHeader[1] += 31 - (zlibHeader[0] * 256 + zlibHeader[1]) % 31;
+
+    for (int i = 0; i < bandCount; i++) {
+        adler = adler32_combine(adler, bands[i].adler, (z_off_t) bands[i].inputLength);
+    }
+
+    writeUInt32BE(zlibTrailer, (uint32_t) adler);
+
+    for (int i = 0; i < bandCount; i++) {
+        const uint8_t *parts[3] = {zlibHeader, bands[i].output, zlibTrailer};
+        size_t partLengths[3] = {i == 0 ? sizeof(zlibHeader) : 0, bands[i].outputLength, i == bandCount - 1 ? sizeof(zlibTrailer) : 0};
+
+        if (!writeChunk(file, "IDAT", parts, partLengths, 3))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Write an image of cairo ARGB32 pixels to the given file as a PNG. Returns false if the image couldn't be
+ * compressed or written.
+ */
+bool pngWriteARGB32(FILE *file, const uint8_t *pixels, int stride, int width, int height, const pngWriterSettings_t *settings)
+{
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+    pngImage_t *image = malloc(sizeof(*image));
+    pngBand_t *bands;
+    thread_t *threads;
+    int bandCount;
+    uint8_t header[13];
+    bool success;
+
+    image->pixels = pixels;
+    image->stride = stride;
+    image->width = width;
+    image->height = height;
+    image->compressionLevel = settings->compressionLevel;
+    image->filter = settings->filter;
+
+    if (settings->reduceColors) {
+        chooseReducedColorType(image);
+    } else {
+        image->colorType = PNG_COLOR_TYPE_RGBA;
+        image->bytesPerPixel = 4;
+    }
+
+    // Filters rarely help palette images, so libpng doesn't try them either
+    if (image->colorType == PNG_COLOR_TYPE_PALETTE && image->filter == PNG_FILTER_ADAPTIVE) {
+        image->filter = PNG_FILTER_NONE;
+    }
+
+    bandCount = settings->threadCount;
+
+    if (bandCount > height / PNG_MIN_ROWS_PER_BAND)
+        bandCount = height / PNG_MIN_ROWS_PER_BAND;
+    if (bandCount < 1)
+        bandCount = 1;
+
+    bands = calloc(bandCount, sizeof(*bands));
+    threads = malloc(bandCount * sizeof(*threads));
+
+    for (int i = 0; i < bandCount; i++) {
+        bands[i].image = image;
+        bands[i].firstRow = (int) ((int64_t) height * i / bandCount);
+        bands[i].rowCount = (int) ((int64_t) height * (i + 1) / bandCount) - bands[i].firstRow;
+        bands[i].last = i == bandCount - 1;
+    }
+
+    // The calling thread compresses the first band itself
+    for (int i = 1; i < bandCount; i++) {
+        threads[i] = thread_create(pngBandRun, &bands[i]);
+    }
+
+    pngBandRun(&bands[0]);
+
+    for (int i = 1; i < bandCount; i++) {
+        thread_join(threads[i]);
+    }
+
+    success = true;
+
+    for (int i = 0; i < bandCount; i++) {
+        if (bands[i].failed)
+            success = false;
+    }
+
+    writeUInt32BE(header, (uint32_t) width);
+    writeUInt32BE(header + 4, (uint32_t) height);
+    header[8] = 8; // Bit depth
+    header[9] = (uint8_t) image->colorType;
+    header[10] = 0; // Deflate
+    header[11] = 0; // Adaptive filtering
+    header[12] = 0; // No interlace
+
+    success = success
+        && fwrite(signature, 1, sizeof(signature), file) == sizeof(signature)
+        && writeSimpleChunk(file, "IHDR", header, sizeof(header))
+        && (image->colorType != PNG_COLOR_TYPE_PALETTE || writePalette(file, image))
+        && writeImageData(file, image, bands, bandCount)
+        && writeSimpleChunk(file, "IEND", NULL, 0);
+
+    for (int i = 0; i < bandCount; i++) {
+        free(bands[i].output);
+    }
+
+    free(bands);
+    free(threads);
+    free(image);
+
+    return success;
+}
+
+bool pngWriteARGB32ToFile(const char *filename, const uint8_t *pixels, int stride, int width, int height, const pngWriterSettings_t *settings)
+{
+    FILE *file = fopen(filename, "wb");
+    bool success;
+
+    if (!file)
+        return false;
+
+    success = pngWriteARGB32(file, pixels, stride, width, height, settings);
+
+    return fclose(file) == 0 && success;
+}
@@ -0,0 +1,40 @@
+#ifndef PNGWRITER_H_
+#define PNGWRITER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// The values of the first five are the filter type bytes that PNG stores at the start of each row
+typedef enum PngFilter {
+    PNG_FILTER_NONE = 0,
+    PNG_FILTER_SUB,
+    PNG_FILTER_UP,
+    PNG_FILTER_AVERAGE,
+    PNG_FILTER_PAETH,
+    // Pick whichever of the filters above looks like it'll compress each row best (like libpng does by default)
+    PNG_FILTER_ADAPTIVE,
+    PNG_FILTER_COUNT
+} PngFilter;
+
+extern const char* const PNG_FILTER_NAME[PNG_FILTER_COUNT];
+
+typedef struct pngWriterSettings_t {
+    // zlib's compression level, 0 only stores the image and 9 is the slowest
+    int compressionLevel;
+    PngFilter filter;
+
+    // Write images with few enough colours as a palette, or images with no colour as greyscale
+    bool reduceColors;
+
+    // The image is cut into this many bands of rows which are compressed at the same time
+    int threadCount;
+} pngWriterSettings_t;
+
+void pngWriterSettingsInit(pngWriterSettings_t *settings);
+bool pngFilterParse(const char *name, PngFilter *filter);
+
+bool pngWriteARGB32(FILE *file, const uint8_t *pixels, int stride, int width, int height, const pngWriterSettings_t *settings);
+bool pngWriteARGB32ToFile(const char *filename, const uint8_t *pixels, int stride, int width, int height, const pngWriterSettings_t *settings);
+
+#endif
@@ -0,0 +1,313 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+
+#ifdef WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+#include "rendercache.h"
+
+/*
+ * The cache file is laid out so that it can be mapped into memory and used in place:
+ *
+ * renderCacheHeader_t
+ * uint8_t columnType[fieldCount]
+ * uint64_t columnOffset[fieldCount]
+ * Then the arrays, each beginning on an 8-byte boundary at the offset given for it in the header (or columnOffset).
+ *
+ * Values are in the byte order of the machine which wrote the cache, so caches aren't meant to be moved between
+ * machines (the version and key checks will reject most of those anyway).
+ */
+
+#define RENDER_CACHE_MAGIC "BBRCACHE"
+
+// Arrays in the file begin at multiples of this so they can be read in place
+#define RENDER_CACHE_ALIGNMENT 8
+
+typedef struct renderCacheHeader_t {
+    char magic[8];
+    uint32_t version;
+    // Catches caches written by builds where these structures have a different layout:
+    uint32_t headerSize, statsSize, attitudeSize;
+
+    uint64_t key;
+
+    int32_t fieldCount, frameCount;
+    uint32_t syncBeepTime;
+    uint32_t hasAttitude;
+
+    uint64_t fieldStatsOffset, frameTimeOffset, frameGapOffset, attitudeOffset;
+    uint64_t fileSize;
+} renderCacheHeader_t;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t*) data;
+
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Compute the key which identifies the cache for the log data between logStart and logEnd, when it's prepared with
+ * the given settings (which should have any padding zeroed).
+ */
+uint64_t renderCacheKey(const char *logStart, const char *logEnd, const void *settings, size_t settingsSize)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    uint32_t version = RENDER_CACHE_VERSION;
+
+    hash = fnv1a(hash, &version, sizeof(version));
+    hash = fnv1a(hash, settings, settingsSize);
+    hash = fnv1a(hash, logStart, logEnd - logStart);
+
+    return hash;
+}
+
+static uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + RENDER_CACHE_ALIGNMENT - 1) & ~((uint64_t) RENDER_CACHE_ALIGNMENT - 1);
+}
+
+/**
+ * Check that an array of length bytes at the given offset lies within the mapped file, and begins on the boundary that
+ * renderCacheSave() puts it on.
+ */
+static bool arrayInMapping(const fileMapping_t *mapping, uint64_t offset, uint64_t length)
+{
+    return offset % RENDER_CACHE_ALIGNMENT == 0 && offset <= mapping->size && length <= mapping->size - offset;
+}
+
+static bool writeAt(FILE *file, uint64_t offset, const void *data, size_t length)
+{
+    return fseek(file, (long) offset, SEEK_SET) == 0 && fwrite(data, 1, length, file) == length;
+}
+
+/**
+ * Write the contents to a new cache file with the given name. It's written to a temporary file which is moved into
+ * place once it's complete, so renders running at the same time never see half of a cache file.
+ */
+bool renderCacheSave(const char *filename, uint64_t key, const renderCacheContents_t *contents)
+{
+    const datapoints_t *points = contents->points;
+    renderCacheHeader_t header;
+    uint8_t *columnType;
+    uint64_t *columnOffset;
+    uint64_t offset;
+    char *tempFilename;
+    FILE *file;
+    bool success = true;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RENDER_CACHE_MAGIC, sizeof(header.magic));
+
+    header.version = RENDER_CACHE_VERSION;
+    header.headerSize = sizeof(header);
+    header.statsSize = sizeof(contents->fieldStats);
+    header.attitudeSize = sizeof(attitude_t);
+    header.key = key;
+    header.fieldCount = points->fieldCount;
+    header.frameCount = points->frameCount;
+    header.syncBeepTime = contents->syncBeepTime;
+    header.hasAttitude = contents->frameAttitude != NULL;
+
+    columnType = malloc(points->fieldCount * sizeof(*columnType));
+    columnOffset = malloc(points->fieldCount * sizeof(*columnOffset));
+
+    // Lay out the arrays
+    offset = sizeof(header) + points->fieldCount * (sizeof(*columnType) + sizeof(*columnOffset));
+
+    header.fieldStatsOffset = offset = alignOffset(offset);
+    offset += sizeof(contents->fieldStats);
+
+    header.frameTimeOffset = offset = alignOffset(offset);
+    offset += points->frameCount * sizeof(*points->frameTime);
+
+    header.frameGapOffset = offset = alignOffset(offset);
+    offset += points->frameCount * sizeof(*points->frameGap);
+
+    if (contents->frameAttitude) {
+        header.attitudeOffset = offset = alignOffset(offset);
+        offset += points->frameCount * sizeof(*contents->frameAttitude);
+    }
+
+    for (int i = 0; i < points->fieldCount; i++) {
+        columnType[i] = (uint8_t) points->columns[i].type;
+        columnOffset[i] = offset = alignOffset(offset);
+        offset += points->frameCount * datapointsColumnTypeSize(points->columns[i].type);
+    }
+
+    header.fileSize = offset;
+
+    tempFilename = malloc(strlen(filename) + 5);
+    sprintf(tempFilename, "%s.tmp", filename);
+
+    file = fopen(tempFilename, "wb");
+
+    if (!file) {
+        fprintf(stderr, "Failed to create cache file '%s'\n", tempFilename);
+        free(tempFilename);
+        free(columnType);
+        free(columnOffset);
+        return false;
+    }
+
+    success = writeAt(file, 0, &header, sizeof(header))
+        && writeAt(file, sizeof(header), columnType, points->fieldCount * sizeof(*columnType))
+        && writeAt(file, sizeof(header) + points->fieldCount * sizeof(*columnType), columnOffset, points->fieldCount * sizeof(*columnOffset))
+        && writeAt(file, header.fieldStatsOffset, contents->fieldStats, sizeof(contents->fieldStats))
+        && writeAt(file, header.frameTimeOffset, points->frameTime, points->frameCount * sizeof(*points->frameTime))
+        && writeAt(file, header.frameGapOffset, points->frameGap, points->frameCount * sizeof(*points->frameGap));
+
+    if (success && contents->frameAttitude) {
+        success = writeAt(file, header.attitudeOffset, contents->frameAttitude, points->frameCount * sizeof(*contents->frameAttitude));
+    }
+
+    for (int i = 0; success && i < points->fieldCount; i++) {
+        success = writeAt(file, columnOffset[i], points->columns[i].values, points->frameCount * datapointsColumnTypeSize(points->columns[i].type));
+    }
+
+    // Pad the end of the file out to its full size
+    if (success && header.fileSize > 0) {
+        uint8_t zero = 0;
+        long end;
+
+        success = fseek(file, 0, SEEK_END) == 0 && (end = ftell(file)) >= 0
+            && ((uint64_t) end >= header.fileSize || writeAt(file, header.fileSize - 1, &zero, 1));
+    }
+
+    success = fclose(file) == 0 && success;
+
+    if (success) {
+        // Windows won't rename over an existing file
+        remove(filename);
+        success = rename(tempFilename, filename) == 0;
+    }
+
+    if (!success) {
+        fprintf(stderr, "Failed to write cache file '%s'\n", filename);
+        remove(tempFilename);
+    }
+
+    free(tempFilename);
+    free(columnType);
+    free(columnOffset);
+
+    return success;
+}
+
+/**
+ * Map the cache file with the given name, and return its contents if it was written for the given key with datapoints
+ * of fieldCount fields. The fieldNames are used for the datapoints.
+ *
+ * Returns NULL if the cache doesn't exist or can't be used.
+ */
+renderCache_t* renderCacheOpen(const char *filename, uint64_t key, int fieldCount, char **fieldNames)
+{
+    renderCache_t *cache;
+    const renderCacheHeader_t *header;
+    const uint8_t *columnType;
+    const uint64_t *columnOffset;
+    DatapointsColumnType *types;
+    void **values;
+    char *data;
+
+#ifdef WIN32
+    int fd = open(filename, O_RDONLY | O_BINARY);
+#else
+    int fd = open(filename, O_RDONLY);
+#endif
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    cache = calloc(1, sizeof(*cache));
+    cache->fd = fd;
+
+    if (!mmap_file(&cache->mapping, fd) || cache->mapping.size < sizeof(renderCacheHeader_t)) {
+        goto invalid;
+    }
+
+    data = (char*) cache->mapping.data;
+    header = (const renderCacheHeader_t*) data;
+
+    if (memcmp(header->magic, RENDER_CACHE_MAGIC, sizeof(header->magic)) != 0
+            || header->version != RENDER_CACHE_VERSION
+            || header->headerSize != sizeof(*header)
+            || header->statsSize != sizeof(cache->contents.fieldStats)
+            || header->attitudeSize != sizeof(attitude_t)
+            || header->key != key
+            || header->fieldCount != fieldCount
+            || header->fileSize != cache->mapping.size) {
+        goto invalid;
+    }
+
+    // A cache that was cut short or damaged must be re-decoded rather than read past the end of the mapping
+    if (fieldCount < 0 || header->frameCount < 0
+            || cache->mapping.size - sizeof(*header) < (uint64_t) fieldCount * (sizeof(*columnType) + sizeof(*columnOffset))
+            || !arrayInMapping(&cache->mapping, header->fieldStatsOffset, sizeof(cache->contents.fieldStats))
+            || !arrayInMapping(&cache->mapping, header->frameTimeOffset, (uint64_t) header->frameCount * sizeof(int64_t))
+            || !arrayInMapping(&cache->mapping, header->frameGapOffset, (uint64_t) header->frameCount * sizeof(uint8_t))
+            || (header->hasAttitude && !arrayInMapping(&cache->mapping, header->attitudeOffset, (uint64_t) header->frameCount * sizeof(attitude_t)))) {
+        goto invalid;
+    }
+
+    columnType = (const uint8_t*) (data + sizeof(*header));
+    columnOffset = (const uint64_t*) (data + sizeof(*header) + fieldCount * sizeof(*columnType));
+
+    // The column offsets don't start on an aligned address, so copy them out before use
+    types = malloc(fieldCount * sizeof(*types));
+    values = malloc(fieldCount * sizeof(*values));
+
+    for (int i = 0; i < fieldCount; i++) {
+        uint64_t offset;
+
+        memcpy(&offset, columnOffset + i, sizeof(offset));
+
+        if (columnType[i] > DATAPOINTS_COLUMN_INT64
+                || !arrayInMapping(&cache->mapping, offset, (uint64_t) header->frameCount * datapointsColumnTypeSize((DatapointsColumnType) columnType[i]))) {
+            free(types);
+            free(values);
+            goto invalid;
+        }
+
+        types[i] = (DatapointsColumnType) columnType[i];
+        values[i] = data + offset;
+    }
+
+    memcpy(cache->contents.fieldStats, data + header->fieldStatsOffset, sizeof(cache->contents.fieldStats));
+    cache->contents.syncBeepTime = header->syncBeepTime;
+    cache->contents.frameAttitude = header->hasAttitude ? (attitude_t*) (data + header->attitudeOffset) : NULL;
+    cache->contents.points = datapointsCreateFromColumns(fieldCount, fieldNames, types, values,
+        (int64_t*) (data + header->frameTimeOffset), (uint8_t*) (data + header->frameGapOffset), header->frameCount);
+
+    free(types);
+    free(values);
+
+    return cache;
+
+invalid:
+    munmap_file(&cache->mapping);
+    close(fd);
+    free(cache);
+
+    return NULL;
+}
+
+void renderCacheClose(renderCache_t *cache)
+{
+    if (cache) {
+        datapointsDestroy(cache->contents.points);
+        munmap_file(&cache->mapping);
+        close(cache->fd);
+        free(cache);
+    }
+}
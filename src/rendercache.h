@@ -0,0 +1,47 @@
+#ifndef RENDERCACHE_H_
+#define RENDERCACHE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "platform.h"
+#include "parser.h"
+#include "datapoints.h"
+#include "imu.h"
+
+// Increase this whenever the layout of the cache file or the way the renderer prepares its datapoints changes
+#define RENDER_CACHE_VERSION 2
+
+/**
+ * The datapoints prepared by the renderer (with their computed fields filled in and smoothing applied), along with
+ * everything else it learned by decoding the frames of the log.
+ */
+typedef struct renderCacheContents_t {
+    datapoints_t *points;
+
+    // The attitude for each frame, or NULL if the log has none
+    attitude_t *frameAttitude;
+
+    flightLogFieldStatistics_t fieldStats[FLIGHT_LOG_MAX_FIELDS];
+    uint32_t syncBeepTime;
+} renderCacheContents_t;
+
+/**
+ * A cache file which has been mapped into memory, the arrays of the contents point into the mapping.
+ */
+typedef struct renderCache_t {
+    int fd;
+    fileMapping_t mapping;
+
+    renderCacheContents_t contents;
+} renderCache_t;
+
+uint64_t renderCacheKey(const char *logStart, const char *logEnd, const void *settings, size_t settingsSize);
+
+bool renderCacheSave(const char *filename, uint64_t key, const renderCacheContents_t *contents);
+
+renderCache_t* renderCacheOpen(const char *filename, uint64_t key, int fieldCount, char **fieldNames);
+void renderCacheClose(renderCache_t *cache);
+
+#endif
@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "resample.h"
+
+/*
+ * Resamples a stream of irregularly-spaced samples onto a uniform timebase in a single pass.
+ *
+ * Time is divided into intervals which start at multiples of the resampling interval, and one row is produced for
+ * each interval that contains at least one sample. Each column of the row is aggregated from the samples in its
+ * interval by mean/min/max/last, or is linearly interpolated at the start of the interval from the samples either
+ * side of it. Interpolation never spans a gap in the data (the first sample after a gap is held instead).
+ *
+ * Only the current interval and the previous sample are stored, so memory use doesn't depend on the log length.
+ */
+
+static const char* const RESAMPLE_AGGREGATION_NAME[] = {
+    "mean",
+    "min",
+    "max",
+    "last",
+    "linear"
+};
+
+bool resampleAggregationFromName(const char *name, ResampleAggregation *aggregation)
+{
+    for (int i = 0; i < (int) (sizeof(RESAMPLE_AGGREGATION_NAME) / sizeof(RESAMPLE_AGGREGATION_NAME[0])); i++) {
+        if (strcmp(name, RESAMPLE_AGGREGATION_NAME[i]) == 0) {
+            *aggregation = (ResampleAggregation) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int64_t resamplerBinForTime(resampler_t *resampler, int64_t time)
+{
+    // Round towards negative infinity so that bins are the same size either side of zero
+    if (time < 0) {
+        return -((-time + resampler->interval - 1) / resampler->interval);
+    }
+
+    return time / resampler->interval;
+}
+
+static void resamplerEmitRow(resampler_t *resampler)
+{
+    for (int i = 0; i < resampler->columnCount; i++) {
+        switch (resampler->aggregation[i]) {
+            case RESAMPLE_MEAN:
+                resampler->row[i] = resampler->sum[i] / resampler->binSampleCount;
+            break;
+            case RESAMPLE_MIN:
+                resampler->row[i] = resampler->min[i];
+            break;
+            case RESAMPLE_MAX:
+                resampler->row[i] = resampler->max[i];
+            break;
+            case RESAMPLE_LAST:
+                resampler->row[i] = resampler->last[i];
+            break;
+            case RESAMPLE_LINEAR:
+                resampler->row[i] = resampler->interpolated[i];
+            break;
+        }
+    }
+
+    resampler->onRowReady(resampler, resampler->binIndex * resampler->interval, resampler->row, resampler->userData);
+
+    resampler->haveBin = false;
+}
+
+/**
+ * Add a sample to the stream, the time of which should be no earlier than the previous sample.
+ */
+void resamplerAddSample(resampler_t *resampler, int64_t time, const double *values)
+{
+    int64_t bin = resamplerBinForTime(resampler, time);
+    int i;
+
+    if (resampler->haveBin && bin != resampler->binIndex) {
+        resamplerEmitRow(resampler);
+    }
+
+    if (!resampler->haveBin) {
+        resampler->haveBin = true;
+        resampler->binIndex = bin;
+        resampler->binSampleCount = 0;
+        resampler->haveInterpolated = false;
+    }
+
+    if (!resampler->haveInterpolated) {
+        int64_t binStart = bin * resampler->interval;
+
+        if (resampler->havePrevious && resampler->previousTime < binStart && time > binStart) {
+            double fraction = (double) (binStart - resampler->previousTime) / (time - resampler->previousTime);
+
+            for (i = 0; i < resampler->columnCount; i++) {
+                resampler->interpolated[i] = resampler->previous[i] + (values[i] - resampler->previous[i]) * fraction;
+            }
+        } else {
+            // Nothing to interpolate from, so hold the first value in the interval
+            memcpy(resampler->interpolated, values, sizeof(*values) * resampler->columnCount);
+        }
+
+        resampler->haveInterpolated = true;
+    }
+
+    if (resampler->binSampleCount == 0) {
+        for (i = 0; i < resampler->columnCount; i++) {
+            resampler->sum[i] = values[i];
+            resampler->min[i] = values[i];
+            resampler->max[i] = values[i];
+        }
+    } else {
+        for (i = 0; i < resampler->columnCount; i++) {
+            resampler->sum[i] += values[i];
+
+            if (values[i] < resampler->min[i])
+                resampler->min[i] = values[i];
+            if (values[i] > resampler->max[i])
+                resampler->max[i] = values[i];
+        }
+    }
+
+    memcpy(resampler->last, values, sizeof(*values) * resampler->columnCount);
+    resampler->binSampleCount++;
+
+    memcpy(resampler->previous, values, sizeof(*values) * resampler->columnCount);
+    resampler->previousTime = time;
+    resampler->havePrevious = true;
+}
+
+/**
+ * Mark a break in the data (e.g. due to a corrupt frame), so that we won't interpolate between the samples either side
+ * of the gap.
+ */
+void resamplerAddGap(resampler_t *resampler)
+{
+    resampler->havePrevious = false;
+}
+
+/**
+ * Emit the final row if it has any samples in it.
+ */
+void resamplerFlush(resampler_t *resampler)
+{
+    if (resampler->haveBin) {
+        resamplerEmitRow(resampler);
+    }
+
+    resampler->havePrevious = false;
+}
+
+resampler_t* resamplerCreate(int columnCount, int64_t interval, const ResampleAggregation *aggregation, ResamplerRowReady onRowReady, void *userData)
+{
+    resampler_t *result = malloc(sizeof(*result));
+
+    result->columnCount = columnCount;
+    result->interval = interval;
+    result->onRowReady = onRowReady;
+    result->userData = userData;
+
+    result->aggregation = malloc(sizeof(*result->aggregation) * columnCount);
+    memcpy(result->aggregation, aggregation, sizeof(*result->aggregation) * columnCount);
+
+    result->sum = malloc(sizeof(double) * columnCount);
+    result->min = malloc(sizeof(double) * columnCount);
+    result->max = malloc(sizeof(double) * columnCount);
+    result->last = malloc(sizeof(double) * columnCount);
+    result->interpolated = malloc(sizeof(double) * columnCount);
+    result->previous = malloc(sizeof(double) * columnCount);
+    result->row = malloc(sizeof(double) * columnCount);
+
+    result->haveBin = false;
+    result->haveInterpolated = false;
+    result->havePrevious = false;
+
+    return result;
+}
+
+void resamplerDestroy(resampler_t *resampler)
+{
+    if (!resampler)
+        return;
+
+    free(resampler->aggregation);
+    free(resampler->sum);
+    free(resampler->min);
+    free(resampler->max);
+    free(resampler->last);
+    free(resampler->interpolated);
+    free(resampler->previous);
+    free(resampler->row);
+    free(resampler);
+}
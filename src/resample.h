@@ -0,0 +1,58 @@
+#ifndef RESAMPLE_H_
+#define RESAMPLE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum ResampleAggregation {
+    RESAMPLE_MEAN = 0,
+    RESAMPLE_MIN,
+    RESAMPLE_MAX,
+    RESAMPLE_LAST,
+    RESAMPLE_LINEAR
+} ResampleAggregation;
+
+struct resampler_t;
+
+/**
+ * Called when the resampler has finished computing the values of a row of output. The rowTime is the start of
+ * the interval the row summarises (a multiple of the resampler's interval).
+ */
+typedef void (*ResamplerRowReady)(struct resampler_t *resampler, int64_t rowTime, const double *values, void *userData);
+
+typedef struct resampler_t {
+    int columnCount;
+    int64_t interval;
+    ResampleAggregation *aggregation;
+
+    ResamplerRowReady onRowReady;
+    void *userData;
+
+    // The interval we're currently accumulating samples for, and the samples we've seen so far in that interval:
+    bool haveBin;
+    int64_t binIndex;
+    int binSampleCount;
+
+    double *sum, *min, *max, *last;
+
+    // The value of the linearly-interpolated columns at the start of the current interval
+    double *interpolated;
+    bool haveInterpolated;
+
+    // The last sample we saw, if there hasn't been a gap since then
+    bool havePrevious;
+    int64_t previousTime;
+    double *previous;
+
+    double *row;
+} resampler_t;
+
+resampler_t* resamplerCreate(int columnCount, int64_t interval, const ResampleAggregation *aggregation, ResamplerRowReady onRowReady, void *userData);
+void resamplerAddSample(resampler_t *resampler, int64_t time, const double *values);
+void resamplerAddGap(resampler_t *resampler);
+void resamplerFlush(resampler_t *resampler);
+void resamplerDestroy(resampler_t *resampler);
+
+bool resampleAggregationFromName(const char *name, ResampleAggregation *aggregation);
+
+#endif
@@ -0,0 +1,492 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "spectrum.h"
+#include "fft.h"
+#include "platform.h"
+
+/*
+ * Estimates the frequency content of log fields.
+ *
+ * Samples arrive at the log's (slightly irregular) frame times and are linearly interpolated onto a uniform series
+ * as they're added. Gaps in the log divide the series into runs, and interpolation never crosses a gap.
+ *
+ * The spectrum is then computed from Hann-windowed, half-overlapping windows of each run. The power spectral density
+ * of each window is averaged over the whole log (Welch's method) and over the windows centred in each row of the
+ * spectrogram. Windows are divided into jobs that are shared out between worker threads, and every job covers whole
+ * rows of the spectrogram for one channel, so the workers never write to the same memory.
+ */
+
+typedef struct spectrumWindow_t {
+    int start; // Index of the first sample of the window in the uniform series
+    int row;
+} spectrumWindow_t;
+
+typedef struct spectrumJob_t {
+    int firstWindow, windowCount;
+} spectrumJob_t;
+
+typedef struct spectrumWorker_t {
+    spectrumAnalyzer_t *analyzer;
+
+    const spectrumWindow_t *windows;
+    const spectrumJob_t *jobs;
+    int jobCount;
+
+    const fftRealPlan_t *plan;
+    const float *taper;
+    double scale;
+
+    // This worker takes every threadCount'th unit of work, starting from threadIndex
+    int threadIndex, threadCount;
+
+    // This worker's share of the Welch sum for each channel, psd[channel * binCount + bin]
+    double *psd;
+} spectrumWorker_t;
+
+void spectrumSettingsInit(spectrumSettings_t *settings)
+{
+    settings->fftSize = 512;
+    settings->sampleInterval = 1000;
+    settings->rowInterval = 0;
+    settings->threadCount = platform_cpu_count();
+}
+
+spectrumAnalyzer_t* spectrumAnalyzerCreate(int channelCount, const spectrumSettings_t *settings)
+{
+    spectrumAnalyzer_t *analyzer = calloc(1, sizeof(*analyzer));
+
+    analyzer->settings = *settings;
+    analyzer->channelCount = channelCount;
+
+    analyzer->samples = calloc(channelCount, sizeof(*analyzer->samples));
+    analyzer->previous = calloc(channelCount, sizeof(*analyzer->previous));
+    analyzer->interpolated = calloc(channelCount, sizeof(*analyzer->interpolated));
+
+    if (settings->sampleInterval <= 0) {
+        analyzer->pendingTime = malloc(SPECTRUM_ESTIMATE_SAMPLES * sizeof(*analyzer->pendingTime));
+        analyzer->pendingValues = malloc(SPECTRUM_ESTIMATE_SAMPLES * channelCount * sizeof(*analyzer->pendingValues));
+    }
+
+    return analyzer;
+}
+
+static void spectrumAnalyzerAppend(spectrumAnalyzer_t *analyzer, const float *values)
+{
+    if (analyzer->sampleCount >= analyzer->sampleCapacity) {
+        analyzer->sampleCapacity = analyzer->sampleCapacity == 0 ? 65536 : analyzer->sampleCapacity * 2;
+
+        for (int i = 0; i < analyzer->channelCount; i++) {
+            analyzer->samples[i] = realloc(analyzer->samples[i], analyzer->sampleCapacity * sizeof(*analyzer->samples[i]));
+        }
+    }
+
+    for (int i = 0; i < analyzer->channelCount; i++) {
+        analyzer->samples[i][analyzer->sampleCount] = values[i];
+    }
+
+    analyzer->sampleCount++;
+    analyzer->runs[analyzer->runCount - 1].count++;
+}
+
+static void spectrumAnalyzerStartRun(spectrumAnalyzer_t *analyzer, int64_t time)
+{
+    if (analyzer->runCount >= analyzer->runCapacity) {
+        analyzer->runCapacity = analyzer->runCapacity == 0 ? 16 : analyzer->runCapacity * 2;
+        analyzer->runs = realloc(analyzer->runs, analyzer->runCapacity * sizeof(*analyzer->runs));
+    }
+
+    analyzer->runs[analyzer->runCount].startTime = time;
+    analyzer->runs[analyzer->runCount].start = analyzer->sampleCount;
+    analyzer->runs[analyzer->runCount].count = 0;
+
+    analyzer->runCount++;
+}
+
+static int compareInt64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/**
+ * Set the sample interval to the median spacing of the samples that were held back (which ignores the odd dropped
+ * frame), then add those samples to the series.
+ */
+static void spectrumAnalyzerEstimateInterval(spectrumAnalyzer_t *analyzer)
+{
+    int64_t deltas[SPECTRUM_ESTIMATE_SAMPLES];
+    int deltaCount = 0;
+    int pendingCount = analyzer->pendingCount;
+
+    for (int i = 1; i < pendingCount; i++) {
+        if (analyzer->pendingTime[i] > analyzer->pendingTime[i - 1]) {
+            deltas[deltaCount++] = analyzer->pendingTime[i] - analyzer->pendingTime[i - 1];
+        }
+    }
+
+    analyzer->pendingCount = 0;
+
+    if (deltaCount == 0) {
+        return;
+    }
+
+    qsort(deltas, deltaCount, sizeof(deltas[0]), compareInt64);
+
+    analyzer->settings.sampleInterval = deltas[deltaCount / 2];
+
+    for (int i = 0; i < pendingCount; i++) {
+        spectrumAnalyzerAddSample(analyzer, analyzer->pendingTime[i], analyzer->pendingValues + i * analyzer->channelCount);
+    }
+}
+
+/**
+ * Add the values of each channel at the given time. Times should be increasing, a sample that goes backwards in time
+ * (or that follows a long pause in logging) starts a new run.
+ */
+void spectrumAnalyzerAddSample(spectrumAnalyzer_t *analyzer, int64_t time, const float *values)
+{
+    double interval = analyzer->settings.sampleInterval;
+
+    if (interval <= 0) {
+        analyzer->pendingTime[analyzer->pendingCount] = time;
+        memcpy(analyzer->pendingValues + analyzer->pendingCount * analyzer->channelCount, values, analyzer->channelCount * sizeof(*values));
+
+        if (++analyzer->pendingCount == SPECTRUM_ESTIMATE_SAMPLES) {
+            spectrumAnalyzerEstimateInterval(analyzer);
+        }
+        return;
+    }
+
+    if (!analyzer->havePrevious || time <= analyzer->previousTime
+            || time - analyzer->previousTime > interval * SPECTRUM_MAX_GAP_INTERVALS) {
+        spectrumAnalyzerStartRun(analyzer, time);
+        spectrumAnalyzerAppend(analyzer, values);
+    } else {
+        spectrumRun_t *run = &analyzer->runs[analyzer->runCount - 1];
+        float *interpolated = analyzer->interpolated;
+
+        // Interpolate every point of the uniform series that lies between the previous sample and this one
+        while (1) {
+            double sampleTime = run->startTime + run->count * interval;
+            float fraction;
+
+            if (sampleTime > time)
+                break;
+
+            fraction = (float) ((sampleTime - analyzer->previousTime) / (time - analyzer->previousTime));
+
+            for (int i = 0; i < analyzer->channelCount; i++) {
+                interpolated[i] = analyzer->previous[i] + (values[i] - analyzer->previous[i]) * fraction;
+            }
+
+            spectrumAnalyzerAppend(analyzer, interpolated);
+        }
+    }
+
+    memcpy(analyzer->previous, values, analyzer->channelCount * sizeof(*values));
+    analyzer->previousTime = time;
+    analyzer->havePrevious = true;
+}
+
+/**
+ * Call when frames were lost from the log, so that we don't interpolate across the hole.
+ */
+void spectrumAnalyzerAddGap(spectrumAnalyzer_t *analyzer)
+{
+    analyzer->havePrevious = false;
+}
+
+/**
+ * Call once all the samples have been added, to finish building the uniform series (if the series is going to be
+ * read directly instead of by spectrumAnalyzerCompute()).
+ */
+void spectrumAnalyzerFlush(spectrumAnalyzer_t *analyzer)
+{
+    // The log might have been too short to estimate the interval from all the samples we wanted
+    if (analyzer->pendingCount > 0) {
+        spectrumAnalyzerEstimateInterval(analyzer);
+    }
+}
+
+static void* spectrumWorkerRun(void *data)
+{
+    spectrumWorker_t *worker = (spectrumWorker_t *) data;
+    spectrumAnalyzer_t *analyzer = worker->analyzer;
+
+    int fftSize = analyzer->settings.fftSize;
+    int binCount = analyzer->binCount;
+    int channelCount = analyzer->channelCount;
+    int workCount = worker->jobCount * channelCount;
+
+    float *buffer = malloc(fftSize * sizeof(*buffer));
+    fftComplex_t *bins = malloc(binCount * sizeof(*bins));
+    fftComplex_t *scratch = malloc(fftSize / 2 * sizeof(*scratch));
+    double *power = malloc(binCount * sizeof(*power));
+
+    for (int work = worker->threadIndex; work < workCount; work += worker->threadCount) {
+        const spectrumJob_t *job = &worker->jobs[work / channelCount];
+        int channel = work % channelCount;
+        double *psd = worker->psd + channel * binCount;
+
+        for (int w = job->firstWindow; w < job->firstWindow + job->windowCount; w++) {
+            const spectrumWindow_t *window = &worker->windows[w];
+            const float *samples = analyzer->samples[channel] + window->start;
+            double mean = 0;
+
+            // Remove the mean of the window so its DC level doesn't leak into the low frequency bins
+            for (int i = 0; i < fftSize; i++) {
+                mean += samples[i];
+            }
+            mean /= fftSize;
+
+            for (int i = 0; i < fftSize; i++) {
+                buffer[i] = (float) (samples[i] - mean) * worker->taper[i];
+            }
+
+            fftRealForward(worker->plan, buffer, bins, scratch);
+
+            for (int k = 0; k < binCount; k++) {
+                // The negative frequencies are folded into the positive ones (except for DC and Nyquist)
+                double fold = k == 0 || k == binCount - 1 ? 1 : 2;
+
+                power[k] = ((double) bins[k].re * bins[k].re + (double) bins[k].im * bins[k].im) * worker->scale * fold;
+                psd[k] += power[k];
+            }
+
+            if (analyzer->spectrogram) {
+                float *row = analyzer->spectrogram + ((size_t) window->row * channelCount + channel) * binCount;
+
+                for (int k = 0; k < binCount; k++) {
+                    row[k] += (float) power[k];
+                }
+            }
+        }
+    }
+
+    free(buffer);
+    free(bins);
+    free(scratch);
+    free(power);
+
+    return NULL;
+}
+
+static int compareWindows(const void *a, const void *b)
+{
+    const spectrumWindow_t *x = (const spectrumWindow_t *) a, *y = (const spectrumWindow_t *) b;
+
+    if (x->row != y->row)
+        return x->row < y->row ? -1 : 1;
+
+    return x->start < y->start ? -1 : (x->start > y->start ? 1 : 0);
+}
+
+/**
+ * Compute the Welch PSD (and the spectrogram, if a row interval was given) from all the samples added so far.
+ */
+void spectrumAnalyzerCompute(spectrumAnalyzer_t *analyzer)
+{
+    int fftSize = analyzer->settings.fftSize;
+    int hop = fftSize / 2;
+    double interval;
+    int64_t rowInterval = analyzer->settings.rowInterval;
+    int channelCount = analyzer->channelCount;
+
+    spectrumWindow_t *windows;
+    spectrumJob_t *jobs;
+    int jobCount;
+    int64_t firstRowTime = 0;
+
+    fftRealPlan_t *plan;
+    float *taper;
+    double taperPower;
+
+    int threadCount;
+    spectrumWorker_t *workers;
+    thread_t *threads;
+
+    spectrumAnalyzerFlush(analyzer);
+
+    interval = analyzer->settings.sampleInterval;
+
+    analyzer->binCount = fftSize / 2 + 1;
+    analyzer->binWidth = interval > 0 ? 1000000.0 / (interval * fftSize) : 0;
+
+    free(analyzer->psd);
+    analyzer->psd = calloc(channelCount * analyzer->binCount, sizeof(*analyzer->psd));
+
+    // Time can go backwards in the log, so a later run may start before the first one does
+    for (int r = 0; r < analyzer->runCount; r++) {
+        if (r == 0 || analyzer->runs[r].startTime < firstRowTime)
+            firstRowTime = analyzer->runs[r].startTime;
+    }
+
+    // Decide where the windows lie in each run, and which row of the spectrogram each one belongs to:
+    windows = malloc((analyzer->sampleCount / hop + 1) * sizeof(*windows));
+    analyzer->windowCount = 0;
+
+    for (int r = 0; r < analyzer->runCount; r++) {
+        const spectrumRun_t *run = &analyzer->runs[r];
+
+        for (int start = 0; start + fftSize <= run->count; start += hop) {
+            spectrumWindow_t *window = &windows[analyzer->windowCount++];
+
+            window->start = run->start + start;
+
+            if (rowInterval > 0) {
+                double centreTime = run->startTime + (start + fftSize / 2) * interval;
+
+                window->row = (int) ((centreTime - firstRowTime) / rowInterval);
+            } else {
+                window->row = 0;
+            }
+        }
+    }
+
+    free(analyzer->rowTime);
+    free(analyzer->rowWindowCount);
+    free(analyzer->spectrogram);
+
+    analyzer->rowTime = NULL;
+    analyzer->rowWindowCount = NULL;
+    analyzer->spectrogram = NULL;
+    analyzer->rowCount = 0;
+
+    if (rowInterval > 0 && analyzer->windowCount > 0) {
+        for (int i = 0; i < analyzer->windowCount; i++) {
+            if (windows[i].row >= analyzer->rowCount)
+                analyzer->rowCount = windows[i].row + 1;
+        }
+
+        analyzer->rowTime = malloc(analyzer->rowCount * sizeof(*analyzer->rowTime));
+        analyzer->rowWindowCount = calloc(analyzer->rowCount, sizeof(*analyzer->rowWindowCount));
+        analyzer->spectrogram = calloc((size_t) analyzer->rowCount * channelCount * analyzer->binCount, sizeof(*analyzer->spectrogram));
+
+        for (int i = 0; i < analyzer->rowCount; i++) {
+            analyzer->rowTime[i] = firstRowTime + i * rowInterval;
+        }
+
+        for (int i = 0; i < analyzer->windowCount; i++) {
+            analyzer->rowWindowCount[windows[i].row]++;
+        }
+    }
+
+    // A run that went back in time has windows in earlier rows than the ones before it, so gather each row's windows
+    // together (this doesn't move any windows when time only goes forwards)
+    qsort(windows, analyzer->windowCount, sizeof(*windows), compareWindows);
+
+    // Divide the windows up into jobs, without splitting any row between two jobs:
+    jobs = malloc((analyzer->windowCount / SPECTRUM_WINDOWS_PER_JOB + analyzer->rowCount + 1) * sizeof(*jobs));
+    jobCount = 0;
+
+    for (int i = 0; i < analyzer->windowCount; i++) {
+        if (jobCount == 0 || (jobs[jobCount - 1].windowCount >= SPECTRUM_WINDOWS_PER_JOB && windows[i].row != windows[i - 1].row)) {
+            jobs[jobCount].firstWindow = i;
+            jobs[jobCount].windowCount = 0;
+            jobCount++;
+        }
+
+        jobs[jobCount - 1].windowCount++;
+    }
+
+    plan = fftRealPlanCreate(fftSize, false);
+    taper = malloc(fftSize * sizeof(*taper));
+    taperPower = 0;
+
+    // Periodic Hann window
+    for (int i = 0; i < fftSize; i++) {
+        taper[i] = (float) (0.5 - 0.5 * cos(2 * M_PI * i / fftSize));
+        taperPower += (double) taper[i] * taper[i];
+    }
+
+    threadCount = analyzer->settings.threadCount;
+
+    if (threadCount > jobCount * channelCount)
+        threadCount = jobCount * channelCount;
+    if (threadCount < 1)
+        threadCount = 1;
+
+    workers = malloc(threadCount * sizeof(*workers));
+    threads = malloc(threadCount * sizeof(*threads));
+
+    for (int i = 0; i < threadCount; i++) {
+        workers[i].analyzer = analyzer;
+        workers[i].windows = windows;
+        workers[i].jobs = jobs;
+        workers[i].jobCount = jobCount;
+        workers[i].plan = plan;
+        workers[i].taper = taper;
+        // Scale to power per Hz, compensating for the power removed by the window
+        workers[i].scale = interval / (1000000.0 * taperPower);
+        workers[i].threadIndex = i;
+        workers[i].threadCount = threadCount;
+        workers[i].psd = calloc(channelCount * analyzer->binCount, sizeof(*workers[i].psd));
+    }
+
+    // The calling thread does the first share of the work itself
+    for (int i = 1; i < threadCount; i++) {
+        threads[i] = thread_create(spectrumWorkerRun, &workers[i]);
+    }
+
+    spectrumWorkerRun(&workers[0]);
+
+    for (int i = 1; i < threadCount; i++) {
+        thread_join(threads[i]);
+    }
+
+    // Combine the results of each worker and turn the sums into averages:
+    for (int i = 0; i < threadCount; i++) {
+        for (int j = 0; j < channelCount * analyzer->binCount; j++) {
+            analyzer->psd[j] += workers[i].psd[j];
+        }
+
+        free(workers[i].psd);
+    }
+
+    if (analyzer->windowCount > 0) {
+        for (int j = 0; j < channelCount * analyzer->binCount; j++) {
+            analyzer->psd[j] /= analyzer->windowCount;
+        }
+    }
+
+    for (int row = 0; row < analyzer->rowCount; row++) {
+        if (analyzer->rowWindowCount[row] > 1) {
+            float *values = analyzer->spectrogram + (size_t) row * channelCount * analyzer->binCount;
+
+            for (int j = 0; j < channelCount * analyzer->binCount; j++) {
+                values[j] /= analyzer->rowWindowCount[row];
+            }
+        }
+    }
+
+    free(workers);
+    free(threads);
+    free(taper);
+    fftRealPlanDestroy(plan);
+    free(jobs);
+    free(windows);
+}
+
+void spectrumAnalyzerDestroy(spectrumAnalyzer_t *analyzer)
+{
+    if (analyzer) {
+        for (int i = 0; i < analyzer->channelCount; i++) {
+            free(analyzer->samples[i]);
+        }
+
+        free(analyzer->samples);
+        free(analyzer->runs);
+        free(analyzer->previous);
+        free(analyzer->interpolated);
+        free(analyzer->pendingTime);
+        free(analyzer->pendingValues);
+        free(analyzer->psd);
+        free(analyzer->rowTime);
+        free(analyzer->rowWindowCount);
+        free(analyzer->spectrogram);
+        free(analyzer);
+    }
+}
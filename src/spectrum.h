@@ -0,0 +1,86 @@
+#ifndef SPECTRUM_H_
+#define SPECTRUM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Samples are only interpolated across gaps in the log shorter than this many sample intervals
+#define SPECTRUM_MAX_GAP_INTERVALS 4
+
+// When the sample interval isn't known, this many samples are held back to estimate it from
+#define SPECTRUM_ESTIMATE_SAMPLES 64
+
+// The number of windows in each unit of work given to a worker thread (rows of the spectrogram are never split)
+#define SPECTRUM_WINDOWS_PER_JOB 64
+
+typedef struct spectrumSettings_t {
+    // Number of samples in each FFT window (must be even), windows overlap by half
+    int fftSize;
+
+    // Microseconds between the samples of the uniform series that the log is resampled onto, or 0 to estimate it from
+    // the spacing of the first samples
+    double sampleInterval;
+
+    // Microseconds of the log that each row of the spectrogram covers, or 0 to skip computing the spectrogram
+    int64_t rowInterval;
+
+    int threadCount;
+} spectrumSettings_t;
+
+/**
+ * A stretch of the uniform series with no gaps in it (windows never span two runs).
+ */
+typedef struct spectrumRun_t {
+    int64_t startTime;
+    int start, count;
+} spectrumRun_t;
+
+typedef struct spectrumAnalyzer_t {
+    spectrumSettings_t settings;
+    int channelCount;
+
+    // The uniformly-resampled series for each channel, and the runs they're divided into:
+    float **samples;
+    int sampleCount, sampleCapacity;
+
+    spectrumRun_t *runs;
+    int runCount, runCapacity;
+
+    // The last input sample, so we can interpolate up to the next one:
+    bool havePrevious;
+    int64_t previousTime;
+    float *previous, *interpolated;
+
+    // Samples held back while we estimate the sample interval:
+    int64_t *pendingTime;
+    float *pendingValues;
+    int pendingCount;
+
+    // Results from spectrumAnalyzerCompute():
+    int binCount;
+    double binWidth;
+
+    // Welch estimate of the power spectral density for each channel, psd[channel * binCount + bin]
+    int windowCount;
+    double *psd;
+
+    /*
+     * Power spectral density averaged over the windows that are centred in each row of the spectrogram,
+     * spectrogram[(row * channelCount + channel) * binCount + bin]. Rows with no windows in them are left as zero.
+     */
+    int rowCount;
+    int64_t *rowTime;
+    int *rowWindowCount;
+    float *spectrogram;
+} spectrumAnalyzer_t;
+
+void spectrumSettingsInit(spectrumSettings_t *settings);
+
+spectrumAnalyzer_t* spectrumAnalyzerCreate(int channelCount, const spectrumSettings_t *settings);
+void spectrumAnalyzerAddSample(spectrumAnalyzer_t *analyzer, int64_t time, const float *values);
+void spectrumAnalyzerAddGap(spectrumAnalyzer_t *analyzer);
+void spectrumAnalyzerFlush(spectrumAnalyzer_t *analyzer);
+void spectrumAnalyzerCompute(spectrumAnalyzer_t *analyzer);
+void spectrumAnalyzerDestroy(spectrumAnalyzer_t *analyzer);
+
+#endif
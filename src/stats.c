@@ -1,3 +1,5 @@
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "stats.h"
@@ -27,13 +29,35 @@ void seriesStats_append(seriesStats_t *stats, double val)
     } else {
         double oldM = stats->m;
 
-        stats->m = oldM + (val - oldM) / stats->count;
+        stats->m = oldM + (val - oldM) / (stats->count + 1);
         stats->s = stats->s + (val - oldM) * (val - stats->m);
     }
 
     stats->count++;
 }
 
+/**
+ * Combine the statistics of another series into this one, as if its values had been appended to this series (Chan et
+ * al's parallel variant of the algorithm).
+ */
+void seriesStats_merge(seriesStats_t *stats, const seriesStats_t *other)
+{
+    if (other->count == 0) {
+        return;
+    }
+
+    if (stats->count == 0) {
+        *stats = *other;
+    } else {
+        int count = stats->count + other->count;
+        double delta = other->m - stats->m;
+
+        stats->m += delta * other->count / count;
+        stats->s += other->s + delta * delta * ((double) stats->count * other->count / count);
+        stats->count = count;
+    }
+}
+
 double seriesStats_getMean(seriesStats_t *stats)
 {
     return stats->count > 0 ? stats->m : 0.0;
@@ -48,3 +72,304 @@ double seriesStats_getStandardDeviation(seriesStats_t *stats)
 {
     return sqrt(seriesStats_getVariance(stats));
 }
+
+/*
+ * A mergeable sketch of the distribution of a series of integers for estimating quantiles with bounded relative
+ * error, using log-linear buckets (like HdrHistogram). Every sketch uses the same bucket boundaries, so the sketches of
+ * separate series (e.g. chunks of a log or several logs) can be combined just by adding up their bucket counts.
+ */
+
+#define QUANTILE_SKETCH_SUB_BUCKETS (1 << QUANTILE_SKETCH_SUB_BUCKET_BITS)
+#define QUANTILE_SKETCH_MAX_BUCKETS ((64 - QUANTILE_SKETCH_SUB_BUCKET_BITS + 1) * QUANTILE_SKETCH_SUB_BUCKETS)
+
+// Extra buckets to allocate when a store has to grow, so we don't need to reallocate for every new bucket
+#define QUANTILE_SKETCH_STORE_GROW_SLACK 32
+
+static int highestBitSet(uint64_t value)
+{
+#ifdef __GNUC__
+    return 63 - __builtin_clzll(value);
+#else
+    int result = 0;
+
+    while (value >>= 1) {
+        result++;
+    }
+
+    return result;
+#endif
+}
+
+static int quantileSketch_bucketForMagnitude(uint64_t magnitude)
+{
+    int exponent;
+
+    if (magnitude < QUANTILE_SKETCH_SUB_BUCKETS) {
+        return (int) magnitude;
+    }
+
+    exponent = highestBitSet(magnitude);
+
+    return (exponent - QUANTILE_SKETCH_SUB_BUCKET_BITS + 1) * QUANTILE_SKETCH_SUB_BUCKETS
+        + (int) ((magnitude >> (exponent - QUANTILE_SKETCH_SUB_BUCKET_BITS)) & (QUANTILE_SKETCH_SUB_BUCKETS - 1));
+}
+
+/**
+ * Get the value in the middle of the range of magnitudes covered by the bucket.
+ */
+static double quantileSketch_bucketMagnitude(int bucket)
+{
+    int shift;
+
+    if (bucket < QUANTILE_SKETCH_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    shift = bucket / QUANTILE_SKETCH_SUB_BUCKETS - 1;
+
+    return (double) ((uint64_t) (QUANTILE_SKETCH_SUB_BUCKETS + bucket % QUANTILE_SKETCH_SUB_BUCKETS) << shift)
+        + ((double) ((uint64_t) 1 << shift) - 1) / 2;
+}
+
+static void quantileSketchStore_add(quantileSketchStore_t *store, int bucket, uint64_t count)
+{
+    if (store->length == 0 || bucket < store->offset || bucket >= store->offset + store->length) {
+        int newStart, newEnd;
+
+        if (store->length == 0) {
+            newStart = bucket - QUANTILE_SKETCH_STORE_GROW_SLACK / 2;
+            newEnd = bucket + QUANTILE_SKETCH_STORE_GROW_SLACK / 2;
+        } else if (bucket < store->offset) {
+            newStart = bucket - QUANTILE_SKETCH_STORE_GROW_SLACK;
+            newEnd = store->offset + store->length;
+        } else {
+            newStart = store->offset;
+            newEnd = bucket + QUANTILE_SKETCH_STORE_GROW_SLACK;
+        }
+
+        if (newStart < 0)
+            newStart = 0;
+        if (newEnd > QUANTILE_SKETCH_MAX_BUCKETS)
+            newEnd = QUANTILE_SKETCH_MAX_BUCKETS;
+
+        uint64_t *newCounts = calloc(newEnd - newStart, sizeof(*newCounts));
+
+        if (store->length > 0) {
+            memcpy(newCounts + (store->offset - newStart), store->counts, store->length * sizeof(*newCounts));
+        }
+
+        free(store->counts);
+
+        store->counts = newCounts;
+        store->offset = newStart;
+        store->length = newEnd - newStart;
+    }
+
+    store->counts[bucket - store->offset] += count;
+}
+
+void quantileSketch_init(quantileSketch_t *sketch)
+{
+    memset(sketch, 0, sizeof(*sketch));
+}
+
+void quantileSketch_destroy(quantileSketch_t *sketch)
+{
+    free(sketch->negative.counts);
+    free(sketch->positive.counts);
+
+    quantileSketch_init(sketch);
+}
+
+void quantileSketch_add(quantileSketch_t *sketch, int64_t value)
+{
+    if (value < 0) {
+        quantileSketchStore_add(&sketch->negative, quantileSketch_bucketForMagnitude(-(uint64_t) value), 1);
+    } else {
+        quantileSketchStore_add(&sketch->positive, quantileSketch_bucketForMagnitude((uint64_t) value), 1);
+    }
+
+    if (sketch->count == 0 || value < sketch->min)
+        sketch->min = value;
+    if (sketch->count == 0 || value > sketch->max)
+        sketch->max = value;
+
+    sketch->count++;
+}
+
+/**
+ * Add the values summarised by the other sketch into this one.
+ */
+void quantileSketch_merge(quantileSketch_t *sketch, const quantileSketch_t *other)
+{
+    int i;
+
+    if (other->count == 0) {
+        return;
+    }
+
+    for (i = 0; i < other->negative.length; i++) {
+        if (other->negative.counts[i]) {
+            quantileSketchStore_add(&sketch->negative, other->negative.offset + i, other->negative.counts[i]);
+        }
+    }
+
+    for (i = 0; i < other->positive.length; i++) {
+        if (other->positive.counts[i]) {
+            quantileSketchStore_add(&sketch->positive, other->positive.offset + i, other->positive.counts[i]);
+        }
+    }
+
+    if (sketch->count == 0 || other->min < sketch->min)
+        sketch->min = other->min;
+    if (sketch->count == 0 || other->max > sketch->max)
+        sketch->max = other->max;
+
+    sketch->count += other->count;
+}
+
+uint64_t quantileSketch_getCount(const quantileSketch_t *sketch)
+{
+    return sketch->count;
+}
+
+/**
+ * Estimate the value at the given quantile (0.0 - 1.0) of the series.
+ */
+double quantileSketch_getQuantile(const quantileSketch_t *sketch, double quantile)
+{
+    uint64_t rank;
+    double result = sketch->max;
+    int i;
+
+    if (sketch->count == 0) {
+        return 0.0;
+    }
+
+    if (quantile <= 0) {
+        return sketch->min;
+    }
+
+    if (quantile >= 1) {
+        return sketch->max;
+    }
+
+    rank = (uint64_t) (quantile * (sketch->count - 1));
+
+    // The negative values run from the largest magnitude to the smallest
+    for (i = sketch->negative.length - 1; i >= 0; i--) {
+        if (rank < sketch->negative.counts[i]) {
+            result = -quantileSketch_bucketMagnitude(sketch->negative.offset + i);
+            goto found;
+        }
+        rank -= sketch->negative.counts[i];
+    }
+
+    for (i = 0; i < sketch->positive.length; i++) {
+        if (rank < sketch->positive.counts[i]) {
+            result = quantileSketch_bucketMagnitude(sketch->positive.offset + i);
+            goto found;
+        }
+        rank -= sketch->positive.counts[i];
+    }
+
+    found:
+    // The middle of the bucket might lie outside the range of values we actually saw
+    if (result < sketch->min)
+        result = sketch->min;
+    if (result > sketch->max)
+        result = sketch->max;
+
+    return result;
+}
+
+/*
+ * A histogram with equal-width bins, and counts of the values that fell outside the range of the bins. Histograms
+ * with the same bins can be merged.
+ */
+
+void histogram_init(histogram_t *histogram, int64_t min, int64_t binWidth, int binCount)
+{
+    histogram->min = min;
+    histogram->binWidth = binWidth;
+    histogram->binCount = binCount;
+    histogram->counts = calloc(binCount, sizeof(*histogram->counts));
+    histogram->underflow = 0;
+    histogram->overflow = 0;
+}
+
+void histogram_destroy(histogram_t *histogram)
+{
+    free(histogram->counts);
+    histogram->counts = NULL;
+}
+
+void histogram_add(histogram_t *histogram, int64_t value)
+{
+    if (value < histogram->min) {
+        histogram->underflow++;
+    } else {
+        int64_t bin = (value - histogram->min) / histogram->binWidth;
+
+        if (bin >= histogram->binCount) {
+            histogram->overflow++;
+        } else {
+            histogram->counts[bin]++;
+        }
+    }
+}
+
+/**
+ * Get the start of the bin that the value at the given quantile (0.0 - 1.0) falls into. Values outside the range of
+ * the bins are reported as the nearest end of the range.
+ */
+int64_t histogram_getQuantile(const histogram_t *histogram, double quantile)
+{
+    uint64_t total = histogram->underflow + histogram->overflow;
+    uint64_t rank;
+
+    for (int i = 0; i < histogram->binCount; i++) {
+        total += histogram->counts[i];
+    }
+
+    if (total == 0) {
+        return histogram->min;
+    }
+
+    rank = (uint64_t) ((quantile < 0 ? 0 : quantile > 1 ? 1 : quantile) * (total - 1));
+
+    if (rank < histogram->underflow) {
+        return histogram->min;
+    }
+
+    rank -= histogram->underflow;
+
+    for (int i = 0; i < histogram->binCount; i++) {
+        if (rank < histogram->counts[i]) {
+            return histogram->min + i * histogram->binWidth;
+        }
+
+        rank -= histogram->counts[i];
+    }
+
+    return histogram->min + histogram->binCount * histogram->binWidth;
+}
+
+/**
+ * Add the counts of the other histogram into this one. Returns false if the histograms' bins don't match.
+ */
+bool histogram_merge(histogram_t *histogram, const histogram_t *other)
+{
+    if (histogram->min != other->min || histogram->binWidth != other->binWidth || histogram->binCount != other->binCount) {
+        return false;
+    }
+
+    for (int i = 0; i < histogram->binCount; i++) {
+        histogram->counts[i] += other->counts[i];
+    }
+
+    histogram->underflow += other->underflow;
+    histogram->overflow += other->overflow;
+
+    return true;
+}
@@ -1,6 +1,9 @@
 #ifndef STATS_H_
 #define STATS_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
 typedef struct seriesStats_t {
     double m, s;
     int count;
@@ -9,9 +12,54 @@ typedef struct seriesStats_t {
 void seriesStats_init(seriesStats_t *stats);
 
 void seriesStats_append(seriesStats_t *stats, double val);
+void seriesStats_merge(seriesStats_t *stats, const seriesStats_t *other);
 int seriesStats_getCount(seriesStats_t *stats);
 double seriesStats_getMean(seriesStats_t *stats);
 double seriesStats_getVariance(seriesStats_t *stats);
 double seriesStats_getStandardDeviation(seriesStats_t *stats);
 
+/*
+ * Values below 2^QUANTILE_SKETCH_SUB_BUCKET_BITS get a bucket each, larger values are split into that many buckets
+ * per power of two, so values are reported with a relative error of at most 1/(2 * 2^QUANTILE_SKETCH_SUB_BUCKET_BITS).
+ */
+#define QUANTILE_SKETCH_SUB_BUCKET_BITS 6
+
+typedef struct quantileSketchStore_t {
+    // Index of the bucket counts[0] refers to
+    int offset;
+    int length;
+    uint64_t *counts;
+} quantileSketchStore_t;
+
+typedef struct quantileSketch_t {
+    uint64_t count;
+    int64_t min, max;
+
+    // Buckets for the magnitudes of the negative values and the non-negative values
+    quantileSketchStore_t negative, positive;
+} quantileSketch_t;
+
+void quantileSketch_init(quantileSketch_t *sketch);
+void quantileSketch_destroy(quantileSketch_t *sketch);
+
+void quantileSketch_add(quantileSketch_t *sketch, int64_t value);
+void quantileSketch_merge(quantileSketch_t *sketch, const quantileSketch_t *other);
+uint64_t quantileSketch_getCount(const quantileSketch_t *sketch);
+double quantileSketch_getQuantile(const quantileSketch_t *sketch, double quantile);
+
+typedef struct histogram_t {
+    int64_t min, binWidth;
+    int binCount;
+
+    uint64_t *counts;
+    uint64_t underflow, overflow;
+} histogram_t;
+
+void histogram_init(histogram_t *histogram, int64_t min, int64_t binWidth, int binCount);
+void histogram_destroy(histogram_t *histogram);
+
+void histogram_add(histogram_t *histogram, int64_t value);
+bool histogram_merge(histogram_t *histogram, const histogram_t *other);
+int64_t histogram_getQuantile(const histogram_t *histogram, double quantile);
+
 #endif
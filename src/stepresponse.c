@@ -0,0 +1,343 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stepresponse.h"
+#include "fft.h"
+#include "platform.h"
+
+/*
+ * Estimates the closed-loop step response of each axis from the setpoint and gyro series.
+ *
+ * The log is cut into Hann-windowed, half-overlapping windows, and the windows where the pilot moved the sticks for
+ * that axis are kept. In each window the impulse response is recovered by Wiener deconvolution of the gyro against
+ * the setpoint (in the frequency domain, with zero-padding so the convolution isn't circular), then integrated to
+ * give the step response. The step responses of every window are averaged, and their spread gives a confidence
+ * interval for that average.
+ *
+ * Windows are shared between worker threads in jobs, and each worker keeps its own sums so the workers never write
+ * to the same memory.
+ */
+
+typedef struct stepResponseJob_t {
+    int axis;
+    int firstWindow, windowCount;
+} stepResponseJob_t;
+
+typedef struct stepResponseWorker_t {
+    const spectrumAnalyzer_t *series;
+    const int *setpointChannel, *gyroChannel;
+
+    // The first sample of each window, in the uniform series
+    const int *windowStart;
+    const stepResponseJob_t *jobs;
+    int jobCount;
+
+    int windowSize, fftSize, length;
+
+    const fftRealPlan_t *forward, *inverse;
+    const float *taper;
+    // 1 / SNR for each frequency bin
+    const float *noise;
+
+    // This worker takes every threadCount'th job, starting from threadIndex
+    int threadIndex, threadCount;
+
+    // This worker's sums of the step responses it computed and of their squares, [axis * length + i]
+    double *sum, *sumSquares;
+} stepResponseWorker_t;
+
+void stepResponseSettingsInit(stepResponseSettings_t *settings)
+{
+    settings->windowLength = 1000000;
+    settings->responseLength = 500000;
+    settings->minimumSetpoint = 20;
+    settings->cutoffFrequency = 25;
+    settings->threadCount = platform_cpu_count();
+}
+
+static void* stepResponseWorkerRun(void *data)
+{
+    stepResponseWorker_t *worker = (stepResponseWorker_t *) data;
+
+    int windowSize = worker->windowSize;
+    int fftSize = worker->fftSize;
+    int binCount = fftSize / 2 + 1;
+
+    float *setpoint = calloc(fftSize, sizeof(*setpoint));
+    float *gyro = calloc(fftSize, sizeof(*gyro));
+    float *impulse = malloc(fftSize * sizeof(*impulse));
+    fftComplex_t *setpointBins = malloc(binCount * sizeof(*setpointBins));
+    fftComplex_t *gyroBins = malloc(binCount * sizeof(*gyroBins));
+    fftComplex_t *scratch = malloc(fftSize / 2 * sizeof(*scratch));
+
+    for (int j = worker->threadIndex; j < worker->jobCount; j += worker->threadCount) {
+        const stepResponseJob_t *job = &worker->jobs[j];
+        const float *setpointSeries = worker->series->samples[worker->setpointChannel[job->axis]];
+        const float *gyroSeries = worker->series->samples[worker->gyroChannel[job->axis]];
+        double *sum = worker->sum + job->axis * worker->length;
+        double *sumSquares = worker->sumSquares + job->axis * worker->length;
+
+        for (int w = job->firstWindow; w < job->firstWindow + job->windowCount; w++) {
+            int start = worker->windowStart[w];
+            double inputPower = 0, step = 0;
+
+            // The second half of each buffer stays zero as padding
+            for (int i = 0; i < windowSize; i++) {
+                setpoint[i] = setpointSeries[start + i] * worker->taper[i];
+                gyro[i] = gyroSeries[start + i] * worker->taper[i];
+            }
+
+            fftRealForward(worker->forward, setpoint, setpointBins, scratch);
+            fftRealForward(worker->forward, gyro, gyroBins, scratch);
+
+            for (int k = 0; k < binCount; k++) {
+                inputPower += (double) setpointBins[k].re * setpointBins[k].re + (double) setpointBins[k].im * setpointBins[k].im;
+            }
+            inputPower /= binCount;
+
+            // H = G X* / (|X|^2 + noise), where the noise is relative to the average power of the input
+            for (int k = 0; k < binCount; k++) {
+                fftComplex_t x = setpointBins[k], g = gyroBins[k];
+                double denominator = (double) x.re * x.re + (double) x.im * x.im + inputPower * worker->noise[k];
+
+                gyroBins[k].re = (float) ((g.re * x.re + g.im * x.im) / denominator);
+                gyroBins[k].im = (float) ((g.im * x.re - g.re * x.im) / denominator);
+            }
+
+            fftRealInverse(worker->inverse, gyroBins, impulse, scratch);
+
+            for (int i = 0; i < worker->length; i++) {
+                step += impulse[i] / fftSize;
+
+                sum[i] += step;
+                sumSquares[i] += step * step;
+            }
+        }
+    }
+
+    free(setpoint);
+    free(gyro);
+    free(impulse);
+    free(setpointBins);
+    free(gyroBins);
+    free(scratch);
+
+    return NULL;
+}
+
+/**
+ * Estimate the step response of each axis from the uniform series that was collected by the given spectrum analyzer,
+ * where the setpoint and gyro rate of each axis are in the given channels of the series (in the same units).
+ *
+ * Returns NULL if no samples were added to the series.
+ */
+stepResponse_t* stepResponseEstimate(spectrumAnalyzer_t *series, int axisCount, const int *setpointChannel, const int *gyroChannel,
+    const stepResponseSettings_t *settings)
+{
+    stepResponse_t *response;
+    double interval;
+    int windowSize, hop, fftSize;
+
+    int *windowStart, windowCount;
+    stepResponseJob_t *jobs;
+    int jobCount;
+
+    fftRealPlan_t *forward, *inverse;
+    float *taper, *noise;
+
+    int threadCount;
+    stepResponseWorker_t *workers;
+    thread_t *threads;
+
+    spectrumAnalyzerFlush(series);
+
+    interval = series->settings.sampleInterval;
+
+    if (interval <= 0) {
+        return NULL;
+    }
+
+    // Windows need an even number of samples so that they can overlap by half
+    windowSize = ((int) (settings->windowLength / interval) + 1) & ~1;
+    hop = windowSize / 2;
+    fftSize = windowSize * 2;
+
+    if (windowSize < 2) {
+        return NULL;
+    }
+
+    response = calloc(1, sizeof(*response));
+
+    response->axisCount = axisCount;
+    response->sampleInterval = interval;
+    response->length = (int) (settings->responseLength / interval);
+
+    if (response->length > windowSize)
+        response->length = windowSize;
+
+    // Find the windows of each axis where the sticks moved, and divide them into jobs:
+    windowStart = malloc((series->sampleCount / hop + 1) * axisCount * sizeof(*windowStart));
+    windowCount = 0;
+
+    jobs = malloc(((series->sampleCount / hop + 1) / STEP_RESPONSE_WINDOWS_PER_JOB + 1) * axisCount * sizeof(*jobs));
+    jobCount = 0;
+
+    for (int axis = 0; axis < axisCount; axis++) {
+        const float *setpoint = series->samples[setpointChannel[axis]];
+
+        for (int r = 0; r < series->runCount; r++) {
+            const spectrumRun_t *run = &series->runs[r];
+
+            for (int start = run->start; start + windowSize <= run->start + run->count; start += hop) {
+                bool active = false;
+
+                for (int i = start; i < start + windowSize; i++) {
+                    if (fabsf(setpoint[i]) >= settings->minimumSetpoint) {
+                        active = true;
+                        break;
+                    }
+                }
+
+                if (!active)
+                    continue;
+
+                if (jobCount == 0 || jobs[jobCount - 1].axis != axis || jobs[jobCount - 1].windowCount >= STEP_RESPONSE_WINDOWS_PER_JOB) {
+                    jobs[jobCount].axis = axis;
+                    jobs[jobCount].firstWindow = windowCount;
+                    jobs[jobCount].windowCount = 0;
+                    jobCount++;
+                }
+
+                windowStart[windowCount++] = start;
+                jobs[jobCount - 1].windowCount++;
+                response->windowCount[axis]++;
+            }
+        }
+    }
+
+    forward = fftRealPlanCreate(fftSize, false);
+    inverse = fftRealPlanCreate(fftSize, true);
+
+    taper = malloc(windowSize * sizeof(*taper));
+
+    for (int i = 0; i < windowSize; i++) {
+        taper[i] = (float) (0.5 - 0.5 * cos(2 * M_PI * i / windowSize));
+    }
+
+    // Trust the signal below the cutoff frequency, and fade that trust away quickly above it
+    noise = malloc((fftSize / 2 + 1) * sizeof(*noise));
+
+    for (int k = 0; k <= fftSize / 2; k++) {
+        double frequency = k * 1000000.0 / (interval * fftSize);
+        double snr = STEP_RESPONSE_SNR;
+
+        if (frequency > settings->cutoffFrequency) {
+            double excess = (frequency - settings->cutoffFrequency) / (settings->cutoffFrequency * 0.25);
+
+            snr *= exp(-excess * excess);
+        }
+
+        noise[k] = (float) (1 / (snr + 1e-9));
+    }
+
+    threadCount = settings->threadCount;
+
+    if (threadCount > jobCount)
+        threadCount = jobCount;
+    if (threadCount < 1)
+        threadCount = 1;
+
+    workers = malloc(threadCount * sizeof(*workers));
+    threads = malloc(threadCount * sizeof(*threads));
+
+    for (int i = 0; i < threadCount; i++) {
+        workers[i].series = series;
+        workers[i].setpointChannel = setpointChannel;
+        workers[i].gyroChannel = gyroChannel;
+        workers[i].windowStart = windowStart;
+        workers[i].jobs = jobs;
+        workers[i].jobCount = jobCount;
+        workers[i].windowSize = windowSize;
+        workers[i].fftSize = fftSize;
+        workers[i].length = response->length;
+        workers[i].forward = forward;
+        workers[i].inverse = inverse;
+        workers[i].taper = taper;
+        workers[i].noise = noise;
+        workers[i].threadIndex = i;
+        workers[i].threadCount = threadCount;
+        workers[i].sum = calloc(axisCount * response->length, sizeof(*workers[i].sum));
+        workers[i].sumSquares = calloc(axisCount * response->length, sizeof(*workers[i].sumSquares));
+    }
+
+    // The calling thread does the first share of the work itself
+    for (int i = 1; i < threadCount; i++) {
+        threads[i] = thread_create(stepResponseWorkerRun, &workers[i]);
+    }
+
+    stepResponseWorkerRun(&workers[0]);
+
+    for (int i = 1; i < threadCount; i++) {
+        thread_join(threads[i]);
+    }
+
+    // Combine the sums from each worker into the average and its confidence interval:
+    response->mean = calloc(axisCount * response->length, sizeof(*response->mean));
+    response->lower = calloc(axisCount * response->length, sizeof(*response->lower));
+    response->upper = calloc(axisCount * response->length, sizeof(*response->upper));
+
+    for (int axis = 0; axis < axisCount; axis++) {
+        int n = response->windowCount[axis];
+
+        for (int i = axis * response->length; i < (axis + 1) * response->length; i++) {
+            double sum = 0, sumSquares = 0, mean, halfWidth = 0;
+
+            for (int t = 0; t < threadCount; t++) {
+                sum += workers[t].sum[i];
+                sumSquares += workers[t].sumSquares[i];
+            }
+
+            if (n == 0)
+                continue;
+
+            mean = sum / n;
+
+            if (n > 1) {
+                double variance = (sumSquares - sum * mean) / (n - 1);
+
+                halfWidth = 1.96 * sqrt(variance > 0 ? variance : 0) / sqrt(n);
+            }
+
+            response->mean[i] = mean;
+            response->lower[i] = mean - halfWidth;
+            response->upper[i] = mean + halfWidth;
+        }
+    }
+
+    for (int i = 0; i < threadCount; i++) {
+        free(workers[i].sum);
+        free(workers[i].sumSquares);
+    }
+
+    free(workers);
+    free(threads);
+    free(noise);
+    free(taper);
+    fftRealPlanDestroy(forward);
+    fftRealPlanDestroy(inverse);
+    free(jobs);
+    free(windowStart);
+
+    return response;
+}
+
+void stepResponseDestroy(stepResponse_t *response)
+{
+    if (response) {
+        free(response->mean);
+        free(response->lower);
+        free(response->upper);
+        free(response);
+    }
+}
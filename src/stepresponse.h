@@ -0,0 +1,52 @@
+#ifndef STEPRESPONSE_H_
+#define STEPRESPONSE_H_
+
+#include <stdint.h>
+
+#include "spectrum.h"
+
+#define STEP_RESPONSE_MAX_AXES 3
+
+/*
+ * The signal to noise ratio assumed by the deconvolution below the cutoff frequency. Lower values give a smoother
+ * estimate that settles further below its true level.
+ */
+#define STEP_RESPONSE_SNR 100
+
+// The number of windows in each unit of work given to a worker thread
+#define STEP_RESPONSE_WINDOWS_PER_JOB 16
+
+typedef struct stepResponseSettings_t {
+    // Microseconds of log in each (half-overlapping) window, and the length of the response to estimate from each
+    int64_t windowLength, responseLength;
+
+    // Windows where the setpoint never gets this far from zero are skipped, since there's no step to respond to
+    double minimumSetpoint;
+
+    // Frequencies above this (in Hz) are mostly noise, so they're suppressed in the deconvolution
+    double cutoffFrequency;
+
+    int threadCount;
+} stepResponseSettings_t;
+
+/**
+ * The averaged step response of each axis, with a 95% confidence interval for the average. The value of sample `i`
+ * of axis `a` is found at mean[a * length + i], and sample `i` is `i * sampleInterval` microseconds after the step.
+ */
+typedef struct stepResponse_t {
+    int axisCount;
+    int length;
+    double sampleInterval;
+
+    int windowCount[STEP_RESPONSE_MAX_AXES];
+
+    double *mean, *lower, *upper;
+} stepResponse_t;
+
+void stepResponseSettingsInit(stepResponseSettings_t *settings);
+
+stepResponse_t* stepResponseEstimate(spectrumAnalyzer_t *series, int axisCount, const int *setpointChannel, const int *gyroChannel,
+    const stepResponseSettings_t *settings);
+void stepResponseDestroy(stepResponse_t *response);
+
+#endif
@@ -0,0 +1,395 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "streammerge.h"
+
+/*
+ * Joins several streams of timestamped frames (e.g. the main, GPS and slow frames of a log) into rows, one for each
+ * frame of the primary stream (stream 0), in a single pass with bounded memory.
+ *
+ * Frames are queued per stream and merged in timestamp order with a k-way merge. Since the streams are interleaved
+ * in the log roughly in time order, a frame is merged once a frame with a later timestamp has been added to any of
+ * the streams. A secondary frame with the same timestamp as a primary frame is merged before it, so it is joined onto
+ * that row.
+ *
+ * Rows that need a later frame from a linearly-interpolated or nearest-joined stream wait in a ring buffer until that
+ * frame arrives (or until the buffer fills up or there's a gap in that stream, in which case the last value is held).
+ */
+
+#define STREAM_MERGER_QUEUE_CAPACITY 64
+
+static const char* const MERGE_JOIN_POLICY_NAME[] = {
+    "hold",
+    "linear",
+    "nearest"
+};
+
+bool mergeJoinPolicyFromName(const char *name, MergeJoinPolicy *policy)
+{
+    for (int i = 0; i < (int) (sizeof(MERGE_JOIN_POLICY_NAME) / sizeof(MERGE_JOIN_POLICY_NAME[0])); i++) {
+        if (strcmp(name, MERGE_JOIN_POLICY_NAME[i]) == 0) {
+            *policy = (MergeJoinPolicy) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static streamMergerRow_t* streamMergerGetRow(streamMerger_t *merger, int index)
+{
+    return &merger->rows[(merger->rowStart + index) % merger->rowCapacity];
+}
+
+/**
+ * Fill in the values of the given secondary stream for the row, using the last sample we merged from that stream and
+ * the next sample after the row's time (or NULL if there won't be one).
+ */
+static void streamMergerResolveRow(streamMerger_t *merger, streamMergerRow_t *row, int streamIndex, const streamMergerEvent_t *next)
+{
+    streamMergerStream_t *stream = &merger->streams[streamIndex];
+    const int64_t *source = NULL;
+
+    if (stream->policy == MERGE_JOIN_LINEAR) {
+        if (stream->havePrevious && !stream->gapSincePrevious && next && next->time > stream->previousTime) {
+            double fraction = (double) (row->time - stream->previousTime) / (next->time - stream->previousTime);
+
+            for (int i = 0; i < stream->fieldCount; i++) {
+                row->secondary[streamIndex][i] = stream->previous[i] + (int64_t) llround((next->values[i] - stream->previous[i]) * fraction);
+            }
+
+            row->haveSecondary[streamIndex] = true;
+        } else if (stream->havePrevious) {
+            source = stream->previous;
+        }
+    } else if (stream->policy == MERGE_JOIN_NEAREST) {
+        if (stream->havePrevious && next) {
+            source = row->time - stream->previousTime <= next->time - row->time ? stream->previous : next->values;
+        } else if (stream->havePrevious) {
+            source = stream->previous;
+        } else if (next) {
+            source = next->values;
+        }
+    } else if (stream->havePrevious) {
+        source = stream->previous;
+    }
+
+    if (source) {
+        memcpy(row->secondary[streamIndex], source, stream->fieldCount * sizeof(*source));
+        row->haveSecondary[streamIndex] = true;
+    }
+
+    if (row->unresolved[streamIndex]) {
+        row->unresolved[streamIndex] = false;
+        row->unresolvedCount--;
+    }
+}
+
+/**
+ * Emit the rows at the front of the row buffer which have all their streams joined. If `force` is set, emit the first
+ * row even if it is still waiting on a stream (holding that stream's last value instead).
+ */
+static void streamMergerEmitRows(streamMerger_t *merger, bool force)
+{
+    while (merger->rowLength > 0) {
+        streamMergerRow_t *row = streamMergerGetRow(merger, 0);
+
+        if (row->unresolvedCount > 0) {
+            if (!force)
+                break;
+
+            for (int i = 1; i < merger->streamCount; i++) {
+                if (row->unresolved[i]) {
+                    streamMergerResolveRow(merger, row, i, NULL);
+                }
+            }
+        }
+
+        for (int i = 1; i < merger->streamCount; i++) {
+            merger->rowSecondary[i - 1] = row->haveSecondary[i] ? row->secondary[i] : NULL;
+        }
+
+        merger->onRowReady(merger, row->time, row->primary, merger->rowSecondary, merger->userData);
+
+        merger->rowStart = (merger->rowStart + 1) % merger->rowCapacity;
+        merger->rowLength--;
+
+        force = false;
+    }
+}
+
+static void streamMergerMergePrimary(streamMerger_t *merger, const streamMergerEvent_t *event)
+{
+    streamMergerRow_t *row;
+
+    if (merger->rowLength == merger->rowCapacity) {
+        streamMergerEmitRows(merger, true);
+    }
+
+    row = streamMergerGetRow(merger, merger->rowLength);
+    merger->rowLength++;
+
+    row->time = event->time;
+    memcpy(row->primary, event->values, merger->streams[0].fieldCount * sizeof(*row->primary));
+    row->unresolvedCount = 0;
+
+    for (int i = 1; i < merger->streamCount; i++) {
+        streamMergerStream_t *stream = &merger->streams[i];
+
+        row->haveSecondary[i] = false;
+        row->unresolved[i] = false;
+
+        // Unless we're holding the last value or have an exact match, we need to wait for the next sample to arrive
+        if (stream->policy == MERGE_JOIN_HOLD || (stream->havePrevious && stream->previousTime == row->time)
+                || (stream->policy == MERGE_JOIN_LINEAR && (!stream->havePrevious || stream->gapSincePrevious))) {
+            streamMergerResolveRow(merger, row, i, NULL);
+        } else {
+            row->unresolved[i] = true;
+            row->unresolvedCount++;
+        }
+    }
+
+    streamMergerEmitRows(merger, false);
+}
+
+static void streamMergerMergeSecondary(streamMerger_t *merger, int streamIndex, const streamMergerEvent_t *event)
+{
+    streamMergerStream_t *stream = &merger->streams[streamIndex];
+
+    // This is the next sample for any rows that were waiting on this stream
+    for (int i = 0; i < merger->rowLength; i++) {
+        streamMergerRow_t *row = streamMergerGetRow(merger, i);
+
+        if (row->unresolved[streamIndex]) {
+            streamMergerResolveRow(merger, row, streamIndex, event);
+        }
+    }
+
+    memcpy(stream->previous, event->values, stream->fieldCount * sizeof(*stream->previous));
+    stream->previousTime = event->time;
+    stream->havePrevious = true;
+    stream->gapSincePrevious = false;
+
+    streamMergerEmitRows(merger, false);
+}
+
+/**
+ * Merge the earliest queued frame of all the streams, if we can be sure no earlier frame will arrive (or if `force` is
+ * set). Returns false if there was nothing to merge.
+ */
+static bool streamMergerMergeNext(streamMerger_t *merger, bool force)
+{
+    int best = -1;
+    streamMergerEvent_t *event;
+    streamMergerStream_t *stream;
+
+    for (int i = 0; i < merger->streamCount; i++) {
+        stream = &merger->streams[i];
+
+        if (stream->queueLength > 0) {
+            int64_t time = stream->queue[stream->queueStart].time;
+
+            // On a tie, secondary frames are merged first so they'll be joined onto the primary frame
+            if (best == -1 || time < merger->streams[best].queue[merger->streams[best].queueStart].time
+                    || (best == 0 && time == merger->streams[0].queue[merger->streams[0].queueStart].time)) {
+                best = i;
+            }
+        }
+    }
+
+    if (best == -1) {
+        return false;
+    }
+
+    stream = &merger->streams[best];
+    event = &stream->queue[stream->queueStart];
+
+    // A secondary frame with the same timestamp may still be on its way for this primary frame
+    if (best == 0 && !force && event->time >= merger->watermark) {
+        return false;
+    }
+
+    stream->queueStart = (stream->queueStart + 1) % merger->queueCapacity;
+    stream->queueLength--;
+
+    if (best == 0) {
+        streamMergerMergePrimary(merger, event);
+    } else {
+        streamMergerMergeSecondary(merger, best, event);
+    }
+
+    return true;
+}
+
+/**
+ * Add a frame to the given stream. Frames within each stream must be added in time order.
+ */
+void streamMergerAdd(streamMerger_t *merger, int streamIndex, int64_t time, const int64_t *values)
+{
+    streamMergerStream_t *stream = &merger->streams[streamIndex];
+    streamMergerEvent_t *event;
+
+    while (stream->queueLength == merger->queueCapacity) {
+        streamMergerMergeNext(merger, true);
+    }
+
+    event = &stream->queue[(stream->queueStart + stream->queueLength) % merger->queueCapacity];
+    event->time = time;
+    memcpy(event->values, values, stream->fieldCount * sizeof(*values));
+    stream->queueLength++;
+
+    if (!merger->haveWatermark || time > merger->watermark) {
+        merger->watermark = time;
+        merger->haveWatermark = true;
+    }
+
+    while (streamMergerMergeNext(merger, false))
+        ;
+}
+
+/**
+ * Mark a break in the given stream (e.g. due to corruption). Values from that stream won't be interpolated across the
+ * gap, the last value before the gap is held instead.
+ */
+void streamMergerAddGap(streamMerger_t *merger, int streamIndex)
+{
+    streamMergerStream_t *stream = &merger->streams[streamIndex];
+
+    if (streamIndex == 0) {
+        // Rows are only produced from the primary frames we have, so there's nothing to do
+        return;
+    }
+
+    // Merge the frames that arrived before the gap
+    while (stream->queueLength > 0) {
+        streamMergerMergeNext(merger, true);
+    }
+
+    for (int i = 0; i < merger->rowLength; i++) {
+        streamMergerRow_t *row = streamMergerGetRow(merger, i);
+
+        if (row->unresolved[streamIndex]) {
+            streamMergerResolveRow(merger, row, streamIndex, NULL);
+        }
+    }
+
+    stream->gapSincePrevious = true;
+
+    streamMergerEmitRows(merger, false);
+}
+
+/**
+ * Merge and emit everything that was added, since no more frames will arrive. The merger can then be reused for
+ * another set of streams.
+ */
+void streamMergerFlush(streamMerger_t *merger)
+{
+    while (streamMergerMergeNext(merger, true))
+        ;
+
+    while (merger->rowLength > 0) {
+        streamMergerEmitRows(merger, true);
+    }
+
+    for (int i = 0; i < merger->streamCount; i++) {
+        merger->streams[i].havePrevious = false;
+        merger->streams[i].gapSincePrevious = false;
+    }
+
+    merger->haveWatermark = false;
+}
+
+/**
+ * Create a merger for the given number of streams, with stream 0 being the primary stream that produces the rows.
+ *
+ * The policy for stream 0 is ignored. Up to `rowCapacity` rows will be buffered while waiting for interpolated
+ * streams.
+ */
+streamMerger_t* streamMergerCreate(int streamCount, const int *fieldCount, const MergeJoinPolicy *policy, int rowCapacity,
+    StreamMergerRowReady onRowReady, void *userData)
+{
+    streamMerger_t *result = malloc(sizeof(*result));
+    int i, j;
+
+    result->streamCount = streamCount;
+    result->queueCapacity = STREAM_MERGER_QUEUE_CAPACITY;
+    result->onRowReady = onRowReady;
+    result->userData = userData;
+    result->haveWatermark = false;
+    result->watermark = 0;
+
+    result->streams = malloc(streamCount * sizeof(*result->streams));
+
+    for (i = 0; i < streamCount; i++) {
+        streamMergerStream_t *stream = &result->streams[i];
+
+        stream->fieldCount = fieldCount[i];
+        stream->policy = policy[i];
+        stream->queue = malloc(result->queueCapacity * sizeof(*stream->queue));
+        stream->queueStart = 0;
+        stream->queueLength = 0;
+        stream->havePrevious = false;
+        stream->gapSincePrevious = false;
+        stream->previousTime = 0;
+        stream->previous = calloc(fieldCount[i] > 0 ? fieldCount[i] : 1, sizeof(*stream->previous));
+
+        for (j = 0; j < result->queueCapacity; j++) {
+            stream->queue[j].values = malloc((fieldCount[i] > 0 ? fieldCount[i] : 1) * sizeof(*stream->queue[j].values));
+        }
+    }
+
+    result->rowCapacity = rowCapacity > 0 ? rowCapacity : 1;
+    result->rowStart = 0;
+    result->rowLength = 0;
+    result->rows = malloc(result->rowCapacity * sizeof(*result->rows));
+
+    for (i = 0; i < result->rowCapacity; i++) {
+        streamMergerRow_t *row = &result->rows[i];
+
+        row->primary = malloc((fieldCount[0] > 0 ? fieldCount[0] : 1) * sizeof(*row->primary));
+        row->secondary = malloc(streamCount * sizeof(*row->secondary));
+        row->haveSecondary = calloc(streamCount, sizeof(*row->haveSecondary));
+        row->unresolved = calloc(streamCount, sizeof(*row->unresolved));
+        row->secondary[0] = NULL;
+
+        for (j = 1; j < streamCount; j++) {
+            row->secondary[j] = malloc((fieldCount[j] > 0 ? fieldCount[j] : 1) * sizeof(*row->secondary[j]));
+        }
+    }
+
+    result->rowSecondary = malloc((streamCount > 1 ? streamCount - 1 : 1) * sizeof(*result->rowSecondary));
+
+    return result;
+}
+
+void streamMergerDestroy(streamMerger_t *merger)
+{
+    int i, j;
+
+    if (!merger)
+        return;
+
+    for (i = 0; i < merger->streamCount; i++) {
+        for (j = 0; j < merger->queueCapacity; j++) {
+            free(merger->streams[i].queue[j].values);
+        }
+        free(merger->streams[i].queue);
+        free(merger->streams[i].previous);
+    }
+
+    for (i = 0; i < merger->rowCapacity; i++) {
+        for (j = 1; j < merger->streamCount; j++) {
+            free(merger->rows[i].secondary[j]);
+        }
+        free(merger->rows[i].secondary);
+        free(merger->rows[i].haveSecondary);
+        free(merger->rows[i].unresolved);
+        free(merger->rows[i].primary);
+    }
+
+    free(merger->rows);
+    free(merger->rowSecondary);
+    free(merger->streams);
+    free(merger);
+}
@@ -0,0 +1,82 @@
+#ifndef STREAMMERGE_H_
+#define STREAMMERGE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum MergeJoinPolicy {
+    // Use the most recent sample at or before the row's time
+    MERGE_JOIN_HOLD = 0,
+    // Interpolate between the samples either side of the row's time
+    MERGE_JOIN_LINEAR,
+    // Use whichever sample is closest in time to the row
+    MERGE_JOIN_NEAREST
+} MergeJoinPolicy;
+
+struct streamMerger_t;
+
+/**
+ * Called for each frame of the primary stream (stream 0) in time order. secondary[i - 1] holds the values of stream i
+ * joined onto this row, or NULL if stream i had no data to join to it.
+ */
+typedef void (*StreamMergerRowReady)(struct streamMerger_t *merger, int64_t time, const int64_t *primary, const int64_t * const *secondary, void *userData);
+
+typedef struct streamMergerEvent_t {
+    int64_t time;
+    int64_t *values;
+} streamMergerEvent_t;
+
+typedef struct streamMergerStream_t {
+    int fieldCount;
+    MergeJoinPolicy policy;
+
+    // Frames that have been added to this stream but that haven't been merged yet, as a ring buffer:
+    streamMergerEvent_t *queue;
+    int queueStart, queueLength;
+
+    // The last sample that was merged from this stream, and whether there's been a gap in the stream since then
+    bool havePrevious, gapSincePrevious;
+    int64_t previousTime;
+    int64_t *previous;
+} streamMergerStream_t;
+
+typedef struct streamMergerRow_t {
+    int64_t time;
+    int64_t *primary;
+
+    // The joined values from each secondary stream, and whether we're still waiting for a later sample to join them
+    int64_t **secondary;
+    bool *haveSecondary, *unresolved;
+    int unresolvedCount;
+} streamMergerRow_t;
+
+typedef struct streamMerger_t {
+    int streamCount;
+    streamMergerStream_t *streams;
+
+    int queueCapacity;
+
+    // The latest timestamp added to any stream
+    int64_t watermark;
+    bool haveWatermark;
+
+    // Rows of the primary stream that are waiting for later samples of the interpolated streams, as a ring buffer:
+    streamMergerRow_t *rows;
+    int rowCapacity, rowStart, rowLength;
+
+    const int64_t **rowSecondary;
+
+    StreamMergerRowReady onRowReady;
+    void *userData;
+} streamMerger_t;
+
+streamMerger_t* streamMergerCreate(int streamCount, const int *fieldCount, const MergeJoinPolicy *policy, int rowCapacity,
+    StreamMergerRowReady onRowReady, void *userData);
+void streamMergerAdd(streamMerger_t *merger, int stream, int64_t time, const int64_t *values);
+void streamMergerAddGap(streamMerger_t *merger, int stream);
+void streamMergerFlush(streamMerger_t *merger);
+void streamMergerDestroy(streamMerger_t *merger);
+
+bool mergeJoinPolicyFromName(const char *name, MergeJoinPolicy *policy);
+
+#endif
@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "surfacepool.h"
+
+struct surfacePool_t {
+    int width, height;
+
+    //The surfaces that aren't in use
+    cairo_surface_t **spare;
+    int spareCount, spareCapacity;
+
+    //Held while the list of free surfaces is changed
+    semaphore_t lock;
+};
+
+surfacePool_t* surfacePoolCreate(int width, int height)
+{
+    surfacePool_t *pool = malloc(sizeof(*pool));
+
+    pool->width = width;
+    pool->height = height;
+
+    pool->spare = NULL;
+    pool->spareCount = 0;
+    pool->spareCapacity = 0;
+
+    semaphore_create(&pool->lock, 1);
+
+    return pool;
+}
+
+/**
+ * Free the pool and the surfaces that have been given back to it.
+ */
+void surfacePoolDestroy(surfacePool_t *pool)
+{
+    if (!pool)
+        return;
+
+    for (int i = 0; i < pool->spareCount; i++) {
+        cairo_surface_destroy(pool->spare[i]);
+    }
+
+    semaphore_destroy(&pool->lock);
+
+    free(pool->spare);
+    free(pool);
+}
+
+/**
+ * Get a surface cleared to transparent black, just like a newly created one.
+ */
+cairo_surface_t* surfacePoolAcquire(surfacePool_t *pool)
+{
+    cairo_surface_t *surface = NULL;
+
+    semaphore_wait(&pool->lock);
+
+    if (pool->spareCount > 0) {
+        surface = pool->spare[--pool->spareCount];
+    }
+
+    semaphore_signal(&pool->lock);
+
+    if (!surface)
+        return cairo_image_surface_create(CAIRO_FORMAT_ARGB32, pool->width, pool->height);
+
+    cairo_surface_flush(surface);
+    memset(cairo_image_surface_get_data(surface), 0, (size_t) cairo_image_surface_get_stride(surface) * pool->height);
+    cairo_surface_mark_dirty(surface);
+
+    return surface;
+}
+
+/**
+ * Give back a surface from surfacePoolAcquire() which nothing is drawing on or reading any more.
+ */
+void surfacePoolRelease(surfacePool_t *pool, cairo_surface_t *surface)
+{
+    semaphore_wait(&pool->lock);
+
+    if (pool->spareCount == pool->spareCapacity) {
+        pool->spareCapacity = pool->spareCapacity ? pool->spareCapacity * 2 : 8;
+        pool->spare = realloc(pool->spare, pool->spareCapacity * sizeof(*pool->spare));
+    }
+
+    pool->spare[pool->spareCount++] = surface;
+
+    semaphore_signal(&pool->lock);
+}
@@ -0,0 +1,20 @@
+#ifndef SURFACEPOOL_H_
+#define SURFACEPOOL_H_
+
+#include <cairo.h>
+
+/**
+ * Image surfaces of one size which are handed back once a frame drawn on them has been written out, so the next frame
+ * can be drawn on memory that's already been allocated and paged in rather than on a brand new surface.
+ *
+ * Surfaces may be taken and given back from any thread.
+ */
+typedef struct surfacePool_t surfacePool_t;
+
+surfacePool_t* surfacePoolCreate(int width, int height);
+void surfacePoolDestroy(surfacePool_t *pool);
+
+cairo_surface_t* surfacePoolAcquire(surfacePool_t *pool);
+void surfacePoolRelease(surfacePool_t *pool, cairo_surface_t *surface);
+
+#endif
@@ -0,0 +1,361 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "textcache.h"
+
+// Spare pixels kept around the ink of each image, since antialiasing can reach a little past a glyph's outline
+#define TEXT_IMAGE_PADDING 2
+
+// Only text made of these single-byte characters is cached
+#define TEXT_CACHE_CHARACTERS 128
+
+typedef struct textImage_t {
+    //NULL if the text has no ink
+    cairo_surface_t *surface;
+    //Where the text's origin lies in the surface
+    int originX, originY;
+} textImage_t;
+
+typedef struct textCacheGlyph_t {
+    bool measured, drawn;
+    cairo_text_extents_t extents;
+    textImage_t image;
+} textCacheGlyph_t;
+
+typedef struct textCacheLabel_t {
+    char *text;
+    cairo_text_extents_t extents;
+
+    //A label can only be copied as a whole if its glyphs are a whole number of pixels apart
+    bool wholePixels;
+
+    bool drawn;
+    textImage_t image;
+} textCacheLabel_t;
+
+/**
+ * The glyphs and labels drawn with one font face, size and colour.
+ */
+typedef struct textCacheFont_t {
+    cairo_font_face_t *face;
+    cairo_matrix_t fontMatrix;
+    double red, green, blue, alpha;
+
+    textCacheGlyph_t glyphs[TEXT_CACHE_CHARACTERS];
+
+    textCacheLabel_t *labels;
+    int labelCount, labelCapacity;
+} textCacheFont_t;
+
+struct textCache_t {
+    textCacheFont_t **fonts;
+    int fontCount, fontCapacity;
+};
+
+textCache_t* textCacheCreate(void)
+{
+    return calloc(1, sizeof(textCache_t));
+}
+
+static void destroyTextImage(textImage_t *image)
+{
+    if (image->surface)
+        cairo_surface_destroy(image->surface);
+}
+
+void textCacheDestroy(textCache_t *cache)
+{
+    if (!cache)
+        return;
+
+    for (int i = 0; i < cache->fontCount; i++) {
+        textCacheFont_t *font = cache->fonts[i];
+
+        for (int j = 0; j < TEXT_CACHE_CHARACTERS; j++) {
+            destroyTextImage(&font->glyphs[j].image);
+        }
+
+        for (int j = 0; j < font->labelCount; j++) {
+            destroyTextImage(&font->labels[j].image);
+            free(font->labels[j].text);
+        }
+
+        free(font->labels);
+        cairo_font_face_destroy(font->face);
+        free(font);
+    }
+
+    free(cache->fonts);
+    free(cache);
+}
+
+static bool isCachedText(const char *text)
+{
+    for (const unsigned char *c = (const unsigned char *) text; *c; c++) {
+        if (*c >= TEXT_CACHE_CHARACTERS)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Find the font that the context would draw text with, or return NULL if text drawn by the context can't be cached.
+ */
+static textCacheFont_t* findFont(textCache_t *cache, cairo_t *cr)
+{
+    cairo_matrix_t matrix, fontMatrix;
+    cairo_font_face_t *face;
+    double red, green, blue, alpha;
+    textCacheFont_t *font;
+
+    //Glyphs are only guaranteed to land on whole pixels when the text is just translated
+    cairo_get_matrix(cr, &matrix);
+
+    if (matrix.xx != 1 || matrix.yx != 0 || matrix.xy != 0 || matrix.yy != 1)
+        return NULL;
+
+    if (cairo_pattern_get_rgba(cairo_get_source(cr), &red, &green, &blue, &alpha) != CAIRO_STATUS_SUCCESS)
+        return NULL;
+
+    face = cairo_get_font_face(cr);
+    cairo_get_font_matrix(cr, &fontMatrix);
+
+    for (int i = 0; i < cache->fontCount; i++) {
+        font = cache->fonts[i];
+
+        if (font->face == face
+                && font->fontMatrix.xx == fontMatrix.xx && font->fontMatrix.yx == fontMatrix.yx
+                && font->fontMatrix.xy == fontMatrix.xy && font->fontMatrix.yy == fontMatrix.yy
+                && font->red == red && font->green == green && font->blue == blue && font->alpha == alpha) {
+            return font;
+        }
+    }
+
+    if (cache->fontCount == cache->fontCapacity) {
+        cache->fontCapacity = cache->fontCapacity ? cache->fontCapacity * 2 : 8;
+        cache->fonts = realloc(cache->fonts, cache->fontCapacity * sizeof(*cache->fonts));
+    }
+
+    font = calloc(1, sizeof(*font));
+
+    font->face = cairo_font_face_reference(face);
+    font->fontMatrix = fontMatrix;
+    font->red = red;
+    font->green = green;
+    font->blue = blue;
+    font->alpha = alpha;
+
+    cache->fonts[cache->fontCount++] = font;
+
+    return font;
+}
+
+/**
+ * Draw the text in the context's font and colour onto a new image, with the text's origin on a whole pixel.
+ */
+static void createTextImage(textImage_t *image, cairo_t *cr, const char *text, const cairo_text_extents_t *extents)
+{
+    int left, top, right, bottom;
+    cairo_matrix_t fontMatrix;
+    cairo_font_options_t *fontOptions;
+    cairo_t *imageCr;
+
+    image->surface = NULL;
+
+    if (extents->width <= 0 || extents->height <= 0)
+        return;
+
+    left = (int) floor(extents->x_bearing) - TEXT_IMAGE_PADDING;
+    top = (int) floor(extents->y_bearing) - TEXT_IMAGE_PADDING;
+    right = (int) ceil(extents->x_bearing + extents->width) + TEXT_IMAGE_PADDING;
+    bottom = (int) ceil(extents->y_bearing + extents->height) + TEXT_IMAGE_PADDING;
+
+    image->originX = -left;
+    image->originY = -top;
+    image->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, right - left, bottom - top);
+
+    imageCr = cairo_create(image->surface);
+
+    cairo_set_font_face(imageCr, cairo_get_font_face(cr));
+    cairo_get_font_matrix(cr, &fontMatrix);
+    cairo_set_font_matrix(imageCr, &fontMatrix);
+
+    fontOptions = cairo_font_options_create();
+    cairo_get_font_options(cr, fontOptions);
+    cairo_set_font_options(imageCr, fontOptions);
+    cairo_font_options_destroy(fontOptions);
+
+    cairo_set_source(imageCr, cairo_get_source(cr));
+    cairo_move_to(imageCr, image->originX, image->originY);
+    cairo_show_text(imageCr, text);
+
+    cairo_destroy(imageCr);
+}
+
+/**
+ * Copy the image so that the text's origin lands on (x, y) in user space, rounded to the nearest pixel the same way
+ * that cairo rounds the position of each glyph it draws. The image is painted OVER what's already there, so it blends
+ * with any glyph painted just before it rather than being composited together with it as cairo_show_text() would.
+ */
+static void paintTextImage(cairo_t *cr, const textImage_t *image, double x, double y)
+{
+    if (!image->surface)
+        return;
+
+    cairo_user_to_device(cr, &x, &y);
+
+    cairo_save(cr);
+    {
+        cairo_identity_matrix(cr);
+        cairo_set_source_surface(cr, image->surface, floor(x + 0.5) - image->originX, floor(y + 0.5) - image->originY);
+        cairo_paint(cr);
+    }
+    cairo_restore(cr);
+}
+
+static textCacheGlyph_t* findGlyph(textCacheFont_t *font, cairo_t *cr, char c)
+{
+    textCacheGlyph_t *glyph = &font->glyphs[(unsigned char) c];
+    char text[2] = {c, '\0'};
+
+    if (!glyph->measured) {
+        cairo_scaled_font_text_extents(cairo_get_scaled_font(cr), text, &glyph->extents);
+        glyph->measured = true;
+    }
+
+    if (!glyph->drawn) {
+        createTextImage(&glyph->image, cr, text, &glyph->extents);
+        glyph->drawn = true;
+    }
+
+    return glyph;
+}
+
+static textCacheLabel_t* findLabel(textCacheFont_t *font, cairo_t *cr, const char *text)
+{
+    textCacheLabel_t *label;
+
+    for (int i = 0; i < font->labelCount; i++) {
+        if (strcmp(font->labels[i].text, text) == 0)
+            return &font->labels[i];
+    }
+
+    if (font->labelCount == font->labelCapacity) {
+        font->labelCapacity = font->labelCapacity ? font->labelCapacity * 2 : 16;
+        font->labels = realloc(font->labels, font->labelCapacity * sizeof(*font->labels));
+    }
+
+    label = &font->labels[font->labelCount++];
+
+    label->text = strdup(text);
+    label->drawn = false;
+    label->image.surface = NULL;
+
+    cairo_scaled_font_text_extents(cairo_get_scaled_font(cr), text, &label->extents);
+
+    label->wholePixels = true;
+
+    for (const char *c = text; *c; c++) {
+        const cairo_text_extents_t *extents = &findGlyph(font, cr, *c)->extents;
+
+        if (extents->x_advance != floor(extents->x_advance) || extents->y_advance != floor(extents->y_advance))
+            label->wholePixels = false;
+    }
+
+    return label;
+}
+
+/**
+ * Draw text at the current point a glyph at a time, leaving the current point after it like cairo_show_text() does.
+ * The glyphs land in the same places as cairo's, but pixels where their antialiased edges overlap are painted twice.
+ */
+static void showGlyphs(textCacheFont_t *font, cairo_t *cr, const char *text)
+{
+    double x = 0, y = 0;
+
+    if (cairo_has_current_point(cr))
+        cairo_get_current_point(cr, &x, &y);
+
+    //Step from glyph to glyph in the same way as cairo, so the sums round the same way
+    for (const char *c = text; *c; c++) {
+        textCacheGlyph_t *glyph = findGlyph(font, cr, *c);
+
+        paintTextImage(cr, &glyph->image, x, y);
+
+        x += glyph->extents.x_advance;
+        y += glyph->extents.y_advance;
+    }
+
+    cairo_move_to(cr, x, y);
+}
+
+/**
+ * Draw text at the current point like cairo_show_text(), from the images of its characters.
+ */
+void textCacheShowText(textCache_t *cache, cairo_t *cr, const char *text)
+{
+    textCacheFont_t *font = isCachedText(text) ? findFont(cache, cr) : NULL;
+
+    if (font)
+        showGlyphs(font, cr, text);
+    else
+        cairo_show_text(cr, text);
+}
+
+/**
+ * Draw text which is drawn over and over unchanged at the current point like cairo_show_text(), from an image of the
+ * whole text.
+ */
+void textCacheShowLabel(textCache_t *cache, cairo_t *cr, const char *label)
+{
+    textCacheFont_t *font = isCachedText(label) ? findFont(cache, cr) : NULL;
+    textCacheLabel_t *cached;
+    double x = 0, y = 0;
+
+    if (!font) {
+        cairo_show_text(cr, label);
+        return;
+    }
+
+    cached = findLabel(font, cr, label);
+
+    if (!cached->wholePixels) {
+        showGlyphs(font, cr, label);
+        return;
+    }
+
+    if (!cached->drawn) {
+        createTextImage(&cached->image, cr, label, &cached->extents);
+        cached->drawn = true;
+    }
+
+    if (cairo_has_current_point(cr))
+        cairo_get_current_point(cr, &x, &y);
+
+    paintTextImage(cr, &cached->image, x, y);
+
+    for (const char *c = label; *c; c++) {
+        const cairo_text_extents_t *extents = &findGlyph(font, cr, *c)->extents;
+
+        x += extents->x_advance;
+        y += extents->y_advance;
+    }
+
+    cairo_move_to(cr, x, y);
+}
+
+/**
+ * Measure text which is drawn over and over unchanged like cairo_text_extents() does, measuring it only the first time.
+ */
+void textCacheLabelExtents(textCache_t *cache, cairo_t *cr, const char *label, cairo_text_extents_t *extents)
+{
+    textCacheFont_t *font = isCachedText(label) ? findFont(cache, cr) : NULL;
+
+    if (font)
+        *extents = findLabel(font, cr, label)->extents;
+    else
+        cairo_text_extents(cr, label, extents);
+}
@@ -0,0 +1,33 @@
+#ifndef TEXTCACHE_H_
+#define TEXTCACHE_H_
+
+#include <cairo.h>
+
+/**
+ * Keeps the images of text drawn with cairo, so that drawing the same text again is just a copy instead of laying out
+ * and compositing each glyph.
+ *
+ * Labels (text which is drawn the same way on every frame) are kept whole. Other text (like the value of a field) is
+ * drawn a glyph at a time from the images of the single characters. Both are kept separately for each font face,
+ * font size and colour.
+ *
+ * Cairo draws glyphs on whole pixels and hints their advances to whole pixels, so each copy is placed where
+ * cairo_show_text() would have put that glyph. The result isn't always pixel-identical, though: cairo composites all the
+ * glyphs of a string in one go, but here each image is painted over the last one, with 8-bit premultiplied colour. Where
+ * the antialiased edges of neighbouring glyphs overlap, or the colour isn't opaque, those pixels come out slightly
+ * different (a little darker or more opaque). Text drawn with a transformation that isn't a plain translation, or with
+ * a source that isn't a solid colour, is drawn by cairo as usual.
+ *
+ * A cache must only be used from one thread, and with contexts which all have the same font options.
+ */
+typedef struct textCache_t textCache_t;
+
+textCache_t* textCacheCreate(void);
+void textCacheDestroy(textCache_t *cache);
+
+void textCacheShowLabel(textCache_t *cache, cairo_t *cr, const char *label);
+void textCacheLabelExtents(textCache_t *cache, cairo_t *cr, const char *label, cairo_text_extents_t *extents);
+
+void textCacheShowText(textCache_t *cache, cairo_t *cr, const char *text);
+
+#endif
@@ -1,4 +1,5 @@
 #include <string.h>
+#include <ctype.h>
 #include "tools.h"
 
 int32_t signExtend24Bit(uint32_t u)
@@ -44,6 +45,55 @@ bool endsWith(const char *string, const char *checkEndsWith)
     return stringLen >= endsWithLen && strncmp(string + stringLen - endsWithLen, checkEndsWith, endsWithLen) == 0;
 }
 
+/**
+ * Remove the whitespace from the end of the string in place, and return a pointer past the whitespace at its start.
+ */
+char* trimWhitespace(char *string)
+{
+    char *end = string + strlen(string);
+
+    while (isspace((unsigned char) *string))
+        string++;
+
+    while (end > string && isspace((unsigned char) end[-1]))
+        end--;
+
+    *end = '\0';
+
+    return string;
+}
+
+/**
+ * Match the string against a shell-style wildcard pattern, where '*' matches any run of characters (including none)
+ * and '?' matches any single character. All other characters (including square brackets, which appear in field
+ * names like "motor[0]") match themselves.
+ */
+bool globMatch(const char *pattern, const char *string)
+{
+    const char *starPattern = NULL, *starString = NULL;
+
+    while (*string) {
+        if (*pattern == '*') {
+            // Remember where this star was so we can backtrack and have it consume one more character later
+            starPattern = ++pattern;
+            starString = string;
+        } else if (*pattern == '?' || *pattern == *string) {
+            pattern++;
+            string++;
+        } else if (starPattern) {
+            pattern = starPattern;
+            string = ++starString;
+        } else {
+            return false;
+        }
+    }
+
+    while (*pattern == '*')
+        pattern++;
+
+    return *pattern == '\0';
+}
+
 double doubleAbs(double a)
 {
     if (a < 0)
@@ -36,6 +36,8 @@ double doubleMax(double a, double b);
 
 bool startsWith(const char *string, const char *checkStartsWith);
 bool endsWith(const char *string, const char *checkEndsWith);
+char* trimWhitespace(char *string);
+bool globMatch(const char *pattern, const char *string);
 
 void* memmem(const void *haystack, size_t haystackLen, const void *needle, size_t needleLen);
 
@@ -0,0 +1,432 @@
+#include <stdlib.h>
+#include <string.h>
+
+//For msvcrt to define M_PI:
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "trackwriter.h"
+
+/*
+ * Writes the GPS track of a log as GPX, KML or GeoJSON.
+ *
+ * Points are formatted by hand into a large buffer which is written to the (unbuffered) file when it fills up, since
+ * there can be hundreds of thousands of points in a long flight.
+ *
+ * If a tolerance is set, the track is simplified as it is written using an opening-window variant of Douglas-Peucker:
+ * starting from the last point written (the anchor), points are skipped for as long as every skipped point lies within
+ * the tolerance of the straight line from the anchor to the newest point. When a new point would break that, the point
+ * before it is written and becomes the new anchor. Distances are measured in meters, including altitude. Since at most
+ * TRACKWRITER_SIMPLIFY_WINDOW points are skipped in a row, the work per point is bounded.
+ */
+
+#define GPS_DEGREES_DIVIDER 10000000L
+
+// Approximate size of one unit of latitude (10^-7 degrees) on the earth's surface
+#define METERS_PER_COORDINATE_UNIT (6371000.0 * M_PI / 180 / GPS_DEGREES_DIVIDER)
+
+static const char* const TRACK_FORMAT_NAME[] = {
+    "gpx",
+    "kml",
+    "geojson"
+};
+
+static const char* const TRACK_FORMAT_FILE_EXTENSION[] = {
+    "gpx",
+    "kml",
+    "geojson"
+};
+
+static const char GPX_FILE_HEADER[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<gpx creator=\"Blackbox flight data recorder\" version=\"1.1\" xmlns=\"http://www.topografix.com/GPX/1/1\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\""
+        " xsi:schemaLocation=\"http://www.topografix.com/GPX/1/1 http://www.topografix.com/GPX/1/1/gpx.xsd\">\n"
+    "<metadata><name>Blackbox flight log</name></metadata>\n"
+    "<trk><name>Blackbox flight log</name><trkseg>\n";
+
+static const char GPX_FILE_TRAILER[] =
+    "</trkseg></trk>\n"
+    "</gpx>";
+
+static const char KML_FILE_HEADER[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n"
+    "<Document><name>Blackbox flight log</name>\n"
+    "<Placemark><name>Blackbox flight log</name><LineString><altitudeMode>absolute</altitudeMode><coordinates>\n";
+
+static const char KML_FILE_TRAILER[] =
+    "</coordinates></LineString></Placemark>\n"
+    "</Document></kml>\n";
+
+static const char GEOJSON_FILE_HEADER[] =
+    "{\"type\":\"Feature\",\"properties\":{\"name\":\"Blackbox flight log\"},\"geometry\":{\"type\":\"LineString\",\"coordinates\":[\n";
+
+static const char GEOJSON_FILE_TRAILER[] =
+    "\n]}}\n";
+
+bool trackFormatFromName(const char *name, TrackFormat *format)
+{
+    for (int i = 0; i < (int) (sizeof(TRACK_FORMAT_NAME) / sizeof(TRACK_FORMAT_NAME[0])); i++) {
+        if (strcmp(name, TRACK_FORMAT_NAME[i]) == 0) {
+            *format = (TrackFormat) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char* trackFormatFileExtension(TrackFormat format)
+{
+    return TRACK_FORMAT_FILE_EXTENSION[format];
+}
+
+static void trackWriterFlushBuffer(trackWriter_t *writer)
+{
+    if (writer->bufferLength > 0) {
+        fwrite(writer->buffer, 1, writer->bufferLength, writer->file);
+        writer->bufferLength = 0;
+    }
+}
+
+static void trackWriterAppend(trackWriter_t *writer, const char *text, int length)
+{
+    while (length > 0) {
+        int chunk = TRACKWRITER_BUFFER_SIZE - writer->bufferLength;
+
+        if (chunk == 0) {
+            trackWriterFlushBuffer(writer);
+            continue;
+        }
+
+        if (chunk > length)
+            chunk = length;
+
+        memcpy(writer->buffer + writer->bufferLength, text, chunk);
+        writer->bufferLength += chunk;
+
+        text += chunk;
+        length -= chunk;
+    }
+}
+
+static void trackWriterAppendString(trackWriter_t *writer, const char *text)
+{
+    trackWriterAppend(writer, text, strlen(text));
+}
+
+/**
+ * Append the decimal digits of the value, zero-padded to at least the given number of digits.
+ */
+static void trackWriterAppendUnsigned(trackWriter_t *writer, uint64_t value, int minDigits)
+{
+    char digits[20];
+    int length = 0;
+
+    do {
+        digits[sizeof(digits) - 1 - length] = '0' + value % 10;
+        value /= 10;
+        length++;
+    } while (value > 0 || length < minDigits);
+
+    trackWriterAppend(writer, digits + sizeof(digits) - length, length);
+}
+
+static void trackWriterAppendInteger(trackWriter_t *writer, int64_t value)
+{
+    if (value < 0) {
+        trackWriterAppend(writer, "-", 1);
+        trackWriterAppendUnsigned(writer, -(uint64_t) value, 1);
+    } else {
+        trackWriterAppendUnsigned(writer, value, 1);
+    }
+}
+
+/**
+ * Append a coordinate given in degrees times GPS_DEGREES_DIVIDER as decimal degrees.
+ */
+static void trackWriterAppendCoordinate(trackWriter_t *writer, int32_t coordinate)
+{
+    uint64_t magnitude;
+
+    if (coordinate < 0) {
+        trackWriterAppend(writer, "-", 1);
+        magnitude = -(int64_t) coordinate;
+    } else {
+        magnitude = coordinate;
+    }
+
+    trackWriterAppendUnsigned(writer, magnitude / GPS_DEGREES_DIVIDER, 1);
+    trackWriterAppend(writer, ".", 1);
+    trackWriterAppendUnsigned(writer, magnitude % GPS_DEGREES_DIVIDER, 7);
+}
+
+static void trackWriterAppendGPXTime(trackWriter_t *writer, int64_t time)
+{
+    //We'll just assume that the timespan is less than 24 hours, and make up a date
+    uint32_t hours, mins, secs, frac;
+
+    frac = time % 1000000;
+    secs = time / 1000000;
+
+    mins = secs / 60;
+    secs %= 60;
+
+    hours = mins / 60;
+    mins %= 60;
+
+    trackWriterAppendString(writer, "<time>2000-01-01T");
+    trackWriterAppendUnsigned(writer, hours, 2);
+    trackWriterAppend(writer, ":", 1);
+    trackWriterAppendUnsigned(writer, mins, 2);
+    trackWriterAppend(writer, ":", 1);
+    trackWriterAppendUnsigned(writer, secs, 2);
+    trackWriterAppend(writer, ".", 1);
+    trackWriterAppendUnsigned(writer, frac, 6);
+    trackWriterAppendString(writer, "Z</time>");
+}
+
+static bool trackWriterAddPreamble(trackWriter_t *writer)
+{
+    writer->file = fopen(writer->filename, "wb");
+
+    if (!writer->file) {
+        fprintf(stderr, "Failed to create track file %s\n", writer->filename);
+        return false;
+    }
+
+    // We do our own buffering
+    setvbuf(writer->file, NULL, _IONBF, 0);
+
+    switch (writer->format) {
+        case TRACK_FORMAT_GPX:
+            trackWriterAppendString(writer, GPX_FILE_HEADER);
+        break;
+        case TRACK_FORMAT_KML:
+            trackWriterAppendString(writer, KML_FILE_HEADER);
+        break;
+        case TRACK_FORMAT_GEOJSON:
+            trackWriterAppendString(writer, GEOJSON_FILE_HEADER);
+        break;
+    }
+
+    return true;
+}
+
+static void trackWriterWritePoint(trackWriter_t *writer, const trackPoint_t *point)
+{
+    if (writer->state == TRACKWRITER_STATE_EMPTY) {
+        if (!trackWriterAddPreamble(writer)) {
+            writer->state = TRACKWRITER_STATE_FAILED;
+            return;
+        }
+
+        writer->state = TRACKWRITER_STATE_WRITING_TRACK;
+    } else if (writer->state == TRACKWRITER_STATE_FAILED) {
+        return;
+    }
+
+    switch (writer->format) {
+        case TRACK_FORMAT_GPX:
+            trackWriterAppendString(writer, "  <trkpt lat=\"");
+            trackWriterAppendCoordinate(writer, point->lat);
+            trackWriterAppendString(writer, "\" lon=\"");
+            trackWriterAppendCoordinate(writer, point->lon);
+            trackWriterAppendString(writer, "\"><ele>");
+            trackWriterAppendInteger(writer, point->altitude);
+            trackWriterAppendString(writer, "</ele>");
+
+            if (point->time != -1) {
+                trackWriterAppendGPXTime(writer, point->time);
+            }
+
+            trackWriterAppendString(writer, "</trkpt>\n");
+        break;
+        case TRACK_FORMAT_KML:
+            // KML has no time on LineString coordinates
+            trackWriterAppendCoordinate(writer, point->lon);
+            trackWriterAppend(writer, ",", 1);
+            trackWriterAppendCoordinate(writer, point->lat);
+            trackWriterAppend(writer, ",", 1);
+            trackWriterAppendInteger(writer, point->altitude);
+            trackWriterAppend(writer, "\n", 1);
+        break;
+        case TRACK_FORMAT_GEOJSON:
+            if (writer->pointCount > 0) {
+                trackWriterAppend(writer, ",\n", 2);
+            }
+
+            trackWriterAppend(writer, "[", 1);
+            trackWriterAppendCoordinate(writer, point->lon);
+            trackWriterAppend(writer, ",", 1);
+            trackWriterAppendCoordinate(writer, point->lat);
+            trackWriterAppend(writer, ",", 1);
+            trackWriterAppendInteger(writer, point->altitude);
+            trackWriterAppend(writer, "]", 1);
+        break;
+    }
+
+    writer->pointCount++;
+}
+
+/**
+ * Find the position of the point in meters relative to the origin, using an equirectangular projection (which is
+ * accurate enough over the distances between track points).
+ */
+static void trackWriterProject(const trackPoint_t *origin, const trackPoint_t *point, double *position)
+{
+    double originLatitude = (double) origin->lat / GPS_DEGREES_DIVIDER * M_PI / 180;
+    int64_t lonDelta = (int64_t) point->lon - origin->lon;
+
+    // Take the short way around if we crossed the antimeridian
+    if (lonDelta > 180 * GPS_DEGREES_DIVIDER) {
+        lonDelta -= 360 * GPS_DEGREES_DIVIDER;
+    } else if (lonDelta < -180 * GPS_DEGREES_DIVIDER) {
+        lonDelta += 360 * GPS_DEGREES_DIVIDER;
+    }
+
+    position[0] = lonDelta * METERS_PER_COORDINATE_UNIT * cos(originLatitude);
+    position[1] = ((int64_t) point->lat - origin->lat) * METERS_PER_COORDINATE_UNIT;
+    position[2] = point->altitude - origin->altitude;
+}
+
+/**
+ * Check if all the skipped points in the window are within the tolerance of the line from the anchor to the given
+ * point.
+ */
+static bool trackWriterSegmentFits(trackWriter_t *writer, const trackPoint_t *end)
+{
+    double segment[3], position[3];
+    double segmentLengthSquared;
+
+    trackWriterProject(&writer->anchor, end, segment);
+
+    segmentLengthSquared = segment[0] * segment[0] + segment[1] * segment[1] + segment[2] * segment[2];
+
+    for (int i = 0; i < writer->windowLength; i++) {
+        double t = 0, distanceSquared = 0;
+
+        trackWriterProject(&writer->anchor, &writer->window[i], position);
+
+        // Find the closest point on the segment
+        if (segmentLengthSquared > 0) {
+            t = (position[0] * segment[0] + position[1] * segment[1] + position[2] * segment[2]) / segmentLengthSquared;
+
+            if (t < 0)
+                t = 0;
+            else if (t > 1)
+                t = 1;
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            double delta = position[axis] - t * segment[axis];
+
+            distanceSquared += delta * delta;
+        }
+
+        if (distanceSquared > writer->tolerance * writer->tolerance) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Add a point to the current track.
+ *
+ * Time is in microseconds since device power-on (or -1 if unknown). Lat and lon are degrees multiplied by
+ * GPS_DEGREES_DIVIDER. Altitude is in meters.
+ */
+void trackWriterAddPoint(trackWriter_t *writer, int64_t time, int32_t lat, int32_t lon, int16_t altitude)
+{
+    trackPoint_t point;
+
+    if (!writer)
+        return;
+
+    point.time = time;
+    point.lat = lat;
+    point.lon = lon;
+    point.altitude = altitude;
+
+    if (writer->tolerance <= 0) {
+        trackWriterWritePoint(writer, &point);
+        return;
+    }
+
+    if (!writer->haveAnchor) {
+        trackWriterWritePoint(writer, &point);
+
+        writer->anchor = point;
+        writer->haveAnchor = true;
+        return;
+    }
+
+    if (writer->windowLength == TRACKWRITER_SIMPLIFY_WINDOW || (writer->windowLength > 0 && !trackWriterSegmentFits(writer, &point))) {
+        // We can't skip the last point we saw, so it starts the next segment
+        writer->anchor = writer->window[writer->windowLength - 1];
+        writer->windowLength = 0;
+
+        trackWriterWritePoint(writer, &writer->anchor);
+    }
+
+    writer->window[writer->windowLength++] = point;
+}
+
+/**
+ * Create a writer for the given file, which won't be created until the first point is added.
+ *
+ * If tolerance is greater than zero, points that lie within that many meters of the simplified track are dropped.
+ */
+trackWriter_t* trackWriterCreate(const char *filename, TrackFormat format, double tolerance)
+{
+    trackWriter_t *result = malloc(sizeof(*result));
+
+    result->filename = strdup(filename);
+    result->format = format;
+    result->state = TRACKWRITER_STATE_EMPTY;
+    result->file = NULL;
+
+    result->buffer = malloc(TRACKWRITER_BUFFER_SIZE);
+    result->bufferLength = 0;
+    result->pointCount = 0;
+
+    result->tolerance = tolerance;
+    result->haveAnchor = false;
+    result->windowLength = 0;
+
+    return result;
+}
+
+void trackWriterDestroy(trackWriter_t* writer)
+{
+    if (!writer)
+        return;
+
+    // The end of the track is always kept
+    if (writer->windowLength > 0) {
+        trackWriterWritePoint(writer, &writer->window[writer->windowLength - 1]);
+    }
+
+    if (writer->state == TRACKWRITER_STATE_WRITING_TRACK) {
+        switch (writer->format) {
+            case TRACK_FORMAT_GPX:
+                trackWriterAppendString(writer, GPX_FILE_TRAILER);
+            break;
+            case TRACK_FORMAT_KML:
+                trackWriterAppendString(writer, KML_FILE_TRAILER);
+            break;
+            case TRACK_FORMAT_GEOJSON:
+                trackWriterAppendString(writer, GEOJSON_FILE_TRAILER);
+            break;
+        }
+
+        trackWriterFlushBuffer(writer);
+        fclose(writer->file);
+    }
+
+    free(writer->buffer);
+    free(writer->filename);
+    free(writer);
+}
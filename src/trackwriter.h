@@ -0,0 +1,61 @@
+#ifndef TRACKWRITER_H_
+#define TRACKWRITER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef enum TrackFormat {
+    TRACK_FORMAT_GPX = 0,
+    TRACK_FORMAT_KML,
+    TRACK_FORMAT_GEOJSON
+} TrackFormat;
+
+typedef enum TrackWriterState {
+    TRACKWRITER_STATE_EMPTY = 0,
+    TRACKWRITER_STATE_WRITING_TRACK,
+    TRACKWRITER_STATE_FAILED
+} TrackWriterState;
+
+#define TRACKWRITER_BUFFER_SIZE (64 * 1024)
+
+// The most points that simplification will drop in a row, so that memory use and time per point are bounded
+#define TRACKWRITER_SIMPLIFY_WINDOW 256
+
+typedef struct trackPoint_t {
+    int64_t time;
+    int32_t lat, lon;
+    int16_t altitude;
+} trackPoint_t;
+
+typedef struct trackWriter_t {
+    TrackFormat format;
+    TrackWriterState state;
+    FILE *file;
+
+    char *filename;
+
+    // Output is formatted into this buffer and written out when it fills up:
+    char *buffer;
+    int bufferLength;
+
+    int pointCount;
+
+    // Points within this distance (in meters) of the simplified track will be dropped, or 0 to write every point
+    double tolerance;
+
+    // The last point written to the file, and the points since then that we might not need to write:
+    bool haveAnchor;
+    trackPoint_t anchor;
+    trackPoint_t window[TRACKWRITER_SIMPLIFY_WINDOW];
+    int windowLength;
+} trackWriter_t;
+
+void trackWriterAddPoint(trackWriter_t *writer, int64_t time, int32_t lat, int32_t lon, int16_t altitude);
+trackWriter_t* trackWriterCreate(const char *filename, TrackFormat format, double tolerance);
+void trackWriterDestroy(trackWriter_t* writer);
+
+bool trackFormatFromName(const char *name, TrackFormat *format);
+const char* trackFormatFileExtension(TrackFormat format);
+
+#endif
@@ -0,0 +1,294 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+#include "videowriter.h"
+
+/*
+ * Frames arrive as cairo's ARGB32 pixels: one native-endian 32-bit word per pixel with the alpha in the top byte,
+ * and the colour premultiplied by the alpha. Premultiplied colour is the colour the pixel would have over black, so
+ * that's what the Y4M frames show (Y4M has no alpha).
+ *
+ * The I420 conversion uses the usual 8-bit fixed-point BT.601 limited range coefficients, and the chroma of each 2x2
+ * block of pixels is taken from the average of their colours. The SSE2 kernel gives exactly the same results as the
+ * plain C one, which handles the columns left over at the right edge and machines without SSE2.
+ */
+
+const char* const VIDEO_FORMAT_NAME[VIDEO_FORMAT_COUNT] = {
+    "y4m",
+    "bgra"
+};
+
+bool videoFormatParse(const char *name, VideoFormat *format)
+{
+    for (int i = 0; i < VIDEO_FORMAT_COUNT; i++) {
+        if (strcmp(name, VIDEO_FORMAT_NAME[i]) == 0) {
+            *format = (VideoFormat) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static uint32_t readPixel(const uint8_t *row, int x)
+{
+    uint32_t pixel;
+
+    memcpy(&pixel, row + x * 4, sizeof(pixel));
+
+    return pixel;
+}
+
+static uint8_t lumaFromRGB(int r, int g, int b)
+{
+    return (uint8_t) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static uint8_t blueChromaFromRGB(int r, int g, int b)
+{
+    return (uint8_t) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+static uint8_t redChromaFromRGB(int r, int g, int b)
+{
+    return (uint8_t) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+/**
+ * Convert the pixels from startX onwards of a pair of rows (which may be the same row, at the bottom of an image with
+ * an odd height). startX must be even.
+ */
+static void convertRowPairPlain(const uint8_t *row0, const uint8_t *row1, int startX, int width, uint8_t *y0, uint8_t *y1,
+    uint8_t *u, uint8_t *v)
+{
+    for (int x = startX; x < width; x += 2) {
+        // The last column of an image with an odd width is paired with itself
+        int x1 = x + 1 < width ? x + 1 : x;
+        uint32_t block[4] = {readPixel(row0, x), readPixel(row0, x1), readPixel(row1, x), readPixel(row1, x1)};
+        int rSum = 0, gSum = 0, bSum = 0;
+
+        for (int i = 0; i < 4; i++) {
+            rSum += (block[i] >> 16) & 0xFF;
+            gSum += (block[i] >> 8) & 0xFF;
+            bSum += block[i] & 0xFF;
+        }
+
+        y0[x] = lumaFromRGB((block[0] >> 16) & 0xFF, (block[0] >> 8) & 0xFF, block[0] & 0xFF);
+        y1[x] = lumaFromRGB((block[2] >> 16) & 0xFF, (block[2] >> 8) & 0xFF, block[2] & 0xFF);
+
+        if (x1 != x) {
+            y0[x1] = lumaFromRGB((block[1] >> 16) & 0xFF, (block[1] >> 8) & 0xFF, block[1] & 0xFF);
+            y1[x1] = lumaFromRGB((block[3] >> 16) & 0xFF, (block[3] >> 8) & 0xFF, block[3] & 0xFF);
+        }
+
+        u[x / 2] = blueChromaFromRGB((rSum + 2) >> 2, (gSum + 2) >> 2, (bSum + 2) >> 2);
+        v[x / 2] = redChromaFromRGB((rSum + 2) >> 2, (gSum + 2) >> 2, (bSum + 2) >> 2);
+    }
+}
+
+#ifdef __SSE2__
+
+/**
+ * Split 8 pixels into their red, green and blue channels, as 16-bit lanes.
+ */
+static void unpackPixelsSSE2(const uint8_t *pixels, __m128i *r, __m128i *g, __m128i *b)
+{
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    __m128i p0 = _mm_loadu_si128((const __m128i *) pixels);
+    __m128i p1 = _mm_loadu_si128((const __m128i *) (pixels + 16));
+
+    *b = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+    *g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+    *r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+}
+
+static void storeLumaSSE2(__m128i r, __m128i g, __m128i b, uint8_t *y)
+{
+    // The weighted sum reaches 56228, so it's shifted as unsigned
+    __m128i sum = _mm_add_epi16(
+        _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+        _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128))
+    );
+    __m128i luma = _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+
+    _mm_storel_epi64((__m128i *) y, _mm_packus_epi16(luma, luma));
+}
+
+/**
+ * Average each horizontal pair of the sums of two rows, giving the average of each 2x2 block in the low 4 lanes.
+ */
+static __m128i averageBlocksSSE2(__m128i row0, __m128i row1)
+{
+    __m128i sums = _mm_madd_epi16(_mm_add_epi16(row0, row1), _mm_set1_epi16(1));
+    __m128i average = _mm_srli_epi32(_mm_add_epi32(sums, _mm_set1_epi32(2)), 2);
+
+    return _mm_packs_epi32(average, average);
+}
+
+static void storeChromaSSE2(__m128i r, __m128i g, __m128i b, int16_t rWeight, int16_t gWeight, int16_t bWeight, uint8_t *chroma)
+{
+    __m128i sum = _mm_add_epi16(
+        _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(rWeight)), _mm_mullo_epi16(g, _mm_set1_epi16(gWeight))),
+        _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(bWeight)), _mm_set1_epi16(128))
+    );
+    __m128i value = _mm_add_epi16(_mm_srai_epi16(sum, 8), _mm_set1_epi16(128));
+    int32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(value, value));
+
+    memcpy(chroma, &packed, sizeof(packed));
+}
+
+/**
+ * Convert as many pixels of the pair of rows as possible 8 at a time, returning the number converted.
+ */
+static int convertRowPairSSE2(const uint8_t *row0, const uint8_t *row1, int width, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v)
+{
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+        __m128i r0, g0, b0, r1, g1, b1, r, g, b;
+
+        unpackPixelsSSE2(row0 + x * 4, &r0, &g0, &b0);
+        unpackPixelsSSE2(row1 + x * 4, &r1, &g1, &b1);
+
+        storeLumaSSE2(r0, g0, b0, y0 + x);
+        storeLumaSSE2(r1, g1, b1, y1 + x);
+
+        r = averageBlocksSSE2(r0, r1);
+        g = averageBlocksSSE2(g0, g1);
+        b = averageBlocksSSE2(b0, b1);
+
+        storeChromaSSE2(r, g, b, -38, -74, 112, u + x / 2);
+        storeChromaSSE2(r, g, b, 112, -94, -18, v + x / 2);
+    }
+
+    return x;
+}
+
+#endif
+
+/**
+ * Convert an image of ARGB32 pixels into the three planes of an I420 image. The chroma planes are (width + 1) / 2 by
+ * (height + 1) / 2.
+ */
+void videoConvertARGBToI420(const uint8_t *pixels, int stride, int width, int height, uint8_t *y, uint8_t *u, uint8_t *v)
+{
+    int chromaWidth = (width + 1) / 2;
+
+    for (int row = 0; row < height; row += 2) {
+        int nextRow = row + 1 < height ? row + 1 : row;
+        const uint8_t *row0 = pixels + (size_t) row * stride;
+        const uint8_t *row1 = pixels + (size_t) nextRow * stride;
+        uint8_t *y0 = y + (size_t) row * width;
+        uint8_t *y1 = y + (size_t) nextRow * width;
+        uint8_t *uRow = u + (size_t) (row / 2) * chromaWidth;
+        uint8_t *vRow = v + (size_t) (row / 2) * chromaWidth;
+        int x = 0;
+
+#ifdef __SSE2__
+        x = convertRowPairSSE2(row0, row1, width, y0, y1, uRow, vRow);
+#endif
+
+        convertRowPairPlain(row0, row1, x, width, y0, y1, uRow, vRow);
+    }
+}
+
+static void convertToBGRA(const uint8_t *pixels, int stride, int width, int height, uint8_t *frame)
+{
+    for (int row = 0; row < height; row++) {
+        const uint8_t *source = pixels + (size_t) row * stride;
+
+        for (int x = 0; x < width; x++) {
+            uint32_t pixel = readPixel(source, x);
+
+            frame[0] = pixel & 0xFF;
+            frame[1] = (pixel >> 8) & 0xFF;
+            frame[2] = (pixel >> 16) & 0xFF;
+            frame[3] = pixel >> 24;
+            frame += 4;
+        }
+    }
+}
+
+/**
+ * Begin a video on the given file by writing its header. The file stays open when the writer is destroyed.
+ */
+videoWriter_t* videoWriterCreate(FILE *file, VideoFormat format, int width, int height, int fpsNumerator, int fpsDenominator)
+{
+    videoWriter_t *writer = malloc(sizeof(*writer));
+
+    writer->file = file;
+    writer->format = format;
+    writer->width = width;
+    writer->height = height;
+    writer->fpsNumerator = fpsNumerator;
+    writer->fpsDenominator = fpsDenominator;
+
+    switch (format) {
+        case VIDEO_FORMAT_Y4M:
+            fprintf(file, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", width, height, fpsNumerator, fpsDenominator);
+        break;
+        case VIDEO_FORMAT_BGRA:
+            fprintf(file, "BGRA W%d H%d F%d:%d\n", width, height, fpsNumerator, fpsDenominator);
+        break;
+        default:
+            ;
+    }
+
+    return writer;
+}
+
+void videoWriterDestroy(videoWriter_t *writer)
+{
+    if (writer) {
+        fflush(writer->file);
+        free(writer);
+    }
+}
+
+/**
+ * Get the size of the buffer that videoWriterConvertFrame() needs for each frame.
+ */
+size_t videoWriterFrameSize(const videoWriter_t *writer)
+{
+    size_t pixelCount = (size_t) writer->width * writer->height;
+
+    if (writer->format == VIDEO_FORMAT_Y4M) {
+        return pixelCount + 2 * (size_t) ((writer->width + 1) / 2) * ((writer->height + 1) / 2);
+    }
+
+    return pixelCount * 4;
+}
+
+/**
+ * Convert an image of ARGB32 pixels into the writer's format. This doesn't touch the file, so frames can be converted
+ * on several threads at once, as long as they're written in order.
+ */
+void videoWriterConvertFrame(const videoWriter_t *writer, const uint8_t *pixels, int stride, uint8_t *frame)
+{
+    if (writer->format == VIDEO_FORMAT_Y4M) {
+        size_t lumaSize = (size_t) writer->width * writer->height;
+        size_t chromaSize = (size_t) ((writer->width + 1) / 2) * ((writer->height + 1) / 2);
+
+        videoConvertARGBToI420(pixels, stride, writer->width, writer->height, frame, frame + lumaSize, frame + lumaSize + chromaSize);
+    } else {
+        convertToBGRA(pixels, stride, writer->width, writer->height, frame);
+    }
+}
+
+/**
+ * Write the next frame of the video, returns false if it couldn't be written (e.g. the reader of a pipe went away).
+ */
+bool videoWriterWriteFrame(videoWriter_t *writer, const uint8_t *frame)
+{
+    size_t frameSize = videoWriterFrameSize(writer);
+
+    if (writer->format == VIDEO_FORMAT_Y4M && fputs("FRAME\n", writer->file) == EOF) {
+        return false;
+    }
+
+    return fwrite(frame, 1, frameSize, writer->file) == frameSize;
+}
@@ -0,0 +1,41 @@
+#ifndef VIDEOWRITER_H_
+#define VIDEOWRITER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum VideoFormat {
+    // YUV4MPEG2 with 4:2:0 chroma (BT.601, limited range), which video encoders such as ffmpeg and x264 read directly
+    VIDEO_FORMAT_Y4M = 0,
+    // A one-line text header followed by each frame's premultiplied BGRA pixels, for encoders that keep the alpha
+    VIDEO_FORMAT_BGRA,
+    VIDEO_FORMAT_COUNT
+} VideoFormat;
+
+extern const char* const VIDEO_FORMAT_NAME[VIDEO_FORMAT_COUNT];
+
+/**
+ * Writes the frames of an uncompressed video one after another to a file, pipe or stdout.
+ */
+typedef struct videoWriter_t {
+    FILE *file;
+    VideoFormat format;
+    int width, height;
+    //The frame rate is fpsNumerator / fpsDenominator frames per second
+    int fpsNumerator, fpsDenominator;
+} videoWriter_t;
+
+bool videoFormatParse(const char *name, VideoFormat *format);
+
+videoWriter_t* videoWriterCreate(FILE *file, VideoFormat format, int width, int height, int fpsNumerator, int fpsDenominator);
+void videoWriterDestroy(videoWriter_t *writer);
+
+size_t videoWriterFrameSize(const videoWriter_t *writer);
+void videoWriterConvertFrame(const videoWriter_t *writer, const uint8_t *pixels, int stride, uint8_t *frame);
+bool videoWriterWriteFrame(videoWriter_t *writer, const uint8_t *frame);
+
+void videoConvertARGBToI420(const uint8_t *pixels, int stride, int width, int height, uint8_t *y, uint8_t *u, uint8_t *v);
+
+#endif
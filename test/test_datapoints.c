@@ -10,7 +10,7 @@
 int main(void)
 {
 	char *fieldNames[] = {"Test"};
-	int32_t val;
+	int64_t val;
 
 	//First some basic tests about locating frames
 	{
@@ -31,6 +31,87 @@ int main(void)
 		datapointsDestroy(points);
 	}
 
+	//Frames are stored a field at a time in the narrowest type for each field, but can still be read back whole
+	{
+		char *fourFieldNames[] = {"A", "B", "C", "D"};
+		flightLogFieldStatistics_t ranges[] = {{0, 200}, {-1000, 1000}, {-5, 3}, {INT64_MIN, INT64_MAX}};
+		datapoints_t *points = datapointsCreateWithRanges(4, fourFieldNames, ranges, 4);
+		int64_t frame[4], frameTime, column[4];
+
+		assert(points->columns[0].type == DATAPOINTS_COLUMN_UINT8);
+		assert(points->columns[1].type == DATAPOINTS_COLUMN_INT16);
+		assert(points->columns[2].type == DATAPOINTS_COLUMN_INT8);
+		assert(points->columns[3].type == DATAPOINTS_COLUMN_INT64);
+		assert(datapointsGetStorageSize(points) == 4 * (1 + 2 + 1 + 8 + sizeof(int64_t) + sizeof(uint8_t)));
+
+		for (int i = 0; i < 4; i++) {
+			frame[0] = i * 50;
+			frame[1] = -i * 300;
+			frame[2] = -i;
+			frame[3] = INT64_MAX - i;
+			datapointsAddFrame(points, i * 100, frame);
+		}
+
+		assert(datapointsReadField(points, 1, 1, 10, column) == 3);
+		assert(column[0] == -300 && column[1] == -600 && column[2] == -900);
+
+		// Values that don't fit the type are clamped
+		assert(datapointsSetFieldAtIndex(points, 2, 0, 1000));
+		assert(datapointsSetFieldAtIndex(points, 2, 2, -1000));
+
+		assert(datapointsGetFrameAtIndex(points, 2, &frameTime, frame));
+		assert(frameTime == 200 && frame[0] == 255 && frame[1] == -600 && frame[2] == -128 && frame[3] == INT64_MAX - 2);
+
+		datapointsDestroy(points);
+	}
+
+	//Searches from a cursor should agree with searches of the whole log, whichever way time moves
+	{
+		datapoints_t *points = datapointsCreate(1, fieldNames, 100);
+		datapointsCursor_t cursor;
+
+		for (int i = 0; i < 100; i++) {
+			val = i;
+			// Some frames share timestamps
+			datapointsAddFrame(points, 10 + (i / 3) * 7, &val);
+		}
+
+		datapointsCursorInit(&cursor);
+
+		for (int64_t time = 0; time < 300; time += 3) {
+			assert(datapointsAdvanceToTime(points, &cursor, time) == datapointsFindFrameAtTime(points, time));
+		}
+
+		assert(datapointsAdvanceToTime(points, &cursor, 50) == datapointsFindFrameAtTime(points, 50));
+		assert(datapointsAdvanceToTime(points, &cursor, 0) == -1);
+		assert(datapointsAdvanceToTime(points, &cursor, 1000) == 99);
+
+		datapointsDestroy(points);
+	}
+
+	//Interpolating values between frames, but not across gaps
+	{
+		datapoints_t *points = datapointsCreate(1, fieldNames, 3);
+		double value;
+
+		val = 10;
+		datapointsAddFrame(points, 100, &val);
+		val = 20;
+		datapointsAddFrame(points, 200, &val);
+		datapointsAddGap(points);
+		val = 100;
+		datapointsAddFrame(points, 300, &val);
+
+		assert(!datapointsGetValueAtTime(points, 0, 99, &value));
+		assert(datapointsGetValueAtTime(points, 0, 100, &value) && value == 10);
+		assert(datapointsGetValueAtTime(points, 0, 125, &value) && value == 12.5);
+		assert(datapointsGetValueAtTime(points, 0, 250, &value) && value == 20);
+		assert(datapointsGetValueAtTime(points, 0, 300, &value) && value == 100);
+		assert(!datapointsGetValueAtTime(points, 0, 301, &value));
+
+		datapointsDestroy(points);
+	}
+
 	//Test smoothing partitioning by making every value its own partition
 	{
 		datapoints_t *points;
@@ -83,6 +164,171 @@ int main(void)
 		datapointsDestroy(points);
 	}
 
+	//Filters don't smooth across gaps
+	for (int type = 0; type < FILTER_TYPE_COUNT; type++) {
+		datapoints_t *points = datapointsCreate(1, fieldNames, 200);
+		filterSettings_t settings = {(FilterType) type, 3, 50};
+
+		for (int i = 0; i < 200; i++) {
+			val = i < 100 ? 10 : 1000;
+			datapointsAddFrame(points, i * 1000, &val);
+
+			if (i == 99)
+				datapointsAddGap(points);
+		}
+
+		datapointsFilterField(points, 0, &settings);
+
+		for (int i = 0; i < 200; i++) {
+			assert(datapointsGetFieldAtIndex(points, i, 0, &val));
+			assert(val == (i < 100 ? 10 : 1000));
+		}
+
+		datapointsDestroy(points);
+	}
+
+	//The low-pass filters overshoot at a step, which a narrow column is widened to keep rather than clipping
+	for (int type = FILTER_TYPE_LOWPASS; type <= FILTER_TYPE_FILTFILT; type++) {
+		flightLogFieldStatistics_t range = {0, 255};
+		filterSettings_t settings = {(FilterType) type, 0, 50};
+		datapoints_t *narrow = datapointsCreateWithRanges(1, fieldNames, &range, 400);
+		datapoints_t *wide = datapointsCreate(1, fieldNames, 400);
+		int64_t narrowValue, wideValue, highest = 0;
+
+		assert(narrow->columns[0].type == DATAPOINTS_COLUMN_UINT8);
+
+		for (int i = 0; i < 400; i++) {
+			int64_t step = (i / 100) % 2 ? 255 : 0;
+
+			datapointsAddFrame(narrow, i * 1000, &step);
+			datapointsAddFrame(wide, i * 1000, &step);
+		}
+
+		datapointsFilterField(narrow, 0, &settings);
+		datapointsFilterField(wide, 0, &settings);
+
+		for (int i = 0; i < 400; i++) {
+			assert(datapointsGetFieldAtIndex(narrow, i, 0, &narrowValue));
+			assert(datapointsGetFieldAtIndex(wide, i, 0, &wideValue));
+			assert(narrowValue == wideValue);
+
+			if (narrowValue > highest)
+				highest = narrowValue;
+		}
+
+		assert(highest > 255);
+		assert(narrow->columns[0].type == DATAPOINTS_COLUMN_INT16);
+
+		datapointsDestroy(narrow);
+		datapointsDestroy(wide);
+	}
+
+	//Discarding frames from the start moves the rest down, and the space can be reused
+	{
+		datapoints_t *points = datapointsCreate(1, fieldNames, 4);
+
+		for (int i = 0; i < 4; i++) {
+			val = i * 10;
+			datapointsAddFrame(points, i * 100, &val);
+
+			if (i == 1)
+				datapointsAddGap(points);
+		}
+
+		datapointsDiscardFrames(points, 3);
+
+		assert(points->frameCount == 1 && points->discardedFrameCount == 3);
+		assert(datapointsGetFieldAtIndex(points, 0, 0, &val) && val == 30);
+		assert(datapointsFindFrameAtTime(points, 300) == 0);
+
+		datapointsSetCapacity(points, 8);
+
+		for (int i = 4; i < 10; i++) {
+			val = i * 10;
+			assert(datapointsAddFrame(points, i * 100, &val));
+		}
+
+		assert(points->frameCount == 7);
+		assert(datapointsGetFieldAtIndex(points, 6, 0, &val) && val == 90);
+
+		for (int i = 0; i < points->frameCount; i++) {
+			assert(!datapointsGetGapStartsAtIndex(points, i));
+		}
+
+		datapointsDestroy(points);
+	}
+
+	//Smoothing frames as they arrive, and discarding them once they're smoothed, gives the same result as smoothing the whole log
+	for (int type = FILTER_TYPE_MOVING_AVERAGE; type <= FILTER_TYPE_GAUSSIAN; type++) {
+		const int frameCount = 500;
+		datapoints_t *whole = datapointsCreate(1, fieldNames, frameCount);
+		datapoints_t *streamed = datapointsCreate(1, fieldNames, 16);
+		filterSettings_t settings = {(FilterType) type, 3, 0};
+		datapointsSmoother_t smoother;
+		int64_t result[500], expected;
+
+		assert(datapointsSmootherInit(&smoother, 0, &settings));
+
+		for (int i = 0; i < frameCount; i++) {
+			bool gap = i % 97 == 50 || i == 201 || i == 202;
+
+			val = (i * 7919) % 1000 - 500;
+
+			datapointsAddFrame(whole, i, &val);
+			if (gap)
+				datapointsAddGap(whole);
+
+			if (streamed->frameCount == streamed->frameCapacity)
+				datapointsSetCapacity(streamed, streamed->frameCapacity * 2);
+
+			datapointsAddFrame(streamed, i, &val);
+			if (gap)
+				datapointsAddGap(streamed);
+
+			if (i % 13 == 0) {
+				int discard;
+
+				datapointsSmootherAdvance(&smoother, streamed, false);
+
+				//Keep the results of the smoothed frames, then discard all but a few of them
+				discard = smoother.smoothedFrameCount - streamed->discardedFrameCount - 5;
+
+				for (int j = 0; j < discard; j++) {
+					datapointsGetFieldAtIndex(streamed, j, 0, &result[j + streamed->discardedFrameCount]);
+				}
+
+				datapointsDiscardFrames(streamed, discard);
+			}
+		}
+
+		datapointsSmootherAdvance(&smoother, streamed, true);
+		assert(smoother.smoothedFrameCount == frameCount);
+		assert(streamed->frameCount < 50);
+
+		for (int j = 0; j < streamed->frameCount; j++) {
+			datapointsGetFieldAtIndex(streamed, j, 0, &result[j + streamed->discardedFrameCount]);
+		}
+
+		datapointsFilterField(whole, 0, &settings);
+
+		for (int i = 0; i < frameCount; i++) {
+			assert(datapointsGetFieldAtIndex(whole, i, 0, &expected));
+			assert(result[i] == expected);
+		}
+
+		datapointsSmootherDestroy(&smoother);
+		datapointsDestroy(whole);
+		datapointsDestroy(streamed);
+	}
+
+	//The low-pass filters depend on the whole of each run, so they can't be streamed
+	{
+		filterSettings_t settings = {FILTER_TYPE_LOWPASS, 0, 50};
+		datapointsSmoother_t smoother;
+
+		assert(!datapointsSmootherInit(&smoother, 0, &settings));
+	}
+
 	printf("Done\n");
 
 	return 0;
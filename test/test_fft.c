@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+#include "../src/fft.h"
+
+static void naiveDFT(const fftComplex_t *input, fftComplex_t *output, int size, bool inverse)
+{
+	for (int k = 0; k < size; k++) {
+		double re = 0, im = 0;
+
+		for (int n = 0; n < size; n++) {
+			double phase = (inverse ? 2 : -2) * M_PI * ((double) k * n / size);
+
+			re += input[n].re * cos(phase) - input[n].im * sin(phase);
+			im += input[n].re * sin(phase) + input[n].im * cos(phase);
+		}
+
+		output[k].re = re;
+		output[k].im = im;
+	}
+}
+
+static void assertClose(const fftComplex_t *a, const fftComplex_t *b, int count, int size)
+{
+	// Single precision rounding error grows with the size of the transform
+	double tolerance = 1e-4 * size;
+
+	for (int i = 0; i < count; i++) {
+		assert(fabs(a[i].re - b[i].re) < tolerance);
+		assert(fabs(a[i].im - b[i].im) < tolerance);
+	}
+}
+
+int main(void)
+{
+	// Powers of two, the other specialised radixes, and the generic butterfly (7, 11, 13)
+	int sizes[] = {1, 2, 3, 4, 5, 6, 7, 8, 12, 15, 16, 30, 64, 100, 154, 256, 360, 1024, 2 * 13 * 11};
+
+	srand(42);
+
+	for (int s = 0; s < (int) (sizeof(sizes) / sizeof(sizes[0])); s++) {
+		int size = sizes[s];
+		fftComplex_t *input = malloc(size * sizeof(*input));
+		fftComplex_t *expected = malloc(size * sizeof(*expected));
+		fftComplex_t *output = malloc(size * sizeof(*output));
+
+		for (int i = 0; i < size; i++) {
+			input[i].re = (float) rand() / RAND_MAX - 0.5f;
+			input[i].im = (float) rand() / RAND_MAX - 0.5f;
+		}
+
+		//Complex transforms in both directions
+		for (int inverse = 0; inverse < 2; inverse++) {
+			fftPlan_t *plan = fftPlanCreate(size, inverse);
+
+			fftTransform(plan, input, output);
+			naiveDFT(input, expected, size, inverse);
+
+			assertClose(output, expected, size, size);
+
+			fftPlanDestroy(plan);
+		}
+
+		//Real transforms produce the non-negative half of the complex spectrum
+		if (size % 2 == 0) {
+			fftRealPlan_t *plan = fftRealPlanCreate(size, false);
+			float *realInput = malloc(size * sizeof(*realInput));
+			fftComplex_t *scratch = malloc(size / 2 * sizeof(*scratch));
+
+			for (int i = 0; i < size; i++) {
+				realInput[i] = input[i].re;
+				input[i].im = 0;
+			}
+
+			naiveDFT(input, expected, size, false);
+			fftRealForward(plan, realInput, output, scratch);
+
+			assertClose(output, expected, size / 2 + 1, size);
+
+			//The inverse transform restores the input (multiplied by the size)
+			fftRealPlan_t *inversePlan = fftRealPlanCreate(size, true);
+			float *roundTrip = malloc(size * sizeof(*roundTrip));
+
+			fftRealInverse(inversePlan, output, roundTrip, scratch);
+
+			for (int i = 0; i < size; i++) {
+				assert(fabs(roundTrip[i] / size - realInput[i]) < 1e-4);
+			}
+
+			free(roundTrip);
+			fftRealPlanDestroy(inversePlan);
+			free(realInput);
+			free(scratch);
+			fftRealPlanDestroy(plan);
+		} else {
+			assert(fftRealPlanCreate(size, false) == NULL);
+		}
+
+		free(input);
+		free(expected);
+		free(output);
+	}
+
+	//A pure tone lands in a single bin
+	{
+		int size = 64;
+		fftRealPlan_t *plan = fftRealPlanCreate(size, false);
+		float input[64];
+		fftComplex_t output[33], scratch[32];
+
+		for (int i = 0; i < size; i++) {
+			input[i] = cos(2 * M_PI * 5 * i / size);
+		}
+
+		fftRealForward(plan, input, output, scratch);
+
+		for (int k = 0; k <= size / 2; k++) {
+			double magnitude = sqrt(output[k].re * output[k].re + output[k].im * output[k].im);
+
+			if (k == 5) {
+				assert(fabs(magnitude - size / 2) < 1e-3);
+			} else {
+				assert(magnitude < 1e-3);
+			}
+		}
+
+		fftRealPlanDestroy(plan);
+	}
+
+	return 0;
+}
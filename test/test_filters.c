@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+#include "../src/filters.h"
+
+#define SAMPLE_COUNT 1000
+#define SAMPLE_RATE 1000
+
+static double rms(const float *values, int first, int last)
+{
+	double sum = 0;
+
+	for (int i = first; i < last; i++) {
+		sum += (double) values[i] * values[i];
+	}
+
+	return sqrt(sum / (last - first));
+}
+
+static void fillSine(float *values, int count, double frequency)
+{
+	for (int i = 0; i < count; i++) {
+		values[i] = (float) sin(2 * M_PI * frequency * i / SAMPLE_RATE);
+	}
+}
+
+int main(void)
+{
+	float values[SAMPLE_COUNT], scratch[SAMPLE_COUNT + 64];
+	filterSettings_t settings;
+	FilterType type;
+
+	assert(filterTypeParse("filtfilt", &type) && type == FILTER_TYPE_FILTFILT);
+	assert(!filterTypeParse("median", &type));
+
+	//Averages only use the values that exist at the ends
+	{
+		float input[] = {3, 7, 1, 28, 105};
+		float output[5];
+
+		filterMovingAverage(input, output, 5, 1);
+
+		assert(output[0] == 5);
+		assert(output[1] == 11 / 3.0f);
+		assert(output[4] == 133 / 2.0f);
+	}
+
+	//Every filter should leave a constant signal alone
+	for (int i = 0; i < FILTER_TYPE_COUNT; i++) {
+		settings.type = (FilterType) i;
+		settings.radius = 4;
+		settings.cutoffFrequency = 30;
+
+		for (int j = 0; j < SAMPLE_COUNT; j++) {
+			values[j] = 42;
+		}
+
+		assert(filterScratchSize(&settings, SAMPLE_COUNT) <= (int) (sizeof(scratch) / sizeof(scratch[0])));
+
+		filterApply(&settings, values, SAMPLE_COUNT, SAMPLE_RATE, scratch);
+
+		for (int j = 0; j < SAMPLE_COUNT; j++) {
+			assert(fabsf(values[j] - 42) < 1e-3);
+		}
+	}
+
+	//The low-pass filters keep the passband and attenuate the stopband
+	{
+		settings.type = FILTER_TYPE_LOWPASS;
+		settings.cutoffFrequency = 30;
+
+		fillSine(values, SAMPLE_COUNT, 3);
+		filterApply(&settings, values, SAMPLE_COUNT, SAMPLE_RATE, scratch);
+		assert(fabs(rms(values, 500, SAMPLE_COUNT) - sqrt(0.5)) < 0.02);
+
+		// Two octaves above the cutoff a second order filter should be down by 24dB
+		fillSine(values, SAMPLE_COUNT, 120);
+		filterApply(&settings, values, SAMPLE_COUNT, SAMPLE_RATE, scratch);
+		assert(rms(values, 500, SAMPLE_COUNT) < sqrt(0.5) * 0.07);
+
+		settings.type = FILTER_TYPE_FILTFILT;
+
+		fillSine(values, SAMPLE_COUNT, 120);
+		filterApply(&settings, values, SAMPLE_COUNT, SAMPLE_RATE, scratch);
+		assert(rms(values, 250, 750) < sqrt(0.5) * 0.07 * 0.07);
+	}
+
+	//Filtering forwards and backwards doesn't move the peak of a pulse, but filtering forwards delays it
+	{
+		int peak;
+
+		for (int k = 0; k < 2; k++) {
+			settings.type = k == 0 ? FILTER_TYPE_FILTFILT : FILTER_TYPE_LOWPASS;
+
+			for (int j = 0; j < SAMPLE_COUNT; j++) {
+				values[j] = j >= 490 && j <= 510 ? 100 : 0;
+			}
+
+			filterApply(&settings, values, SAMPLE_COUNT, SAMPLE_RATE, scratch);
+
+			peak = 0;
+			for (int j = 0; j < SAMPLE_COUNT; j++) {
+				if (values[j] > values[peak])
+					peak = j;
+			}
+
+			if (k == 0) {
+				assert(abs(peak - 500) <= 1);
+			} else {
+				assert(peak > 505);
+			}
+		}
+	}
+
+	//The Gaussian smooths noise about as much as the moving average of the same radius
+	{
+		float noise[SAMPLE_COUNT];
+		double averageRMS, gaussianRMS;
+
+		srand(42);
+
+		for (int j = 0; j < SAMPLE_COUNT; j++) {
+			noise[j] = (float) rand() / RAND_MAX - 0.5f;
+		}
+
+		settings.radius = 3;
+
+		for (int j = 0; j < SAMPLE_COUNT; j++)
+			values[j] = noise[j];
+		settings.type = FILTER_TYPE_MOVING_AVERAGE;
+		filterApply(&settings, values, SAMPLE_COUNT, SAMPLE_RATE, scratch);
+		averageRMS = rms(values, 0, SAMPLE_COUNT);
+
+		for (int j = 0; j < SAMPLE_COUNT; j++)
+			values[j] = noise[j];
+		settings.type = FILTER_TYPE_GAUSSIAN;
+		filterApply(&settings, values, SAMPLE_COUNT, SAMPLE_RATE, scratch);
+		gaussianRMS = rms(values, 0, SAMPLE_COUNT);
+
+		assert(averageRMS < rms(noise, 0, SAMPLE_COUNT) * 0.5);
+		assert(fabs(gaussianRMS - averageRMS) < averageRMS * 0.3);
+	}
+
+	return 0;
+}
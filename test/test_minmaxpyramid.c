@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "../src/minmaxpyramid.h"
+
+#define FRAME_COUNT 1000
+
+static void checkQuery(const minMaxPyramid_t *pyramid, const int64_t *values, int first, int count)
+{
+	minMaxRange_t range;
+	int expectedMin = first, expectedMax = first;
+
+	assert(minMaxPyramidQuery(pyramid, first, count, &range));
+
+	// The first frame with the smallest and largest value
+	for (int i = first; i < first + count; i++) {
+		if (values[i] < values[expectedMin])
+			expectedMin = i;
+		if (values[i] > values[expectedMax])
+			expectedMax = i;
+	}
+
+	assert(range.minIndex == expectedMin && range.min == values[expectedMin]);
+	assert(range.maxIndex == expectedMax && range.max == values[expectedMax]);
+}
+
+int main(void)
+{
+	char *fieldNames[] = {"Test"};
+	int64_t values[FRAME_COUNT];
+	datapoints_t *points = datapointsCreate(1, fieldNames, FRAME_COUNT);
+	minMaxPyramid_t *pyramid;
+	minMaxRange_t range;
+
+	srand(1);
+
+	// Few enough different values that there are plenty of ties
+	for (int i = 0; i < FRAME_COUNT; i++) {
+		values[i] = rand() % 50 - 25;
+		datapointsAddFrame(points, i * 125, &values[i]);
+	}
+
+	pyramid = minMaxPyramidCreate(points, 0);
+
+	assert(pyramid->levelCount > 1);
+	assert(pyramid->blockCount[0] == FRAME_COUNT / MINMAX_PYRAMID_BASE_FRAMES);
+
+	// Every short run, and runs that cover many blocks
+	for (int first = 0; first < FRAME_COUNT; first++) {
+		for (int count = 1; count <= 40 && first + count <= FRAME_COUNT; count++) {
+			checkQuery(pyramid, values, first, count);
+		}
+	}
+
+	for (int i = 0; i < 2000; i++) {
+		int first = rand() % FRAME_COUNT;
+		int count = 1 + rand() % (FRAME_COUNT - first);
+
+		checkQuery(pyramid, values, first, count);
+	}
+
+	checkQuery(pyramid, values, 0, FRAME_COUNT);
+
+	// Runs are clipped to the frames that exist
+	assert(minMaxPyramidQuery(pyramid, FRAME_COUNT - 3, 10, &range) && range.minIndex >= FRAME_COUNT - 3);
+	assert(!minMaxPyramidQuery(pyramid, FRAME_COUNT, 10, &range));
+
+	minMaxPyramidDestroy(pyramid);
+
+	// Fewer frames than a block
+	{
+		datapoints_t *few = datapointsCreate(1, fieldNames, 3);
+
+		for (int i = 0; i < 3; i++)
+			datapointsAddFrame(few, i, &values[i]);
+
+		pyramid = minMaxPyramidCreate(few, 0);
+		assert(pyramid->levelCount == 0);
+		checkQuery(pyramid, values, 0, 3);
+
+		minMaxPyramidDestroy(pyramid);
+		datapointsDestroy(few);
+	}
+
+	datapointsDestroy(points);
+
+	return 0;
+}
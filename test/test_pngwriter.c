@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <zlib.h>
+
+#include "../src/pngwriter.h"
+
+#define WIDTH 53
+#define HEIGHT 70
+
+typedef struct decodedPng_t {
+	int width, height, colorType;
+	uint8_t palette[256][4];
+	// Every pixel as straight (not premultiplied) RGBA
+	uint8_t *rgba;
+} decodedPng_t;
+
+static uint32_t readUInt32BE(const uint8_t *buffer)
+{
+	return ((uint32_t) buffer[0] << 24) | ((uint32_t) buffer[1] << 16) | ((uint32_t) buffer[2] << 8) | buffer[3];
+}
+
+static uint32_t argb(int a, int r, int g, int b)
+{
+	return ((uint32_t) a << 24) | ((uint32_t) r << 16) | ((uint32_t) g << 8) | (uint32_t) b;
+}
+
+static int paeth(int a, int b, int c)
+{
+	int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+	return pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+}
+
+/**
+ * A small PNG decoder for the subset of PNG that the writer produces, which checks every CRC and (through zlib) the
+ * checksum of the image data.
+ */
+static void decodePng(FILE *file, decodedPng_t *png)
+{
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	const int channelsOfType[7] = {1, 0, 3, 1, 2, 0, 4};
+	uint8_t header[8], *data = NULL, *inflated;
+	size_t dataLength = 0;
+	int channels, rowLength;
+	bool ended = false;
+	z_stream stream;
+
+	memset(png->palette, 0xFF, sizeof(png->palette));
+
+	assert(fread(header, 1, 8, file) == 8 && memcmp(header, signature, 8) == 0);
+
+	while (!ended) {
+		uint8_t crc[4], *chunk;
+		uint32_t length;
+
+		assert(fread(header, 1, 8, file) == 8);
+		length = readUInt32BE(header);
+
+		chunk = malloc(length + 4);
+		memcpy(chunk, header + 4, 4);
+		assert(fread(chunk + 4, 1, length, file) == length);
+		assert(fread(crc, 1, 4, file) == 4);
+		assert(readUInt32BE(crc) == crc32(0, chunk, length + 4));
+
+		if (memcmp(chunk, "IHDR", 4) == 0) {
+			png->width = (int) readUInt32BE(chunk + 4);
+			png->height = (int) readUInt32BE(chunk + 8);
+			assert(chunk[12] == 8);
+			png->colorType = chunk[13];
+		} else if (memcmp(chunk, "PLTE", 4) == 0) {
+			for (uint32_t i = 0; i < length / 3; i++)
+				memcpy(png->palette[i], chunk + 4 + i * 3, 3);
+		} else if (memcmp(chunk, "tRNS", 4) == 0) {
+			for (uint32_t i = 0; i < length; i++)
+				png->palette[i][3] = chunk[4 + i];
+		} else if (memcmp(chunk, "IDAT", 4) == 0) {
+			data = realloc(data, dataLength + length);
+			memcpy(data + dataLength, chunk + 4, length);
+			dataLength += length;
+		} else if (memcmp(chunk, "IEND", 4) == 0) {
+			ended = true;
+		}
+
+		free(chunk);
+	}
+
+	channels = channelsOfType[png->colorType];
+	rowLength = png->width * channels;
+	inflated = malloc((size_t) (rowLength + 1) * png->height);
+
+	memset(&stream, 0, sizeof(stream));
+	assert(inflateInit(&stream) == Z_OK);
+	stream.next_in = data;
+	stream.avail_in = (uInt) dataLength;
+	stream.next_out = inflated;
+	stream.avail_out = (uInt) (rowLength + 1) * png->height;
+	assert(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+	assert(stream.avail_out == 0 && stream.avail_in == 0);
+	inflateEnd(&stream);
+
+	// Undo the filters in place
+	for (int y = 0; y < png->height; y++) {
+		uint8_t *row = inflated + (size_t) y * (rowLength + 1) + 1;
+		uint8_t *previous = y > 0 ? row - (rowLength + 1) : NULL;
+
+		for (int i = 0; i < rowLength; i++) {
+			int left = i >= channels ? row[i - channels] : 0;
+			int up = previous ? previous[i] : 0;
+			int upLeft = previous && i >= channels ? previous[i - channels] : 0;
+
+			switch (row[-1]) {
+				case 0: break;
+				case 1: row[i] += left; break;
+				case 2: row[i] += up; break;
+				case 3: row[i] += (left + up) >> 1; break;
+				case 4: row[i] += paeth(left, up, upLeft); break;
+				default: assert(false);
+			}
+		}
+	}
+
+	png->rgba = malloc((size_t) png->width * png->height * 4);
+
+	for (int y = 0; y < png->height; y++) {
+		const uint8_t *row = inflated + (size_t) y * (rowLength + 1) + 1;
+
+		for (int x = 0; x < png->width; x++) {
+			const uint8_t *in = row + x * channels;
+			uint8_t *out = png->rgba + ((size_t) y * png->width + x) * 4;
+
+			switch (png->colorType) {
+				case 0: out[0] = out[1] = out[2] = in[0]; out[3] = 255; break;
+				case 2: memcpy(out, in, 3); out[3] = 255; break;
+				case 3: memcpy(out, png->palette[in[0]], 4); break;
+				case 4: out[0] = out[1] = out[2] = in[0]; out[3] = in[1]; break;
+				default: memcpy(out, in, 4);
+			}
+		}
+	}
+
+	free(inflated);
+	free(data);
+}
+
+static uint8_t unpremultiply(int color, int alpha)
+{
+	int result = alpha == 0 ? 0 : (color * 255 + alpha / 2) / alpha;
+
+	return (uint8_t) (result > 255 ? 255 : result);
+}
+
+/**
+ * Write the image with the given settings, and check that it reads back as the same picture in the expected PNG
+ * colour type.
+ */
+static void checkRoundTrip(const uint32_t *pixels, const pngWriterSettings_t *settings, int expectedColorType)
+{
+	FILE *file = tmpfile();
+	decodedPng_t png;
+
+	assert(pngWriteARGB32(file, (const uint8_t *) pixels, WIDTH * 4, WIDTH, HEIGHT, settings));
+	rewind(file);
+
+	decodePng(file, &png);
+	fclose(file);
+
+	assert(png.width == WIDTH && png.height == HEIGHT);
+	assert(png.colorType == expectedColorType);
+
+	for (int i = 0; i < WIDTH * HEIGHT; i++) {
+		int a = pixels[i] >> 24;
+		const uint8_t *out = png.rgba + i * 4;
+
+		assert(out[3] == a);
+		assert(out[0] == unpremultiply((pixels[i] >> 16) & 0xFF, a));
+		assert(out[1] == unpremultiply((pixels[i] >> 8) & 0xFF, a));
+		assert(out[2] == unpremultiply(pixels[i] & 0xFF, a));
+	}
+
+	free(png.rgba);
+}
+
+int main(void)
+{
+	uint32_t noisy[WIDTH * HEIGHT], overlay[WIDTH * HEIGHT], greyAlpha[WIDTH * HEIGHT], opaque[WIDTH * HEIGHT];
+	pngWriterSettings_t settings;
+	PngFilter filter;
+
+	assert(pngFilterParse("paeth", &filter) && filter == PNG_FILTER_PAETH);
+	assert(!pngFilterParse("fast", &filter));
+
+	srand(1);
+
+	for (int i = 0; i < WIDTH * HEIGHT; i++) {
+		int a = rand() & 0xFF;
+
+		// Premultiplied colour can't be brighter than the alpha
+		noisy[i] = argb(a, rand() % (a + 1), rand() % (a + 1), rand() % (a + 1));
+		greyAlpha[i] = argb(a, 0, 0, 0) | (uint32_t) (rand() % (a + 1)) * 0x010101;
+		opaque[i] = argb(255, rand() & 0xFF, rand() & 0xFF, rand() & 0xFF);
+
+		// A transparent frame with a few lines drawn on it
+		overlay[i] = i % WIDTH == 10 || i / WIDTH == 30 ? argb(128, 100, 0, 50) : (i % 7 == 0 ? argb(255, 255, 255, 255) : 0);
+	}
+
+	// Every filter at every sort of compression level, in one band or several
+	for (int f = 0; f < PNG_FILTER_COUNT; f++) {
+		for (int level = 0; level <= 9; level += 3) {
+			for (int threads = 1; threads <= 4; threads += 3) {
+				pngWriterSettingsInit(&settings);
+				settings.filter = (PngFilter) f;
+				settings.compressionLevel = level;
+				settings.threadCount = threads;
+
+				checkRoundTrip(noisy, &settings, 6);
+			}
+		}
+	}
+
+	pngWriterSettingsInit(&settings);
+	settings.reduceColors = true;
+	settings.threadCount = 3;
+
+	checkRoundTrip(overlay, &settings, 3);
+	checkRoundTrip(greyAlpha, &settings, 4);
+	checkRoundTrip(opaque, &settings, 2);
+	checkRoundTrip(noisy, &settings, 6);
+
+	// Without the reduction, the overlay is kept as RGBA
+	settings.reduceColors = false;
+	checkRoundTrip(overlay, &settings, 6);
+
+	return 0;
+}
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <assert.h>
+
+// Included whole so the test can find its way around the header of the file it damages
+#include "../src/rendercache.c"
+
+#define FRAME_COUNT 100
+#define FIELD_COUNT 2
+
+#define CACHE_FILENAME "test_rendercache.bbcache"
+
+static char *fieldNames[] = {"narrow", "wide"};
+
+static char *cacheData;
+static long cacheSize;
+
+static void readCacheFile(void)
+{
+	FILE *file = fopen(CACHE_FILENAME, "rb");
+
+	assert(file);
+	assert(fseek(file, 0, SEEK_END) == 0);
+	cacheSize = ftell(file);
+	cacheData = malloc(cacheSize);
+	assert(fseek(file, 0, SEEK_SET) == 0);
+	assert(fread(cacheData, 1, cacheSize, file) == (size_t) cacheSize);
+	fclose(file);
+}
+
+/**
+ * Write the first `size` bytes of the saved cache with a change of `value` at `offset` (if it's within them), and check
+ * that the cache is rejected.
+ */
+static void checkRejected(long size, size_t offset, const void *value, size_t valueSize)
+{
+	char *data = malloc(cacheSize);
+	FILE *file;
+
+	memcpy(data, cacheData, cacheSize);
+
+	if (offset + valueSize <= (size_t) size)
+		memcpy(data + offset, value, valueSize);
+
+	file = fopen(CACHE_FILENAME, "wb");
+	assert(file);
+	assert(fwrite(data, 1, size, file) == (size_t) size);
+	fclose(file);
+
+	assert(renderCacheOpen(CACHE_FILENAME, 42, FIELD_COUNT, fieldNames) == NULL);
+
+	free(data);
+}
+
+int main(void)
+{
+	flightLogFieldStatistics_t ranges[FIELD_COUNT] = {{.min = -100, .max = 100}, {.min = INT64_MIN, .max = INT64_MAX}};
+	renderCacheContents_t contents;
+	attitude_t attitude[FRAME_COUNT];
+	renderCache_t *cache;
+	uint64_t value;
+	uint8_t type;
+
+	memset(&contents, 0, sizeof(contents));
+
+	contents.points = datapointsCreateWithRanges(FIELD_COUNT, fieldNames, ranges, FRAME_COUNT);
+	contents.frameAttitude = attitude;
+	contents.syncBeepTime = 1234;
+
+	for (int i = 0; i < FRAME_COUNT; i++) {
+		int64_t frame[FIELD_COUNT] = {i - 50, (int64_t) i * 1000000000LL};
+
+		datapointsAddFrame(contents.points, i * 125, frame);
+		attitude[i].roll = i;
+		attitude[i].pitch = -i;
+		attitude[i].heading = i / 2.0f;
+	}
+
+	assert(renderCacheSave(CACHE_FILENAME, 42, &contents));
+
+	// A good cache is read back whole
+	cache = renderCacheOpen(CACHE_FILENAME, 42, FIELD_COUNT, fieldNames);
+	assert(cache);
+	assert(cache->contents.points->frameCount == FRAME_COUNT);
+	assert(cache->contents.syncBeepTime == 1234);
+
+	for (int i = 0; i < FRAME_COUNT; i++) {
+		int64_t frameTime, frame[FIELD_COUNT];
+
+		assert(datapointsGetFrameAtIndex(cache->contents.points, i, &frameTime, frame));
+		assert(frameTime == i * 125 && frame[0] == i - 50 && frame[1] == (int64_t) i * 1000000000LL);
+		assert(cache->contents.frameAttitude[i].pitch == -i);
+	}
+
+	renderCacheClose(cache);
+
+	// But one for another log or a different set of fields isn't
+	assert(renderCacheOpen(CACHE_FILENAME, 43, FIELD_COUNT, fieldNames) == NULL);
+	assert(renderCacheOpen(CACHE_FILENAME, 42, FIELD_COUNT - 1, fieldNames) == NULL);
+
+	readCacheFile();
+
+	// Cut short, whether or not the size in the header agrees
+	checkRejected(cacheSize - 1, 0, NULL, 0);
+	checkRejected(sizeof(renderCacheHeader_t) - 1, 0, NULL, 0);
+
+	value = sizeof(renderCacheHeader_t) + 4;
+	checkRejected((long) value, offsetof(renderCacheHeader_t, fileSize), &value, sizeof(value));
+
+	// Arrays which reach past the end of the file, or which don't start on the boundary they were written on
+	value = cacheSize - 8;
+	checkRejected(cacheSize, offsetof(renderCacheHeader_t, frameTimeOffset), &value, sizeof(value));
+	checkRejected(cacheSize, offsetof(renderCacheHeader_t, attitudeOffset), &value, sizeof(value));
+
+	value = UINT64_MAX - 7;
+	checkRejected(cacheSize, offsetof(renderCacheHeader_t, fieldStatsOffset), &value, sizeof(value));
+	checkRejected(cacheSize, sizeof(renderCacheHeader_t) + FIELD_COUNT + sizeof(uint64_t), &value, sizeof(value));
+
+	value = ((renderCacheHeader_t*) cacheData)->frameGapOffset + 1;
+	checkRejected(cacheSize, offsetof(renderCacheHeader_t, frameGapOffset), &value, sizeof(value));
+
+	// A column type that doesn't exist
+	type = DATAPOINTS_COLUMN_INT64 + 1;
+	checkRejected(cacheSize, sizeof(renderCacheHeader_t), &type, sizeof(type));
+
+	// And the frame count of another log
+	value = FRAME_COUNT * 1000;
+	checkRejected(cacheSize, offsetof(renderCacheHeader_t, frameCount), &value, sizeof(int32_t));
+
+	remove(CACHE_FILENAME);
+	free(cacheData);
+	datapointsDestroy(contents.points);
+
+	return 0;
+}
@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+
+#include "../src/resample.h"
+
+#define MAX_ROWS 16
+
+static int rowCount;
+static int64_t rowTimes[MAX_ROWS];
+static double rowValues[MAX_ROWS][5];
+
+static void onRowReady(resampler_t *resampler, int64_t rowTime, const double *values, void *userData)
+{
+	(void) userData;
+
+	assert(rowCount < MAX_ROWS);
+
+	rowTimes[rowCount] = rowTime;
+
+	for (int i = 0; i < resampler->columnCount; i++) {
+		rowValues[rowCount][i] = values[i];
+	}
+
+	rowCount++;
+}
+
+int main(void)
+{
+	ResampleAggregation aggregation[5] = {RESAMPLE_MEAN, RESAMPLE_MIN, RESAMPLE_MAX, RESAMPLE_LAST, RESAMPLE_LINEAR};
+
+	//Aggregation of several samples per interval
+	{
+		resampler_t *resampler = resamplerCreate(5, 10, aggregation, onRowReady, NULL);
+		int64_t times[] = {2, 5, 8, 12, 15, 18};
+		double vals[] = {1, 4, 7, 10, 2, 3};
+
+		rowCount = 0;
+
+		for (int i = 0; i < 6; i++) {
+			double row[5] = {vals[i], vals[i], vals[i], vals[i], vals[i]};
+
+			resamplerAddSample(resampler, times[i], row);
+		}
+
+		// The first interval is only emitted once a sample arrives for the next one
+		resamplerFlush(resampler);
+
+		assert(rowCount == 2);
+
+		assert(rowTimes[0] == 0);
+		assert(rowValues[0][0] == 4);
+		assert(rowValues[0][1] == 1);
+		assert(rowValues[0][2] == 7);
+		assert(rowValues[0][3] == 7);
+		assert(rowValues[0][4] == 1); // Nothing before the first sample to interpolate from, so it's held
+
+		assert(rowTimes[1] == 10);
+		assert(rowValues[1][0] == 5);
+		assert(rowValues[1][1] == 2);
+		assert(rowValues[1][2] == 10);
+		assert(rowValues[1][3] == 3);
+		assert(fabs(rowValues[1][4] - 8.5) < 1e-9); // Halfway between 7 at t=8 and 10 at t=12
+
+		resamplerDestroy(resampler);
+	}
+
+	//Empty intervals are skipped and gaps aren't interpolated across
+	{
+		resampler_t *resampler = resamplerCreate(5, 10, aggregation, onRowReady, NULL);
+		double row0[5] = {0, 0, 0, 0, 0};
+		double row1[5] = {20, 20, 20, 20, 20};
+		double row2[5] = {40, 40, 40, 40, 40};
+
+		rowCount = 0;
+
+		resamplerAddSample(resampler, 5, row0);
+		resamplerAddSample(resampler, 35, row1);
+		resamplerAddGap(resampler);
+		resamplerAddSample(resampler, 45, row2);
+		resamplerFlush(resampler);
+
+		assert(rowCount == 3);
+		assert(rowTimes[0] == 0 && rowTimes[1] == 30 && rowTimes[2] == 40);
+		assert(fabs(rowValues[1][4] - 50.0 / 3) < 1e-9);
+		assert(rowValues[2][4] == 40);
+
+		resamplerDestroy(resampler);
+	}
+
+	return 0;
+}
@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+#include "../src/spectrum.h"
+
+#define SAMPLE_INTERVAL 1000
+#define ROW_INTERVAL 100000
+#define HALF_SAMPLES 1000
+
+static float signal(int i)
+{
+	// 100Hz, with a 230Hz tone that only appears later on
+	return (float) (100 * sin(2 * M_PI * 100 * i * SAMPLE_INTERVAL / 1e6)
+		+ (i > HALF_SAMPLES * 3 / 2 ? 50 * sin(2 * M_PI * 230 * i * SAMPLE_INTERVAL / 1e6) : 0));
+}
+
+static void addSamples(spectrumAnalyzer_t *analyzer, int first, int count)
+{
+	for (int i = first; i < first + count; i++) {
+		float value = signal(i);
+
+		spectrumAnalyzerAddSample(analyzer, (int64_t) i * SAMPLE_INTERVAL, &value);
+	}
+}
+
+static spectrumAnalyzer_t* createAnalyzer(void)
+{
+	spectrumSettings_t settings;
+
+	spectrumSettingsInit(&settings);
+	settings.fftSize = 128;
+	settings.sampleInterval = SAMPLE_INTERVAL;
+	settings.rowInterval = ROW_INTERVAL;
+	settings.threadCount = 4;
+
+	return spectrumAnalyzerCreate(1, &settings);
+}
+
+int main(void)
+{
+	spectrumAnalyzer_t *forwards = createAnalyzer(), *backwards = createAnalyzer();
+	int peak = 0, windowTotal = 0;
+
+	// The same two halves of a log, in order with a gap between them, and with time jumping back between them
+	addSamples(forwards, 0, HALF_SAMPLES);
+	spectrumAnalyzerAddGap(forwards);
+	addSamples(forwards, HALF_SAMPLES, HALF_SAMPLES);
+
+	addSamples(backwards, HALF_SAMPLES, HALF_SAMPLES);
+	addSamples(backwards, 0, HALF_SAMPLES);
+
+	spectrumAnalyzerCompute(forwards);
+	spectrumAnalyzerCompute(backwards);
+
+	assert(backwards->runCount == 2);
+	assert(backwards->windowCount == forwards->windowCount);
+
+	for (int k = 1; k < forwards->binCount; k++) {
+		if (forwards->psd[k] > forwards->psd[peak])
+			peak = k;
+	}
+
+	assert(fabs(peak * forwards->binWidth - 100) <= forwards->binWidth);
+
+	for (int k = 0; k < forwards->binCount; k++) {
+		assert(fabs(backwards->psd[k] - forwards->psd[k]) <= 1e-6 * forwards->psd[peak]);
+	}
+
+	// The rows start at the earliest sample rather than the first one added, and cover the whole log
+	assert(backwards->rowCount == forwards->rowCount);
+	assert(backwards->rowTime[0] == 0);
+	assert(backwards->rowWindowCount[0] > 0 && backwards->rowWindowCount[backwards->rowCount - 1] > 0);
+	assert(backwards->rowCount >= 2 * HALF_SAMPLES * SAMPLE_INTERVAL / ROW_INTERVAL - 1);
+
+	for (int row = 0; row < backwards->rowCount; row++) {
+		assert(backwards->rowTime[row] == forwards->rowTime[row]);
+		assert(backwards->rowWindowCount[row] == forwards->rowWindowCount[row]);
+		windowTotal += backwards->rowWindowCount[row];
+
+		for (int k = 0; k < backwards->binCount; k++) {
+			int index = row * backwards->binCount + k;
+
+			assert(fabs(backwards->spectrogram[index] - forwards->spectrogram[index]) <= 1e-4 * forwards->psd[peak]);
+		}
+	}
+
+	assert(windowTotal == backwards->windowCount);
+
+	spectrumAnalyzerDestroy(forwards);
+	spectrumAnalyzerDestroy(backwards);
+
+	return 0;
+}
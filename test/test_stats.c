@@ -0,0 +1,139 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+#include "../src/stats.h"
+
+#define NUM_SAMPLES 10000
+
+static int compareInt64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t*) a, y = *(const int64_t*) b;
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+int main(void)
+{
+	static int64_t samples[NUM_SAMPLES];
+
+	for (int i = 0; i < NUM_SAMPLES; i++) {
+		// A skewed spread of positive and negative values over several orders of magnitude
+		samples[i] = (int64_t) ((rand() % 2000001) - 500000) * (rand() % 3 + 1);
+	}
+
+	//Mean and variance, and merging two halves of the series should give the same result as the whole series
+	{
+		seriesStats_t whole, first, second;
+		double mean = 0, variance = 0;
+
+		seriesStats_init(&whole);
+		seriesStats_init(&first);
+		seriesStats_init(&second);
+
+		for (int i = 0; i < NUM_SAMPLES; i++) {
+			seriesStats_append(&whole, samples[i]);
+			seriesStats_append(i < NUM_SAMPLES / 3 ? &first : &second, samples[i]);
+			mean += samples[i];
+		}
+		mean /= NUM_SAMPLES;
+
+		for (int i = 0; i < NUM_SAMPLES; i++) {
+			variance += (samples[i] - mean) * (samples[i] - mean);
+		}
+		variance /= NUM_SAMPLES - 1;
+
+		seriesStats_merge(&first, &second);
+
+		assert(seriesStats_getCount(&first) == NUM_SAMPLES);
+		assert(fabs(seriesStats_getMean(&whole) - mean) < 1e-6 * fabs(mean));
+		assert(fabs(seriesStats_getVariance(&whole) - variance) < 1e-9 * variance);
+		assert(fabs(seriesStats_getMean(&first) - mean) < 1e-6 * fabs(mean));
+		assert(fabs(seriesStats_getVariance(&first) - variance) < 1e-9 * variance);
+	}
+
+	//Quantiles should be within the sketch's relative error, and merged sketches should match the whole series
+	{
+		quantileSketch_t whole, first, second;
+		double quantiles[] = {0.01, 0.25, 0.5, 0.95, 0.99};
+		static int64_t sorted[NUM_SAMPLES];
+
+		quantileSketch_init(&whole);
+		quantileSketch_init(&first);
+		quantileSketch_init(&second);
+
+		for (int i = 0; i < NUM_SAMPLES; i++) {
+			sorted[i] = samples[i];
+			quantileSketch_add(&whole, samples[i]);
+			quantileSketch_add(i % 2 ? &first : &second, samples[i]);
+		}
+
+		qsort(sorted, NUM_SAMPLES, sizeof(sorted[0]), compareInt64);
+
+		quantileSketch_merge(&first, &second);
+
+		assert(quantileSketch_getCount(&first) == NUM_SAMPLES);
+		assert(whole.min == sorted[0] && whole.max == sorted[NUM_SAMPLES - 1]);
+		assert(first.min == whole.min && first.max == whole.max);
+
+		for (unsigned i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+			double exact = sorted[(int) (quantiles[i] * (NUM_SAMPLES - 1))];
+			double estimate = quantileSketch_getQuantile(&whole, quantiles[i]);
+
+			assert(fabs(estimate - exact) <= fabs(exact) / (2 << QUANTILE_SKETCH_SUB_BUCKET_BITS) + 1);
+			assert(quantileSketch_getQuantile(&first, quantiles[i]) == estimate);
+		}
+
+		quantileSketch_destroy(&whole);
+		quantileSketch_destroy(&first);
+		quantileSketch_destroy(&second);
+	}
+
+	//Small integers are counted exactly
+	{
+		quantileSketch_t sketch;
+
+		quantileSketch_init(&sketch);
+
+		for (int i = -10; i <= 10; i++) {
+			quantileSketch_add(&sketch, i);
+		}
+
+		assert(quantileSketch_getQuantile(&sketch, 0) == -10);
+		assert(quantileSketch_getQuantile(&sketch, 0.5) == 0);
+		assert(quantileSketch_getQuantile(&sketch, 0.25) == -5);
+		assert(quantileSketch_getQuantile(&sketch, 1) == 10);
+
+		quantileSketch_destroy(&sketch);
+	}
+
+	//Histograms
+	{
+		histogram_t a, b, c;
+
+		histogram_init(&a, 100, 10, 5);
+		histogram_init(&b, 100, 10, 5);
+		histogram_init(&c, 0, 10, 5);
+
+		histogram_add(&a, 99);
+		histogram_add(&a, 100);
+		histogram_add(&a, 109);
+		histogram_add(&b, 125);
+		histogram_add(&b, 150);
+
+		assert(a.underflow == 1 && a.counts[0] == 2);
+		assert(histogram_merge(&a, &b));
+		assert(!histogram_merge(&a, &c));
+		assert(a.counts[2] == 1 && a.overflow == 1);
+		assert(histogram_getQuantile(&a, 0.5) == 100);
+		assert(histogram_getQuantile(&a, 0.75) == 120);
+
+		histogram_destroy(&a);
+		histogram_destroy(&b);
+		histogram_destroy(&c);
+	}
+
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+#include "../src/stepresponse.h"
+
+#define SAMPLE_INTERVAL 1000
+#define TIME_CONSTANT 20000
+
+int main(void)
+{
+	spectrumSettings_t seriesSettings;
+	stepResponseSettings_t settings;
+	spectrumAnalyzer_t *series;
+	stepResponse_t *response;
+	int setpointChannel[] = {0}, gyroChannel[] = {1};
+	float values[2] = {0, 0};
+	int holdRemaining = 0;
+
+	srand(42);
+
+	spectrumSettingsInit(&seriesSettings);
+	seriesSettings.sampleInterval = SAMPLE_INTERVAL;
+
+	series = spectrumAnalyzerCreate(2, &seriesSettings);
+
+	// Random stick steps, followed by a craft that responds to them with a first-order lag
+	for (int i = 0; i < 60000; i++) {
+		if (--holdRemaining <= 0) {
+			values[0] = rand() % 401 - 200;
+			holdRemaining = 100 + rand() % 200;
+		}
+
+		values[1] += (values[0] - values[1]) * ((float) SAMPLE_INTERVAL / TIME_CONSTANT);
+
+		spectrumAnalyzerAddSample(series, (int64_t) i * SAMPLE_INTERVAL, values);
+	}
+
+	stepResponseSettingsInit(&settings);
+
+	response = stepResponseEstimate(series, 1, setpointChannel, gyroChannel, &settings);
+
+	assert(response);
+	assert(response->axisCount == 1);
+	assert(response->length == settings.responseLength / SAMPLE_INTERVAL);
+	assert(response->windowCount[0] > 100);
+
+	/*
+	 * Starts from rest, reaches 63% after one time constant and settles close to the setpoint (the regularisation of
+	 * the deconvolution biases the estimate a little low).
+	 */
+	assert(fabs(response->mean[0]) < 0.1);
+	assert(fabs(response->mean[TIME_CONSTANT / SAMPLE_INTERVAL] - (1 - exp(-1))) < 0.1);
+	assert(fabs(response->mean[200] - 1) < 0.15);
+
+	for (int i = 0; i < response->length; i++) {
+		assert(response->lower[i] <= response->mean[i] && response->mean[i] <= response->upper[i]);
+	}
+
+	stepResponseDestroy(response);
+	spectrumAnalyzerDestroy(series);
+
+	// Nothing to estimate from
+	series = spectrumAnalyzerCreate(2, &seriesSettings);
+	response = stepResponseEstimate(series, 1, setpointChannel, gyroChannel, &settings);
+
+	assert(response);
+	assert(response->windowCount[0] == 0);
+
+	stepResponseDestroy(response);
+	spectrumAnalyzerDestroy(series);
+
+	return 0;
+}
@@ -0,0 +1,98 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "../src/streammerge.h"
+
+#define MAX_ROWS 16
+
+static int rowCount;
+static int64_t rowTimes[MAX_ROWS];
+static int64_t rowPrimary[MAX_ROWS];
+static int64_t rowSecondary[MAX_ROWS][2];
+static bool rowHaveSecondary[MAX_ROWS][2];
+
+static void onRowReady(streamMerger_t *merger, int64_t time, const int64_t *primary, const int64_t * const *secondary, void *userData)
+{
+	(void) userData;
+
+	assert(rowCount < MAX_ROWS);
+
+	rowTimes[rowCount] = time;
+	rowPrimary[rowCount] = primary[0];
+
+	for (int i = 0; i < merger->streamCount - 1; i++) {
+		rowHaveSecondary[rowCount][i] = secondary[i] != NULL;
+		rowSecondary[rowCount][i] = secondary[i] ? secondary[i][0] : 0;
+	}
+
+	rowCount++;
+}
+
+static void addValue(streamMerger_t *merger, int stream, int64_t time, int64_t value)
+{
+	streamMergerAdd(merger, stream, time, &value);
+}
+
+int main(void)
+{
+	int fieldCount[3] = {1, 1, 1};
+
+	//Held values, with secondaries that arrive out of order with respect to the primary
+	{
+		MergeJoinPolicy policy[3] = {MERGE_JOIN_HOLD, MERGE_JOIN_HOLD, MERGE_JOIN_HOLD};
+		streamMerger_t *merger = streamMergerCreate(3, fieldCount, policy, 8, onRowReady, NULL);
+
+		rowCount = 0;
+
+		addValue(merger, 0, 10, 1);
+		addValue(merger, 0, 20, 2);
+		addValue(merger, 1, 15, 100);
+		addValue(merger, 0, 30, 3);
+		addValue(merger, 2, 30, 7); // Ties are joined onto the primary row with the same time
+		addValue(merger, 0, 40, 4);
+		streamMergerFlush(merger);
+
+		assert(rowCount == 4);
+
+		assert(rowTimes[0] == 10 && rowPrimary[0] == 1);
+		assert(!rowHaveSecondary[0][0] && !rowHaveSecondary[0][1]);
+
+		assert(rowTimes[1] == 20 && rowSecondary[1][0] == 100 && !rowHaveSecondary[1][1]);
+		assert(rowSecondary[2][0] == 100 && rowSecondary[2][1] == 7);
+		assert(rowTimes[3] == 40 && rowSecondary[3][0] == 100 && rowSecondary[3][1] == 7);
+
+		streamMergerDestroy(merger);
+	}
+
+	//Interpolation and nearest-sample joins wait for the following sample, and don't span gaps
+	{
+		MergeJoinPolicy policy[3] = {MERGE_JOIN_HOLD, MERGE_JOIN_LINEAR, MERGE_JOIN_NEAREST};
+		streamMerger_t *merger = streamMergerCreate(3, fieldCount, policy, 8, onRowReady, NULL);
+
+		rowCount = 0;
+
+		addValue(merger, 1, 0, 0);
+		addValue(merger, 2, 0, 0);
+		addValue(merger, 0, 10, 1);
+		addValue(merger, 0, 30, 2);
+		addValue(merger, 1, 40, 400);
+		addValue(merger, 2, 40, 40);
+		streamMergerAddGap(merger, 1);
+		addValue(merger, 0, 50, 3);
+		addValue(merger, 1, 60, 600);
+		streamMergerFlush(merger);
+
+		assert(rowCount == 3);
+
+		assert(rowTimes[0] == 10 && rowSecondary[0][0] == 100 && rowSecondary[0][1] == 0);
+		assert(rowTimes[1] == 30 && rowSecondary[1][0] == 300 && rowSecondary[1][1] == 40);
+
+		// The gap means the sample at 40 is held rather than interpolated towards the sample at 60
+		assert(rowTimes[2] == 50 && rowSecondary[2][0] == 400 && rowSecondary[2][1] == 40);
+
+		streamMergerDestroy(merger);
+	}
+
+	return 0;
+}
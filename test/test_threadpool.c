@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "../src/platform.h"
+
+#define TASK_COUNT 1000
+
+typedef struct counter_t {
+	semaphore_t lock;
+	int total;
+} counter_t;
+
+static counter_t counter;
+static int done[TASK_COUNT];
+
+static void countTask(void *data)
+{
+	int index = (int) (intptr_t) data;
+
+	done[index]++;
+
+	semaphore_wait(&counter.lock);
+	counter.total += index;
+	semaphore_signal(&counter.lock);
+}
+
+int main(void)
+{
+	threadPool_t *pool;
+	int expected = 0;
+
+	platform_init();
+
+	semaphore_create(&counter.lock, 1);
+
+	// A queue much shorter than the number of tasks, so submitting has to wait for the threads to catch up
+	pool = thread_pool_create(4, 3);
+
+	for (int i = 0; i < TASK_COUNT; i++) {
+		thread_pool_submit(pool, countTask, (void *) (intptr_t) i);
+		expected += i;
+	}
+
+	thread_pool_wait(pool);
+
+	assert(counter.total == expected);
+
+	for (int i = 0; i < TASK_COUNT; i++) {
+		assert(done[i] == 1);
+	}
+
+	// The pool can be used again after waiting, and destroying it finishes the tasks still queued
+	for (int i = 0; i < TASK_COUNT; i++) {
+		thread_pool_submit(pool, countTask, (void *) (intptr_t) i);
+	}
+
+	thread_pool_destroy(pool);
+
+	assert(counter.total == expected * 2);
+
+	for (int i = 0; i < TASK_COUNT; i++) {
+		assert(done[i] == 2);
+	}
+
+	// A single thread with a single slot still works through everything
+	pool = thread_pool_create(1, 1);
+
+	for (int i = 0; i < TASK_COUNT; i++) {
+		thread_pool_submit(pool, countTask, (void *) (intptr_t) i);
+	}
+
+	thread_pool_destroy(pool);
+
+	assert(counter.total == expected * 3);
+
+	semaphore_destroy(&counter.lock);
+
+	return 0;
+}
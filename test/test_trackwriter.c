@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../src/trackwriter.h"
+
+#define TRACK_FILENAME "test_trackwriter.track"
+
+// Sydney, and a point about 11m north of it
+#define LAT -338688000
+#define LON 1512093000
+#define LAT_NORTH (LAT + 1000)
+
+static const char GPX_TRACK[] =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<gpx creator=\"Blackbox flight data recorder\" version=\"1.1\" xmlns=\"http://www.topografix.com/GPX/1/1\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\""
+		" xsi:schemaLocation=\"http://www.topografix.com/GPX/1/1 http://www.topografix.com/GPX/1/1/gpx.xsd\">\n"
+	"<metadata><name>Blackbox flight log</name></metadata>\n"
+	"<trk><name>Blackbox flight log</name><trkseg>\n"
+	"  <trkpt lat=\"-33.8688000\" lon=\"151.2093000\"><ele>12</ele><time>2000-01-01T00:00:00.000000Z</time></trkpt>\n"
+	"  <trkpt lat=\"-33.8687900\" lon=\"151.2093000\"><ele>13</ele><time>2000-01-01T00:00:00.200000Z</time></trkpt>\n"
+	"  <trkpt lat=\"-0.0000005\" lon=\"-151.2093000\"><ele>-4</ele><time>2000-01-01T01:02:03.000456Z</time></trkpt>\n"
+	"  <trkpt lat=\"0.0000000\" lon=\"0.0000000\"><ele>0</ele></trkpt>\n"
+	"</trkseg></trk>\n"
+	"</gpx>";
+
+static const char KML_TRACK[] =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n"
+	"<Document><name>Blackbox flight log</name>\n"
+	"<Placemark><name>Blackbox flight log</name><LineString><altitudeMode>absolute</altitudeMode><coordinates>\n"
+	"151.2093000,-33.8688000,10\n"
+	"151.2093000,-33.8687000,10\n"
+	"151.2094000,-33.8687000,10\n"
+	"</coordinates></LineString></Placemark>\n"
+	"</Document></kml>\n";
+
+static const char GEOJSON_TRACK[] =
+	"{\"type\":\"Feature\",\"properties\":{\"name\":\"Blackbox flight log\"},\"geometry\":{\"type\":\"LineString\",\"coordinates\":[\n"
+	"[151.2093000,-33.8688000,10],\n"
+	"[151.2093000,-33.8687000,-10]\n"
+	"]}}\n";
+
+static void checkTrackFile(const char *expected)
+{
+	size_t length = strlen(expected);
+	char *contents = malloc(length + 2);
+	FILE *file = fopen(TRACK_FILENAME, "rb");
+
+	assert(file);
+	// Read one more byte than we expect, to catch anything written after the end of the track
+	assert(fread(contents, 1, length + 1, file) == length);
+	fclose(file);
+
+	contents[length] = '\0';
+	assert(strcmp(contents, expected) == 0);
+
+	free(contents);
+	remove(TRACK_FILENAME);
+}
+
+int main(void)
+{
+	trackWriter_t *writer;
+
+	// A track with no points doesn't create a file at all
+	remove(TRACK_FILENAME);
+
+	writer = trackWriterCreate(TRACK_FILENAME, TRACK_FORMAT_GPX, 0);
+	trackWriterDestroy(writer);
+
+	assert(fopen(TRACK_FILENAME, "rb") == NULL);
+
+	// Every point is written, and the GPS dropping out for an hour after the second point just leaves a gap in the times
+	writer = trackWriterCreate(TRACK_FILENAME, TRACK_FORMAT_GPX, 0);
+	trackWriterAddPoint(writer, 0, LAT, LON, 12);
+	trackWriterAddPoint(writer, 200000, LAT + 100, LON, 13);
+	trackWriterAddPoint(writer, 3723000456LL, -5, -LON, -4);
+	trackWriterAddPoint(writer, -1, 0, 0, 0);
+	trackWriterDestroy(writer);
+
+	checkTrackFile(GPX_TRACK);
+
+	/*
+	 * Heading north with a dropout along the way, and then turning east. The simplified track keeps the corner (the first
+	 * point after the dropout) and the end, and drops the straight run in between.
+	 */
+	writer = trackWriterCreate(TRACK_FILENAME, TRACK_FORMAT_KML, 1);
+	trackWriterAddPoint(writer, 0, LAT, LON, 10);
+	trackWriterAddPoint(writer, 1000000, LAT + 100, LON, 10);
+	trackWriterAddPoint(writer, 2000000, LAT + 200, LON, 10);
+	trackWriterAddPoint(writer, 3000000, LAT + 300, LON, 10);
+	trackWriterAddPoint(writer, 10000000, LAT_NORTH, LON, 10);
+	trackWriterAddPoint(writer, 11000000, LAT_NORTH, LON + 1000, 10);
+	trackWriterDestroy(writer);
+
+	checkTrackFile(KML_TRACK);
+
+	// Both ends of a simplified track are always kept
+	writer = trackWriterCreate(TRACK_FILENAME, TRACK_FORMAT_GEOJSON, 1);
+	trackWriterAddPoint(writer, 0, LAT, LON, 10);
+	trackWriterAddPoint(writer, 1000000, LAT_NORTH, LON, -10);
+	trackWriterDestroy(writer);
+
+	checkTrackFile(GEOJSON_TRACK);
+
+	return 0;
+}
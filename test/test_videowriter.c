@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../src/videowriter.h"
+
+#define WIDTH 37
+#define HEIGHT 9
+
+static uint32_t argb(int a, int r, int g, int b)
+{
+	return ((uint32_t) a << 24) | ((uint32_t) r << 16) | ((uint32_t) g << 8) | (uint32_t) b;
+}
+
+static int clampByte(int value)
+{
+	return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+int main(void)
+{
+	uint32_t pixels[WIDTH * HEIGHT];
+	int chromaWidth = (WIDTH + 1) / 2, chromaHeight = (HEIGHT + 1) / 2;
+	uint8_t y[WIDTH * HEIGHT], u[19 * 5], v[19 * 5];
+	VideoFormat format;
+
+	assert(videoFormatParse("bgra", &format) && format == VIDEO_FORMAT_BGRA);
+	assert(!videoFormatParse("png", &format));
+
+	//Black, white and mid-grey land on the ends and middle of the limited range
+	{
+		uint32_t grey[2 * 2];
+		uint8_t greyY[4], greyU[1], greyV[1];
+		const int level[3] = {0, 255, 128}, expectedLuma[3] = {16, 235, 126};
+
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 4; j++)
+				grey[j] = argb(255, level[i], level[i], level[i]);
+
+			videoConvertARGBToI420((const uint8_t *) grey, 2 * 4, 2, 2, greyY, greyU, greyV);
+
+			assert(greyY[0] == expectedLuma[i] && greyY[3] == expectedLuma[i]);
+			assert(greyU[0] == 128 && greyV[0] == 128);
+		}
+	}
+
+	//Random pixels in an image with odd sizes (so every edge case of the SIMD and plain paths is covered) should
+	//match a straightforward conversion
+	srand(1);
+
+	for (int i = 0; i < WIDTH * HEIGHT; i++) {
+		pixels[i] = argb(rand() & 0xFF, rand() & 0xFF, rand() & 0xFF, rand() & 0xFF);
+	}
+
+	videoConvertARGBToI420((const uint8_t *) pixels, WIDTH * 4, WIDTH, HEIGHT, y, u, v);
+
+	for (int row = 0; row < HEIGHT; row++) {
+		for (int x = 0; x < WIDTH; x++) {
+			uint32_t p = pixels[row * WIDTH + x];
+			int r = (p >> 16) & 0xFF, g = (p >> 8) & 0xFF, b = p & 0xFF;
+
+			assert(y[row * WIDTH + x] == clampByte(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16));
+		}
+	}
+
+	for (int row = 0; row < chromaHeight; row++) {
+		for (int x = 0; x < chromaWidth; x++) {
+			int rSum = 0, gSum = 0, bSum = 0;
+
+			for (int dy = 0; dy < 2; dy++) {
+				for (int dx = 0; dx < 2; dx++) {
+					int px = x * 2 + dx < WIDTH ? x * 2 + dx : WIDTH - 1;
+					int py = row * 2 + dy < HEIGHT ? row * 2 + dy : HEIGHT - 1;
+					uint32_t p = pixels[py * WIDTH + px];
+
+					rSum += (p >> 16) & 0xFF;
+					gSum += (p >> 8) & 0xFF;
+					bSum += p & 0xFF;
+				}
+			}
+
+			int r = (rSum + 2) >> 2, g = (gSum + 2) >> 2, b = (bSum + 2) >> 2;
+
+			assert(u[row * chromaWidth + x] == clampByte(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128));
+			assert(v[row * chromaWidth + x] == clampByte(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128));
+		}
+	}
+
+	//Frames are written in order after their header, BGRA keeps the bytes of each pixel in that order
+	{
+		char buffer[256];
+		FILE *file = tmpfile();
+		videoWriter_t *writer = videoWriterCreate(file, VIDEO_FORMAT_BGRA, 2, 1, 30, 1);
+		uint32_t twoPixels[2] = {argb(1, 2, 3, 4), argb(5, 6, 7, 8)};
+		uint8_t frame[8];
+		const uint8_t expected[8] = {4, 3, 2, 1, 8, 7, 6, 5};
+
+		assert(videoWriterFrameSize(writer) == 8);
+
+		videoWriterConvertFrame(writer, (const uint8_t *) twoPixels, 8, frame);
+		assert(memcmp(frame, expected, 8) == 0);
+
+		assert(videoWriterWriteFrame(writer, frame));
+		videoWriterDestroy(writer);
+
+		rewind(file);
+		assert(fgets(buffer, sizeof(buffer), file) && strcmp(buffer, "BGRA W2 H1 F30:1\n") == 0);
+		assert(fread(buffer, 1, sizeof(buffer), file) == 8 && memcmp(buffer, expected, 8) == 0);
+
+		fclose(file);
+	}
+
+	{
+		char buffer[256];
+		FILE *file = tmpfile();
+		videoWriter_t *writer = videoWriterCreate(file, VIDEO_FORMAT_Y4M, WIDTH, HEIGHT, 25, 2);
+		size_t frameSize = videoWriterFrameSize(writer);
+		uint8_t *frame = malloc(frameSize);
+
+		assert(frameSize == WIDTH * HEIGHT + 2 * 19 * 5);
+
+		videoWriterConvertFrame(writer, (const uint8_t *) pixels, WIDTH * 4, frame);
+		assert(memcmp(frame, y, sizeof(y)) == 0);
+
+		assert(videoWriterWriteFrame(writer, frame));
+		assert(videoWriterWriteFrame(writer, frame));
+		videoWriterDestroy(writer);
+
+		rewind(file);
+		assert(fgets(buffer, sizeof(buffer), file) && strncmp(buffer, "YUV4MPEG2 W37 H9 F25:2 ", 23) == 0);
+		assert(fgets(buffer, sizeof(buffer), file) && strcmp(buffer, "FRAME\n") == 0);
+
+		fseek(file, (long) frameSize, SEEK_CUR);
+		assert(fgets(buffer, sizeof(buffer), file) && strcmp(buffer, "FRAME\n") == 0);
+
+		free(frame);
+		fclose(file);
+	}
+
+	return 0;
+}